@@ -0,0 +1,355 @@
+#include "affinitybackend.h"
+
+#include <QtGlobal>
+#include <QSet>
+
+#if defined(Q_OS_LINUX)
+#include <sched.h>
+#include <dirent.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <tlhelp32.h>
+#include <iterator>
+#include <vector>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+// Thread ids currently listed under /proc/<pid>/task.
+QVector<pid_t> listTasks(qint64 pid)
+{
+    QVector<pid_t> tids;
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%lld/task", static_cast<long long>(pid));
+    DIR* d = ::opendir(path);
+    if (!d) return tids;
+    while (dirent* e = ::readdir(d)) {
+        if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        tids.append(static_cast<pid_t>(std::strtol(e->d_name, nullptr, 10)));
+    }
+    ::closedir(d);
+    return tids;
+}
+
+// Kernel mask for a non-empty CpuSet; free with CPU_FREE.
+cpu_set_t* allocMask(const CpuSet& cpus, size_t* size)
+{
+    cpu_set_t* set = CPU_ALLOC(cpus.last() + 1);
+    if (!set) return nullptr;
+    *size = CPU_ALLOC_SIZE(cpus.last() + 1);
+    CPU_ZERO_S(*size, set);
+    for (int c = cpus.first(); c >= 0; c = cpus.next(c))
+        CPU_SET_S(c, *size, set);
+    return set;
+}
+
+class LinuxAffinityBackend : public AffinityBackend
+{
+public:
+    QString name() const override { return QStringLiteral("sched_setaffinity"); }
+
+    bool setProcessAffinity(qint64 pid, const CpuSet& cpus, BackendError* err) override
+    {
+        if (pid <= 0) return fail(err, ESRCH);
+        if (cpus.isEmpty()) return fail(err, EINVAL, QStringLiteral("Empty CPU set"));
+
+        size_t size = 0;
+        cpu_set_t* set = allocMask(cpus, &size);
+        if (!set) return fail(err, ENOMEM);
+
+        // sched_setaffinity() is per thread, so walk the task list. New threads inherit
+        // the mask of their creator, but one spawned between listing and setting would be
+        // missed; rescan until a pass finds nothing new.
+        QSet<pid_t> done;
+        int firstError = 0;
+        for (int pass = 0; pass < 4; ++pass) {
+            QVector<pid_t> tids = listTasks(pid);
+            if (tids.isEmpty() && pass == 0)
+                tids.append(static_cast<pid_t>(pid)); // no /proc access: at least the main thread
+            bool sawNew = false;
+            for (pid_t tid : tids) {
+                if (done.contains(tid)) continue;
+                sawNew = true;
+                done.insert(tid);
+                if (::sched_setaffinity(tid, size, set) != 0 && errno != ESRCH && !firstError)
+                    firstError = errno;
+            }
+            if (!sawNew || firstError) break;
+        }
+        CPU_FREE(set);
+
+        if (firstError) return fail(err, firstError);
+        if (done.isEmpty()) return fail(err, ESRCH);
+        return true;
+    }
+
+    bool setThreadAffinity(qint64 tid, const CpuSet& cpus, BackendError* err) override
+    {
+        if (tid <= 0) return fail(err, ESRCH);
+        if (cpus.isEmpty()) return fail(err, EINVAL, QStringLiteral("Empty CPU set"));
+
+        size_t size = 0;
+        cpu_set_t* set = allocMask(cpus, &size);
+        if (!set) return fail(err, ENOMEM);
+        const int rc = ::sched_setaffinity(static_cast<pid_t>(tid), size, set);
+        const int e = errno;
+        CPU_FREE(set);
+        return rc == 0 ? true : fail(err, e);
+    }
+
+    bool processAffinity(qint64 pid, CpuSet* cpus, BackendError* err) override
+    {
+        if (pid <= 0) return fail(err, ESRCH);
+
+        // The kernel mask may be wider than CPU_SETSIZE; grow until it fits.
+        for (int n = CPU_SETSIZE; n <= 64 * 1024; n *= 2) {
+            cpu_set_t* set = CPU_ALLOC(n);
+            if (!set) return fail(err, ENOMEM);
+            const size_t size = CPU_ALLOC_SIZE(n);
+            CPU_ZERO_S(size, set);
+            if (::sched_getaffinity(static_cast<pid_t>(pid), size, set) == 0) {
+                if (cpus) {
+                    cpus->clear();
+                    for (int c = 0; c < n; ++c)
+                        if (CPU_ISSET_S(c, size, set)) cpus->set(c);
+                }
+                CPU_FREE(set);
+                return true;
+            }
+            const int e = errno;
+            CPU_FREE(set);
+            if (e != EINVAL) return fail(err, e);
+        }
+        return fail(err, EINVAL);
+    }
+};
+
+} // namespace
+
+std::unique_ptr<AffinityBackend> AffinityBackend::createNative()
+{
+    return std::make_unique<LinuxAffinityBackend>();
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+namespace {
+
+// Windows 11 / Server 2022 only, so resolved at runtime.
+using SetCpuSetMasksFn = BOOL (WINAPI*)(HANDLE, PGROUP_AFFINITY, USHORT);
+
+SetCpuSetMasksFn resolveCpuSetMasks()
+{
+    static const auto fn = reinterpret_cast<SetCpuSetMasksFn>(
+        ::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"), "SetProcessDefaultCpuSetMasks"));
+    return fn;
+}
+
+SetCpuSetMasksFn resolveThreadCpuSetMasks()
+{
+    static const auto fn = reinterpret_cast<SetCpuSetMasksFn>(
+        ::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"), "SetThreadSelectedCpuSetMasks"));
+    return fn;
+}
+
+// One GROUP_AFFINITY per processor group touched by `cpus`.
+std::vector<GROUP_AFFINITY> groupMasks(const CpuSet& cpus)
+{
+    std::vector<GROUP_AFFINITY> out;
+    const QVector<quint64>& words = cpus.words();
+    for (int g = 0; g < words.size(); ++g) {
+        if (!words[g]) continue;
+        GROUP_AFFINITY ga{};
+        ga.Group = WORD(g);
+        ga.Mask = KAFFINITY(words[g]);
+        out.push_back(ga);
+    }
+    return out;
+}
+
+// Pin each thread of `pid` to one of `masks`, round-robin. Threads can only live in
+// one group at a time, so this is how a multi-group set is spread on older systems.
+bool setThreadGroupAffinities(DWORD pid, const std::vector<GROUP_AFFINITY>& masks, BackendError* err)
+{
+    HANDLE snap = ::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snap == INVALID_HANDLE_VALUE) return fail(err, int(::GetLastError()));
+
+    THREADENTRY32 te{};
+    te.dwSize = sizeof(te);
+    size_t next = 0;
+    int firstError = 0;
+    bool any = false;
+    for (BOOL ok = ::Thread32First(snap, &te); ok; ok = ::Thread32Next(snap, &te)) {
+        if (te.th32OwnerProcessID != pid) continue;
+        HANDLE t = ::OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION, FALSE, te.th32ThreadID);
+        if (!t) {
+            if (!firstError) firstError = int(::GetLastError());
+            continue;
+        }
+        GROUP_AFFINITY ga = masks[next++ % masks.size()];
+        if (::SetThreadGroupAffinity(t, &ga, nullptr)) any = true;
+        else if (!firstError) firstError = int(::GetLastError());
+        ::CloseHandle(t);
+    }
+    ::CloseHandle(snap);
+
+    if (firstError) return fail(err, firstError);
+    return any ? true : fail(err, ERROR_INVALID_PARAMETER, QStringLiteral("Process has no threads"));
+}
+
+class WindowsAffinityBackend : public AffinityBackend
+{
+public:
+    QString name() const override { return QStringLiteral("SetProcessAffinityMask"); }
+
+    bool setProcessAffinity(qint64 pid, const CpuSet& cpus, BackendError* err) override
+    {
+        if (cpus.isEmpty()) return fail(err, ERROR_INVALID_PARAMETER, QStringLiteral("Empty CPU set"));
+        const std::vector<GROUP_AFFINITY> masks = groupMasks(cpus);
+        for (const GROUP_AFFINITY& ga : masks)
+            if (ga.Group >= ::GetActiveProcessorGroupCount())
+                return fail(err, ERROR_INVALID_PARAMETER,
+                            QStringLiteral("CPU %1 does not exist").arg(int(ga.Group) * 64));
+
+        HANDLE h = ::OpenProcess(PROCESS_SET_INFORMATION | PROCESS_QUERY_INFORMATION,
+                                 FALSE, static_cast<DWORD>(pid));
+        if (!h) return fail(err, int(::GetLastError()));
+
+        // A single-group set inside the process's own group: the classic call.
+        USHORT groups[16]{};
+        USHORT groupCount = USHORT(std::size(groups));
+        const bool inOneGroup = ::GetProcessGroupAffinity(h, &groupCount, groups) && groupCount == 1;
+        if (masks.size() == 1 && inOneGroup && groups[0] == masks[0].Group) {
+            const BOOL ok = ::SetProcessAffinityMask(h, DWORD_PTR(masks[0].Mask));
+            const DWORD e = ::GetLastError();
+            ::CloseHandle(h);
+            return ok ? true : fail(err, int(e));
+        }
+
+        // Otherwise prefer default CPU sets, which may span groups and also apply to
+        // threads created later; fall back to moving existing threads group by group.
+        if (auto setMasks = resolveCpuSetMasks()) {
+            std::vector<GROUP_AFFINITY> copy = masks;
+            const BOOL ok = setMasks(h, copy.data(), USHORT(copy.size()));
+            const DWORD e = ::GetLastError();
+            ::CloseHandle(h);
+            return ok ? true : fail(err, int(e));
+        }
+        ::CloseHandle(h);
+        return setThreadGroupAffinities(static_cast<DWORD>(pid), masks, err);
+    }
+
+    bool setThreadAffinity(qint64 tid, const CpuSet& cpus, BackendError* err) override
+    {
+        if (cpus.isEmpty()) return fail(err, ERROR_INVALID_PARAMETER, QStringLiteral("Empty CPU set"));
+        std::vector<GROUP_AFFINITY> masks = groupMasks(cpus);
+
+        HANDLE t = ::OpenThread(THREAD_SET_INFORMATION | THREAD_QUERY_INFORMATION |
+                                THREAD_SET_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(tid));
+        if (!t) return fail(err, int(::GetLastError()));
+        BOOL ok = FALSE;
+        if (masks.size() == 1) {
+            ok = ::SetThreadGroupAffinity(t, &masks[0], nullptr);
+        } else if (auto setMasks = resolveThreadCpuSetMasks()) {
+            ok = setMasks(t, masks.data(), USHORT(masks.size()));
+        } else {
+            ::CloseHandle(t);
+            return fail(err, ERROR_NOT_SUPPORTED,
+                        QStringLiteral("A thread can only span processor groups on Windows 11 or later"));
+        }
+        const DWORD e = ::GetLastError();
+        ::CloseHandle(t);
+        return ok ? true : fail(err, int(e));
+    }
+
+    bool processAffinity(qint64 pid, CpuSet* cpus, BackendError* err) override
+    {
+        HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid));
+        if (!h) return fail(err, int(::GetLastError()));
+
+        USHORT groups[16]{};
+        USHORT groupCount = USHORT(std::size(groups));
+        if (!::GetProcessGroupAffinity(h, &groupCount, groups)) {
+            const DWORD e = ::GetLastError();
+            ::CloseHandle(h);
+            return fail(err, int(e));
+        }
+        DWORD_PTR procMask = 0, sysMask = 0;
+        const BOOL ok = ::GetProcessAffinityMask(h, &procMask, &sysMask);
+        const DWORD e = ::GetLastError();
+        ::CloseHandle(h);
+        if (!ok) return fail(err, int(e));
+
+        if (cpus) {
+            cpus->clear();
+            for (USHORT i = 0; i < groupCount; ++i) {
+                // The process mask only describes a single-group process; for a
+                // multi-group one report every active CPU of each group it spans.
+                const int g = groups[i];
+                const quint64 mask = groupCount == 1
+                    ? quint64(procMask)
+                    : (::GetActiveProcessorCount(WORD(g)) >= 64
+                           ? ~quint64(0)
+                           : (quint64(1) << ::GetActiveProcessorCount(WORD(g))) - 1);
+                for (int bit = 0; bit < 64; ++bit)
+                    if (mask & (quint64(1) << bit)) cpus->set(g * 64 + bit);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+std::unique_ptr<AffinityBackend> AffinityBackend::createNative()
+{
+    return std::make_unique<WindowsAffinityBackend>();
+}
+
+#else
+
+namespace {
+
+class UnsupportedAffinityBackend : public AffinityBackend
+{
+public:
+    QString name() const override { return QStringLiteral("unsupported"); }
+
+    bool setProcessAffinity(qint64, const CpuSet&, BackendError* err) override
+    {
+        return fail(err, -1, QStringLiteral("Affinity is not supported on this platform."));
+    }
+
+    bool setThreadAffinity(qint64, const CpuSet&, BackendError* err) override
+    {
+        return fail(err, -1, QStringLiteral("Affinity is not supported on this platform."));
+    }
+
+    bool processAffinity(qint64, CpuSet*, BackendError* err) override
+    {
+        return fail(err, -1, QStringLiteral("Affinity is not supported on this platform."));
+    }
+};
+
+} // namespace
+
+std::unique_ptr<AffinityBackend> AffinityBackend::createNative()
+{
+    return std::make_unique<UnsupportedAffinityBackend>();
+}
+
+#endif
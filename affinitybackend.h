@@ -0,0 +1,37 @@
+#ifndef AFFINITYBACKEND_H
+#define AFFINITYBACKEND_H
+
+#include <QString>
+#include <memory>
+
+#include "cpuset.h"
+
+// Native error reported by a backend call: errno on Linux, GetLastError() on Windows.
+struct BackendError {
+    int     code{0};
+    QString message;
+};
+
+class AffinityBackend
+{
+public:
+    virtual ~AffinityBackend() = default;
+
+    virtual QString name() const = 0;
+
+    // Restrict every thread of `pid` to the given logical CPUs. On Windows CPU n is
+    // bit n%64 of processor group n/64.
+    virtual bool setProcessAffinity(qint64 pid, const CpuSet& cpus, BackendError* err=nullptr) = 0;
+
+    // Restrict a single thread. Linux tids and Windows thread ids share the pid space
+    // of their platform, so `tid` comes from /proc/<pid>/task or a thread snapshot.
+    virtual bool setThreadAffinity(qint64 tid, const CpuSet& cpus, BackendError* err=nullptr) = 0;
+
+    // Read the CPUs `pid` is currently allowed to run on.
+    virtual bool processAffinity(qint64 pid, CpuSet* cpus, BackendError* err=nullptr) = 0;
+
+    // In-process backend for the current platform (sched_*affinity / processor group APIs).
+    static std::unique_ptr<AffinityBackend> createNative();
+};
+
+#endif // AFFINITYBACKEND_H
@@ -0,0 +1,174 @@
+#include "affinityconfig.h"
+#include "affinitybackend.h"
+
+#include <QJsonArray>
+#include <cerrno>
+
+CpuSet AffinityConfig::resolveCpus(const CpuTopology& topo) const
+{
+    if (!cpus.isEmpty())
+        return cpus;
+    const int total = topo.size();
+    int coresToAssign = assignedCores;
+    if (coresToAssign < 1) coresToAssign = 1;
+    if (coresToAssign > total)
+        coresToAssign = total;
+    return selectCpus(topo, coresToAssign, policy);
+}
+
+AffinityConfig AffinityConfig::resolved(const CpuTopology& topo) const
+{
+    AffinityConfig c = *this;
+    c.cpus = resolveCpus(topo);
+    return c;
+}
+
+bool AffinityConfig::sameSettings(const AffinityConfig& o) const
+{
+    // Through JSON, so a field added later is compared without touching this.
+    QJsonObject a = toJson(), b = o.toJson();
+    for (QJsonObject* j : {&a, &b}) {
+        j->remove("processName");
+        j->remove("pid");
+    }
+    return a == b;
+}
+
+QJsonObject AffinityConfig::toJson() const
+{
+    QJsonObject o;
+    o["processName"]   = processName;
+    o["pid"]           = QString::number(pid);
+    o["assignedCores"] = assignedCores;
+    o["policy"]        = corePolicyKey(policy);
+    if (!cpus.isEmpty())
+        o["cpus"]      = cpus.toRangeList();
+    if (!threadRules.isEmpty()) {
+        QJsonArray rules;
+        for (const ThreadPinRule& r : threadRules) rules.append(r.toJson());
+        o["threadRules"] = rules;
+    }
+    if (memoryPolicy != MemoryPolicy::Default) {
+        o["memoryPolicy"]  = memoryPolicyKey(memoryPolicy);
+        o["migrateMemory"] = migrateMemory;
+    }
+    if (!cpusetGroup.isEmpty()) {
+        o["cpusetGroup"]   = cpusetGroup;
+        o["partition"]     = cpusetPartitionKey(partition);
+    }
+    sched.writeJson(o);
+    if (rebalance.enabled)
+        o["rebalance"]     = rebalance.toJson();
+    if (includeChildren)
+        o["includeChildren"] = true;
+    return o;
+}
+
+AffinityConfig AffinityConfig::fromJson(const QJsonObject& o, bool* ok)
+{
+    AffinityConfig c;
+    c.processName   = o.value("processName").toString();
+    c.pid           = o.value("pid").toString().toLongLong();
+    c.assignedCores = o.value("assignedCores").toInt(0);
+    if (c.assignedCores < 1) c.assignedCores = 1;
+    c.policy        = corePolicyFromKey(o.value("policy").toString(), CorePolicy::PackL3);
+    bool valid = true;
+    c.cpus          = CpuSet::fromRangeList(o.value("cpus").toString(), &valid);
+    for (const QJsonValue& v : o.value("threadRules").toArray()) {
+        bool ruleOk = false;
+        const ThreadPinRule r = ThreadPinRule::fromJson(v.toObject(), &ruleOk);
+        if (ruleOk) c.threadRules.append(r);
+        else valid = false;
+    }
+    c.memoryPolicy  = memoryPolicyFromKey(o.value("memoryPolicy").toString());
+    c.migrateMemory = o.value("migrateMemory").toBool(false);
+    c.cpusetGroup   = o.value("cpusetGroup").toString();
+    c.partition     = cpusetPartitionFromKey(o.value("partition").toString());
+    if (!c.cpusetGroup.isEmpty() && !CgroupCpuset::isValidName(c.cpusetGroup))
+        valid = false;
+    bool schedOk = false;
+    c.sched         = SchedSettings::readJson(o, &schedOk);
+    if (!schedOk) valid = false;
+    if (o.contains("rebalance")) {
+        bool rebalanceOk = false;
+        c.rebalance = RebalanceBounds::fromJson(o.value("rebalance").toObject(), &rebalanceOk);
+        if (!rebalanceOk) valid = false;
+    }
+    c.includeChildren = o.value("includeChildren").toBool(false);
+    if (ok) *ok = valid;
+    return c;
+}
+
+bool applyProcessSettings(AffinityBackend& backend, const CpuTopology& topo, qint64 pid,
+                          const AffinityConfig& cfg, BackendError* err)
+{
+    const CpuSet cpus = cfg.resolveCpus(topo);
+    if (cfg.sched.isDefault()) {
+        if (!cfg.cpusetGroup.isEmpty())
+            return CgroupAffinityBackend(cfg.cpusetGroup, cfg.partition).setProcessAffinity(pid, cpus, err);
+        return backend.setProcessAffinity(pid, cpus, err);
+    }
+
+    // The kernel only admits SCHED_DEADLINE tasks that may run on their whole
+    // root domain, which is every online CPU unless the group is a partition
+    // of its own. Refuse before the mask is changed instead of rolling back.
+    const bool ownDomain = !cfg.cpusetGroup.isEmpty() && cfg.partition != CpusetPartition::Member;
+    if (cfg.sched.cls == SchedClass::Deadline && !ownDomain && !(topo.online() - cpus).isEmpty()) {
+        if (err) {
+            err->code = EINVAL;
+            err->message = QStringLiteral("SCHED_DEADLINE needs every online CPU (%1), not %2; "
+                                          "use a partition group to confine it")
+                               .arg(topo.online().toRangeList(), cpus.toRangeList());
+        }
+        return false;
+    }
+
+    // Remember where the process was, in case the scheduling settings fail.
+    QString previousGroup;
+    CpuSet previousCpus;
+    if (!cfg.cpusetGroup.isEmpty()) {
+        previousGroup = CgroupCpuset::groupOf(pid);
+        CgroupAffinityBackend cgroup(cfg.cpusetGroup, cfg.partition);
+        if (!cgroup.setProcessAffinity(pid, cpus, err))
+            return false;
+    } else {
+        if (!backend.processAffinity(pid, &previousCpus, err))
+            return false;
+        if (!backend.setProcessAffinity(pid, cpus, err))
+            return false;
+    }
+    if (applySchedSettings(pid, cfg.sched, err))
+        return true;
+
+    // The group's own CPUs stay as configured; only the process moves back.
+    BackendError undoErr;
+    bool undone;
+    if (!cfg.cpusetGroup.isEmpty()) {
+        undone = !previousGroup.isEmpty() && CgroupCpuset::moveProcesses(previousGroup, {pid}, nullptr, &undoErr);
+        if (previousGroup.isEmpty()) undoErr.message = QStringLiteral("its previous cgroup is unknown");
+    } else {
+        undone = backend.setProcessAffinity(pid, previousCpus, &undoErr);
+    }
+    if (!undone && err)
+        err->message += QStringLiteral("; putting the process back failed too: %1").arg(undoErr.message);
+    return false;
+}
+
+bool applyAffinityConfig(AffinityBackend& backend, const CpuTopology& topo, qint64 pid,
+                         const AffinityConfig& cfg, int* threadsPinned, BackendError* err)
+{
+    if (threadsPinned) *threadsPinned = 0;
+    // The memory goes to the nodes of the CPUs the mask got.
+    const AffinityConfig fixed = cfg.resolved(topo);
+    if (!applyProcessSettings(backend, topo, pid, fixed, err))
+        return false;
+    bool ok = applyThreadRules(backend, pid, fixed.threadRules, threadsPinned, err);
+    if (fixed.migrateMemory) {
+        BackendError memErr;
+        if (!migrateProcessMemory(pid, fixed.memoryPolicy, numaNodesOf(topo, fixed.cpus), nullptr, &memErr)) {
+            if (ok && err) *err = memErr;
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,62 @@
+#ifndef AFFINITYCONFIG_H
+#define AFFINITYCONFIG_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+#include "cgroupcpuset.h"
+#include "cpuset.h"
+#include "cputopology.h"
+#include "numamemory.h"
+#include "rebalancer.h"
+#include "schedpolicy.h"
+#include "threadpinning.h"
+
+class AffinityBackend;
+struct BackendError;
+
+// Settings for one process, as stored in an .affinity.json file.
+struct AffinityConfig {
+    QString processName;
+    qint64  pid{0};
+    int     assignedCores{0};
+    CorePolicy policy{CorePolicy::PackL3};
+    CpuSet  cpus;   // explicit CPUs; when non-empty, overrides assignedCores/policy
+    QVector<ThreadPinRule> threadRules;   // applied after the process mask
+    MemoryPolicy memoryPolicy{MemoryPolicy::Default};   // relative to the nodes of the CPUs
+    bool    migrateMemory{false};   // move pages already allocated on apply
+    QString cpusetGroup;    // when set, confine via this cgroup instead of the process mask
+    CpusetPartition partition{CpusetPartition::Member};
+    SchedSettings sched;    // class, nice, I/O priority and clamps for every thread
+    RebalanceBounds rebalance;   // let the rebalancer resize the set within these limits
+    bool    includeChildren{false};   // apply to every descendant, and to new ones while active
+
+    // The explicit set, or `assignedCores` CPUs picked by `policy`.
+    CpuSet resolveCpus(const CpuTopology& topo) const;
+    // A copy with `cpus` set to resolveCpus(). Random and IRQ-avoiding
+    // policies pick again on every call, so resolve once and hand this on.
+    AffinityConfig resolved(const CpuTopology& topo) const;
+
+    // Everything but processName and pid is equal.
+    bool sameSettings(const AffinityConfig& o) const;
+
+    QJsonObject toJson() const;
+    static AffinityConfig fromJson(const QJsonObject& o, bool* ok=nullptr);
+};
+
+// Sets the process mask (or cgroup) of `pid` together with its scheduling
+// settings: if the latter fail, the previous mask or group is restored, so the
+// process ends up with both or neither. If restoring fails as well, `err`
+// says so. SCHED_DEADLINE with fewer than all online CPUs is refused unless
+// the group is a partition.
+bool applyProcessSettings(AffinityBackend& backend, const CpuTopology& topo, qint64 pid,
+                          const AffinityConfig& cfg, BackendError* err=nullptr);
+
+// applyProcessSettings(), then the thread rules, then moves its memory if asked
+// to. Stops at the first process-level error; thread and memory errors are
+// reported after every step was tried.
+bool applyAffinityConfig(AffinityBackend& backend, const CpuTopology& topo, qint64 pid,
+                         const AffinityConfig& cfg, int* threadsPinned=nullptr, BackendError* err=nullptr);
+
+#endif // AFFINITYCONFIG_H
@@ -0,0 +1,491 @@
+#include "affinitydaemon.h"
+#include "affinitybackend.h"
+#include "cpusampler.h"
+#include "processenumerator.h"
+#include "processtree.h"
+#include "processwatcher.h"
+#include "snapshot.h"
+#include "telemetry.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSaveFile>
+#include <QTimer>
+
+// ---------- LatencyStats ----------
+
+void LatencyStats::add(qint64 ns)
+{
+    ns = qMax<qint64>(0, ns);
+    if (count == 0 || ns < minNs) minNs = ns;
+    if (ns > maxNs) maxNs = ns;
+    sumNs += ns;
+    ++count;
+
+    int b = 0;
+    for (qint64 us = ns / 1000; us > 1 && b < 31; us >>= 1) ++b;
+    ++buckets[b];
+}
+
+qint64 LatencyStats::percentileNs(double p) const
+{
+    if (count == 0) return 0;
+    const quint64 want = quint64(p * double(count - 1)) + 1;
+    quint64 seen = 0;
+    for (int b = 0; b < 32; ++b) {
+        seen += buckets[b];
+        if (seen >= want)
+            return qMin(maxNs, (qint64(2) << b) * 1000);
+    }
+    return maxNs;
+}
+
+QString LatencyStats::summary() const
+{
+    if (count == 0)
+        return QStringLiteral("no enforcements yet");
+    return QStringLiteral("%1 applied, %2 failed, latency min %3 / p50 %4 / p99 %5 / max %6 µs")
+        .arg(count).arg(failures)
+        .arg(minNs / 1000).arg(percentileNs(0.50) / 1000)
+        .arg(percentileNs(0.99) / 1000).arg(maxNs / 1000);
+}
+
+// ---------- AffinityDaemon ----------
+
+AffinityDaemon::AffinityDaemon(const Options& opts, QObject* parent)
+    : QObject(parent)
+    , opts_(opts)
+    , backend_(AffinityBackend::createNative())
+    , topology_(CpuTopology::detect())
+{
+}
+
+AffinityDaemon::~AffinityDaemon()
+{
+    irqSteering_.restore();
+    if (sampler_) sampler_->stop();
+}
+
+bool AffinityDaemon::start(QString* error)
+{
+    QString why;
+    const Profile profile = Profile::load(opts_.rulesPath, &why);
+    if (profile.rules.isEmpty()) {
+        if (error) *error = !why.isEmpty() ? why : QStringLiteral("%1 contains no rules").arg(opts_.rulesPath);
+        return false;
+    }
+    rules_.build(profile.rules);
+    profile_ = profile;
+
+    watcher_ = new ProcessWatcher(this);
+    // Connected first, so a process under a followed tree that has a rule of
+    // its own ends up with that rule.
+    trees_ = new ProcessTreeFollower(*backend_, topology_, watcher_, this);
+    connect(trees_, &ProcessTreeFollower::adopted, this, [this](qint64 root, qint64 pid, bool ok) {
+        if (ok) recordEvent(HistoryEvent::Applied, pid, QStringLiteral("child of PID %1").arg(root));
+        else qWarning().noquote() << QStringLiteral("cpuaffinity: PID %1 under PID %2: not applied").arg(pid).arg(root);
+    });
+    connect(watcher_, &ProcessWatcher::processStarted, this, &AffinityDaemon::onProcessStarted);
+    connect(watcher_, &ProcessWatcher::overflowed, this, &AffinityDaemon::applyToExisting);
+    if (!watcher_->start(opts_.netlink, opts_.pollIntervalMs)) {
+        if (error) *error = QStringLiteral("No way to watch for new processes on this platform");
+        return false;
+    }
+    qInfo().noquote() << QStringLiteral("cpuaffinity: %1 rule(s) from %2, watching via %3, backend %4")
+                             .arg(rules_.size()).arg(opts_.rulesPath, watcher_->modeName(), backend_->name());
+
+    if (!opts_.recordDir.isEmpty()) {
+        // Before applyToExisting() so its applies are recorded too.
+        HistoryWriter::Options ho;
+        ho.directory = opts_.recordDir;
+        ho.maxFileBytes = opts_.recordMaxFileBytes;
+        ho.maxFiles = opts_.recordMaxFiles;
+        history_ = std::make_unique<HistoryWriter>(ho);
+        if (!history_->open(error))
+            return false;
+        usage_ = std::make_unique<UsageSampler>();
+        usage_->sample();   // primes the counters
+        recordTimer_ = new QTimer(this);
+        recordTimer_->setInterval(qMax(100, opts_.recordIntervalMs));
+        connect(recordTimer_, &QTimer::timeout, this, &AffinityDaemon::record);
+        recordTimer_->start();
+        qInfo().noquote() << QStringLiteral("cpuaffinity: recording history to %1").arg(history_->currentFile());
+    }
+
+    if (opts_.rebalanceIntervalMs > 0) {
+        // Set up before applyToExisting() so running processes are managed too.
+        // The window spans one interval of samples.
+        sampler_ = std::make_unique<CpuSampler>(250);
+        Rebalancer::Options ro;
+        ro.windowSamples = qMax(1, opts_.rebalanceIntervalMs / 250);
+        rebalancer_ = std::make_unique<Rebalancer>(ro, *sampler_, *backend_, topology_);
+        rebalancer_->setAuditLog(opts_.auditLogPath);
+        sampler_->start();
+        rebalanceTimer_ = new QTimer(this);
+        rebalanceTimer_->setInterval(opts_.rebalanceIntervalMs);
+        connect(rebalanceTimer_, &QTimer::timeout, this, &AffinityDaemon::rebalance);
+        rebalanceTimer_->start();
+    }
+
+    if (opts_.applyExisting)
+        applyToExisting();
+
+    if (opts_.steerIrqs) {
+        // Also catches processes that exited and an IRQ balancer undoing our masks.
+        irqTimer_ = new QTimer(this);
+        irqTimer_->setInterval(10000);
+        connect(irqTimer_, &QTimer::timeout, this, &AffinityDaemon::steerIrqs);
+        irqTimer_->start();
+        steerIrqs();
+    }
+
+    if (opts_.watchRules)
+        watchRulesFile();
+
+    if (opts_.statsIntervalSecs > 0) {
+        statsTimer_ = new QTimer(this);
+        statsTimer_->setInterval(opts_.statsIntervalSecs * 1000);
+        connect(statsTimer_, &QTimer::timeout, this, &AffinityDaemon::reportStats);
+        statsTimer_->start();
+    }
+    return true;
+}
+
+void AffinityDaemon::onProcessStarted(qint64 pid, qint64 eventNs)
+{
+    const ProcessIdentity id(pid);
+    if (id.comm().isEmpty() || !rules_.mayMatch(id.comm()))
+        return;
+    const int rule = rules_.match(id);
+    if (rule < 0)
+        return;
+    if (enforce(id, rule))
+        latency_.add(ProcessWatcher::nowNs() - eventNs);
+    else
+        ++latency_.failures;
+}
+
+bool AffinityDaemon::enforce(const ProcessIdentity& id, int rule)
+{
+    const ProfileRule& r = rules_.rule(rule);
+    // Pick the CPUs once; what gets claimed and rebalanced is what was applied.
+    const AffinityConfig cfg = r.config.resolved(topology_);
+    BackendError err;
+    int pinned = 0;
+    bool ok;
+    QString scope;
+    if (cfg.includeChildren) {
+        // All or nothing, like any apply to several processes.
+        const AffinitySnapshot before = AffinitySnapshot::take(*backend_, processTree(id.pid()));
+        TreeApplyReport report;
+        trees_->detach(id.pid());
+        ok = trees_->follow(id.pid(), cfg, &report);
+        err = report.firstError;
+        if (!ok) {
+            trees_->unfollow(id.pid());
+            const RestoreReport undo = restoreSnapshot(*backend_, before);
+            err.message += undo.ok() ? QStringLiteral("; rolled back, %1").arg(undo.summary())
+                                     : QStringLiteral("; rolling back failed too: %1").arg(undo.failures.join(QStringLiteral("; ")));
+        }
+        scope = QStringLiteral(" and %1 descendant(s)").arg(qMax(0, report.applied - 1));
+    } else {
+        trees_->detach(id.pid());
+        ok = applyAffinityConfig(*backend_, topology_, id.pid(), cfg, &pinned, &err);
+    }
+    if (!ok) {
+        qWarning().noquote() << QStringLiteral("cpuaffinity: %1 (PID %2, rule %3): %4 (error %5)")
+                                    .arg(id.comm()).arg(id.pid()).arg(r.name, err.message).arg(err.code);
+        return false;
+    }
+    track(id.pid(), id.comm(), rule, cfg.cpus);
+    recordEvent(HistoryEvent::Applied, id.pid(),
+                QStringLiteral("%1%2: rule %3").arg(id.comm(), scope, r.name));
+    return true;
+}
+
+void AffinityDaemon::track(qint64 pid, const QString& comm, int rule, const CpuSet& cpus)
+{
+    const ProfileRule& r = rules_.rule(rule);
+    if (opts_.watchRules)
+        enforced_.insert(pid, rule);
+    if (opts_.steerIrqs) {
+        // Steer right away only when this process claims CPUs nobody claimed yet.
+        claimed_.insert(pid, cpus);
+        if (irqTimer_ && !(cpus - steeredAway_).isEmpty())
+            steerIrqs();
+    }
+    // A cgroup confines the whole group and the rebalancer resizes one
+    // process mask, not a tree.
+    if (rebalancer_ && r.config.rebalance.enabled && r.config.cpusetGroup.isEmpty()
+        && !r.config.includeChildren) {
+        sampler_->track(pid);
+        rebalanced_.insert(pid);
+        rebalancer_->manage(pid, comm, cpus, r.config.rebalance, r.config.threadRules);
+    } else if (rebalanced_.remove(pid)) {
+        rebalancer_->unmanage(pid);
+        sampler_->untrack(pid);
+    }
+}
+
+// The process keeps its settings; no rule claims it any more.
+void AffinityDaemon::forget(qint64 pid)
+{
+    enforced_.remove(pid);
+    trees_->unfollow(pid);
+    claimed_.remove(pid);
+    if (rebalanced_.remove(pid)) {
+        rebalancer_->unmanage(pid);
+        sampler_->untrack(pid);
+    }
+}
+
+void AffinityDaemon::pruneExited()
+{
+    for (auto it = enforced_.begin(); it != enforced_.end();) {
+        if (QFile::exists(QStringLiteral("/proc/%1").arg(it.key()))) ++it;
+        else it = enforced_.erase(it);
+    }
+}
+
+void AffinityDaemon::watchRulesFile()
+{
+    // Editors and config management often replace the file, which drops it
+    // from the watch list; the directory tells when it is back.
+    rulesWatcher_ = new QFileSystemWatcher(this);
+    rulesWatcher_->addPath(opts_.rulesPath);
+    rulesWatcher_->addPath(QFileInfo(opts_.rulesPath).absolutePath());
+    reloadTimer_ = new QTimer(this);
+    reloadTimer_->setSingleShot(true);
+    reloadTimer_->setInterval(300);
+    connect(reloadTimer_, &QTimer::timeout, this, [this] {
+        QString error;
+        if (!reload(&error))
+            qWarning().noquote() << QStringLiteral("cpuaffinity: keeping the current rules: %1").arg(error);
+    });
+    auto changed = [this] {
+        if (!rulesWatcher_->files().contains(opts_.rulesPath) && QFile::exists(opts_.rulesPath))
+            rulesWatcher_->addPath(opts_.rulesPath);
+        reloadTimer_->start();
+    };
+    connect(rulesWatcher_, &QFileSystemWatcher::fileChanged, this, changed);
+    connect(rulesWatcher_, &QFileSystemWatcher::directoryChanged, this, changed);
+}
+
+bool AffinityDaemon::reload(QString* error)
+{
+    QString why;
+    const Profile next = Profile::load(opts_.rulesPath, &why);
+    if (next.rules.isEmpty()) {
+        if (error) *error = !why.isEmpty() ? why : QStringLiteral("%1 contains no rules").arg(opts_.rulesPath);
+        return false;
+    }
+    const ProfileDiff diff = ProfileDiff::compute(profile_.rules, next.rules);
+    if (diff.isEmpty())
+        return true;   // saved without changes, or a sibling file changed
+
+    QElapsedTimer timer;
+    timer.start();
+    RuleIndex index;
+    index.build(next.rules);
+
+    // A process is left alone when the rule it falls under now is the rule
+    // it fell under before, with the same settings. Processes the old rules
+    // matched but never touched (--no-existing) stay untouched too.
+    QVector<QVector<qint64>> targets(next.rules.size());
+    QHash<qint64, QString> names;
+    int untouched = 0, released = 0;
+    ProcessEnumerator e;
+    e.setWindowedOnly(false);
+    QSet<qint64> alive;
+    for (const ProcEntry& p : e.scan()) {
+        alive.insert(p.pid);
+        const int wasEnforced = enforced_.value(p.pid, -1);
+        if (wasEnforced < 0 && !index.mayMatch(p.name))
+            continue;
+        const ProcessIdentity id(p.pid, p.name);
+        const int rule = index.mayMatch(p.name) ? index.match(id) : -1;
+        if (rule < 0) {
+            if (wasEnforced >= 0) {
+                forget(p.pid);
+                ++released;
+            }
+            continue;
+        }
+        const int before = wasEnforced >= 0 ? wasEnforced : rules_.mayMatch(p.name) ? rules_.match(id) : -1;
+        if (before >= 0 && diff.previous[rule] == before && diff.changes[rule] != ProfileDiff::Config) {
+            if (wasEnforced >= 0) enforced_.insert(p.pid, rule);
+            ++untouched;
+            continue;
+        }
+        targets[rule].append(p.pid);
+        names.insert(p.pid, p.name);
+    }
+    for (auto it = enforced_.begin(); it != enforced_.end();) {
+        if (alive.contains(it.key())) ++it;
+        else it = enforced_.erase(it);
+    }
+
+    profile_ = next;
+    rules_ = index;
+
+    int applied = 0, failed = 0;
+    for (int rule = 0; rule < targets.size(); ++rule) {
+        const QVector<qint64>& pids = targets[rule];
+        if (pids.isEmpty())
+            continue;
+        const AffinityConfig& cfg = rules_.rule(rule).config;
+        // A named group takes its new CPUs with one write and every process
+        // with one open; the rest goes process by process.
+        const bool groupOnly = !cfg.cpusetGroup.isEmpty() && cfg.sched.isDefault()
+                               && cfg.threadRules.isEmpty() && !cfg.migrateMemory && !cfg.includeChildren;
+        if (groupOnly) {
+            BackendError err;
+            int moved = 0;
+            const CpuSet cpus = cfg.resolveCpus(topology_);
+            if (CgroupCpuset::configure(cfg.cpusetGroup, cpus, cfg.partition, &err)
+                && CgroupCpuset::moveProcesses(cfg.cpusetGroup, pids, &moved, &err)) {
+                for (qint64 pid : pids) track(pid, names.value(pid), rule, cpus);
+                applied += int(pids.size());
+                continue;
+            }
+            qWarning().noquote() << QStringLiteral("cpuaffinity: rule %1: %2 (error %3)")
+                                        .arg(rules_.rule(rule).name, err.message).arg(err.code);
+            for (qint64 pid : pids) forget(pid);
+            failed += int(pids.size());
+            continue;
+        }
+        for (qint64 pid : pids) {
+            if (enforce(ProcessIdentity(pid, names.value(pid)), rule)) {
+                ++applied;
+            } else {
+                forget(pid);   // its old rule index means nothing any more
+                ++failed;
+            }
+        }
+    }
+    qInfo().noquote() << QStringLiteral("cpuaffinity: reloaded %1 (%2): %3 process(es) re-applied, %4 failed, "
+                                        "%5 untouched, %6 released in %7 ms")
+                             .arg(opts_.rulesPath, diff.summary()).arg(applied).arg(failed)
+                             .arg(untouched).arg(released).arg(timer.elapsed());
+    recordEvent(HistoryEvent::Note, 0, QStringLiteral("reloaded %1: %2, %3 re-applied, %4 released")
+                                           .arg(opts_.rulesPath, diff.summary()).arg(applied).arg(released));
+    return true;
+}
+
+// Also used after netlink overflow, when exec events may have been lost.
+void AffinityDaemon::applyToExisting()
+{
+    ProcessEnumerator e;
+    e.setWindowedOnly(false);
+    int applied = 0;
+    for (const ProcEntry& p : e.scan()) {
+        if (!rules_.mayMatch(p.name))
+            continue;
+        const ProcessIdentity id(p.pid, p.name);
+        const int rule = rules_.match(id);
+        if (rule >= 0 && enforce(id, rule))
+            ++applied;
+    }
+    qInfo().noquote() << QStringLiteral("cpuaffinity: applied rules to %1 running process(es)").arg(applied);
+}
+
+void AffinityDaemon::reportStats()
+{
+    pruneExited();
+    qInfo().noquote() << QStringLiteral("cpuaffinity: %1").arg(latency_.summary());
+    if (opts_.metricsPath.isEmpty())
+        return;
+
+    QSaveFile f(opts_.metricsPath);
+    if (!f.open(QIODevice::WriteOnly))
+        return;
+    QByteArray out;
+    out += "# TYPE cpuaffinity_enforcements_total counter\n";
+    out += "cpuaffinity_enforcements_total " + QByteArray::number(latency_.count) + "\n";
+    out += "# TYPE cpuaffinity_enforcement_failures_total counter\n";
+    out += "cpuaffinity_enforcement_failures_total " + QByteArray::number(latency_.failures) + "\n";
+    out += "# TYPE cpuaffinity_enforcement_latency_seconds summary\n";
+    for (double q : {0.5, 0.9, 0.99}) {
+        out += "cpuaffinity_enforcement_latency_seconds{quantile=\"" + QByteArray::number(q) + "\"} "
+             + QByteArray::number(double(latency_.percentileNs(q)) / 1e9, 'g', 6) + "\n";
+    }
+    out += "cpuaffinity_enforcement_latency_seconds_sum "
+         + QByteArray::number(double(latency_.sumNs) / 1e9, 'g', 9) + "\n";
+    out += "cpuaffinity_enforcement_latency_seconds_count " + QByteArray::number(latency_.count) + "\n";
+    f.write(out);
+    f.commit();
+}
+
+void AffinityDaemon::steerIrqs()
+{
+    CpuSet claimed;
+    for (auto it = claimed_.begin(); it != claimed_.end();) {
+        if (!QFile::exists(QStringLiteral("/proc/%1").arg(it.key()))) {
+            it = claimed_.erase(it);
+            continue;
+        }
+        claimed |= it.value();
+        ++it;
+    }
+    steeredAway_ = claimed;
+    if (claimed.isEmpty())
+        return;
+
+    const IrqSteering::Result r = irqSteering_.steer(claimed, topology_.online());
+    if (!r.overridden.isEmpty() && !warnedOverride_) {
+        // Only once: a balancer will keep doing it every few seconds.
+        const qint64 balancer = irqBalancerPid();
+        qWarning().noquote() << QStringLiteral("cpuaffinity: %1 IRQ(s) were moved back onto CPUs %2 by %3; "
+                                               "ban those CPUs in its configuration (IRQBALANCE_BANNED_CPULIST)")
+                                    .arg(r.overridden.size())
+                                    .arg(claimed.toRangeList(),
+                                         balancer ? QStringLiteral("irqbalance (PID %1)").arg(balancer)
+                                                  : QStringLiteral("another program"));
+        warnedOverride_ = true;
+    }
+    if (!r.moved.isEmpty())
+        qInfo().noquote() << QStringLiteral("cpuaffinity: moved %1 IRQ(s) off CPUs %2")
+                                 .arg(r.moved.size()).arg(claimed.toRangeList());
+}
+
+void AffinityDaemon::rebalance()
+{
+    for (const RebalanceDecision& d : rebalancer_->tick()) {
+        const QString line = QStringLiteral("cpuaffinity: %1 %2 (PID %3) CPUs %4 -> %5: %6")
+                                 .arg(rebalanceActionKey(d.action), d.name).arg(d.pid)
+                                 .arg(d.from.toRangeList(), d.to.toRangeList(), d.reason);
+        if (d.applied) qInfo().noquote() << line;
+        else qWarning().noquote() << line + QStringLiteral(" failed: ") + d.error;
+        recordEvent(HistoryEvent::Rebalanced, d.pid,
+                    QStringLiteral("%1 %2 CPUs %3 -> %4: %5%6")
+                        .arg(rebalanceActionKey(d.action), d.name, d.from.toRangeList(), d.to.toRangeList(), d.reason,
+                             d.applied ? QString() : QStringLiteral(" (failed: %1)").arg(d.error)));
+        if (opts_.steerIrqs && d.applied && claimed_.contains(d.pid))
+            claimed_.insert(d.pid, d.to);
+    }
+    // Exited processes were dropped by tick().
+    for (auto it = rebalanced_.begin(); it != rebalanced_.end();) {
+        if (rebalancer_->isManaged(*it)) {
+            ++it;
+            continue;
+        }
+        sampler_->untrack(*it);
+        it = rebalanced_.erase(it);
+    }
+}
+
+void AffinityDaemon::record()
+{
+    usage_->sample();
+    history_->append(HistoryFrame::capture(*usage_, backend_.get()));
+}
+
+void AffinityDaemon::recordEvent(HistoryEvent::Kind kind, qint64 pid, const QString& text)
+{
+    if (!history_) return;
+    history_->addEvent(HistoryEvent{QDateTime::currentMSecsSinceEpoch(), kind, pid, text});
+}
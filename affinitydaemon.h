@@ -0,0 +1,117 @@
+#ifndef AFFINITYDAEMON_H
+#define AFFINITYDAEMON_H
+
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+#include "cputopology.h"
+#include "history.h"
+#include "irqaffinity.h"
+#include "profile.h"
+#include "rebalancer.h"
+
+class AffinityBackend;
+class CpuSampler;
+class ProcessTreeFollower;
+class ProcessWatcher;
+class QFileSystemWatcher;
+class QTimer;
+class UsageSampler;
+
+// Time from exec to affinity applied, bucketed by powers of two microseconds.
+struct LatencyStats {
+    quint64 count{0};
+    quint64 failures{0};
+    qint64  minNs{0};
+    qint64  maxNs{0};
+    qint64  sumNs{0};
+    quint64 buckets[32]{};     // bucket i: [2^i, 2^(i+1)) µs, bucket 0 also holds < 1 µs
+
+    void add(qint64 ns);
+    qint64 percentileNs(double p) const;   // upper bound of the bucket holding p
+    QString summary() const;
+};
+
+// Headless enforcement: applies the first matching profile rule to every
+// process that starts, plus the ones already running at startup. When the
+// rules file changes, only processes whose rule or settings changed are
+// touched again.
+class AffinityDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options {
+        QString rulesPath;
+        bool    netlink{true};
+        int     pollIntervalMs{250};
+        int     statsIntervalSecs{60};
+        QString metricsPath;          // Prometheus text file, rewritten every stats interval
+        bool    applyExisting{true};
+        bool    steerIrqs{false};     // keep IRQs off the CPUs enforced rules claim
+        int     rebalanceIntervalMs{0};   // 0 = never resize sets of rules with "rebalance"
+        QString auditLogPath;         // rebalancer decisions, one JSON object per line
+        bool    watchRules{true};     // reload the rules file when it changes
+        QString recordDir;            // history of utilisation, masks and decisions; empty = off
+        int     recordIntervalMs{1000};
+        qint64  recordMaxFileBytes{64 << 20};
+        int     recordMaxFiles{8};
+    };
+
+    explicit AffinityDaemon(const Options& opts, QObject* parent=nullptr);
+    ~AffinityDaemon() override;
+
+    bool start(QString* error=nullptr);
+    const LatencyStats& latency() const { return latency_; }
+
+    // Loads the rules file again and re-applies what the change affects.
+    // Keeps the current rules if the file does not load.
+    bool reload(QString* error=nullptr);
+
+private:
+    void onProcessStarted(qint64 pid, qint64 eventNs);
+    bool enforce(const ProcessIdentity& id, int rule);
+    void track(qint64 pid, const QString& comm, int rule, const CpuSet& cpus);
+    void forget(qint64 pid);
+    void pruneExited();
+    void watchRulesFile();
+    void applyToExisting();
+    void reportStats();
+    void steerIrqs();
+    void rebalance();
+    void record();
+    void recordEvent(HistoryEvent::Kind kind, qint64 pid, const QString& text);
+
+    Options opts_;
+    std::unique_ptr<AffinityBackend> backend_;
+    CpuTopology topology_;
+    ProcessWatcher* watcher_{};
+    ProcessTreeFollower* trees_{};    // trees of rules with "includeChildren"
+    QTimer* statsTimer_{};
+    QTimer* irqTimer_{};
+    QTimer* rebalanceTimer_{};
+
+    Profile profile_;                 // what rules_ was built from, for diffing on reload
+    RuleIndex rules_;
+    LatencyStats latency_;
+    QHash<qint64, int> enforced_;     // PID -> rule it was enforced with
+    QFileSystemWatcher* rulesWatcher_{};
+    QTimer* reloadTimer_{};           // editors write in several steps
+
+    QHash<qint64, CpuSet> claimed_;   // CPUs of every process we enforced, by PID
+    CpuSet steeredAway_;              // union of claimed_ at the last steerIrqs()
+    IrqSteering irqSteering_;
+    bool warnedOverride_{false};
+
+    std::unique_ptr<CpuSampler> sampler_;      // only with a rebalance interval
+    std::unique_ptr<Rebalancer> rebalancer_;
+    QSet<qint64> rebalanced_;                   // PIDs tracked in sampler_
+
+    std::unique_ptr<UsageSampler> usage_;       // only when recording
+    std::unique_ptr<HistoryWriter> history_;
+    QTimer* recordTimer_{};
+};
+
+#endif // AFFINITYDAEMON_H
@@ -0,0 +1,444 @@
+// Microbenchmarks for the tool's own hot paths. Prints one JSON document:
+//
+//   { "schema": 1, "host": {...}, "results": [
+//       { "name": "apply.process", "params": {"threads": 100}, "iterations": 40,
+//         "min_us": ..., "median_us": ..., "p95_us": ..., "mean_us": ..., "stddev_us": ... } ] }
+//
+// Usage: cpuaffinity_bench [--filter apply] [--quick] [--output results.json]
+
+#include "affinitybackend.h"
+#include "affinityconfig.h"
+#include "cputopology.h"
+#include "processenumerator.h"
+#include "processinfo.h"
+#include "processtablemodel.h"
+#include "processtree.h"
+#include "profile.h"
+#include "threadpinning.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSemaphore>
+#include <QSysInfo>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Runs a body until it has both enough iterations and enough wall time, then
+// records order statistics of the per-iteration times.
+class Bench
+{
+public:
+    struct Options {
+        QString filter;
+        int minIterations{10};
+        int maxIterations{100000};
+        qint64 minTimeMs{300};
+    };
+
+    explicit Bench(const Options& opts) : opts_(opts) {}
+
+    bool enabled(const QString& name) const
+    {
+        return opts_.filter.isEmpty() || name.contains(opts_.filter);
+    }
+
+    // A body that returns bool stops the benchmark by returning false; nothing
+    // is recorded for it and failed() becomes true.
+    template <class Fn>
+    bool run(const QString& name, const QJsonObject& params, Fn&& fn)
+    {
+        if (!enabled(name)) return true;
+        // Warm caches, first-touch allocations, lazy statics.
+        if (!call(fn)) return fail();
+
+        std::vector<qint64> ns;
+        QElapsedTimer total;
+        total.start();
+        QElapsedTimer one;
+        while (int(ns.size()) < opts_.maxIterations
+               && (int(ns.size()) < opts_.minIterations || total.elapsed() < opts_.minTimeMs)) {
+            one.start();
+            const bool ok = call(fn);
+            ns.push_back(one.nsecsElapsed());
+            if (!ok) return fail();
+        }
+        record(name, params, ns);
+        return true;
+    }
+
+    QJsonArray results() const { return results_; }
+    bool failed() const { return failed_; }
+
+private:
+    template <class Fn>
+    static bool call(Fn& fn)
+    {
+        if constexpr (std::is_void_v<decltype(fn())>) {
+            fn();
+            return true;
+        } else {
+            return bool(fn());
+        }
+    }
+
+    bool fail()
+    {
+        failed_ = true;
+        return false;
+    }
+
+    void record(const QString& name, const QJsonObject& params, std::vector<qint64>& ns)
+    {
+        std::sort(ns.begin(), ns.end());
+        double sum = 0;
+        for (qint64 v : ns) sum += double(v);
+        const double mean = sum / double(ns.size());
+        double var = 0;
+        for (qint64 v : ns) var += (double(v) - mean) * (double(v) - mean);
+        auto us = [](double v) { return std::round(v / 10.0) / 100.0; };   // 0.01 µs
+        auto at = [&](double q) { return double(ns[size_t(q * double(ns.size() - 1))]); };
+
+        QJsonObject r;
+        r["name"] = name;
+        r["params"] = params;
+        r["iterations"] = int(ns.size());
+        r["min_us"] = us(double(ns.front()));
+        r["median_us"] = us(at(0.5));
+        r["p95_us"] = us(at(0.95));
+        r["mean_us"] = us(mean);
+        r["stddev_us"] = us(std::sqrt(var / double(ns.size())));
+        results_.append(r);
+        QTextStream(stderr) << name << ' ' << QJsonDocument(params).toJson(QJsonDocument::Compact)
+                            << ": median " << r["median_us"].toDouble() << " us\n";
+    }
+
+    Options opts_;
+    QJsonArray results_;
+    bool failed_{false};
+};
+
+// `count` threads parked on a semaphore, so the process has a known number of
+// tasks while masks are applied. Small stacks keep 10k threads affordable.
+class ThreadHerd
+{
+public:
+    explicit ThreadHerd(int count)
+    {
+        threads_.reserve(size_t(count));
+        for (int i = 0; i < count; ++i) {
+            std::unique_ptr<QThread> t(QThread::create([this] { release_.acquire(); }));
+            t->setStackSize(64 * 1024);
+            t->start();
+            if (!t->isRunning())
+                break;   // RLIMIT_NPROC, pids.max, ...
+            threads_.push_back(std::move(t));
+        }
+    }
+
+    ~ThreadHerd()
+    {
+        release_.release(int(threads_.size()));
+        for (auto& t : threads_) t->wait();
+    }
+
+    int size() const { return int(threads_.size()); }
+
+private:
+    QSemaphore release_;
+    std::vector<std::unique_ptr<QThread>> threads_;
+};
+
+#if defined(Q_OS_LINUX)
+// `count` processes forked as a tree, eight children per process, each with
+// `threads` threads. They form one process group, killed at the end.
+class ProcessHerd
+{
+public:
+    ProcessHerd(int count, int threads)
+    {
+        int ready[2];
+        if (::pipe2(ready, O_CLOEXEC) != 0) return;
+        root_ = ::fork();
+        if (root_ == 0) {
+            ::setpgid(0, 0);
+            ::close(ready[0]);
+            node(0, count, threads, ready[1]);
+        }
+        ::close(ready[1]);
+        if (root_ > 0) {
+            ::setpgid(root_, root_);
+            // One byte per process: 1 once it runs, 0 for each one that could
+            // not be forked.
+            char c = 0;
+            for (int i = 0; i < count && ::read(ready[0], &c, 1) == 1; ++i) size_ += c;
+        }
+        ::close(ready[0]);
+    }
+
+    ~ProcessHerd()
+    {
+        if (root_ <= 0) return;
+        ::kill(-root_, SIGKILL);
+        int status;
+        while (::waitpid(root_, &status, 0) < 0 && errno == EINTR) {}
+    }
+
+    ProcessHerd(const ProcessHerd&) = delete;
+    ProcessHerd& operator=(const ProcessHerd&) = delete;
+
+    qint64 root() const { return root_; }
+    int size() const { return size_; }
+
+private:
+    static int subtreeSize(int index, int count)
+    {
+        if (index >= count) return 0;
+        int n = 1;
+        for (int c = 8 * index + 1; c <= 8 * index + 8; ++c) n += subtreeSize(c, count);
+        return n;
+    }
+
+    // Children are forked before this process starts its threads.
+    [[noreturn]] static void node(int index, int count, int threads, int ready)
+    {
+        for (int c = 8 * index + 1; c <= 8 * index + 8 && c < count; ++c) {
+            const pid_t child = ::fork();
+            if (child == 0) node(c, count, threads, ready);
+            if (child < 0) {
+                const std::vector<char> none(size_t(subtreeSize(c, count)), 0);
+                [[maybe_unused]] const ssize_t n = ::write(ready, none.data(), none.size());
+            }
+        }
+        ThreadHerd herd(threads - 1);   // plus the main thread
+        const char one = 1;
+        [[maybe_unused]] const ssize_t n = ::write(ready, &one, 1);
+        for (;;) ::pause();
+    }
+
+    qint64 root_{-1};
+    int size_{0};
+};
+#endif
+
+AffinityConfig sampleConfig(int threadRules)
+{
+    AffinityConfig c;
+    c.processName = QStringLiteral("bench");
+    c.pid = 4242;
+    c.assignedCores = 4;
+    c.policy = CorePolicy::SpreadNuma;
+    c.cpus = CpuSet::fromRangeList(QStringLiteral("0-3,8-11,64-71"));
+    for (int i = 0; i < threadRules; ++i) {
+        ThreadPinRule r;
+        r.pattern = QStringLiteral("^worker-%1$").arg(i);
+        r.cpus = CpuSet::fromList({i % 8});
+        c.threadRules.append(r);
+    }
+    return c;
+}
+
+void benchEnumeration(Bench& b)
+{
+    // ProcessListDialog::populate: a fresh scan into the model.
+    b.run("enumerate.populate", {}, [] {
+        ProcessEnumerator e;
+        e.setWindowedOnly(false);
+        ProcessTableModel model;
+        model.reset(e.scan());
+    });
+
+    // ProcessListDialog::refresh: delta against the previous scan.
+    ProcessEnumerator warm;
+    warm.setWindowedOnly(false);
+    warm.scan();
+    b.run("enumerate.rescan", {}, [&] { warm.rescan(); });
+}
+
+void benchInfo(Bench& b)
+{
+    // What updateProcessInfoView runs on the loader thread.
+    const qint64 self = QCoreApplication::applicationPid();
+    b.run("info.collect", {{"pid", "self"}}, [&] { collectProcessInfo(self); });
+}
+
+void benchJson(Bench& b)
+{
+    for (int rules : {0, 100}) {
+        const AffinityConfig cfg = sampleConfig(rules);
+        b.run("config.roundtrip", {{"threadRules", rules}}, [&] {
+            const QByteArray text = QJsonDocument(cfg.toJson()).toJson(QJsonDocument::Compact);
+            bool ok = false;
+            AffinityConfig::fromJson(QJsonDocument::fromJson(text).object(), &ok);
+        });
+    }
+
+    Profile profile;
+    for (int i = 0; i < 10000; ++i) {
+        ProfileRule r;
+        r.comm = QStringLiteral("svc%1").arg(i);
+        r.config = sampleConfig(0);
+        profile.rules.append(r);
+    }
+    const QByteArray text = QJsonDocument(profile.toJson()).toJson(QJsonDocument::Compact);
+    b.run("profile.load", {{"rules", 10000}}, [&] {
+        RuleIndex index;
+        index.build(Profile::fromJson(QJsonDocument::fromJson(text).object()).rules);
+    });
+}
+
+void benchApply(Bench& b)
+{
+    std::unique_ptr<AffinityBackend> backend = AffinityBackend::createNative();
+    const qint64 self = QCoreApplication::applicationPid();
+    CpuSet all;
+    BackendError err;
+    if (!backend->processAffinity(self, &all, &err) || all.isEmpty()) {
+        QTextStream(stderr) << "apply: cannot read own affinity: " << err.message << '\n';
+        return;
+    }
+    // Alternate between two masks so every call really changes something.
+    CpuSet narrower = all;
+    if (all.count() > 1) narrower.reset(all.last());
+
+    for (int wanted : {1, 100, 10000}) {
+        if (!b.enabled(QStringLiteral("apply.process"))) break;
+        ThreadHerd herd(wanted - 1);   // plus the main thread
+        const int threads = herd.size() + 1;
+        bool flip = false;
+        const bool ok = b.run("apply.process", {{"threads", threads}}, [&] {
+            flip = !flip;
+            return backend->setProcessAffinity(self, flip ? narrower : all, &err);
+        });
+        if (!ok) {
+            // Timing calls that fail early would only measure the error path.
+            QTextStream(stderr) << "apply.process: setProcessAffinity failed with " << threads
+                                << " threads: " << err.message << " (error " << err.code << ")\n";
+        }
+        if (!backend->setProcessAffinity(self, all, &err)) {
+            QTextStream(stderr) << "apply: cannot restore own affinity: " << err.message << '\n';
+            return;
+        }
+        if (!ok) return;
+    }
+}
+
+void benchTree(Bench& b)
+{
+#if defined(Q_OS_LINUX)
+    if (!b.enabled(QStringLiteral("apply.tree"))) return;
+    std::unique_ptr<AffinityBackend> backend = AffinityBackend::createNative();
+    const CpuTopology topo = CpuTopology::detect();
+    AffinityConfig wide, narrow;
+    wide.cpus = narrow.cpus = topo.online();
+    if (wide.cpus.count() > 1) narrow.cpus.reset(wide.cpus.last());
+
+    // What a daemon rule with "includeChildren" does to a build or a
+    // pre-forked server: every thread of every process gets the mask.
+    const struct { int processes; int threads; } sizes[] = {{10, 10}, {100, 10}, {2000, 25}};
+    for (const auto& size : sizes) {
+        ProcessHerd herd(size.processes, size.threads);
+        int threads = 0;
+        const QVector<qint64> pids = processTree(herd.root());
+        for (qint64 pid : pids) threads += int(listThreads(pid).size());
+        TreeApplyReport report;
+        bool flip = false;
+        const bool ok = b.run("apply.tree", {{"processes", int(pids.size())}, {"threads", threads}}, [&] {
+            flip = !flip;
+            return applyToTree(*backend, topo, herd.root(), flip ? narrow : wide, &report);
+        });
+        if (!ok) {
+            QTextStream(stderr) << "apply.tree: " << report.summary() << '\n';
+            return;
+        }
+        if (herd.size() < size.processes) {
+            // pid_max, threads-max, RLIMIT_NPROC: larger trees will not fit either.
+            QTextStream(stderr) << "apply.tree: only " << herd.size() << " of " << size.processes
+                                << " processes could be started\n";
+            return;
+        }
+    }
+#else
+    Q_UNUSED(b);
+#endif
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity_bench"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Microbenchmarks for CPUAffinity's hot paths."));
+    parser.addHelpOption();
+    const QCommandLineOption filterOpt(QStringLiteral("filter"),
+                                       QStringLiteral("Only run benchmarks whose name contains <text>."),
+                                       QStringLiteral("text"));
+    const QCommandLineOption quickOpt(QStringLiteral("quick"),
+                                      QStringLiteral("Fewer iterations, for smoke tests."));
+    const QCommandLineOption outputOpt({QStringLiteral("o"), QStringLiteral("output")},
+                                       QStringLiteral("Write the JSON report to <file> instead of stdout."),
+                                       QStringLiteral("file"));
+    parser.addOptions({filterOpt, quickOpt, outputOpt});
+    parser.process(app);
+
+    Bench::Options opts;
+    opts.filter = parser.value(filterOpt);
+    if (parser.isSet(quickOpt)) {
+        opts.minIterations = 3;
+        opts.minTimeMs = 20;
+    }
+    Bench bench(opts);
+    benchEnumeration(bench);
+    benchInfo(bench);
+    benchJson(bench);
+    benchApply(bench);
+    benchTree(bench);
+
+    QJsonObject host;
+    host["os"] = QSysInfo::prettyProductName();
+    host["kernel"] = QSysInfo::kernelVersion();
+    host["arch"] = QSysInfo::currentCpuArchitecture();
+    host["cpus"] = CpuTopology::detect().size();
+    host["backend"] = AffinityBackend::createNative()->name();
+
+    QJsonObject report;
+    report["schema"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["host"] = host;
+    report["results"] = bench.results();
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (!parser.isSet(outputOpt)) {
+        QTextStream(stdout) << json;
+        return bench.failed() ? 1 : 0;
+    }
+    QFile f(parser.value(outputOpt));
+    if (!f.open(QIODevice::WriteOnly) || f.write(json) != json.size()) {
+        QTextStream(stderr) << "cannot write " << f.fileName() << '\n';
+        return 1;
+    }
+    return bench.failed() ? 1 : 0;
+}
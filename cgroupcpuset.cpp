@@ -0,0 +1,307 @@
+#include "cgroupcpuset.h"
+
+#include <QFile>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+QVector<CpusetPartition> allCpusetPartitions()
+{
+    return {CpusetPartition::Member, CpusetPartition::Root, CpusetPartition::Isolated};
+}
+
+QString cpusetPartitionKey(CpusetPartition p)
+{
+    switch (p) {
+    case CpusetPartition::Member:   return QStringLiteral("member");
+    case CpusetPartition::Root:     return QStringLiteral("root");
+    case CpusetPartition::Isolated: return QStringLiteral("isolated");
+    }
+    return QString();
+}
+
+QString cpusetPartitionLabel(CpusetPartition p)
+{
+    switch (p) {
+    case CpusetPartition::Member:   return QStringLiteral("Shared (member)");
+    case CpusetPartition::Root:     return QStringLiteral("Exclusive (partition root)");
+    case CpusetPartition::Isolated: return QStringLiteral("Isolated (no load balancing)");
+    }
+    return QString();
+}
+
+CpusetPartition cpusetPartitionFromKey(const QString& key, CpusetPartition fallback)
+{
+    for (CpusetPartition p : allCpusetPartitions())
+        if (cpusetPartitionKey(p) == key) return p;
+    return fallback;
+}
+
+static QByteArray readSmall(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return f.readAll().trimmed();
+}
+
+QString CgroupCpuset::mountPoint()
+{
+    static const QString mount = [] {
+        QFile f(QStringLiteral("/proc/self/mountinfo"));
+        if (!f.open(QIODevice::ReadOnly))
+            return QString();
+        // "42 32 0:38 / /sys/fs/cgroup/unified rw,relatime - cgroup2 cgroup2 rw"
+        while (!f.atEnd()) {
+            const QByteArray line = f.readLine();
+            const int sep = line.indexOf(" - ");
+            if (sep < 0 || !line.mid(sep + 3).startsWith("cgroup2 ")) continue;
+            const QList<QByteArray> fields = line.left(sep).split(' ');
+            if (fields.size() >= 5)
+                return QString::fromUtf8(fields[4]);
+        }
+        return QString();
+    }();
+    return mount;
+}
+
+bool CgroupCpuset::isAvailable(QString* why)
+{
+#if defined(Q_OS_LINUX)
+    const QString mount = mountPoint();
+    if (mount.isEmpty()) {
+        if (why) *why = QStringLiteral("cgroup v2 is not mounted");
+        return false;
+    }
+    if (!readSmall(mount + "/cgroup.controllers").split(' ').contains("cpuset")) {
+        if (why) *why = QStringLiteral("the cpuset controller is bound to cgroup v1");
+        return false;
+    }
+    return true;
+#else
+    if (why) *why = QStringLiteral("cgroups are Linux only");
+    return false;
+#endif
+}
+
+QString CgroupCpuset::groupOf(qint64 pid)
+{
+    // v2: "0::/path". On v1-only hosts fall back to the cpuset hierarchy.
+    QByteArray v1;
+    for (const QByteArray& line : readSmall(QStringLiteral("/proc/%1/cgroup").arg(pid)).split('\n')) {
+        if (line.startsWith("0::"))
+            return QString::fromUtf8(line.mid(3));
+        const int a = line.indexOf(':'), b = line.indexOf(':', a + 1);
+        if (a >= 0 && b > a && line.mid(a + 1, b - a - 1).split(',').contains("cpuset"))
+            v1 = line.mid(b + 1);
+    }
+    return QString::fromUtf8(v1);
+}
+
+CpuSet CgroupCpuset::effectiveCpus(const QString& group)
+{
+    const QString mount = mountPoint();
+    if (mount.isEmpty() || group.isEmpty())
+        return CpuSet();
+    bool ok = false;
+    const CpuSet cpus = CpuSet::fromRangeList(
+        QString::fromLatin1(readSmall(mount + group + "/cpuset.cpus.effective")), &ok);
+    return ok ? cpus : CpuSet();
+}
+
+bool CgroupCpuset::isValidName(const QString& name)
+{
+    if (name.isEmpty() || name == QLatin1String("/"))
+        return false;
+    for (const QString& part : name.split('/', Qt::SkipEmptyParts)) {
+        if (part == QLatin1String(".") || part == QLatin1String(".."))
+            return false;
+    }
+    if (name.startsWith('/'))
+        return true;
+    for (const QChar c : name) {
+        if (!c.isLetterOrNumber() && c != '-' && c != '_' && c != '.')
+            return false;
+    }
+    return true;
+}
+
+QString CgroupCpuset::groupPath(const QString& name)
+{
+    if (name.startsWith('/'))
+        return name;
+    return QStringLiteral("/cpuaffinity-") + name;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+bool writeFile(const QString& path, const QByteArray& data, BackendError* err)
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("%1: %2").arg(path, qt_error_string(e)));
+    }
+    const bool ok = ::write(fd, data.constData(), size_t(data.size())) == data.size();
+    const int code = errno;
+    ::close(fd);
+    if (!ok)
+        return fail(err, code, QStringLiteral("%1: %2").arg(path, qt_error_string(code)));
+    return true;
+}
+
+// "+cpuset" in the subtree_control of every ancestor of `group`.
+bool enableCpuset(const QString& mount, const QString& group, BackendError* err)
+{
+    QString dir = mount;
+    const QStringList parts = group.split('/', Qt::SkipEmptyParts);
+    for (int i = 0; i < parts.size(); ++i) {
+        const QString control = dir + "/cgroup.subtree_control";
+        if (!readSmall(control).split(' ').contains("cpuset") && !writeFile(control, "+cpuset", err))
+            return false;
+        dir += QLatin1Char('/') + parts[i];
+    }
+    return true;
+}
+
+} // namespace
+
+bool CgroupCpuset::configure(const QString& name, const CpuSet& cpus, CpusetPartition partition,
+                             BackendError* err)
+{
+    QString why;
+    if (!isAvailable(&why))
+        return fail(err, ENOTSUP, QStringLiteral("cgroup cpuset unavailable: %1").arg(why));
+    if (!isValidName(name))
+        return fail(err, EINVAL, QStringLiteral("Invalid cgroup name \"%1\"").arg(name));
+    if (cpus.isEmpty())
+        return fail(err, EINVAL, QStringLiteral("Empty CPU set"));
+
+    const QString mount = mountPoint();
+    const QString group = groupPath(name);
+    const QString dir = mount + group;
+    if (!name.startsWith('/') && ::mkdir(QFile::encodeName(dir).constData(), 0755) < 0 && errno != EEXIST) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("%1: %2").arg(dir, qt_error_string(e)));
+    }
+    if (!enableCpuset(mount, group, err))
+        return false;
+
+    // Rewriting an unchanged partition would tear it down and rebuild it.
+    const QByteArray current = readSmall(dir + "/cpuset.cpus.partition");
+    const CpuSet currentCpus = CpuSet::fromRangeList(QString::fromLatin1(readSmall(dir + "/cpuset.cpus")));
+    if (currentCpus == cpus && current == cpusetPartitionKey(partition).toLatin1())
+        return true;
+
+    // A partition root must give its CPUs back before they can change.
+    if (!current.startsWith("member") && !current.isEmpty()
+        && !writeFile(dir + "/cpuset.cpus.partition", "member", err))
+        return false;
+    if (!writeFile(dir + "/cpuset.cpus", cpus.toRangeList().toLatin1(), err))
+        return false;
+    if (partition != CpusetPartition::Member) {
+        if (!writeFile(dir + "/cpuset.cpus.partition", cpusetPartitionKey(partition).toLatin1(), err))
+            return false;
+        // The write succeeds even when the kernel cannot honour it, e.g.
+        // "isolated invalid (Cpu list in cpuset.cpus not exclusive)".
+        const QByteArray state = readSmall(dir + "/cpuset.cpus.partition");
+        if (state.contains("invalid"))
+            return fail(err, EINVAL, QStringLiteral("%1: %2").arg(group, QString::fromUtf8(state)));
+    }
+    return true;
+}
+
+bool CgroupCpuset::moveProcesses(const QString& name, const QVector<qint64>& pids, int* moved,
+                                 BackendError* err)
+{
+    if (moved) *moved = 0;
+    const bool root = name == QLatin1String("/");
+    if (!root && !isValidName(name))
+        return fail(err, EINVAL, QStringLiteral("Invalid cgroup name \"%1\"").arg(name));
+    const QString path = mountPoint() + (root ? QString() : groupPath(name)) + "/cgroup.procs";
+    const int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("%1: %2").arg(path, qt_error_string(e)));
+    }
+
+    // The kernel takes one pid per write; keep going past processes that exited.
+    bool ok = true;
+    for (qint64 pid : pids) {
+        char buf[24];
+        const int n = std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(pid));
+        if (::pwrite(fd, buf, size_t(n), 0) == n) {
+            if (moved) ++*moved;
+        } else if (ok) {
+            const int e = errno;
+            ok = fail(err, e, QStringLiteral("PID %1: %2").arg(pid).arg(qt_error_string(e)));
+        }
+    }
+    ::close(fd);
+    return ok;
+}
+
+#else
+
+bool CgroupCpuset::configure(const QString&, const CpuSet&, CpusetPartition, BackendError* err)
+{
+    return fail(err, -1, QStringLiteral("cgroups are Linux only"));
+}
+
+bool CgroupCpuset::moveProcesses(const QString&, const QVector<qint64>&, int* moved, BackendError* err)
+{
+    if (moved) *moved = 0;
+    return fail(err, -1, QStringLiteral("cgroups are Linux only"));
+}
+
+#endif
+
+// ---------- CgroupAffinityBackend ----------
+
+CgroupAffinityBackend::CgroupAffinityBackend(const QString& group, CpusetPartition partition)
+    : group_(group)
+    , partition_(partition)
+    , native_(AffinityBackend::createNative())
+{
+}
+
+QString CgroupAffinityBackend::name() const
+{
+    return QStringLiteral("cgroup v2 cpuset");
+}
+
+bool CgroupAffinityBackend::setProcessAffinity(qint64 pid, const CpuSet& cpus, BackendError* err)
+{
+    QString group = group_;
+    if (group.isEmpty())
+        group = QStringLiteral("cpus-") + cpus.toRangeList().replace(',', '_');
+    if (!CgroupCpuset::configure(group, cpus, partition_, err))
+        return false;
+    return CgroupCpuset::moveProcesses(group, {pid}, nullptr, err);
+}
+
+bool CgroupAffinityBackend::setThreadAffinity(qint64 tid, const CpuSet& cpus, BackendError* err)
+{
+    return native_->setThreadAffinity(tid, cpus, err);
+}
+
+bool CgroupAffinityBackend::processAffinity(qint64 pid, CpuSet* cpus, BackendError* err)
+{
+    return native_->processAffinity(pid, cpus, err);
+}
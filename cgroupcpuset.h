@@ -0,0 +1,77 @@
+#ifndef CGROUPCPUSET_H
+#define CGROUPCPUSET_H
+
+#include <QString>
+#include <QVector>
+#include <memory>
+
+#include "affinitybackend.h"
+#include "cpuset.h"
+
+// cpuset.cpus.partition of a cgroup v2 group.
+enum class CpusetPartition {
+    Member,      // shares CPUs with its siblings
+    Root,        // CPUs taken away from the rest of the hierarchy
+    Isolated,    // like Root, and the scheduler does not balance load onto them
+};
+
+QString cpusetPartitionKey(CpusetPartition p);          // value written to the kernel
+QString cpusetPartitionLabel(CpusetPartition p);        // human readable
+CpusetPartition cpusetPartitionFromKey(const QString& key, CpusetPartition fallback = CpusetPartition::Member);
+QVector<CpusetPartition> allCpusetPartitions();
+
+// cgroup v2 cpuset groups. A plain name such as "db" is the top-level group
+// /sys/fs/cgroup/cpuaffinity-db, created on demand (partitions need a
+// partition-root parent, which only the top level always has); a name
+// starting with '/' is an existing group relative to the mount, e.g.
+// /system.slice/nginx.service.
+class CgroupCpuset
+{
+public:
+    // cgroup2 mount point, empty when there is none.
+    static QString mountPoint();
+    static bool isAvailable(QString* why=nullptr);
+
+    // Group of `pid` relative to the mount ("0::" line of /proc/<pid>/cgroup);
+    // on v1-only hosts the cpuset hierarchy path. Empty if unreadable.
+    static QString groupOf(qint64 pid);
+    // cpuset.cpus.effective of a group path as returned by groupOf().
+    static CpuSet effectiveCpus(const QString& group);
+
+    static bool isValidName(const QString& name);
+    static QString groupPath(const QString& name);   // relative to the mount
+
+    // Creates the group if needed, enables the cpuset controller on the way
+    // down, then sets its CPUs and partition type. Every process already in the
+    // group follows with this single write.
+    static bool configure(const QString& name, const CpuSet& cpus, CpusetPartition partition,
+                          BackendError* err=nullptr);
+
+    // One cgroup.procs write per process moves all of its threads at once.
+    // Besides the names configure() takes, "/" moves them back to the root.
+    static bool moveProcesses(const QString& name, const QVector<qint64>& pids,
+                              int* moved=nullptr, BackendError* err=nullptr);
+};
+
+// Affinity through a cpuset group instead of per-task masks, so children that
+// reset their own affinity stay confined. With no group name, processes are
+// grouped by CPU set ("cpus-8-15"), so every process sharing those CPUs shares
+// one group. Thread masks and reads go to the native backend.
+class CgroupAffinityBackend : public AffinityBackend
+{
+public:
+    explicit CgroupAffinityBackend(const QString& group = QString(),
+                                   CpusetPartition partition = CpusetPartition::Member);
+
+    QString name() const override;
+    bool setProcessAffinity(qint64 pid, const CpuSet& cpus, BackendError* err=nullptr) override;
+    bool setThreadAffinity(qint64 tid, const CpuSet& cpus, BackendError* err=nullptr) override;
+    bool processAffinity(qint64 pid, CpuSet* cpus, BackendError* err=nullptr) override;
+
+private:
+    QString group_;
+    CpusetPartition partition_;
+    std::unique_ptr<AffinityBackend> native_;
+};
+
+#endif // CGROUPCPUSET_H
@@ -0,0 +1,561 @@
+#include "cli.h"
+#include "affinitybackend.h"
+#include "affinitydaemon.h"
+#include "experiment.h"
+#include "history.h"
+#include "launcher.h"
+#include "processenumerator.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "telemetry.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QTimer>
+#include <cstring>
+#include <functional>
+
+#if defined(Q_OS_UNIX)
+#include <QSocketNotifier>
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(Q_OS_UNIX)
+int signalFds[2] = {-1, -1};
+
+void onSignal(int)
+{
+    const char c = 1;
+    [[maybe_unused]] const ssize_t n = ::write(signalFds[0], &c, 1);
+}
+
+// Turns SIGINT/SIGTERM into a clean QCoreApplication::quit(), or into
+// `onQuit` for modes that do not run the event loop.
+void installQuitHandler(QCoreApplication& app, const std::function<void()>& onQuit = {})
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, signalFds) != 0)
+        return;
+    auto* notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, [&app, onQuit] {
+        char c;
+        [[maybe_unused]] const ssize_t n = ::read(signalFds[1], &c, 1);
+        if (onQuit) onQuit();
+        else app.quit();
+    });
+    struct sigaction sa{};
+    sa.sa_handler = onSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    ::sigaction(SIGINT, &sa, nullptr);
+    ::sigaction(SIGTERM, &sa, nullptr);
+}
+#else
+void installQuitHandler(QCoreApplication&, const std::function<void()>& = {}) {}
+#endif
+
+} // namespace
+
+static bool hasFlag(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--") == 0) break;
+        if (std::strcmp(argv[i], flag) == 0) return true;
+    }
+    return false;
+}
+
+bool isCliInvocation(int argc, char* argv[])
+{
+    return hasFlag(argc, argv, "--daemon") || hasFlag(argc, argv, "--experiment")
+        || hasFlag(argc, argv, "--snapshot") || hasFlag(argc, argv, "--rollback")
+        || hasFlag(argc, argv, "--list-snapshots") || hasFlag(argc, argv, "--apply")
+        || hasFlag(argc, argv, "--collector") || hasFlag(argc, argv, "--run");
+}
+
+int runCli(int argc, char* argv[])
+{
+    if (hasFlag(argc, argv, "--experiment"))
+        return runExperiment(argc, argv);
+    if (hasFlag(argc, argv, "--collector"))
+        return runCollector(argc, argv);
+    if (hasFlag(argc, argv, "--run"))
+        return runLaunch(argc, argv);
+    if (hasFlag(argc, argv, "--snapshot") || hasFlag(argc, argv, "--rollback")
+        || hasFlag(argc, argv, "--list-snapshots") || hasFlag(argc, argv, "--apply"))
+        return runSnapshot(argc, argv);
+    return runDaemon(argc, argv);
+}
+
+int runDaemon(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Apply CPU affinity rules to processes as they start."));
+    parser.addHelpOption();
+    const QCommandLineOption daemonOpt(QStringLiteral("daemon"), QStringLiteral("Run headless (implied by cpuaffinityd)."));
+    const QCommandLineOption rulesOpt({QStringLiteral("r"), QStringLiteral("rules")},
+                                      QStringLiteral("Profile with {\"rules\": [...]}, or a single .affinity.json."),
+                                      QStringLiteral("file"));
+    const QCommandLineOption pollOpt(QStringLiteral("poll-interval"),
+                                     QStringLiteral("Polling interval when netlink is unavailable (default 250)."),
+                                     QStringLiteral("ms"), QStringLiteral("250"));
+    const QCommandLineOption noNetlinkOpt(QStringLiteral("no-netlink"), QStringLiteral("Always poll /proc."));
+    const QCommandLineOption noExistingOpt(QStringLiteral("no-existing"),
+                                           QStringLiteral("Do not touch processes already running at startup."));
+    const QCommandLineOption statsOpt(QStringLiteral("stats-interval"),
+                                      QStringLiteral("Log enforcement latency every N seconds, 0 = never (default 60)."),
+                                      QStringLiteral("s"), QStringLiteral("60"));
+    const QCommandLineOption metricsOpt(QStringLiteral("metrics-file"),
+                                        QStringLiteral("Write Prometheus metrics to this file every stats interval."),
+                                        QStringLiteral("path"));
+    const QCommandLineOption steerIrqsOpt(QStringLiteral("steer-irqs"),
+                                          QStringLiteral("Move IRQs off the CPUs of processes the rules were applied to."));
+    const QCommandLineOption rebalanceOpt(QStringLiteral("rebalance"),
+                                          QStringLiteral("Resize the CPU sets of rules with \"rebalance\" bounds every N seconds, 0 = never (default 0)."),
+                                          QStringLiteral("s"), QStringLiteral("0"));
+    const QCommandLineOption auditLogOpt(QStringLiteral("audit-log"),
+                                         QStringLiteral("Append every rebalancer decision and its inputs to this file as JSON lines."),
+                                         QStringLiteral("path"));
+    const QCommandLineOption noReloadOpt(QStringLiteral("no-reload"),
+                                         QStringLiteral("Do not reload the rules file when it changes."));
+    const QCommandLineOption recordOpt(QStringLiteral("record"),
+                                       QStringLiteral("Record utilisation, affinity and rebalancer decisions to history files in this directory."),
+                                       QStringLiteral("dir"));
+    const QCommandLineOption recordIntervalOpt(QStringLiteral("record-interval"),
+                                               QStringLiteral("Milliseconds between recorded samples (default 1000)."),
+                                               QStringLiteral("ms"), QStringLiteral("1000"));
+    const QCommandLineOption recordSizeOpt(QStringLiteral("record-max-size"),
+                                           QStringLiteral("Start a new history file past this many MB (default 64)."),
+                                           QStringLiteral("MB"), QStringLiteral("64"));
+    const QCommandLineOption recordFilesOpt(QStringLiteral("record-files"),
+                                            QStringLiteral("History files to keep (default 8)."),
+                                            QStringLiteral("n"), QStringLiteral("8"));
+    parser.addOptions({daemonOpt, rulesOpt, pollOpt, noNetlinkOpt, noExistingOpt, statsOpt, metricsOpt, steerIrqsOpt,
+                       rebalanceOpt, auditLogOpt, noReloadOpt, recordOpt, recordIntervalOpt, recordSizeOpt, recordFilesOpt});
+    parser.process(app);
+
+    if (!parser.isSet(rulesOpt)) {
+        qCritical("cpuaffinity: --rules is required");
+        return 2;
+    }
+
+    AffinityDaemon::Options opts;
+    opts.rulesPath = parser.value(rulesOpt);
+    opts.netlink = !parser.isSet(noNetlinkOpt);
+    opts.pollIntervalMs = parser.value(pollOpt).toInt();
+    opts.statsIntervalSecs = parser.value(statsOpt).toInt();
+    opts.metricsPath = parser.value(metricsOpt);
+    opts.applyExisting = !parser.isSet(noExistingOpt);
+    opts.steerIrqs = parser.isSet(steerIrqsOpt);
+    opts.rebalanceIntervalMs = qMax(0, parser.value(rebalanceOpt).toInt()) * 1000;
+    opts.auditLogPath = parser.value(auditLogOpt);
+    opts.watchRules = !parser.isSet(noReloadOpt);
+    opts.recordDir = parser.value(recordOpt);
+    opts.recordIntervalMs = parser.value(recordIntervalOpt).toInt();
+    opts.recordMaxFileBytes = qMax<qint64>(1, parser.value(recordSizeOpt).toLongLong()) << 20;
+    opts.recordMaxFiles = qMax(1, parser.value(recordFilesOpt).toInt());
+
+    AffinityDaemon daemon(opts);
+    QString error;
+    if (!daemon.start(&error)) {
+        qCritical().noquote() << "cpuaffinity:" << error;
+        return 1;
+    }
+    installQuitHandler(app);
+    const int rc = app.exec();
+    qInfo().noquote() << "cpuaffinity: exiting," << daemon.latency().summary();
+    return rc;
+}
+
+int runExperiment(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Apply each candidate CPU layout to a workload for a fixed window, rank them by\n"
+        "throughput and save the winner as an .affinity.json."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("command"),
+                                 QStringLiteral("Workload to start when no --pid is given (after --)."),
+                                 QStringLiteral("[-- command args...]"));
+    const QCommandLineOption experimentOpt(QStringLiteral("experiment"), QStringLiteral("Run an A/B experiment."));
+    const QCommandLineOption pidOpt({QStringLiteral("p"), QStringLiteral("pid")},
+                                    QStringLiteral("Running process to experiment on."), QStringLiteral("pid"));
+    const QCommandLineOption candidateOpt({QStringLiteral("c"), QStringLiteral("candidate")},
+                                          QStringLiteral("Layout to try, repeatable: a CPU list (0-3,8) or policy/count (pack-l3/4)."),
+                                          QStringLiteral("layout"));
+    const QCommandLineOption roundsOpt(QStringLiteral("rounds"), QStringLiteral("Windows per layout (default 5)."),
+                                       QStringLiteral("n"), QStringLiteral("5"));
+    const QCommandLineOption windowOpt(QStringLiteral("window"), QStringLiteral("Measured seconds per window (default 5)."),
+                                       QStringLiteral("s"), QStringLiteral("5"));
+    const QCommandLineOption warmupOpt(QStringLiteral("warmup"), QStringLiteral("Unmeasured seconds after each apply (default 1)."),
+                                       QStringLiteral("s"), QStringLiteral("1"));
+    const QCommandLineOption metricOpt(QStringLiteral("metric"),
+                                       QStringLiteral("Command printing a counter (e.g. requests served); scored as its rate."),
+                                       QStringLiteral("command"));
+    const QCommandLineOption metricValueOpt(QStringLiteral("metric-value"),
+                                            QStringLiteral("Score the metric's value at the end of each window, not its rate."));
+    const QCommandLineOption lowerOpt(QStringLiteral("lower-is-better"),
+                                      QStringLiteral("Smaller metric values win (latencies)."));
+    const QCommandLineOption objectiveOpt(QStringLiteral("objective"),
+                                          QStringLiteral("auto, ips, ipc or metric (default auto)."),
+                                          QStringLiteral("name"), QStringLiteral("auto"));
+    const QCommandLineOption outputOpt({QStringLiteral("o"), QStringLiteral("output")},
+                                       QStringLiteral("Where to save the winning config (default <process>.affinity.json)."),
+                                       QStringLiteral("file"));
+    const QCommandLineOption reportOpt(QStringLiteral("report"),
+                                       QStringLiteral("Also write the full ranking as JSON."), QStringLiteral("file"));
+    parser.addOptions({experimentOpt, pidOpt, candidateOpt, roundsOpt, windowOpt, warmupOpt, metricOpt,
+                       metricValueOpt, lowerOpt, objectiveOpt, outputOpt, reportOpt});
+    parser.process(app);
+
+    Experiment::Options opts;
+    opts.pid = parser.value(pidOpt).toLongLong();
+    opts.command = parser.positionalArguments();
+    for (const QString& spec : parser.values(candidateOpt)) {
+        bool ok = false;
+        opts.candidates.append(ExperimentCandidate::parse(spec, &ok));
+        if (!ok) {
+            qCritical().noquote() << "cpuaffinity: bad layout" << spec;
+            return 2;
+        }
+    }
+    if (opts.candidates.size() < 2) {
+        qCritical("cpuaffinity: give at least two --candidate layouts");
+        return 2;
+    }
+    opts.rounds = qMax(1, parser.value(roundsOpt).toInt());
+    opts.windowMs = qMax(100, int(parser.value(windowOpt).toDouble() * 1000));
+    opts.warmupMs = qMax(0, int(parser.value(warmupOpt).toDouble() * 1000));
+    opts.metricCommand = parser.value(metricOpt);
+    opts.metricIsRate = !parser.isSet(metricValueOpt);
+    opts.lowerIsBetter = parser.isSet(lowerOpt);
+    opts.objective = experimentObjectiveFromKey(parser.value(objectiveOpt));
+
+    std::unique_ptr<AffinityBackend> backend = AffinityBackend::createNative();
+    const CpuTopology topology = CpuTopology::detect();
+    Experiment experiment(opts, *backend, topology);
+    // run() never enters the event loop; it stops at its next check and
+    // still restores the target's mask.
+    installQuitHandler(app, [&experiment] { experiment.stop(); });
+    QString error;
+    if (!experiment.run(&error)) {
+        qCritical().noquote() << "cpuaffinity:" << error;
+        return 1;
+    }
+
+    for (const ExperimentStats& s : experiment.ranking()) {
+        qInfo().noquote() << QStringLiteral("%1  %2 = %3  [%4, %5]  ipc %6")
+                                 .arg(opts.candidates[s.candidate].label, -16)
+                                 .arg(experimentObjectiveKey(experiment.objective()))
+                                 .arg(s.mean, 0, 'g', 6).arg(s.ciLow, 0, 'g', 6).arg(s.ciHigh, 0, 'g', 6)
+                                 .arg(s.ipc, 0, 'f', 2);
+    }
+    if (!experiment.winnerIsSignificant())
+        qInfo("cpuaffinity: the top two layouts overlap at 95%%; consider more --rounds");
+
+    const AffinityConfig best = experiment.winner();
+    const QString output = parser.isSet(outputOpt) ? parser.value(outputOpt)
+                                                   : best.processName + QStringLiteral(".affinity.json");
+    QSaveFile f(output);
+    if (!f.open(QIODevice::WriteOnly)
+        || f.write(QJsonDocument(best.toJson()).toJson(QJsonDocument::Indented)) < 0 || !f.commit()) {
+        qCritical().noquote() << "cpuaffinity: cannot write" << output;
+        return 1;
+    }
+    qInfo().noquote() << "cpuaffinity: saved" << output;
+
+    if (parser.isSet(reportOpt)) {
+        QSaveFile r(parser.value(reportOpt));
+        if (!r.open(QIODevice::WriteOnly) || r.write(QJsonDocument(experiment.report()).toJson()) < 0 || !r.commit())
+            qWarning().noquote() << "cpuaffinity: cannot write" << parser.value(reportOpt);
+    }
+    return 0;
+}
+
+// A bare name refers to the snapshot directory, anything path-like to a file.
+static QString snapshotPath(const QString& arg)
+{
+    if (arg.contains(QLatin1Char('/')) || arg.endsWith(QStringLiteral(".snapshot")))
+        return arg;
+    return AffinitySnapshot::pathFor(arg);
+}
+
+int runSnapshot(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Save the affinity, scheduling class and cgroup of every thread, or restore them.\n"
+        "Names are kept in %1.").arg(AffinitySnapshot::directory()));
+    parser.addHelpOption();
+    const QCommandLineOption snapshotOpt(QStringLiteral("snapshot"),
+                                         QStringLiteral("Take a snapshot and save it under a name or to a file."),
+                                         QStringLiteral("name|file"));
+    const QCommandLineOption rollbackOpt(QStringLiteral("rollback"),
+                                         QStringLiteral("Restore a snapshot taken earlier."), QStringLiteral("name|file"));
+    const QCommandLineOption listOpt(QStringLiteral("list-snapshots"), QStringLiteral("List named snapshots, newest first."));
+    const QCommandLineOption applyOpt(QStringLiteral("apply"),
+                                      QStringLiteral("Apply a rules file to the running processes it matches, all or none;\n"
+                                                     "the state before is saved as the snapshot \"before-apply\"."),
+                                      QStringLiteral("file"));
+    const QCommandLineOption pidOpt({QStringLiteral("p"), QStringLiteral("pid")},
+                                    QStringLiteral("Only this process, repeatable (default: all)."), QStringLiteral("pid"));
+    parser.addOptions({snapshotOpt, rollbackOpt, listOpt, applyOpt, pidOpt});
+    parser.process(app);
+
+    if (parser.isSet(listOpt)) {
+        for (const QString& name : AffinitySnapshot::names())
+            qInfo().noquote() << name;
+        return 0;
+    }
+
+    std::unique_ptr<AffinityBackend> backend = AffinityBackend::createNative();
+    QString error;
+    if (parser.isSet(rollbackOpt)) {
+        const QString path = snapshotPath(parser.value(rollbackOpt));
+        const AffinitySnapshot snap = AffinitySnapshot::load(path, &error);
+        if (snap.isEmpty()) {
+            qCritical().noquote() << "cpuaffinity:" << (error.isEmpty() ? path + QStringLiteral(" is empty") : error);
+            return 1;
+        }
+        const RestoreReport report = restoreSnapshot(*backend, snap);
+        for (const QString& failure : report.failures)
+            qWarning().noquote() << "cpuaffinity:" << failure;
+        qInfo().noquote() << "cpuaffinity:" << report.summary();
+        return report.ok() ? 0 : 1;
+    }
+
+    QVector<qint64> pids;
+    for (const QString& p : parser.values(pidOpt))
+        pids.append(p.toLongLong());
+
+    if (parser.isSet(applyOpt)) {
+        const Profile profile = Profile::load(parser.value(applyOpt), &error);
+        if (profile.rules.isEmpty()) {
+            qCritical().noquote() << "cpuaffinity:" << (error.isEmpty() ? QStringLiteral("no rules") : error);
+            return 1;
+        }
+        RuleIndex rules;
+        rules.build(profile.rules);
+        QVector<QPair<qint64, AffinityConfig>> targets;
+        ProcessEnumerator e;
+        e.setWindowedOnly(false);
+        for (const ProcEntry& p : e.scan()) {
+            if ((!pids.isEmpty() && !pids.contains(p.pid)) || !rules.mayMatch(p.name))
+                continue;
+            const int rule = rules.match(ProcessIdentity(p.pid, p.name));
+            if (rule >= 0)
+                targets.append(qMakePair(p.pid, rules.rule(rule).config));
+        }
+        if (targets.isEmpty()) {
+            qCritical().noquote() << "cpuaffinity: no matching processes, nothing was changed";
+            return 1;
+        }
+        AffinitySnapshot before;
+        BackendError err;
+        const bool ok = applyTransaction(*backend, CpuTopology::detect(), targets, &before, &err);
+        before.name = QStringLiteral("before-apply");
+        if (ok && !before.save(AffinitySnapshot::pathFor(before.name), &error))
+            qWarning().noquote() << "cpuaffinity: cannot save the snapshot:" << error;
+        if (!ok) {
+            qCritical().noquote() << "cpuaffinity:" << err.message;
+            return 1;
+        }
+        qInfo().noquote() << QStringLiteral("cpuaffinity: applied to %1 process(es); undo with --rollback before-apply")
+                                 .arg(targets.size());
+        return 0;
+    }
+
+    const QString path = snapshotPath(parser.value(snapshotOpt));
+    AffinitySnapshot snap = AffinitySnapshot::take(*backend, pids);
+    snap.name = QFileInfo(path).completeBaseName();
+    if (!snap.save(path, &error)) {
+        qCritical().noquote() << "cpuaffinity: cannot write" << path << error;
+        return 1;
+    }
+    qInfo().noquote() << QStringLiteral("cpuaffinity: saved %1 process(es), %2 thread(s) to %3")
+                             .arg(snap.processes.size()).arg(snap.threadCount()).arg(path);
+    return 0;
+}
+
+int runCollector(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Publish the process list and CPU usage to shared memory for viewers to read."));
+    parser.addHelpOption();
+    const QCommandLineOption collectorOpt(QStringLiteral("collector"), QStringLiteral("Run the telemetry collector."));
+    const QCommandLineOption intervalOpt(QStringLiteral("interval"),
+                                         QStringLiteral("Milliseconds between publishes (default 1000)."),
+                                         QStringLiteral("ms"), QStringLiteral("1000"));
+    const QCommandLineOption recordOpt(QStringLiteral("record"),
+                                       QStringLiteral("Also record each publish to history files in this directory."),
+                                       QStringLiteral("dir"));
+    const QCommandLineOption recordSizeOpt(QStringLiteral("record-max-size"),
+                                           QStringLiteral("Start a new history file past this many MB (default 64)."),
+                                           QStringLiteral("MB"), QStringLiteral("64"));
+    const QCommandLineOption recordFilesOpt(QStringLiteral("record-files"),
+                                            QStringLiteral("History files to keep (default 8)."),
+                                            QStringLiteral("n"), QStringLiteral("8"));
+    parser.addOptions({collectorOpt, intervalOpt, recordOpt, recordSizeOpt, recordFilesOpt});
+    parser.process(app);
+
+    TelemetryCollector collector(parser.value(intervalOpt).toInt());
+    QString error;
+    if (!collector.open(&error)) {
+        qCritical().noquote() << "cpuaffinity:" << error;
+        return 1;
+    }
+
+    std::unique_ptr<HistoryWriter> history;
+    std::unique_ptr<AffinityBackend> backend;
+    if (parser.isSet(recordOpt)) {
+        HistoryWriter::Options ho;
+        ho.directory = parser.value(recordOpt);
+        ho.maxFileBytes = qMax<qint64>(1, parser.value(recordSizeOpt).toLongLong()) << 20;
+        ho.maxFiles = qMax(1, parser.value(recordFilesOpt).toInt());
+        history = std::make_unique<HistoryWriter>(ho);
+        if (!history->open(&error)) {
+            qCritical().noquote() << "cpuaffinity:" << error;
+            return 1;
+        }
+        backend = AffinityBackend::createNative();
+        qInfo().noquote() << "cpuaffinity: recording history to" << history->currentFile();
+    }
+    auto publish = [&] {
+        collector.publish();
+        if (history) history->append(HistoryFrame::capture(collector.sampler(), backend.get()));
+    };
+    publish();
+    qInfo().noquote() << QStringLiteral("cpuaffinity: publishing %1 process(es) every %2 ms")
+                             .arg(collector.processCount()).arg(collector.intervalMs());
+
+    QTimer timer;
+    timer.setInterval(collector.intervalMs());
+    QObject::connect(&timer, &QTimer::timeout, &app, publish);
+    timer.start();
+    installQuitHandler(app);
+    const int rc = app.exec();
+    collector.close();
+    return rc;
+}
+
+// The rule `name`, the only rule, or the first whose comm is the command's.
+static const ProfileRule* launchRule(const Profile& profile, const QString& name, const QString& program)
+{
+    if (!name.isEmpty()) {
+        for (const ProfileRule& r : profile.rules)
+            if (r.name == name) return &r;
+        return nullptr;
+    }
+    if (profile.rules.size() == 1)
+        return &profile.rules.first();
+    const QString comm = commKey(QFileInfo(program).fileName());
+    for (const ProfileRule& r : profile.rules)
+        if (!r.comm.isEmpty() && commKey(r.comm) == comm) return &r;
+    return nullptr;
+}
+
+int runLaunch(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("cpuaffinity"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral(
+        "Start a command with its CPUs, memory policy, scheduling and cgroup applied before it runs:\n"
+        "  cpuaffinity --run -c game.affinity.json -- ./game --fullscreen"));
+    parser.addHelpOption();
+    const QCommandLineOption runOpt(QStringLiteral("run"), QStringLiteral("Run the command given after --."));
+    const QCommandLineOption configOpt({QStringLiteral("c"), QStringLiteral("config")},
+                                       QStringLiteral("An .affinity.json, or a profile with {\"rules\": [...]}."),
+                                       QStringLiteral("file"));
+    const QCommandLineOption ruleOpt(QStringLiteral("rule"),
+                                     QStringLiteral("Profile rule to use (default: the only rule, or the first whose comm is the command's)."),
+                                     QStringLiteral("name"));
+    const QCommandLineOption cpusOpt(QStringLiteral("cpus"),
+                                     QStringLiteral("CPUs to run on, e.g. 0-3,8; overrides the config's."),
+                                     QStringLiteral("list"));
+    const QCommandLineOption followOpt(QStringLiteral("follow-threads"),
+                                       QStringLiteral("Apply the thread rules to threads started in the first N ms (default 0)."),
+                                       QStringLiteral("ms"), QStringLiteral("0"));
+    parser.addOptions({runOpt, configOpt, ruleOpt, cpusOpt, followOpt});
+    parser.addPositionalArgument(QStringLiteral("command"), QStringLiteral("The command and its arguments, after --."));
+    parser.process(app);
+
+    const QStringList command = parser.positionalArguments();
+    if (command.isEmpty()) {
+        qCritical("cpuaffinity: no command given after --");
+        return 2;
+    }
+    if (!parser.isSet(configOpt) && !parser.isSet(cpusOpt)) {
+        qCritical("cpuaffinity: --config or --cpus is required");
+        return 2;
+    }
+
+    AffinityConfig cfg;
+    QString error;
+    if (parser.isSet(configOpt)) {
+        const Profile profile = Profile::load(parser.value(configOpt), &error);
+        if (profile.rules.isEmpty()) {
+            qCritical().noquote() << "cpuaffinity:" << (error.isEmpty() ? QStringLiteral("no rules") : error);
+            return 1;
+        }
+        const ProfileRule* rule = launchRule(profile, parser.value(ruleOpt), command.first());
+        if (!rule) {
+            qCritical().noquote() << "cpuaffinity: no rule in" << parser.value(configOpt) << "for" << command.first()
+                                  << "- pick one with --rule";
+            return 1;
+        }
+        cfg = rule->config;
+    }
+    if (parser.isSet(cpusOpt)) {
+        bool ok = false;
+        cfg.cpus = CpuSet::fromRangeList(parser.value(cpusOpt), &ok);
+        if (!ok || cfg.cpus.isEmpty()) {
+            qCritical().noquote() << "cpuaffinity: bad CPU list" << parser.value(cpusOpt);
+            return 2;
+        }
+    }
+
+    std::unique_ptr<AffinityBackend> backend = AffinityBackend::createNative();
+    const CpuTopology topo = CpuTopology::detect();
+    Launcher launcher(*backend, topo);
+    BackendError err;
+    if (!launcher.start(cfg, command, &err)) {
+        qCritical().noquote() << "cpuaffinity:" << err.message;
+        return 127;
+    }
+#if defined(Q_OS_UNIX)
+    // Ctrl+C reaches the child through the terminal; we wait for its exit code.
+    ::signal(SIGINT, SIG_IGN);
+#endif
+    qInfo().noquote() << QStringLiteral("cpuaffinity: pid %1 on CPUs %2, %3")
+                             .arg(launcher.pid()).arg(launcher.cpus().toRangeList(), launcher.timings().summary());
+    const int followMs = parser.value(followOpt).toInt();
+    if (followMs > 0 && !cfg.threadRules.isEmpty()) {
+        const int pinned = launcher.followThreads(cfg.threadRules, followMs, &err);
+        qInfo().noquote() << QStringLiteral("cpuaffinity: pinned %1 thread(s) during startup").arg(pinned);
+        if (err.code)
+            qWarning().noquote() << "cpuaffinity:" << err.message;
+    }
+    return launcher.wait();
+}
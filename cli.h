@@ -0,0 +1,29 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Command-line modes that run without widgets. main() checks isCliInvocation()
+// before creating a QApplication.
+bool isCliInvocation(int argc, char* argv[]);
+int runCli(int argc, char* argv[]);
+
+// --daemon: load a rules file and enforce it on every new process.
+int runDaemon(int argc, char* argv[]);
+
+// --experiment: try candidate CPU layouts on a workload and save the best.
+int runExperiment(int argc, char* argv[]);
+
+// --snapshot / --rollback: save every thread's affinity and scheduling, or put
+// a saved snapshot back. --apply applies a rules file to running processes as
+// one transaction.
+int runSnapshot(int argc, char* argv[]);
+
+// --collector: publish the process list and CPU usage to shared memory, so the
+// process list and info panels of every running GUI read it instead of /proc.
+// With --record, every publish is also appended to history files.
+int runCollector(int argc, char* argv[]);
+
+// --run: start a command with a config's CPUs, memory policy, scheduling and
+// cgroup already applied, and exit with its exit code.
+int runLaunch(int argc, char* argv[]);
+
+#endif // CLI_H
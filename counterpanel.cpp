@@ -0,0 +1,146 @@
+#include "counterpanel.h"
+#include "affinitybackend.h"
+
+#include <QHeaderView>
+#include <QLabel>
+#include <QStandardItemModel>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
+
+CounterPanel::CounterPanel(QWidget* parent)
+    : QWidget(parent)
+    , backend_(AffinityBackend::createNative())
+{
+    model_ = new QStandardItemModel(0, ColumnCount, this);
+    model_->setHorizontalHeaderLabels({"CPU", "Busy %", "IPC", "GHz", "LLC miss %", "L1D miss %",
+                                       "Branch miss %", "Ctx sw/s", "Migr/s"});
+
+    table_ = new QTableView(this);
+    table_->setModel(model_);
+    table_->setSelectionMode(QAbstractItemView::NoSelection);
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->verticalHeader()->hide();
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 4);
+    table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+    status_ = new QLabel(this);
+    status_->setWordWrap(true);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(table_, 1);
+    layout->addWidget(status_);
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(1000);
+    connect(refreshTimer_, &QTimer::timeout, this, &CounterPanel::refresh);
+}
+
+CounterPanel::~CounterPanel() = default;
+
+void CounterPanel::setPid(qint64 pid)
+{
+    pid_ = pid;
+    counters_.close();
+    model_->setRowCount(0);
+    if (isVisible()) openCounters();
+}
+
+void CounterPanel::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    openCounters();
+    refreshTimer_->start();
+}
+
+void CounterPanel::hideEvent(QHideEvent* event)
+{
+    refreshTimer_->stop();
+    counters_.close();
+    QWidget::hideEvent(event);
+}
+
+void CounterPanel::openCounters()
+{
+    counters_.close();
+    if (pid_ <= 0) {
+        status_->setText("No process selected.");
+        return;
+    }
+    if (!PerfCounters::isSupported()) {
+        status_->setText("Performance counters are not available on this system.");
+        return;
+    }
+
+    // Per-CPU counts over the CPUs the process may run on.
+    CpuSet cpus;
+    BackendError err;
+    QString error;
+    const bool ok = backend_->processAffinity(pid_, &cpus, &err) && !cpus.isEmpty()
+                        ? counters_.openPerCpu(pid_, cpus, &error)
+                        : counters_.open(pid_, &error);
+    if (!ok) {
+        status_->setText(QString("Cannot open counters for PID %1: %2").arg(pid_).arg(error));
+        return;
+    }
+    lastPerCpu_ = counters_.readPerCpu(&lastTotal_);
+    status_->setText(counters_.limitation().isEmpty()
+                         ? QString("Hardware and software events, refreshed every second.")
+                         : counters_.limitation() + ".");
+}
+
+void CounterPanel::setRow(int row, const QString& label, const PerfReading& d)
+{
+    auto setCell = [this, row](int col, const QString& text) {
+        if (QStandardItem* item = model_->item(row, col)) {
+            if (item->text() != text) item->setText(text);
+        } else {
+            auto* created = new QStandardItem(text);
+            if (col != ColCpu) created->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            model_->setItem(row, col, created);
+        }
+    };
+    const QString none = QStringLiteral("—");
+    auto fixed = [&](double v, int decimals) { return v < 0 ? none : QString::number(v, 'f', decimals); };
+    const double seconds = double(d.timestampNs) / 1e9;
+    auto perSec = [&](PerfReading::Counter c) {
+        return d.has(c) && seconds > 0 ? QString::number(double(d.value(c)) / seconds, 'f', 0) : none;
+    };
+
+    setCell(ColCpu, label);
+    setCell(ColUtil, d.has(PerfReading::TaskClockNs) && d.timestampNs > 0
+                         ? fixed(100.0 * double(d.value(PerfReading::TaskClockNs)) / double(d.timestampNs), 1)
+                         : none);
+    setCell(ColIpc, fixed(d.ratio(PerfReading::Instructions, PerfReading::Cycles), 2));
+    setCell(ColGhz, fixed(d.ratio(PerfReading::Cycles, PerfReading::TaskClockNs), 2));
+    const double llc = d.ratio(PerfReading::LlcMisses, PerfReading::LlcReferences);
+    const double l1d = d.ratio(PerfReading::L1dMisses, PerfReading::L1dLoads);
+    const double br = d.ratio(PerfReading::BranchMisses, PerfReading::Branches);
+    setCell(ColLlc, fixed(llc < 0 ? llc : llc * 100.0, 1));
+    setCell(ColL1d, fixed(l1d < 0 ? l1d : l1d * 100.0, 1));
+    setCell(ColBranch, fixed(br < 0 ? br : br * 100.0, 2));
+    setCell(ColCtx, perSec(PerfReading::ContextSwitches));
+    setCell(ColMigr, perSec(PerfReading::Migrations));
+}
+
+void CounterPanel::refresh()
+{
+    if (!counters_.isOpen()) return;
+    counters_.refreshThreads();
+    PerfReading total;
+    const QVector<PerfReading> perCpu = counters_.readPerCpu(&total);
+
+    // Rows are updated in place; CPUs the process did not run on are left out.
+    int rows = 0;
+    setRow(rows++, QStringLiteral("All"), total - lastTotal_);
+    for (int cpu = 0; cpu < perCpu.size() && cpu < lastPerCpu_.size(); ++cpu) {
+        const PerfReading d = perCpu[cpu] - lastPerCpu_[cpu];
+        if (d.value(PerfReading::TaskClockNs) <= 0) continue;
+        setRow(rows++, QString::number(cpu), d);
+    }
+    model_->setRowCount(rows);
+    lastTotal_ = total;
+    lastPerCpu_ = perCpu;
+}
@@ -0,0 +1,51 @@
+#ifndef COUNTERPANEL_H
+#define COUNTERPANEL_H
+
+#include <QWidget>
+#include <memory>
+
+#include "perfcounters.h"
+
+class AffinityBackend;
+class QLabel;
+class QStandardItemModel;
+class QTableView;
+class QTimer;
+
+// perf_event counters of the selected process: one row for the whole process
+// and one per CPU it ran on in the last second. Counters are only open while
+// the panel is shown, so a hidden tab costs nothing.
+class CounterPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    enum Column { ColCpu, ColUtil, ColIpc, ColGhz, ColLlc, ColL1d, ColBranch, ColCtx, ColMigr, ColumnCount };
+
+    explicit CounterPanel(QWidget* parent=nullptr);
+    ~CounterPanel() override;
+
+    // Also call after the process's mask changed, to follow the new CPUs.
+    void setPid(qint64 pid);
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private:
+    void openCounters();
+    void refresh();
+    void setRow(int row, const QString& label, const PerfReading& d);
+
+    qint64 pid_{0};
+    PerfCounters counters_;
+    PerfReading lastTotal_;
+    QVector<PerfReading> lastPerCpu_;
+    std::unique_ptr<AffinityBackend> backend_;
+
+    QTableView* table_{};
+    QStandardItemModel* model_{};
+    QLabel* status_{};
+    QTimer* refreshTimer_{};
+};
+
+#endif // COUNTERPANEL_H
@@ -1,27 +1,121 @@
 #include "cpuaffinity.h"
 #include "./ui_CPUAffinity.h"
 #include "processlistdialog.h"
+#include "affinitybackend.h"
+#include "processinfo.h"
+#include "processtree.h"
+#include "processwatcher.h"
+#include "cpusampler.h"
+#include "cpuseteditor.h"
+#include "historydialog.h"
+#include "irqdialog.h"
+#include "latencypanel.h"
+#include "schededitor.h"
+#include "snapshot.h"
+#include "threadpanel.h"
 
 #include <QFileDialog>
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QInputDialog>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMessageBox>
 #include <QLabel>
 #include <QSpinBox>
+#include <QComboBox>
+#include <QCheckBox>
 #include <QProcess>
 #include <QStandardItemModel>
-#include <QRegularExpression>
 #include <QDateTime>
 #include <QTime>
 #include <cmath>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QTimer>
 
 CPUAffinity::CPUAffinity(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::CPUAffinity)
+    , backend_(AffinityBackend::createNative())
+    , sampler_(std::make_unique<CpuSampler>(100))
+    , topology_(CpuTopology::detect())
 {
     ui->setupUi(this);
+
+    // One model for the info panel, refilled in place on every selection.
+    infoModel_ = new QStandardItemModel(this);
+    if (auto* listView = findChild<QListView*>("processInfoListView"))
+        listView->setModel(infoModel_);
+    infoLoader_ = new ProcessInfoLoader(this);
+    connect(infoLoader_, &ProcessInfoLoader::loaded, this, &CPUAffinity::onProcessInfoLoaded);
+
+    // Live utilisation next to the info panel
+    sampler_->start();
+    ui->utilizationGraph->setSampler(sampler_.get());
+    ui->threadPanel->setSampler(sampler_.get());
+
+    // The sampler already tracks the selected process; two checks per window.
+    rebalancer_ = std::make_unique<Rebalancer>(Rebalancer::Options(), *sampler_, *backend_, topology_);
+    rebalanceTimer_ = new QTimer(this);
+    rebalanceTimer_->setInterval(2000);
+    connect(rebalanceTimer_, &QTimer::timeout, this, &CPUAffinity::onRebalanceTick);
+
+    // Editors save in several steps, often by replacing the file.
+    configWatcher_ = new QFileSystemWatcher(this);
+    configReloadTimer_ = new QTimer(this);
+    configReloadTimer_->setSingleShot(true);
+    configReloadTimer_->setInterval(300);
+    connect(configReloadTimer_, &QTimer::timeout, this, &CPUAffinity::onConfigFileChanged);
+    connect(configWatcher_, &QFileSystemWatcher::fileChanged, configReloadTimer_, qOverload<>(&QTimer::start));
+    connect(configWatcher_, &QFileSystemWatcher::directoryChanged, configReloadTimer_, qOverload<>(&QTimer::start));
+
+    if (auto* c = findChild<QComboBox*>("comboCorePolicy")) {
+        for (CorePolicy p : allCorePolicies())
+            c->addItem(corePolicyLabel(p), corePolicyKey(p));
+    }
+    for (MemoryPolicy p : allMemoryPolicies())
+        ui->comboMemoryPolicy->addItem(memoryPolicyLabel(p), memoryPolicyKey(p));
+#ifndef Q_OS_LINUX
+    // No way to place another process's memory outside Linux.
+    ui->labelMemoryPolicy->hide();
+    ui->comboMemoryPolicy->hide();
+    ui->checkMigrateMemory->hide();
+#endif
+    for (CpusetPartition p : allCpusetPartitions())
+        ui->comboPartition->addItem(cpusetPartitionLabel(p), cpusetPartitionKey(p));
+    QString noCgroupReason;
+    if (!CgroupCpuset::isAvailable(&noCgroupReason)) {
+#ifdef Q_OS_LINUX
+        ui->editCpusetGroup->setEnabled(false);
+        ui->comboPartition->setEnabled(false);
+        ui->editCpusetGroup->setToolTip(QString("Not available: %1").arg(noCgroupReason));
+#else
+        ui->labelCpusetGroup->hide();
+        ui->editCpusetGroup->hide();
+        ui->labelPartition->hide();
+        ui->comboPartition->hide();
+#endif
+    }
+#ifndef Q_OS_LINUX
+    ui->schedEditor->hide();
+    ui->checkRebalance->hide();   // needs the sampler
+    ui->spinRebalanceMin->hide();
+    ui->spinRebalanceMax->hide();
+    ui->actionInterrupts->setVisible(false);
+#endif
+    connect(ui->comboMemoryPolicy, &QComboBox::currentIndexChanged, this, [this](int index) {
+        ui->checkMigrateMemory->setEnabled(index > 0);
+    });
+    ui->cpuSetEditor->setTopology(topology_);
+    ui->cpuSetEditor->setEnabled(false);
+    connect(ui->checkExplicitCpus, &QCheckBox::toggled, ui->cpuSetEditor, &QWidget::setEnabled);
+    ui->spinRebalanceMin->setMaximum(qMax(1, topology_.size()));
+    ui->spinRebalanceMax->setMaximum(qMax(1, topology_.size()));
+    connect(ui->checkRebalance, &QCheckBox::toggled, ui->spinRebalanceMin, &QWidget::setEnabled);
+    connect(ui->checkRebalance, &QCheckBox::toggled, ui->spinRebalanceMax, &QWidget::setEnabled);
+
     connectUi();
 
     // Defaults
@@ -35,6 +129,9 @@ CPUAffinity::CPUAffinity(QWidget *parent)
 
 CPUAffinity::~CPUAffinity()
 {
+    rebalancer_.reset();
+    ui->utilizationGraph->setSampler(nullptr);
+    ui->threadPanel->setSampler(nullptr);
     delete ui;
 }
 
@@ -70,6 +167,10 @@ void CPUAffinity::connectUi()
     connect(ui->actionSave,              &QAction::triggered, this, &CPUAffinity::onActionSave);
     connect(ui->actionSaveAs,            &QAction::triggered, this, &CPUAffinity::onActionSaveAs);
     connect(ui->actionLoad,              &QAction::triggered, this, &CPUAffinity::onActionLoad);
+    connect(ui->actionInterrupts,        &QAction::triggered, this, &CPUAffinity::onActionInterrupts);
+    connect(ui->actionTakeSnapshot,      &QAction::triggered, this, &CPUAffinity::onActionTakeSnapshot);
+    connect(ui->actionRollBack,          &QAction::triggered, this, &CPUAffinity::onActionRollBack);
+    connect(ui->actionReplayHistory,     &QAction::triggered, this, &CPUAffinity::onActionReplayHistory);
     connect(ui->actionCheckForNewVersion,&QAction::triggered, this, &CPUAffinity::onActionCheckForNewVersion);
     connect(ui->actionAbout,             &QAction::triggered, this, &CPUAffinity::onActionAbout);
     connect(ui->actionQuit,              &QAction::triggered, this, &CPUAffinity::close);
@@ -106,6 +207,21 @@ void CPUAffinity::refreshUiProcessLabel()
         ui->labelCurrentProcess->setText(text);
 }
 
+ProcessTreeFollower* CPUAffinity::treeFollower()
+{
+    if (!treeFollower_) {
+        auto* watcher = new ProcessWatcher(this);
+        watcher->start();
+        treeFollower_ = new ProcessTreeFollower(*backend_, topology_, watcher, this);
+        connect(treeFollower_, &ProcessTreeFollower::adopted, this, [this](qint64 root, qint64 pid, bool ok) {
+            if (!ok)
+                statusBar()->showMessage(QString("Could not apply the settings of PID %1 to its new child PID %2")
+                                             .arg(root).arg(pid), 5000);
+        });
+    }
+    return treeFollower_;
+}
+
 QSpinBox* CPUAffinity::findSpinUnassign() const
 {
     // We expect a QSpinBox in Frame Two with objectName "spinUnassign"
@@ -118,94 +234,93 @@ void CPUAffinity::pullEditorsIntoConfig()
 {
     if (auto* s = findChild<QSpinBox*>("spinBoxAssignedCores"))
         cfg_.assignedCores = s->value();
+    if (auto* c = findChild<QComboBox*>("comboCorePolicy"))
+        cfg_.policy = corePolicyFromKey(c->currentData().toString(), cfg_.policy);
+    if (ui->checkExplicitCpus->isChecked())
+        cfg_.cpus = ui->cpuSetEditor->cpuSet();
+    else
+        cfg_.cpus.clear();
+    cfg_.threadRules = ui->threadPanel->rules();
+    cfg_.memoryPolicy = memoryPolicyFromKey(ui->comboMemoryPolicy->currentData().toString());
+    cfg_.migrateMemory = ui->checkMigrateMemory->isChecked();
+    cfg_.cpusetGroup = ui->editCpusetGroup->text().trimmed();
+    cfg_.partition = cpusetPartitionFromKey(ui->comboPartition->currentData().toString());
+    cfg_.sched = ui->schedEditor->settings();
+    cfg_.rebalance.enabled = ui->checkRebalance->isChecked();
+    cfg_.rebalance.minCores = ui->spinRebalanceMin->value();
+    cfg_.rebalance.maxCores = ui->spinRebalanceMax->value();
+    cfg_.includeChildren = ui->checkIncludeChildren->isChecked();
 }
 
 void CPUAffinity::pushConfigIntoEditors()
 {
     if (auto* s = findChild<QSpinBox*>("spinBoxAssignedCores")) {
-        s->setMaximum(totalLogicalProcessors());
+        s->setMaximum(topology_.size() > 0 ? topology_.size() : totalLogicalProcessors());
         s->setValue(cfg_.assignedCores > 0 ? cfg_.assignedCores : 1);
     }
+    if (auto* c = findChild<QComboBox*>("comboCorePolicy")) {
+        const int idx = c->findData(corePolicyKey(cfg_.policy));
+        if (idx >= 0) c->setCurrentIndex(idx);
+    }
+    ui->checkExplicitCpus->setChecked(!cfg_.cpus.isEmpty());
+    if (!cfg_.cpus.isEmpty())
+        ui->cpuSetEditor->setCpuSet(cfg_.cpus);
+    ui->threadPanel->setRules(cfg_.threadRules);
+    ui->comboMemoryPolicy->setCurrentIndex(qMax(0, ui->comboMemoryPolicy->findData(memoryPolicyKey(cfg_.memoryPolicy))));
+    ui->checkMigrateMemory->setChecked(cfg_.migrateMemory);
+    ui->checkMigrateMemory->setEnabled(cfg_.memoryPolicy != MemoryPolicy::Default);
+    ui->editCpusetGroup->setText(cfg_.cpusetGroup);
+    ui->comboPartition->setCurrentIndex(qMax(0, ui->comboPartition->findData(cpusetPartitionKey(cfg_.partition))));
+    ui->schedEditor->setSettings(cfg_.sched);
+    ui->checkRebalance->setChecked(cfg_.rebalance.enabled);
+    ui->spinRebalanceMin->setValue(cfg_.rebalance.minCores);
+    ui->spinRebalanceMax->setValue(cfg_.rebalance.maxCores);
+    ui->spinRebalanceMin->setEnabled(cfg_.rebalance.enabled);
+    ui->spinRebalanceMax->setEnabled(cfg_.rebalance.enabled);
+    ui->checkIncludeChildren->setChecked(cfg_.includeChildren);
 }
 
-void CPUAffinity::updateProcessInfoView()
+void CPUAffinity::showInfoMessage(const QString& text)
 {
-    auto* listView = this->findChild<QListView*>("processInfoListView");
-    if (!listView) return;
-
-    auto* model = new QStandardItemModel(listView);
+    infoModel_->clear();
+    infoModel_->appendRow(new QStandardItem(text));
+}
 
-#ifdef Q_OS_WINDOWS
+void CPUAffinity::updateProcessInfoView()
+{
     if (cfg_.pid <= 0) {
-        model->appendRow(new QStandardItem("No process selected."));
-        listView->setModel(model);
+        infoLoader_->cancel();
+        showInfoMessage("No process selected.");
         return;
     }
 
-    // PS script: get process by PID, fill in path via WMI if needed, then emit a single JSON object.
-    const QString ps = QString(
-                           "$p=Get-Process -Id %1 -ErrorAction SilentlyContinue;"
-                           "if(-not $p){ exit 2 };"
-                           "$wp=Get-CimInstance Win32_Process -Filter \"ProcessId=%1\" -ErrorAction SilentlyContinue;"
-                           "$path=if($p.Path){$p.Path}else{$wp.ExecutablePath};"
-                           "$total=(Get-CimInstance Win32_ComputerSystem).NumberOfLogicalProcessors;"
-                           "$mask=$p.ProcessorAffinity;"
-                           "$assigned=0;"
-                           "for($i=0;$i -lt $total;$i++){ if($mask -band (1 -shl $i)){ $assigned++ } };"
-                           "$obj=[PSCustomObject]@{"
-                           " ProcessName=$p.ProcessName;"
-                           " Id=$p.Id;"
-                           " MainWindowTitle=$p.MainWindowTitle;"
-                           " Path=$path;"
-                           " StartTime=$p.StartTime;"
-                           " CPU=$p.CPU;"
-                           " WorkingSet64=$p.WorkingSet64;"
-                           " PrivateMemorySize64=$p.PrivateMemorySize64;"
-                           " PagedMemorySize64=$p.PagedMemorySize64;"
-                           " Threads=$p.Threads.Count;"
-                           " Handles=$p.Handles;"
-                           " Responding=$p.Responding;"
-                           " AssignedCores=$assigned;"
-                           " TotalCores=$total"
-                           "};"
-                           "$obj | ConvertTo-Json -Depth 3"
-                           ).arg(cfg_.pid);
-
-    QProcess p;
-    p.start("powershell", {"-NoLogo","-NoProfile","-Command", ps});
-    if (!p.waitForFinished(3000)) {
-        model->appendRow(new QStandardItem("Timed out reading process info."));
-        listView->setModel(model);
-        return;
-    }
+    // Cancels whatever is still loading for the previous selection.
+    infoLoader_->request(cfg_.pid);
+    showInfoMessage("Loading process info…");
+}
 
-    const QByteArray out = p.readAllStandardOutput();
-    QJsonParseError jerr{};
-    const QJsonDocument doc = QJsonDocument::fromJson(out, &jerr);
-    if (jerr.error != QJsonParseError::NoError || !doc.isObject()) {
-        model->appendRow(new QStandardItem("Failed to parse process info."));
-        listView->setModel(model);
+void CPUAffinity::onProcessInfoLoaded(quint64 /*generation*/, const ProcessInfo& info)
+{
+    if (!info.valid) {
+        showInfoMessage(info.error.isEmpty() ? QString("Failed to read process info.") : info.error);
         return;
     }
 
-    const QJsonObject o = doc.object();
-
-    if (o.contains("AssignedCores")) {
-        cfg_.assignedCores = o.value("AssignedCores").toInt(0);
+    if (!info.affinity.isEmpty()) {
+        cfg_.assignedCores = info.affinity.count();
+        // Show the current mask unless the user is editing an explicit set.
+        if (!ui->checkExplicitCpus->isChecked())
+            ui->cpuSetEditor->setCpuSet(info.affinity);
 
         if (auto* s = findChild<QSpinBox*>("spinBoxAssignedCores")) {
-            int total = o.value("TotalCores").toInt(totalLogicalProcessors());
-            s->setMaximum(total);
+            s->setMaximum(info.totalCores > 0 ? info.totalCores : totalLogicalProcessors());
             s->setValue(cfg_.assignedCores > 0 ? cfg_.assignedCores : 1);
         }
     }
 
+    infoModel_->clear();
     auto addKV = [&](const QString& label, const QString& value) {
-        model->appendRow(new QStandardItem(label + ": " + (value.isEmpty() ? "—" : value)));
-    };
-    auto addKVVar = [&](const QString& label, const QJsonValue& v) {
-        if (v.isBool()) addKV(label, v.toBool() ? "Yes" : "No");
-        else addKV(label, v.isNull() ? QString() : v.toVariant().toString());
+        infoModel_->appendRow(new QStandardItem(label + ": " + (value.isEmpty() ? "—" : value)));
     };
     auto fmtBytesMB = [](qint64 bytes) -> QString {
         if (bytes <= 0) return "0 MB";
@@ -213,57 +328,47 @@ void CPUAffinity::updateProcessInfoView()
         return QString::number(mb, 'f', 1) + " MB";
     };
 
-    addKV("Name", o.value("ProcessName").toString());
-    addKVVar("PID", o.value("Id"));
-    addKV("Window Title", o.value("MainWindowTitle").toString());
-    addKV("Path", o.value("Path").toString());
-
-    // Start time → local, pretty
-    QString startIso = o.value("StartTime").toString();
-    if (!startIso.isEmpty()) {
-        QDateTime dt;
-
-        static const QRegularExpression msEpochRe("^/Date\\((\\d+)\\)/$");
-        auto m = msEpochRe.match(startIso);
-        if (m.hasMatch()) {
-            qint64 msSinceEpoch = m.captured(1).toLongLong();
-            dt = QDateTime::fromMSecsSinceEpoch(msSinceEpoch, QTimeZone::UTC);
-        } else {
-            dt = QDateTime::fromString(startIso, Qt::ISODateWithMs);
-            if (!dt.isValid())
-                dt = QDateTime::fromString(startIso, Qt::ISODate);
-        }
-
-        if (dt.isValid()) {
-            addKV("Start Time", QLocale().toString(dt.toLocalTime(), QLocale::ShortFormat));
-        } else {
-            addKV("Start Time", startIso);
-        }
-    } else {
-        addKV("Start Time", QString());
-    }
+    addKV("Name", info.name);
+    addKV("PID", QString::number(info.pid));
+#ifdef Q_OS_WINDOWS
+    addKV("Window Title", info.windowTitle);
+#endif
+    addKV("Path", info.path);
+    addKV("Start Time", info.startTime.isValid()
+                            ? QLocale().toString(info.startTime.toLocalTime(), QLocale::ShortFormat)
+                            : QString());
 
     // CPU seconds → hh:mm:ss
-    const double cpuSecs = o.value("CPU").toDouble(0.0);
-    const int secs = static_cast<int>(std::round(cpuSecs));
+    const int secs = static_cast<int>(std::round(info.cpuSeconds));
     addKV("CPU Time", QTime(0,0).addSecs(qMax(0,secs)).toString("hh:mm:ss"));
+    if (info.cpuUsage >= 0)
+        addKV("CPU Usage", QString("%1%").arg(info.cpuUsage * 100.0, 0, 'f', 1));
 
     // Memory
-    const qint64 ws  = static_cast<qint64>(o.value("WorkingSet64").toDouble(0.0));
-    const qint64 pvt = static_cast<qint64>(o.value("PrivateMemorySize64").toDouble(0.0));
-    const qint64 pgd = static_cast<qint64>(o.value("PagedMemorySize64").toDouble(0.0));
-    addKV("Working Set", fmtBytesMB(ws));
-    addKV("Private Memory", fmtBytesMB(pvt));
-    addKV("Paged Memory", fmtBytesMB(pgd));
-
-    addKVVar("Threads", o.value("Threads"));
-    addKVVar("Handles", o.value("Handles"));
-    addKVVar("Responding", o.value("Responding"));
+    addKV("Working Set", fmtBytesMB(info.workingSet));
+#ifdef Q_OS_WINDOWS
+    addKV("Private Memory", fmtBytesMB(info.privateBytes));
+    addKV("Paged Memory", fmtBytesMB(info.pagedBytes));
 #else
-    model->appendRow(new QStandardItem("Process info only works on Windows."));
+    addKV("Anonymous Memory", fmtBytesMB(info.privateBytes));
+    addKV("Swapped", fmtBytesMB(info.pagedBytes));
 #endif
 
-    listView->setModel(model);
+    addKV("Threads", QString::number(info.threads));
+    addKV("Handles", info.handles >= 0 ? QString::number(info.handles) : QString());
+    if (info.responding >= 0)
+        addKV("Responding", info.responding ? "Yes" : "No");
+    addKV("Assigned Cores", QString("%1 of %2").arg(info.affinity.count()).arg(info.totalCores));
+    addKV("Allowed CPUs", info.affinity.toRangeList());
+#ifdef Q_OS_LINUX
+    addKV("Cgroup", info.cgroup);
+    if (!info.cgroupCpus.isEmpty())
+        addKV("Cgroup CPUs", info.cgroupCpus.toRangeList());
+#endif
+    for (int node = 0; node < info.numaBytes.size(); ++node) {
+        if (info.numaBytes[node] > 0 || topology_.nodeCount() > 1)
+            addKV(QString("Memory on Node %1").arg(node), fmtBytesMB(info.numaBytes[node]));
+    }
 }
 
 void CPUAffinity::onActionSelectProcess()
@@ -273,20 +378,24 @@ void CPUAffinity::onActionSelectProcess()
 
 void CPUAffinity::onButtonSelectProcess()
 {
-#ifdef Q_OS_WINDOWS
     ProcessListDialog dlg(this);
     if (dlg.exec() == QDialog::Accepted) {
         auto sel = dlg.selected();
         if (!sel.name.isEmpty()) {
+            sampler_->untrack(cfg_.pid);
+            rebalancer_->unmanage(cfg_.pid);
+            hasApplied_ = false;
             cfg_.processName = sel.name;
             cfg_.pid = sel.pid;
+            sampler_->track(cfg_.pid, true);
+            ui->utilizationGraph->setPid(cfg_.pid);
+            ui->threadPanel->setPid(cfg_.pid);
+            ui->counterPanel->setPid(cfg_.pid);
+            ui->latencyPanel->setPid(cfg_.pid);
             refreshUiProcessLabel();
             updateProcessInfoView();   // refresh the ListView
         }
     }
-#else
-    QMessageBox::information(this, "Unavailable", "Process selection is Windows-only.");
-#endif
 }
 
 
@@ -304,6 +413,7 @@ void CPUAffinity::onActionSave()
         QMessageBox::warning(this, "Save failed", "Could not save the configuration.");
         currentConfigPath_.clear();
     } else {
+        watchConfigFile(currentConfigPath_);
         statusBar()->showMessage("Saved: " + currentConfigPath_, 2000);
     }
 }
@@ -322,6 +432,7 @@ void CPUAffinity::onActionSaveAs()
 
     if (saveConfigTo(path)) {
         currentConfigPath_ = path;
+        watchConfigFile(currentConfigPath_);
         statusBar()->showMessage("Saved: " + currentConfigPath_, 2000);
     } else {
         QMessageBox::warning(this, "Save As failed", "Could not save the configuration.");
@@ -340,6 +451,7 @@ void CPUAffinity::onActionLoad()
 
     if (loadConfigFrom(path)) {
         currentConfigPath_ = path;
+        watchConfigFile(currentConfigPath_);
         pushConfigIntoEditors();
         refreshUiProcessLabel();
         statusBar()->showMessage("Loaded: " + currentConfigPath_, 2000);
@@ -355,7 +467,6 @@ void CPUAffinity::onButtonLoadConfig()
 
 void CPUAffinity::onButtonApply()
 {
-#ifdef Q_OS_WINDOWS
     if (cfg_.processName.isEmpty() || cfg_.pid <= 0) {
         QMessageBox::warning(this, "No process selected",
                              "Please select a process first.");
@@ -364,42 +475,212 @@ void CPUAffinity::onButtonApply()
 
     pullEditorsIntoConfig(); // sync UI → cfg_
 
-    int coresToAssign = cfg_.assignedCores;
-    if (coresToAssign < 1) coresToAssign = 1;
-    if (coresToAssign > totalLogicalProcessors())
-        coresToAssign = totalLogicalProcessors();
-
-    QString psCommand = QString(
-                            "$total=(Get-CimInstance Win32_ComputerSystem).NumberOfLogicalProcessors; "
-                            "$assign=%1; "
-                            "if($assign -gt $total){ $assign=$total }; "
-                            "$mask=0; "
-                            "$sel=Get-Random -Count $assign -InputObject (0..($total-1)); "
-                            "foreach($i in $sel){ $mask=$mask -bor (1 -shl $i) }; "
-                            "(Get-Process -Id %2 -ErrorAction SilentlyContinue) | "
-                            "ForEach-Object { $_.ProcessorAffinity=$mask; "
-                            " Write-Output (\"Affinity for {0} (PID {1}) set to 0x{2:X}\" -f $_.ProcessName, $_.Id, $mask) }"
-                            ).arg(coresToAssign).arg(cfg_.pid);
-
-    QProcess* ps = new QProcess(this);
-    connect(ps, &QProcess::readyReadStandardOutput, this, [this, ps]() {
-        auto text = QString::fromLocal8Bit(ps->readAllStandardOutput()).trimmed();
-        if (!text.isEmpty())
-            this->statusBar()->showMessage(text, 5000);
-    });
-    connect(ps, &QProcess::readyReadStandardError, this, [this, ps]() {
-        auto text = QString::fromLocal8Bit(ps->readAllStandardError()).trimmed();
-        if (!text.isEmpty())
-            QMessageBox::warning(this, "PowerShell Error", text);
-    });
-    connect(ps, qOverload<int,QProcess::ExitStatus>(&QProcess::finished), ps, &QObject::deleteLater);
+    // One pick of the CPUs for the mask, the memory nodes, the rebalancer
+    // and the status text.
+    const AffinityConfig resolved = cfg_.resolved(topology_);
+    const CpuSet cpus = resolved.cpus;
+    if (!cfg_.cpusetGroup.isEmpty() && !CgroupCpuset::isValidName(cfg_.cpusetGroup)) {
+        QMessageBox::warning(this, "Apply failed",
+                             QString("\"%1\" is not a valid cgroup name.").arg(cfg_.cpusetGroup));
+        return;
+    }
+    if (cfg_.rebalance.enabled && cfg_.rebalance.maxCores > 0
+        && cfg_.rebalance.maxCores < cfg_.rebalance.minCores) {
+        QMessageBox::warning(this, "Apply failed", "The rebalance maximum is below the minimum.");
+        return;
+    }
+    QString schedProblem;
+    if (!cfg_.sched.isValid(&schedProblem)) {
+        QMessageBox::warning(this, "Apply failed", schedProblem + ".");
+        return;
+    }
 
-    ps->start("powershell",
-              {"-NoLogo","-NoProfile","-WindowStyle","Hidden","-ExecutionPolicy","Bypass",
-               "-Command", psCommand});
-#else
-    QMessageBox::information(this, "Unsupported", "Affinity setting only works on Windows.");
-#endif
+    // Kept for Tools > Roll Back, whatever goes wrong below.
+    AffinitySnapshot before = AffinitySnapshot::take(
+        *backend_, cfg_.includeChildren ? processTree(cfg_.pid) : QVector<qint64>{cfg_.pid});
+    before.name = QStringLiteral("last-apply");
+    before.save(AffinitySnapshot::pathFor(before.name));
+
+    if (cfg_.includeChildren) {
+        // Every process of the tree gets everything, thread rules and memory
+        // included; new children follow until the settings change.
+        TreeApplyReport report;
+        const bool ok = treeFollower()->follow(cfg_.pid, resolved, &report);
+        if (!ok) {
+            // All or nothing: the processes that did get the settings are put back.
+            treeFollower()->unfollow(cfg_.pid);
+            const RestoreReport undo = restoreSnapshot(*backend_, before);
+            QString msg = QString("The settings failed on %1 of %2 process(es) under %3 (PID %4):\n%5 (error %6)\n\n")
+                              .arg(report.failed).arg(report.applied + report.failed)
+                              .arg(cfg_.processName).arg(cfg_.pid)
+                              .arg(report.firstError.message).arg(report.firstError.code);
+            msg += undo.ok() ? QString("Rolled back: %1.").arg(undo.summary())
+                             : QString("Rolling back failed too: %1").arg(undo.failures.join("\n"));
+            QMessageBox::warning(this, "Apply failed", msg);
+            return;
+        }
+        // The rebalancer resizes one process mask, not a tree.
+        rebalancer_->unmanage(cfg_.pid);
+        statusBar()->showMessage(QString("Affinity for %1 (PID %2) and %3 descendant(s) set to CPUs %4 in %5 ms, "
+                                         "following new child processes")
+                                     .arg(cfg_.processName).arg(cfg_.pid).arg(qMax(0, report.applied - 1))
+                                     .arg(cpus.toRangeList()).arg(report.elapsedUs / 1000.0, 0, 'f', 1),
+                                 5000);
+        applied_ = cfg_;
+        hasApplied_ = true;
+        ui->counterPanel->setPid(cfg_.pid);
+        ui->latencyPanel->markApplied();
+        return;
+    }
+    if (treeFollower_)
+        treeFollower_->detach(cfg_.pid);
+
+    // Mask (or cgroup) and scheduling settings go together or not at all.
+    QElapsedTimer timer;
+    timer.start();
+    BackendError err;
+    const bool ok = applyProcessSettings(*backend_, topology_, cfg_.pid, resolved, &err);
+    const qint64 elapsedUs = timer.nsecsElapsed() / 1000;
+
+    if (!ok) {
+        QMessageBox::warning(this, "Apply failed",
+                             QString("Could not set affinity and scheduling for %1 (PID %2), nothing was changed:\n%3 (error %4)")
+                                 .arg(cfg_.processName).arg(cfg_.pid)
+                                 .arg(err.message).arg(err.code));
+        return;
+    }
+
+    // Thread rules then replace the mask of each thread they match; the
+    // rest keep the process mask.
+    int pinned = 0;
+    if (!applyThreadRules(*backend_, cfg_.pid, cfg_.threadRules, &pinned, &err)) {
+        QMessageBox::warning(this, "Apply failed",
+                             QString("Process affinity was set, but pinning threads of %1 failed:\n%2 (error %3)")
+                                 .arg(cfg_.processName).arg(err.message).arg(err.code));
+    }
+
+    // Pages keep living where they were first touched unless moved.
+    const CpuSet nodes = numaNodesOf(topology_, cpus);
+    qint64 notMoved = 0;
+    const bool migrate = cfg_.migrateMemory && cfg_.memoryPolicy != MemoryPolicy::Default;
+    if (migrate && !migrateProcessMemory(cfg_.pid, cfg_.memoryPolicy, nodes, &notMoved, &err)) {
+        QMessageBox::warning(this, "Apply failed",
+                             QString("Affinity was set, but moving the memory of %1 to node(s) %2 failed:\n%3 (error %4)")
+                                 .arg(cfg_.processName, nodes.toRangeList(), err.message).arg(err.code));
+    }
+
+    QString msg = QString("Affinity for %1 (PID %2) set to CPUs %3 in %4 µs")
+                      .arg(cfg_.processName).arg(cfg_.pid)
+                      .arg(cpus.toRangeList()).arg(elapsedUs);
+    if (!cfg_.cpusetGroup.isEmpty())
+        msg += QString(" via cgroup %1").arg(CgroupCpuset::groupPath(cfg_.cpusetGroup));
+    if (!cfg_.sched.isDefault())
+        msg += QString(", scheduling %1").arg(cfg_.sched.describe());
+    if (!cfg_.threadRules.isEmpty())
+        msg += QString(", %1 thread(s) pinned").arg(pinned);
+    if (migrate) {
+        msg += QString(", memory moved to node(s) %1").arg(nodes.toRangeList());
+        if (notMoved > 0)
+            msg += QString(" (%1 page(s) could not be moved)").arg(notMoved);
+    }
+    // Only masks can be resized; a cgroup is shared with other processes.
+    if (cfg_.rebalance.enabled && cfg_.cpusetGroup.isEmpty()) {
+        rebalancer_->manage(cfg_.pid, cfg_.processName, cpus, cfg_.rebalance, cfg_.threadRules);
+        rebalanceTimer_->start();
+        msg += QString(", rebalancing between %1 and %2 CPU(s)")
+                   .arg(cfg_.rebalance.minCores)
+                   .arg(cfg_.rebalance.maxCores > 0 ? QString::number(cfg_.rebalance.maxCores) : QString("all"));
+    } else {
+        rebalancer_->unmanage(cfg_.pid);
+    }
+    statusBar()->showMessage(msg, 5000);
+    applied_ = cfg_;
+    hasApplied_ = true;
+    ui->counterPanel->setPid(cfg_.pid);   // per-CPU rows follow the new mask
+    ui->latencyPanel->markApplied();      // compare against what it was before
+}
+
+void CPUAffinity::onRebalanceTick()
+{
+    for (const RebalanceDecision& d : rebalancer_->tick()) {
+        QString msg = QString("Rebalancer: %1 %2 (PID %3) CPUs %4 -> %5, %6")
+                          .arg(rebalanceActionKey(d.action), d.name).arg(d.pid)
+                          .arg(d.from.toRangeList(), d.to.toRangeList(), d.reason);
+        if (!d.applied) msg += QString(" (failed: %1)").arg(d.error);
+        statusBar()->showMessage(msg, 10000);
+        if (d.applied && d.pid == cfg_.pid) {
+            ui->counterPanel->setPid(cfg_.pid);
+            updateProcessInfoView();
+        }
+    }
+    if (rebalancer_->managedCount() == 0)
+        rebalanceTimer_->stop();
+}
+
+void CPUAffinity::onActionInterrupts()
+{
+    pullEditorsIntoConfig();
+    IrqDialog dlg(cfg_.resolveCpus(topology_), topology_.online(), this);
+    dlg.exec();
+}
+
+void CPUAffinity::onActionTakeSnapshot()
+{
+    bool ok = false;
+    const QString name = QInputDialog::getText(this, "Take snapshot", "Name:", QLineEdit::Normal,
+                                               QDateTime::currentDateTime().toString("yyyy-MM-dd-HHmmss"), &ok)
+                             .trimmed();
+    if (!ok || name.isEmpty())
+        return;
+    if (name.contains('/') || name.startsWith('.')) {
+        QMessageBox::warning(this, "Take snapshot", "A snapshot name cannot contain '/' or start with '.'.");
+        return;
+    }
+    AffinitySnapshot snap = AffinitySnapshot::take(*backend_);
+    snap.name = name;
+    QString error;
+    if (!snap.save(AffinitySnapshot::pathFor(name), &error)) {
+        QMessageBox::warning(this, "Take snapshot", QString("Could not save the snapshot:\n%1").arg(error));
+        return;
+    }
+    statusBar()->showMessage(QString("Snapshot %1: %2 process(es), %3 thread(s)")
+                                 .arg(name).arg(snap.processes.size()).arg(snap.threadCount()), 5000);
+}
+
+void CPUAffinity::onActionRollBack()
+{
+    const QStringList names = AffinitySnapshot::names();
+    if (names.isEmpty()) {
+        QMessageBox::information(this, "Roll back", "There are no snapshots yet.");
+        return;
+    }
+    bool ok = false;
+    const QString name = QInputDialog::getItem(this, "Roll back", "Restore snapshot:", names, 0, false, &ok);
+    if (!ok)
+        return;
+    QString error;
+    const AffinitySnapshot snap = AffinitySnapshot::load(AffinitySnapshot::pathFor(name), &error);
+    if (snap.isEmpty()) {
+        QMessageBox::warning(this, "Roll back", error.isEmpty() ? QString("%1 is empty.").arg(name) : error);
+        return;
+    }
+    const RestoreReport report = restoreSnapshot(*backend_, snap);
+    for (const AffinitySnapshot::Process& p : snap.processes)
+        rebalancer_->unmanage(p.pid);   // it would resize the restored masks again
+    if (!report.ok()) {
+        QMessageBox::warning(this, "Roll back",
+                             QString("%1:\n%2").arg(report.summary(), report.failures.mid(0, 20).join('\n')));
+    }
+    statusBar()->showMessage(QString("Rolled back to %1: %2").arg(name, report.summary()), 5000);
+}
+
+void CPUAffinity::onActionReplayHistory()
+{
+    const QString dir = QFileDialog::getExistingDirectory(this, "Replay history");
+    if (dir.isEmpty())
+        return;
+    HistoryDialog dlg(dir, this);
+    dlg.exec();
 }
 
 void CPUAffinity::onActionCheckForNewVersion()
@@ -422,33 +703,58 @@ void CPUAffinity::onActionAbout()
 
 // ---------- Config I/O ----------
 
-QJsonObject CPUAffinity::toJson(const AffinityConfig& c)
+bool CPUAffinity::saveConfigTo(const QString& path)
 {
-    QJsonObject o;
-    o["processName"]   = c.processName;
-    o["pid"]           = QString::number(c.pid);
-    o["assignedCores"] = c.assignedCores;
-    return o;
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    const QJsonDocument doc(cfg_.toJson());
+    f.write(doc.toJson(QJsonDocument::Indented));
+    return true;
 }
 
-AffinityConfig CPUAffinity::fromJson(const QJsonObject& o, bool* ok)
+void CPUAffinity::watchConfigFile(const QString& path)
 {
-    AffinityConfig c;
-    c.processName   = o.value("processName").toString();
-    c.pid           = o.value("pid").toString().toLongLong();
-    c.assignedCores = o.value("assignedCores").toInt(0);
-    if (c.assignedCores < 1) c.assignedCores = 1;
-    if (ok) *ok = true;
-    return c;
+    if (!configWatcher_->files().isEmpty())
+        configWatcher_->removePaths(configWatcher_->files());
+    if (!configWatcher_->directories().isEmpty())
+        configWatcher_->removePaths(configWatcher_->directories());
+    configWatcher_->addPath(path);
+    configWatcher_->addPath(QFileInfo(path).absolutePath());
 }
 
-bool CPUAffinity::saveConfigTo(const QString& path)
+// The file was edited elsewhere: take its settings into the editors and, if
+// they were applied and now differ, apply again. The selected process stays.
+void CPUAffinity::onConfigFileChanged()
 {
-    QFile f(path);
-    if (!f.open(QIODevice::WriteOnly)) return false;
-    const QJsonDocument doc(toJson(cfg_));
-    f.write(doc.toJson(QJsonDocument::Indented));
-    return true;
+    if (currentConfigPath_.isEmpty() || !QFile::exists(currentConfigPath_))
+        return;
+    if (!configWatcher_->files().contains(currentConfigPath_))
+        configWatcher_->addPath(currentConfigPath_);   // replaced, not rewritten
+
+    QFile f(currentConfigPath_);
+    if (!f.open(QIODevice::ReadOnly))
+        return;
+    const QJsonDocument doc = QJsonDocument::fromJson(f.readAll());
+    bool ok = false;
+    AffinityConfig next = AffinityConfig::fromJson(doc.object(), &ok);
+    if (!doc.isObject() || !ok) {
+        statusBar()->showMessage(QString("%1 changed but does not load; keeping the current settings")
+                                     .arg(currentConfigPath_), 5000);
+        return;
+    }
+    pullEditorsIntoConfig();
+    if (next.sameSettings(cfg_))
+        return;   // our own save, or an edit that changed nothing
+    next.processName = cfg_.processName;
+    next.pid = cfg_.pid;
+    cfg_ = next;
+    pushConfigIntoEditors();
+
+    if (!hasApplied_ || applied_.sameSettings(cfg_)) {
+        statusBar()->showMessage("Reloaded: " + currentConfigPath_, 5000);
+        return;
+    }
+    onButtonApply();
 }
 
 bool CPUAffinity::loadConfigFrom(const QString& path)
@@ -458,7 +764,7 @@ bool CPUAffinity::loadConfigFrom(const QString& path)
     const auto doc = QJsonDocument::fromJson(f.readAll());
     if (!doc.isObject()) return false;
     bool ok=false;
-    cfg_ = fromJson(doc.object(), &ok);
+    cfg_ = AffinityConfig::fromJson(doc.object(), &ok);
     return ok;
 }
 
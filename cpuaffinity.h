@@ -4,17 +4,24 @@
 #include <QMainWindow>
 #include <QPointer>
 #include <QJsonObject>
+#include <memory>
+
+#include "affinityconfig.h"
+#include "cputopology.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class CPUAffinity; }
+class QFileSystemWatcher;
 class QSpinBox;
+class QStandardItemModel;
 QT_END_NAMESPACE
 
-struct AffinityConfig {
-    QString processName;
-    qint64  pid{0};
-    int     assignedCores{0};
-};
+class AffinityBackend;
+class CpuSampler;
+class QTimer;
+class ProcessInfoLoader;
+class ProcessTreeFollower;
+struct ProcessInfo;
 
 class CPUAffinity : public QMainWindow
 {
@@ -29,6 +36,10 @@ private slots:
     void onActionSave();
     void onActionSaveAs();
     void onActionLoad();
+    void onActionInterrupts();
+    void onActionTakeSnapshot();
+    void onActionRollBack();
+    void onActionReplayHistory();
     void onActionCheckForNewVersion();
     void onActionAbout();
 
@@ -39,27 +50,44 @@ private slots:
     void onButtonSaveConfigAs();
     void onButtonApply();   // Apply all current editor settings
 
+    void onProcessInfoLoaded(quint64 generation, const ProcessInfo& info);
+    void onRebalanceTick();
+    void onConfigFileChanged();
+
 private:
     Ui::CPUAffinity *ui;
 
     // State
     AffinityConfig cfg_;
     QString currentConfigPath_; // empty = not saved yet
+    QFileSystemWatcher* configWatcher_{};   // reloads currentConfigPath_ when it changes
+    QTimer* configReloadTimer_{};
+    AffinityConfig applied_;    // settings last applied to cfg_.pid
+    bool hasApplied_{false};
+    std::unique_ptr<AffinityBackend> backend_;
+    ProcessInfoLoader* infoLoader_{};
+    std::unique_ptr<CpuSampler> sampler_;
+    CpuTopology topology_;
+    std::unique_ptr<Rebalancer> rebalancer_;   // manages the applied process when enabled
+    QTimer* rebalanceTimer_{};
+    ProcessTreeFollower* treeFollower_{};   // created on the first apply with child processes
+    QStandardItemModel* infoModel_{};
 
     // Helpers
     void connectUi();
     void refreshUiProcessLabel();
     void pullEditorsIntoConfig();   // read values from Frame Two
     void pushConfigIntoEditors();   // write values into Frame Two
-    void updateProcessInfoView();
+    void updateProcessInfoView();   // async; see onProcessInfoLoaded
+    void showInfoMessage(const QString& text);
     QSpinBox* findSpinUnassign() const;
+    ProcessTreeFollower* treeFollower();
     static int totalLogicalProcessors();
 
     // Config I/O
-    static QJsonObject toJson(const AffinityConfig& c);
-    static AffinityConfig fromJson(const QJsonObject& o, bool* ok=nullptr);
     bool saveConfigTo(const QString& path);
     bool loadConfigFrom(const QString& path);
+    void watchConfigFile(const QString& path);
 
     // File dialogs
     QString dialogSavePath();
@@ -0,0 +1,8 @@
+#include "cli.h"
+
+// Headless build without the Widgets dependency; same as `CPUAffinity --daemon`
+// (or --experiment).
+int main(int argc, char *argv[])
+{
+    return runCli(argc, argv);
+}
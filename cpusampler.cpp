@@ -0,0 +1,452 @@
+#include "cpusampler.h"
+#include "cpuset.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+struct CpuSampler::TaskState {
+    int     fd{-1};
+    quint64 lastTicks{0};
+    bool    primed{false};
+    std::shared_ptr<Series> series;
+};
+
+struct CpuSampler::ProcState {
+    qint64  pid{0};
+    int     statFd{-1};
+    quint64 lastTicks{0};
+    bool    primed{false};
+    bool    detailed{false};
+    bool    dead{false};
+    int     rescanIn{0};
+    std::shared_ptr<Series> series;
+    QHash<qint64, TaskState> tasks;
+};
+
+namespace {
+
+constexpr int kMaxTasksPerProcess = 512;   // persistent fds per detailed process
+constexpr int kTaskRescanEvery = 10;       // samples between /proc/<pid>/task rescans
+
+#if defined(Q_OS_LINUX)
+
+// Fields 14+15 (utime, stime) and 39 (processor) of a stat line; optionally comm.
+bool parseTaskStat(const char* buf, quint64* ticks, int* cpu, QString* name)
+{
+    const char* lp = std::strchr(buf, '(');
+    const char* rp = std::strrchr(buf, ')');
+    if (!lp || !rp || rp < lp) return false;
+    if (name) *name = QString::fromUtf8(lp + 1, int(rp - lp - 1));
+
+    const char* p = rp + 1;                // points at the space before field 3
+    quint64 utime = 0, stime = 0;
+    for (int field = 3; field <= 39; ++field) {
+        p = std::strchr(p, ' ');
+        if (!p) return false;
+        ++p;
+        if (field == 14) utime = std::strtoull(p, nullptr, 10);
+        else if (field == 15) stime = std::strtoull(p, nullptr, 10);
+        else if (field == 39) *cpu = int(std::strtol(p, nullptr, 10));
+    }
+    *ticks = utime + stime;
+    return true;
+}
+
+bool preadStat(int fd, char* buf, size_t size, quint64* ticks, int* cpu, QString* name = nullptr)
+{
+    const ssize_t n = ::pread(fd, buf, size - 1, 0);
+    if (n <= 0) return false;              // ESRCH once the task is gone
+    buf[n] = '\0';
+    return parseTaskStat(buf, ticks, cpu, name);
+}
+
+// Highest possible CPU id + 1, so CPUs brought online later already have a
+// series.
+int possibleCpuCount()
+{
+    if (FILE* f = std::fopen("/sys/devices/system/cpu/possible", "re")) {
+        char line[256] = {};
+        const bool read = std::fgets(line, sizeof line, f) != nullptr;
+        std::fclose(f);
+        const int last = read ? CpuSet::fromRangeList(QString::fromLatin1(line).trimmed()).last() : -1;
+        if (last >= 0) return last + 1;
+    }
+    return int(qMax(1L, ::sysconf(_SC_NPROCESSORS_CONF)));
+}
+
+qint64 threadCpuNs()
+{
+    timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return qint64(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+#endif
+
+} // namespace
+
+CpuSampler::CpuSampler(int intervalMs)
+    : intervalMs_(qMax(10, intervalMs))
+    , effectiveMs_(qMax(10, intervalMs))
+{
+#if defined(Q_OS_LINUX)
+    statFd_ = ::open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    statBuf_.resize(64 * 1024);
+    const int n = possibleCpuCount();
+    cpus_.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        auto s = std::make_shared<Series>();
+        s->id = i;
+        s->name = QStringLiteral("CPU %1").arg(i);
+        cpus_.append(s);
+    }
+    cpuBusy_.fill(0, n);
+    cpuTotal_.fill(0, n);
+    sampleCpus(); // primes the counters
+#endif
+}
+
+CpuSampler::~CpuSampler()
+{
+    stop();
+#if defined(Q_OS_LINUX)
+    for (auto& p : procs_)
+        closeProcess(*p);
+    if (statFd_ >= 0)
+        ::close(statFd_);
+#endif
+}
+
+void CpuSampler::start()
+{
+#if defined(Q_OS_LINUX)
+    if (worker_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lk(wakeMutex_);
+        stopRequested_ = false;
+    }
+    worker_ = std::thread([this] { run(); });
+#endif
+}
+
+void CpuSampler::stop()
+{
+    if (!worker_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lk(wakeMutex_);
+        stopRequested_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+}
+
+void CpuSampler::setInterval(int ms)
+{
+    intervalMs_ = qMax(10, ms);
+    effectiveMs_ = intervalMs_.load();
+}
+
+void CpuSampler::track(qint64 pid, bool detailed)
+{
+    if (pid <= 0) return;
+    std::lock_guard<std::mutex> lk(requestMutex_);
+    wanted_.insert(pid, detailed);
+}
+
+void CpuSampler::untrack(qint64 pid)
+{
+    std::lock_guard<std::mutex> lk(requestMutex_);
+    wanted_.remove(pid);
+}
+
+void CpuSampler::setDetailed(qint64 pid, bool detailed)
+{
+    std::lock_guard<std::mutex> lk(requestMutex_);
+    if (wanted_.contains(pid))
+        wanted_.insert(pid, detailed);
+}
+
+CpuSampler::SeriesPtr CpuSampler::cpu(int index) const
+{
+    return index >= 0 && index < cpus_.size() ? cpus_[index] : nullptr;
+}
+
+CpuSampler::SeriesPtr CpuSampler::process(qint64 pid) const
+{
+    std::lock_guard<std::mutex> lk(publishMutex_);
+    return procSeries_.value(pid);
+}
+
+QVector<CpuSampler::SeriesPtr> CpuSampler::threads(qint64 pid) const
+{
+    std::lock_guard<std::mutex> lk(publishMutex_);
+    return threadSeries_.value(pid);
+}
+
+#if defined(Q_OS_LINUX)
+
+void CpuSampler::run()
+{
+    using Clock = std::chrono::steady_clock;
+    auto last = Clock::now();
+    auto windowStart = last;
+    qint64 windowCpu = threadCpuNs();
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(wakeMutex_);
+            wake_.wait_for(lk, std::chrono::milliseconds(effectiveMs_.load()),
+                           [this] { return stopRequested_; });
+            if (stopRequested_) break;
+        }
+
+        const auto now = Clock::now();
+        const double dt = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        reconcile();
+        sampleCpus();
+        for (auto& p : procs_)
+            sampleProcess(*p, dt);
+
+        // Self-throttle: keep our own CPU time under 1% of one core.
+        const double wall = std::chrono::duration<double>(now - windowStart).count();
+        if (wall >= 1.0) {
+            const qint64 cpuNs = threadCpuNs();
+            const double ov = double(cpuNs - windowCpu) / (wall * 1e9);
+            overhead_ = ov;
+            windowStart = now;
+            windowCpu = cpuNs;
+
+            const int base = intervalMs_.load();
+            int eff = effectiveMs_.load();
+            if (ov > 0.01)
+                eff = qMin(base * 8, eff + eff / 2 + 1);
+            else if (ov < 0.005 && eff > base)
+                eff = qMax(base, eff * 2 / 3);
+            effectiveMs_ = eff;
+        }
+    }
+}
+
+void CpuSampler::reconcile()
+{
+    QHash<qint64, bool> wanted;
+    {
+        std::lock_guard<std::mutex> lk(requestMutex_);
+        // Processes that exited are dropped for good; a reused pid is a new process.
+        for (auto it = procs_.begin(); it != procs_.end(); ++it) {
+            if ((*it)->dead)
+                wanted_.remove(it.key());
+        }
+        wanted = wanted_;
+    }
+
+    bool changed = false;
+    for (auto it = procs_.begin(); it != procs_.end(); ) {
+        if (!wanted.contains(it.key())) {
+            closeProcess(**it);
+            it = procs_.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = wanted.cbegin(); it != wanted.cend(); ++it) {
+        std::shared_ptr<ProcState> p = procs_.value(it.key());
+        if (!p) {
+            char path[64];
+            std::snprintf(path, sizeof(path), "/proc/%lld/stat", static_cast<long long>(it.key()));
+            const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue;
+
+            p = std::make_shared<ProcState>();
+            p->pid = it.key();
+            p->statFd = fd;
+            p->series = std::make_shared<Series>();
+            p->series->id = p->pid;
+            quint64 ticks = 0;
+            int cpu = -1;
+            if (preadStat(fd, taskBuf_, sizeof(taskBuf_), &ticks, &cpu, &p->series->name)) {
+                p->lastTicks = ticks;
+                p->primed = true;
+            }
+            procs_.insert(p->pid, p);
+            changed = true;
+        }
+        if (p->detailed != it.value()) {
+            p->detailed = it.value();
+            p->rescanIn = 0;
+            if (!p->detailed) {
+                for (TaskState& t : p->tasks)
+                    ::close(t.fd);
+                p->tasks.clear();
+            }
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        std::lock_guard<std::mutex> lk(publishMutex_);
+        procSeries_.clear();
+        threadSeries_.clear();
+        for (const auto& p : procs_) {
+            procSeries_.insert(p->pid, p->series);
+            QVector<SeriesPtr> list;
+            for (const TaskState& t : p->tasks)
+                list.append(t.series);
+            threadSeries_.insert(p->pid, list);
+        }
+    }
+}
+
+void CpuSampler::closeProcess(ProcState& p)
+{
+    for (TaskState& t : p.tasks)
+        ::close(t.fd);
+    p.tasks.clear();
+    if (p.statFd >= 0)
+        ::close(p.statFd);
+    p.statFd = -1;
+}
+
+void CpuSampler::sampleCpus()
+{
+    if (statFd_ < 0) return;
+
+    ssize_t n = 0;
+    for (;;) {
+        n = ::pread(statFd_, statBuf_.data(), size_t(statBuf_.size()) - 1, 0);
+        if (n < 0) return;
+        if (n < statBuf_.size() - 1) break;
+        statBuf_.resize(statBuf_.size() * 2);   // hundreds of CPUs: grow once
+    }
+    statBuf_[int(n)] = '\0';
+
+    const char* p = statBuf_.constData();
+    while (p && *p) {
+        if (p[0] == 'c' && p[1] == 'p' && p[2] == 'u' && p[3] >= '0' && p[3] <= '9') {
+            char* end = nullptr;
+            const int id = int(std::strtol(p + 3, &end, 10));
+            quint64 v[8] = {};
+            const char* q = end;
+            for (quint64& x : v)
+                x = std::strtoull(q, const_cast<char**>(&q), 10);
+            quint64 total = 0;
+            for (quint64 x : v) total += x;
+            const quint64 idle = v[3] + v[4];          // idle + iowait
+            const quint64 busy = total - idle;
+
+            // cpus_ is read by other threads without a lock, so it is never
+            // resized here.
+            if (id < cpus_.size()) {
+                if (cpuTotal_[id] && total > cpuTotal_[id]) {
+                    const double dBusy = double(busy - qMin(busy, cpuBusy_[id]));
+                    const double dTotal = double(total - cpuTotal_[id]);
+                    cpus_[id]->history.push(float(dBusy / dTotal));
+                }
+                cpuBusy_[id] = busy;
+                cpuTotal_[id] = total;
+            }
+        }
+        p = std::strchr(p, '\n');
+        if (p) ++p;
+    }
+}
+
+void CpuSampler::sampleProcess(ProcState& p, double dtSecs)
+{
+    static const double hz = double(::sysconf(_SC_CLK_TCK));
+    if (p.dead || dtSecs <= 0) return;
+
+    quint64 ticks = 0;
+    int cpu = -1;
+    if (!preadStat(p.statFd, taskBuf_, sizeof(taskBuf_), &ticks, &cpu)) {
+        p.dead = true;
+        return;
+    }
+    if (p.primed)
+        p.series->history.push(float(double(ticks - qMin(ticks, p.lastTicks)) / hz / dtSecs));
+    p.lastTicks = ticks;
+    p.primed = true;
+    p.series->lastCpu = cpu;
+
+    if (!p.detailed) return;
+
+    bool changed = false;
+    if (--p.rescanIn <= 0) {
+        p.rescanIn = kTaskRescanEvery;
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/%lld/task", static_cast<long long>(p.pid));
+        if (DIR* d = ::opendir(path)) {
+            while (dirent* e = ::readdir(d)) {
+                if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+                const qint64 tid = std::strtoll(e->d_name, nullptr, 10);
+                if (p.tasks.contains(tid) || p.tasks.size() >= kMaxTasksPerProcess) continue;
+
+                char statPath[32];
+                std::snprintf(statPath, sizeof(statPath), "%s/stat", e->d_name);
+                const int fd = ::openat(::dirfd(d), statPath, O_RDONLY | O_CLOEXEC);
+                if (fd < 0) continue;
+                TaskState t;
+                t.fd = fd;
+                t.series = std::make_shared<Series>();
+                t.series->id = tid;
+                quint64 tt = 0;
+                int tc = -1;
+                if (preadStat(fd, taskBuf_, sizeof(taskBuf_), &tt, &tc, &t.series->name)) {
+                    t.lastTicks = tt;
+                    t.primed = true;
+                }
+                p.tasks.insert(tid, t);
+                changed = true;
+            }
+            ::closedir(d);
+        }
+    }
+
+    for (auto it = p.tasks.begin(); it != p.tasks.end(); ) {
+        TaskState& t = *it;
+        if (!preadStat(t.fd, taskBuf_, sizeof(taskBuf_), &ticks, &cpu)) {
+            ::close(t.fd);
+            it = p.tasks.erase(it);
+            changed = true;
+            continue;
+        }
+        if (t.primed)
+            t.series->history.push(float(double(ticks - qMin(ticks, t.lastTicks)) / hz / dtSecs));
+        t.lastTicks = ticks;
+        t.primed = true;
+        t.series->lastCpu = cpu;
+        ++it;
+    }
+
+    if (changed) {
+        QVector<SeriesPtr> list;
+        list.reserve(p.tasks.size());
+        for (const TaskState& t : p.tasks)
+            list.append(t.series);
+        std::lock_guard<std::mutex> lk(publishMutex_);
+        threadSeries_.insert(p.pid, list);
+    }
+}
+
+#else
+
+void CpuSampler::run() {}
+void CpuSampler::reconcile() {}
+void CpuSampler::sampleCpus() {}
+void CpuSampler::sampleProcess(ProcState&, double) {}
+void CpuSampler::closeProcess(ProcState&) {}
+
+#endif
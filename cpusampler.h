@@ -0,0 +1,102 @@
+#ifndef CPUSAMPLER_H
+#define CPUSAMPLER_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ringbuffer.h"
+
+// Background sampler for per-CPU, per-process and per-thread utilisation.
+// Reads /proc/stat and /proc/<pid>/[task/<tid>/]stat at a fixed interval and
+// pushes deltas into lock-free history rings that the GUI can read at will.
+//
+// Cost control: process-level stat files are kept open and re-read with
+// pread(), and per-thread detail is only collected for "detailed" pids. If
+// the sampler's own CPU time exceeds ~1% of one core, it stretches its
+// interval until it is back under budget.
+class CpuSampler
+{
+public:
+    static constexpr int kHistory = 600;         // 60 s at 100 ms
+    using History = HistoryRing<float, kHistory>;
+
+    struct Series {
+        qint64  id{0};                           // cpu index, pid or tid
+        QString name;
+        History history;                         // per CPU: 0..1, per task: cores (1.0 = one core)
+        std::atomic<int> lastCpu{-1};            // tasks only: CPU it last ran on
+    };
+    using SeriesPtr = std::shared_ptr<const Series>;
+
+    explicit CpuSampler(int intervalMs = 100);
+    ~CpuSampler();
+
+    CpuSampler(const CpuSampler&) = delete;
+    CpuSampler& operator=(const CpuSampler&) = delete;
+
+    void start();
+    void stop();
+    bool isRunning() const { return worker_.joinable(); }
+
+    void setInterval(int ms);
+    int  interval() const { return intervalMs_.load(); }
+    int  effectiveInterval() const { return effectiveMs_.load(); }
+
+    // Processes to sample. `detailed` also samples each of its threads.
+    void track(qint64 pid, bool detailed = false);
+    void untrack(qint64 pid);
+    void setDetailed(qint64 pid, bool detailed);
+
+    int cpuCount() const { return int(cpus_.size()); }
+    SeriesPtr cpu(int index) const;
+    SeriesPtr process(qint64 pid) const;
+    QVector<SeriesPtr> threads(qint64 pid) const;
+
+    // Sampler thread CPU time / wall time over the last second (0.01 = 1%).
+    double overhead() const { return overhead_.load(); }
+
+private:
+    struct TaskState;
+    struct ProcState;
+
+    void run();
+    void reconcile();
+    void sampleCpus();
+    void sampleProcess(ProcState& p, double dtSecs);
+    void closeProcess(ProcState& p);
+
+    QVector<std::shared_ptr<Series>> cpus_;      // one per possible CPU, sized in the constructor
+
+    std::thread worker_;
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stopRequested_{false};
+    std::atomic<int> intervalMs_;
+    std::atomic<int> effectiveMs_;
+    std::atomic<double> overhead_{0.0};
+
+    // Requests from other threads, applied by reconcile() on the sampler thread.
+    mutable std::mutex requestMutex_;
+    QHash<qint64, bool> wanted_;                 // pid -> detailed
+
+    // Published series (structure only; values are read lock-free).
+    mutable std::mutex publishMutex_;
+    QHash<qint64, std::shared_ptr<Series>> procSeries_;
+    QHash<qint64, QVector<SeriesPtr>> threadSeries_;
+
+    // Sampler-thread private state.
+    QHash<qint64, std::shared_ptr<ProcState>> procs_;
+    QVector<quint64> cpuBusy_, cpuTotal_;
+    int statFd_{-1};
+    QByteArray statBuf_;
+    char taskBuf_[1024]{};
+};
+
+#endif // CPUSAMPLER_H
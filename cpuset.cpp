@@ -0,0 +1,189 @@
+#include "cpuset.h"
+
+#include <QStringList>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static int popcount64(quint64 v)
+{
+#if defined(_MSC_VER)
+    return int(__popcnt64(v));
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+static int ctz64(quint64 v)    // v != 0
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward64(&idx, v);
+    return int(idx);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+static int clz64(quint64 v)    // v != 0
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanReverse64(&idx, v);
+    return 63 - int(idx);
+#else
+    return __builtin_clzll(v);
+#endif
+}
+
+CpuSet CpuSet::fromList(const QVector<int>& cpus)
+{
+    CpuSet s;
+    for (int c : cpus) s.set(c);
+    return s;
+}
+
+CpuSet CpuSet::range(int first, int last)
+{
+    CpuSet s;
+    for (int c = qMax(0, first); c <= last; ++c) s.set(c);
+    return s;
+}
+
+CpuSet CpuSet::fromRangeList(const QString& text, bool* ok)
+{
+    CpuSet s;
+    bool good = true;
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        const QString p = part.trimmed();
+        if (p.isEmpty()) continue;
+        const int dash = p.indexOf('-');
+        bool ok1 = false, ok2 = true;
+        const int a = (dash < 0 ? p : p.left(dash)).trimmed().toInt(&ok1);
+        const int b = dash < 0 ? a : p.mid(dash + 1).trimmed().toInt(&ok2);
+        if (!ok1 || !ok2 || a < 0 || b < a || b >= 65536) {
+            good = false;
+            continue;
+        }
+        for (int c = a; c <= b; ++c) s.set(c);
+    }
+    if (ok) *ok = good;
+    return s;
+}
+
+QString CpuSet::toRangeList() const
+{
+    QStringList parts;
+    for (int c = first(); c >= 0; ) {
+        int end = c;
+        int n = next(c);
+        while (n == end + 1) {
+            end = n;
+            n = next(n);
+        }
+        parts << (end == c ? QString::number(c) : QStringLiteral("%1-%2").arg(c).arg(end));
+        c = n;
+    }
+    return parts.join(',');
+}
+
+QVector<int> CpuSet::toList() const
+{
+    QVector<int> out;
+    out.reserve(count());
+    for (int c = first(); c >= 0; c = next(c))
+        out.append(c);
+    return out;
+}
+
+bool CpuSet::test(int cpu) const
+{
+    if (cpu < 0) return false;
+    const int w = cpu / 64;
+    return w < words_.size() && (words_[w] >> (cpu % 64)) & 1u;
+}
+
+void CpuSet::set(int cpu, bool on)
+{
+    if (cpu < 0) return;
+    const int w = cpu / 64;
+    if (on) {
+        if (w >= words_.size()) words_.resize(w + 1, 0);
+        words_[w] |= quint64(1) << (cpu % 64);
+    } else if (w < words_.size()) {
+        words_[w] &= ~(quint64(1) << (cpu % 64));
+        trim();
+    }
+}
+
+int CpuSet::count() const
+{
+    int n = 0;
+    for (quint64 w : words_) n += popcount64(w);
+    return n;
+}
+
+int CpuSet::first() const
+{
+    for (int w = 0; w < words_.size(); ++w)
+        if (words_[w]) return w * 64 + ctz64(words_[w]);
+    return -1;
+}
+
+int CpuSet::last() const
+{
+    if (words_.isEmpty()) return -1;
+    const int w = int(words_.size()) - 1;
+    return w * 64 + 63 - clz64(words_[w]);
+}
+
+int CpuSet::next(int cpu) const
+{
+    int c = cpu + 1;
+    if (c < 0) c = 0;
+    int w = c / 64;
+    if (w >= words_.size()) return -1;
+    quint64 bits = words_[w] & (~quint64(0) << (c % 64));
+    while (!bits) {
+        if (++w >= words_.size()) return -1;
+        bits = words_[w];
+    }
+    return w * 64 + ctz64(bits);
+}
+
+CpuSet CpuSet::operator|(const CpuSet& o) const
+{
+    CpuSet r = words_.size() >= o.words_.size() ? *this : o;
+    const CpuSet& other = words_.size() >= o.words_.size() ? o : *this;
+    for (int w = 0; w < other.words_.size(); ++w)
+        r.words_[w] |= other.words_[w];
+    return r;
+}
+
+CpuSet CpuSet::operator&(const CpuSet& o) const
+{
+    CpuSet r;
+    const int n = int(qMin(words_.size(), o.words_.size()));
+    r.words_.resize(n);
+    for (int w = 0; w < n; ++w)
+        r.words_[w] = words_[w] & o.words_[w];
+    r.trim();
+    return r;
+}
+
+CpuSet CpuSet::operator-(const CpuSet& o) const
+{
+    CpuSet r = *this;
+    const int n = int(qMin(words_.size(), o.words_.size()));
+    for (int w = 0; w < n; ++w)
+        r.words_[w] &= ~o.words_[w];
+    r.trim();
+    return r;
+}
+
+void CpuSet::trim()
+{
+    while (!words_.isEmpty() && words_.last() == 0)
+        words_.removeLast();
+}
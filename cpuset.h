@@ -0,0 +1,50 @@
+#ifndef CPUSET_H
+#define CPUSET_H
+
+#include <QString>
+#include <QVector>
+
+// Arbitrary-width set of logical CPU indexes (no 64-CPU limit).
+// Serialised as a Linux-style range list: "0-15,32-47".
+class CpuSet
+{
+public:
+    CpuSet() = default;
+
+    static CpuSet fromList(const QVector<int>& cpus);
+    static CpuSet fromRangeList(const QString& text, bool* ok=nullptr);
+    static CpuSet range(int first, int last);   // inclusive
+
+    QString toRangeList() const;
+    QVector<int> toList() const;
+
+    bool test(int cpu) const;
+    void set(int cpu, bool on=true);
+    void reset(int cpu) { set(cpu, false); }
+    void clear() { words_.clear(); }
+
+    bool isEmpty() const { return words_.isEmpty(); }
+    int count() const;
+    int first() const;              // -1 if empty
+    int last() const;               // -1 if empty
+    int next(int cpu) const;        // next set CPU after `cpu`, -1 if none
+    int width() const { return int(words_.size()) * 64; }
+
+    CpuSet operator|(const CpuSet& o) const;
+    CpuSet operator&(const CpuSet& o) const;
+    CpuSet operator-(const CpuSet& o) const;   // set difference
+    CpuSet& operator|=(const CpuSet& o) { return *this = *this | o; }
+    bool operator==(const CpuSet& o) const { return words_ == o.words_; }
+    bool operator!=(const CpuSet& o) const { return !(*this == o); }
+    bool intersects(const CpuSet& o) const { return !(*this & o).isEmpty(); }
+
+    // 64-bit words, bit i of word w is CPU w*64+i; no trailing zero words.
+    const QVector<quint64>& words() const { return words_; }
+
+private:
+    void trim();
+
+    QVector<quint64> words_;
+};
+
+#endif // CPUSET_H
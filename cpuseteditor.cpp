@@ -0,0 +1,146 @@
+#include "cpuseteditor.h"
+#include "cputopology.h"
+
+#include <QCheckBox>
+#include <QGridLayout>
+#include <QGroupBox>
+#include <QHBoxLayout>
+#include <QLineEdit>
+#include <QMap>
+#include <QScrollArea>
+#include <QSignalBlocker>
+#include <QToolButton>
+#include <QVBoxLayout>
+
+CpuSetEditor::CpuSetEditor(QWidget* parent)
+    : QWidget(parent)
+{
+    auto* top = new QHBoxLayout;
+    rangeEdit_ = new QLineEdit(this);
+    rangeEdit_->setPlaceholderText(QStringLiteral("e.g. 0-15,32-47"));
+    connect(rangeEdit_, &QLineEdit::editingFinished, this, &CpuSetEditor::onRangeEdited);
+    auto* all = new QToolButton(this);
+    all->setText(QStringLiteral("All"));
+    connect(all, &QToolButton::clicked, this, [this] { setCpuSet(online_); emit cpuSetChanged(value_); });
+    auto* none = new QToolButton(this);
+    none->setText(QStringLiteral("None"));
+    connect(none, &QToolButton::clicked, this, [this] { setCpuSet(CpuSet()); emit cpuSetChanged(value_); });
+    top->addWidget(rangeEdit_, 1);
+    top->addWidget(all);
+    top->addWidget(none);
+
+    scroll_ = new QScrollArea(this);
+    scroll_->setWidgetResizable(true);
+    scroll_->setMinimumHeight(120);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(top);
+    layout->addWidget(scroll_, 1);
+}
+
+void CpuSetEditor::setTopology(const CpuTopology& topo)
+{
+    online_ = topo.online();
+    boxes_.fill(nullptr, online_.last() + 1);
+
+    // socket -> core -> hardware threads
+    QMap<int, QMap<int, QVector<int>>> sockets;
+    for (const CpuInfo& c : topo.cpus())
+        sockets[c.package][c.core].append(c.id);
+
+    int maxThreads = 1;
+    for (const auto& cores : sockets)
+        for (const QVector<int>& threads : cores)
+            maxThreads = qMax(maxThreads, int(threads.size()));
+    // Roughly eight checkboxes per row whatever the SMT width.
+    const int coresPerRow = qMax(1, 8 / maxThreads);
+
+    auto* content = new QWidget;
+    auto* vbox = new QVBoxLayout(content);
+    vbox->setSpacing(4);
+    for (auto s = sockets.cbegin(); s != sockets.cend(); ++s) {
+        auto* group = new QGroupBox(QStringLiteral("Socket %1").arg(s.key()), content);
+        auto* grid = new QGridLayout(group);
+        grid->setHorizontalSpacing(10);
+        grid->setVerticalSpacing(2);
+        int cell = 0;
+        for (auto c = s->cbegin(); c != s->cend(); ++c, ++cell) {
+            const QVector<int> threads = c.value();
+            auto* row = new QHBoxLayout;
+            row->setSpacing(2);
+            // Core button toggles all of its SMT siblings at once.
+            auto* coreBtn = new QToolButton(group);
+            coreBtn->setText(QStringLiteral("C%1").arg(c.key()));
+            coreBtn->setAutoRaise(true);
+            connect(coreBtn, &QToolButton::clicked, this, [this, threads] { toggleCore(threads); });
+            row->addWidget(coreBtn);
+            for (int cpu : threads) {
+                auto* box = new QCheckBox(QString::number(cpu), group);
+                const CpuInfo* info = topo.find(cpu);
+                box->setToolTip(QStringLiteral("CPU %1 — core %2, L3 %3, node %4")
+                                    .arg(cpu).arg(c.key()).arg(info ? info->l3 : 0).arg(info ? info->node : 0));
+                connect(box, &QCheckBox::toggled, this, [this, cpu](bool on) { toggle(cpu, on); });
+                boxes_[cpu] = box;
+                row->addWidget(box);
+            }
+            grid->addLayout(row, cell / coresPerRow, cell % coresPerRow);
+        }
+        vbox->addWidget(group);
+    }
+    vbox->addStretch(1);
+
+    scroll_->setWidget(content);   // deletes the previous grid
+    value_ = value_ & online_;
+    syncWidgets();
+}
+
+void CpuSetEditor::setCpuSet(const CpuSet& cpus)
+{
+    value_ = cpus;
+    syncWidgets();
+}
+
+void CpuSetEditor::toggle(int cpu, bool on)
+{
+    value_.set(cpu, on);
+    const QSignalBlocker block(rangeEdit_);
+    rangeEdit_->setText(value_.toRangeList());
+    emit cpuSetChanged(value_);
+}
+
+void CpuSetEditor::toggleCore(const QVector<int>& cpus)
+{
+    // Any sibling off -> all on, otherwise all off.
+    bool allOn = true;
+    for (int c : cpus) allOn = allOn && value_.test(c);
+    for (int c : cpus) value_.set(c, !allOn);
+    syncWidgets();
+    emit cpuSetChanged(value_);
+}
+
+void CpuSetEditor::onRangeEdited()
+{
+    bool ok = false;
+    const CpuSet parsed = CpuSet::fromRangeList(rangeEdit_->text(), &ok);
+    if (!ok) {
+        rangeEdit_->setText(value_.toRangeList());   // revert invalid input
+        return;
+    }
+    if (parsed == value_) return;
+    value_ = parsed;
+    syncWidgets();
+    emit cpuSetChanged(value_);
+}
+
+void CpuSetEditor::syncWidgets()
+{
+    for (int cpu = 0; cpu < boxes_.size(); ++cpu) {
+        if (QCheckBox* box = boxes_[cpu]) {
+            const QSignalBlocker block(box);
+            box->setChecked(value_.test(cpu));
+        }
+    }
+    const QSignalBlocker block(rangeEdit_);
+    rangeEdit_->setText(value_.toRangeList());
+}
@@ -0,0 +1,41 @@
+#ifndef CPUSETEDITOR_H
+#define CPUSETEDITOR_H
+
+#include <QWidget>
+
+#include "cpuset.h"
+
+class CpuTopology;
+class QCheckBox;
+class QLineEdit;
+class QScrollArea;
+
+// One checkbox per logical CPU, grouped by socket and physical core, with a
+// range-list line edit ("0-15,32-47") kept in sync. Scrolls for big machines.
+class CpuSetEditor : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit CpuSetEditor(QWidget* parent=nullptr);
+
+    void setTopology(const CpuTopology& topo);   // rebuilds the grid
+    void setCpuSet(const CpuSet& cpus);
+    CpuSet cpuSet() const { return value_; }
+
+signals:
+    void cpuSetChanged(const CpuSet& cpus);
+
+private:
+    void toggle(int cpu, bool on);
+    void toggleCore(const QVector<int>& cpus);
+    void onRangeEdited();
+    void syncWidgets();
+
+    QLineEdit* rangeEdit_{};
+    QScrollArea* scroll_{};
+    QVector<QCheckBox*> boxes_;   // indexed by CPU id, null for offline CPUs
+    CpuSet online_;
+    CpuSet value_;
+};
+
+#endif // CPUSETEDITOR_H
@@ -0,0 +1,366 @@
+#include "cputopology.h"
+
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QThread>
+#include <algorithm>
+#include <tuple>
+
+#if defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <vector>
+#endif
+
+namespace {
+
+QByteArray readSys(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return f.readAll().trimmed();
+}
+
+// sysfs "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+QVector<int> parseCpuList(const QByteArray& list)
+{
+    return CpuSet::fromRangeList(QString::fromLatin1(list)).toList();
+}
+
+// Sorted by locality, then the first hardware thread of every physical core,
+// followed by the remaining SMT siblings.
+QVector<int> onePerCoreOrder(QVector<CpuInfo> cpus)
+{
+    std::sort(cpus.begin(), cpus.end(), [](const CpuInfo& a, const CpuInfo& b) {
+        return std::tie(a.node, a.l3, a.package, a.core, a.id)
+             < std::tie(b.node, b.l3, b.package, b.core, b.id);
+    });
+    QVector<int> first, rest;
+    QSet<int> seenCores;
+    for (const CpuInfo& c : cpus) {
+        if (seenCores.contains(c.core)) {
+            rest.append(c.id);
+        } else {
+            seenCores.insert(c.core);
+            first.append(c.id);
+        }
+    }
+    return first + rest;
+}
+
+} // namespace
+
+// ---------- CpuTopology ----------
+
+CpuTopology CpuTopology::flat(int cpuCount)
+{
+    CpuTopology t;
+    for (int i = 0; i < qMax(1, cpuCount); ++i) {
+        CpuInfo c;
+        c.id = i;
+        c.core = i;
+        t.cpus_.append(c);
+    }
+    return t;
+}
+
+#if defined(Q_OS_LINUX)
+
+CpuTopology CpuTopology::detect()
+{
+    const QString base = QStringLiteral("/sys/devices/system/cpu/");
+    const QVector<int> online = parseCpuList(readSys(base + "online"));
+    if (online.isEmpty())
+        return flat(QThread::idealThreadCount());
+
+    CpuTopology t;
+    QHash<qint64, int> coreIds;       // (package, core_id) -> global core
+    QHash<QByteArray, int> llcIds;    // shared_cpu_list -> LLC domain
+
+    for (int cpu : online) {
+        const QString dir = base + QStringLiteral("cpu%1/").arg(cpu);
+        CpuInfo c;
+        c.id = cpu;
+        c.package = qMax(0, readSys(dir + "topology/physical_package_id").toInt());
+        const qint64 coreKey = (qint64(c.package) << 32) | quint32(readSys(dir + "topology/core_id").toInt());
+        c.core = coreIds.value(coreKey, -1);
+        if (c.core < 0) {
+            c.core = int(coreIds.size());
+            coreIds.insert(coreKey, c.core);
+        }
+
+        // Last-level cache: the highest data/unified cache index.
+        int bestLevel = -1;
+        QByteArray shared;
+        for (int i = 0; ; ++i) {
+            const QString idx = dir + QStringLiteral("cache/index%1/").arg(i);
+            const QByteArray level = readSys(idx + "level");
+            if (level.isEmpty()) break;
+            if (readSys(idx + "type") == "Instruction") continue;
+            if (level.toInt() > bestLevel) {
+                bestLevel = level.toInt();
+                shared = readSys(idx + "shared_cpu_list");
+            }
+        }
+        if (shared.isEmpty())
+            shared = "package" + QByteArray::number(c.package);
+        c.l3 = llcIds.value(shared, -1);
+        if (c.l3 < 0) {
+            c.l3 = int(llcIds.size());
+            llcIds.insert(shared, c.l3);
+        }
+        t.cpus_.append(c);
+    }
+
+    QHash<int, int> nodeOf;
+    const QDir nodes(QStringLiteral("/sys/devices/system/node"));
+    for (const QString& name : nodes.entryList({QStringLiteral("node*")}, QDir::Dirs)) {
+        bool ok = false;
+        const int node = name.mid(4).toInt(&ok);
+        if (!ok) continue;
+        for (int cpu : parseCpuList(readSys(nodes.filePath(name + "/cpulist"))))
+            nodeOf.insert(cpu, node);
+    }
+    for (CpuInfo& c : t.cpus_)
+        c.node = nodeOf.value(c.id, 0);
+
+    return t;
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+CpuTopology CpuTopology::detect()
+{
+    DWORD len = 0;
+    ::GetLogicalProcessorInformationEx(RelationAll, nullptr, &len);
+    std::vector<char> buf(len);
+    if (len == 0 || !::GetLogicalProcessorInformationEx(
+            RelationAll, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buf.data()), &len))
+        return flat(QThread::idealThreadCount());
+
+    // Logical CPU index = group * 64 + bit, matching the affinity backend.
+    QMap<int, CpuInfo> byId;
+    QSet<int> haveLlc;
+    int cores = 0, packages = 0, caches = 0;
+    auto forEach = [](const GROUP_AFFINITY& ga, const auto& fn) {
+        for (int bit = 0; bit < 64; ++bit)
+            if (ga.Mask & (KAFFINITY(1) << bit))
+                fn(int(ga.Group) * 64 + bit);
+    };
+
+    for (DWORD off = 0; off < len; ) {
+        const auto* info = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buf.data() + off);
+        off += info->Size;
+        switch (info->Relationship) {
+        case RelationProcessorCore:
+            for (WORD g = 0; g < info->Processor.GroupCount; ++g)
+                forEach(info->Processor.GroupMask[g], [&](int id) { byId[id].id = id; byId[id].core = cores; });
+            ++cores;
+            break;
+        case RelationProcessorPackage:
+            for (WORD g = 0; g < info->Processor.GroupCount; ++g)
+                forEach(info->Processor.GroupMask[g], [&](int id) { byId[id].package = packages; });
+            ++packages;
+            break;
+        case RelationCache:
+            if (info->Cache.Level == 3) {
+                forEach(info->Cache.GroupMask, [&](int id) { byId[id].l3 = caches; haveLlc.insert(id); });
+                ++caches;
+            }
+            break;
+        case RelationNumaNode:
+            forEach(info->NumaNode.GroupMask, [&](int id) { byId[id].node = int(info->NumaNode.NodeNumber); });
+            break;
+        default:
+            break;
+        }
+    }
+
+    CpuTopology t;
+    for (auto it = byId.begin(); it != byId.end(); ++it) {
+        if (it->id < 0) continue;
+        if (!haveLlc.contains(it->id))
+            it->l3 = caches + it->package; // no L3 reported: one domain per socket
+        t.cpus_.append(*it);
+    }
+    if (t.cpus_.isEmpty())
+        return flat(QThread::idealThreadCount());
+    return t;
+}
+
+#else
+
+CpuTopology CpuTopology::detect()
+{
+    return flat(QThread::idealThreadCount());
+}
+
+#endif
+
+const CpuInfo* CpuTopology::find(int cpu) const
+{
+    for (const CpuInfo& c : cpus_)
+        if (c.id == cpu) return &c;
+    return nullptr;
+}
+
+QVector<int> CpuTopology::siblings(int cpu) const
+{
+    QVector<int> out;
+    const CpuInfo* self = find(cpu);
+    if (!self) return out;
+    for (const CpuInfo& c : cpus_)
+        if (c.core == self->core) out.append(c.id);
+    return out;
+}
+
+CpuSet CpuTopology::online() const
+{
+    CpuSet s;
+    for (const CpuInfo& c : cpus_) s.set(c.id);
+    return s;
+}
+
+int CpuTopology::nodeCount() const
+{
+    QSet<int> nodes;
+    for (const CpuInfo& c : cpus_) nodes.insert(c.node);
+    return int(nodes.size());
+}
+
+// ---------- Policies ----------
+
+QVector<CorePolicy> allCorePolicies()
+{
+    return {CorePolicy::PackL3, CorePolicy::OnePerCore, CorePolicy::SpreadNuma,
+            CorePolicy::AvoidIrq, CorePolicy::Random};
+}
+
+QString corePolicyKey(CorePolicy p)
+{
+    switch (p) {
+    case CorePolicy::Random:     return QStringLiteral("random");
+    case CorePolicy::PackL3:     return QStringLiteral("pack-l3");
+    case CorePolicy::OnePerCore: return QStringLiteral("one-per-core");
+    case CorePolicy::SpreadNuma: return QStringLiteral("spread-numa");
+    case CorePolicy::AvoidIrq:   return QStringLiteral("avoid-irq");
+    }
+    return QString();
+}
+
+QString corePolicyLabel(CorePolicy p)
+{
+    switch (p) {
+    case CorePolicy::Random:     return QStringLiteral("Random (legacy)");
+    case CorePolicy::PackL3:     return QStringLiteral("Pack into one L3");
+    case CorePolicy::OnePerCore: return QStringLiteral("One thread per physical core");
+    case CorePolicy::SpreadNuma: return QStringLiteral("Spread across NUMA nodes");
+    case CorePolicy::AvoidIrq:   return QStringLiteral("Avoid core 0 / IRQ cores");
+    }
+    return QString();
+}
+
+CorePolicy corePolicyFromKey(const QString& key, CorePolicy fallback)
+{
+    for (CorePolicy p : allCorePolicies())
+        if (corePolicyKey(p) == key) return p;
+    return fallback;
+}
+
+CpuSet selectCpus(const CpuTopology& topo, int count, CorePolicy policy)
+{
+    const QVector<CpuInfo>& cpus = topo.cpus();
+    if (cpus.isEmpty()) return {};
+    count = qBound(1, count, int(cpus.size()));
+
+    QVector<int> order;
+    switch (policy) {
+    case CorePolicy::Random: {
+        for (const CpuInfo& c : cpus) order.append(c.id);
+        std::shuffle(order.begin(), order.end(), *QRandomGenerator::global());
+        break;
+    }
+    case CorePolicy::OnePerCore:
+        order = onePerCoreOrder(cpus);
+        break;
+    case CorePolicy::PackL3: {
+        QMap<int, QVector<CpuInfo>> domains;
+        for (const CpuInfo& c : cpus) domains[c.l3].append(c);
+        // Prefer a domain that fits the whole request, then spill into
+        // domains on the same NUMA node before going remote.
+        QVector<int> keys = domains.keys();
+        std::stable_sort(keys.begin(), keys.end(), [&](int a, int b) {
+            const bool fitA = domains[a].size() >= count, fitB = domains[b].size() >= count;
+            if (fitA != fitB) return fitA;
+            return domains[a].first().node < domains[b].first().node;
+        });
+        const int homeNode = domains[keys.first()].first().node;
+        std::stable_partition(keys.begin() + 1, keys.end(),
+                              [&](int k) { return domains[k].first().node == homeNode; });
+        for (int k : keys) order += onePerCoreOrder(domains[k]);
+        break;
+    }
+    case CorePolicy::SpreadNuma: {
+        QMap<int, QVector<CpuInfo>> nodes;
+        for (const CpuInfo& c : cpus) nodes[c.node].append(c);
+        QVector<QVector<int>> perNode;
+        for (const auto& list : nodes) perNode.append(onePerCoreOrder(list));
+        for (int i = 0; order.size() < cpus.size(); ++i)
+            for (const QVector<int>& list : perNode)
+                if (i < list.size()) order.append(list[i]);
+        break;
+    }
+    case CorePolicy::AvoidIrq: {
+        QSet<int> avoid;
+        for (int c : topo.siblings(cpus.first().id)) avoid.insert(c);
+        for (int c : interruptHeavyCpus()) avoid.insert(c);
+        QVector<CpuInfo> preferred, fallback;
+        for (const CpuInfo& c : cpus)
+            (avoid.contains(c.id) ? fallback : preferred).append(c);
+        order = onePerCoreOrder(preferred) + onePerCoreOrder(fallback);
+        break;
+    }
+    }
+
+    order.resize(count);
+    return CpuSet::fromList(order);
+}
+
+QVector<int> interruptHeavyCpus()
+{
+    QVector<int> heavy;
+#if defined(Q_OS_LINUX)
+    QFile f(QStringLiteral("/proc/interrupts"));
+    if (!f.open(QIODevice::ReadOnly))
+        return heavy;
+
+    // Header: "CPU0 CPU1 ..." gives the column -> CPU mapping.
+    QVector<int> columns;
+    for (const QByteArray& tok : f.readLine().simplified().split(' '))
+        if (tok.startsWith("CPU")) columns.append(tok.mid(3).toInt());
+    QVector<quint64> totals(columns.size(), 0);
+
+    while (!f.atEnd()) {
+        const QList<QByteArray> toks = f.readLine().simplified().split(' ');
+        for (int i = 1; i < toks.size() && i <= columns.size(); ++i) {
+            bool ok = false;
+            const quint64 v = toks[i].toULongLong(&ok);
+            if (!ok) break;
+            totals[i - 1] += v;
+        }
+    }
+    if (totals.size() < 2)
+        return heavy;
+
+    QVector<quint64> sorted = totals;
+    std::sort(sorted.begin(), sorted.end());
+    const quint64 median = sorted[sorted.size() / 2];
+    for (int i = 0; i < totals.size(); ++i)
+        if (totals[i] > 2 * median + 1000) heavy.append(columns[i]);
+#endif
+    return heavy;
+}
@@ -0,0 +1,59 @@
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <QString>
+#include <QVector>
+
+#include "cpuset.h"
+
+struct CpuInfo {
+    int id{-1};        // logical CPU index
+    int package{0};    // socket
+    int core{0};       // physical core, unique across packages
+    int l3{0};         // last-level cache domain
+    int node{0};       // NUMA node
+};
+
+// Logical CPU layout: SMT siblings, LLC domains, sockets and NUMA nodes.
+class CpuTopology
+{
+public:
+    // sysfs on Linux, GetLogicalProcessorInformationEx on Windows.
+    static CpuTopology detect();
+    // Every CPU its own core, one cache and one node.
+    static CpuTopology flat(int cpuCount);
+
+    const QVector<CpuInfo>& cpus() const { return cpus_; }
+    int size() const { return int(cpus_.size()); }
+    bool isEmpty() const { return cpus_.isEmpty(); }
+    const CpuInfo* find(int cpu) const;
+
+    QVector<int> siblings(int cpu) const;     // SMT siblings, including `cpu`
+    CpuSet online() const;
+    int nodeCount() const;
+
+private:
+    QVector<CpuInfo> cpus_;                   // online CPUs, sorted by id
+};
+
+// How apply picks `assignedCores` logical CPUs.
+enum class CorePolicy {
+    Random,        // any N CPUs (old Get-Random behaviour)
+    PackL3,        // fill one last-level cache domain before the next
+    OnePerCore,    // one hardware thread per physical core first
+    SpreadNuma,    // round-robin across NUMA nodes
+    AvoidIrq,      // keep off CPU 0's core and interrupt-heavy CPUs
+};
+
+QString corePolicyKey(CorePolicy p);          // stable name for config files
+QString corePolicyLabel(CorePolicy p);        // human readable
+CorePolicy corePolicyFromKey(const QString& key, CorePolicy fallback = CorePolicy::PackL3);
+QVector<CorePolicy> allCorePolicies();
+
+// Pick `count` CPUs from `topo` according to `policy`.
+CpuSet selectCpus(const CpuTopology& topo, int count, CorePolicy policy);
+
+// CPUs servicing clearly more interrupts than the rest (from /proc/interrupts).
+QVector<int> interruptHeavyCpus();
+
+#endif // CPUTOPOLOGY_H
@@ -0,0 +1,380 @@
+#include "experiment.h"
+#include "affinitybackend.h"
+#include "processenumerator.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Two-sided 95 % Student t quantiles for 1..30 degrees of freedom.
+constexpr double kT975[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+double tQuantile(int df)
+{
+    if (df < 1) return 0.0;
+    if (df <= 30) return kT975[df - 1];
+    return df <= 60 ? 2.000 : df <= 120 ? 1.980 : 1.960;
+}
+
+double perSecond(qint64 count, double seconds)
+{
+    return count < 0 || seconds <= 0 ? -1.0 : double(count) / seconds;
+}
+
+} // namespace
+
+ExperimentCandidate ExperimentCandidate::parse(const QString& spec, bool* ok)
+{
+    ExperimentCandidate c;
+    c.label = spec.trimmed();
+    bool valid = false;
+    const int slash = c.label.indexOf('/');
+    if (slash > 0) {
+        const QString key = c.label.left(slash);
+        const CorePolicy policy = corePolicyFromKey(key, CorePolicy::Random);
+        c.config.policy = policy;
+        c.config.assignedCores = c.label.mid(slash + 1).toInt(&valid);
+        valid = valid && c.config.assignedCores > 0 && corePolicyKey(policy) == key;
+    } else {
+        c.config.cpus = CpuSet::fromRangeList(c.label, &valid);
+        valid = valid && !c.config.cpus.isEmpty();
+    }
+    if (ok) *ok = valid;
+    return c;
+}
+
+QString experimentObjectiveKey(ExperimentObjective o)
+{
+    switch (o) {
+    case ExperimentObjective::Auto:                  return QStringLiteral("auto");
+    case ExperimentObjective::InstructionsPerSecond: return QStringLiteral("ips");
+    case ExperimentObjective::Ipc:                   return QStringLiteral("ipc");
+    case ExperimentObjective::Metric:                return QStringLiteral("metric");
+    }
+    return QString();
+}
+
+ExperimentObjective experimentObjectiveFromKey(const QString& key, ExperimentObjective fallback)
+{
+    for (ExperimentObjective o : {ExperimentObjective::Auto, ExperimentObjective::InstructionsPerSecond,
+                                  ExperimentObjective::Ipc, ExperimentObjective::Metric}) {
+        if (experimentObjectiveKey(o) == key) return o;
+    }
+    return fallback;
+}
+
+Experiment::Experiment(const Options& opts, AffinityBackend& backend, const CpuTopology& topo)
+    : opts_(opts)
+    , backend_(backend)
+    , topo_(topo)
+{
+}
+
+Experiment::~Experiment()
+{
+    stopTarget();
+}
+
+bool Experiment::startTarget(QString* error)
+{
+    if (opts_.pid > 0) {
+        pid_ = opts_.pid;
+    } else {
+        if (opts_.command.isEmpty()) {
+            if (error) *error = QStringLiteral("Give a PID or a command to run");
+            return false;
+        }
+        child_ = new QProcess;
+        child_->setProcessChannelMode(QProcess::ForwardedChannels);
+        child_->start(opts_.command.first(), opts_.command.mid(1));
+        if (!child_->waitForStarted(5000)) {
+            if (error) *error = QStringLiteral("%1: %2").arg(opts_.command.first(), child_->errorString());
+            return false;
+        }
+        pid_ = child_->processId();
+    }
+    processName_ = ProcessEnumerator::processName(pid_);
+    if (processName_.isEmpty()) {
+        if (error) *error = QStringLiteral("Process %1 not found").arg(pid_);
+        return false;
+    }
+    return true;
+}
+
+void Experiment::stopTarget()
+{
+    if (!child_) return;
+    if (child_->state() != QProcess::NotRunning) {
+        child_->terminate();
+        if (!child_->waitForFinished(3000)) {
+            child_->kill();
+            child_->waitForFinished(1000);
+        }
+    }
+    delete child_;
+    child_ = nullptr;
+}
+
+bool Experiment::readMetric(double* value, QString* error) const
+{
+    QProcess p;
+    p.startCommand(opts_.metricCommand);
+    if (!p.waitForFinished(10000) || p.exitStatus() != QProcess::NormalExit || p.exitCode() != 0) {
+        if (error) *error = QStringLiteral("metric command failed: %1").arg(opts_.metricCommand);
+        p.kill();
+        return false;
+    }
+    static const QRegularExpression number(QStringLiteral(R"([-+]?(?:\d+\.?\d*|\.\d+)(?:[eE][-+]?\d+)?)"));
+    const QRegularExpressionMatch m = number.match(QString::fromLocal8Bit(p.readAllStandardOutput()));
+    if (!m.hasMatch()) {
+        if (error) *error = QStringLiteral("metric command printed no number: %1").arg(opts_.metricCommand);
+        return false;
+    }
+    *value = m.captured(0).toDouble();
+    return true;
+}
+
+double Experiment::score(const ExperimentWindow& w) const
+{
+    switch (objective_) {
+    case ExperimentObjective::Metric:
+        return w.metric;
+    case ExperimentObjective::Ipc: {
+        const double ipc = w.counters.ipc();
+        return ipc > 0 ? ipc : -1.0;
+    }
+    case ExperimentObjective::InstructionsPerSecond:
+    case ExperimentObjective::Auto:
+        break;
+    }
+    return perSecond(w.counters.value(PerfReading::Instructions), w.seconds);
+}
+
+bool Experiment::run(QString* error)
+{
+    windows_.clear();
+    stopping_ = false;
+    if (opts_.candidates.isEmpty()) {
+        if (error) *error = QStringLiteral("No candidate layouts");
+        return false;
+    }
+    if (!startTarget(error))
+        return false;
+
+    objective_ = opts_.objective;
+    if (objective_ == ExperimentObjective::Auto)
+        objective_ = opts_.metricCommand.isEmpty() ? ExperimentObjective::InstructionsPerSecond
+                                                   : ExperimentObjective::Metric;
+    if (objective_ == ExperimentObjective::Metric && opts_.metricCommand.isEmpty()) {
+        if (error) *error = QStringLiteral("The metric objective needs a metric command");
+        return false;
+    }
+
+    PerfCounters counters;
+    QString why;
+    if (!counters.open(pid_, &why))
+        qWarning().noquote() << "cpuaffinity: no perf counters:" << why;
+    if (objective_ != ExperimentObjective::Metric && !counters.read().has(PerfReading::Instructions)) {
+        if (error) *error = QStringLiteral("Hardware counters are unavailable here (%1); "
+                                           "score with a metric command instead")
+                                .arg(why.isEmpty() ? QStringLiteral("no PMU access") : why);
+        return false;
+    }
+
+    CpuSet original;
+    BackendError err;
+    backend_.processAffinity(pid_, &original, &err);
+
+    const int n = int(opts_.candidates.size());
+    bool ok = true;
+    for (int round = 0; round < opts_.rounds && ok && !stopping_; ++round) {
+        for (int k = 0; k < n && ok && !stopping_; ++k) {
+            const int ci = (round + k) % n;
+            const ExperimentCandidate& cand = opts_.candidates[ci];
+            if (!applyAffinityConfig(backend_, topo_, pid_, cand.config, nullptr, &err)) {
+                if (error) *error = QStringLiteral("%1: %2 (error %3)").arg(cand.label, err.message).arg(err.code);
+                ok = false;
+                break;
+            }
+            if (!wait(opts_.warmupMs)) break;
+
+            ExperimentWindow w;
+            w.candidate = ci;
+            w.round = round;
+            double metricStart = 0.0;
+            if (!opts_.metricCommand.isEmpty() && opts_.metricIsRate && !readMetric(&metricStart, error)) {
+                ok = false;
+                break;
+            }
+            counters.refreshThreads();
+            const PerfReading before = counters.read();
+            if (!wait(opts_.windowMs)) break;
+            counters.refreshThreads();
+            w.counters = counters.read() - before;
+            w.seconds = double(w.counters.timestampNs) / 1e9;
+            if (!opts_.metricCommand.isEmpty()) {
+                double metricEnd = 0.0;
+                if (!readMetric(&metricEnd, error)) {
+                    ok = false;
+                    break;
+                }
+                w.metric = opts_.metricIsRate ? (metricEnd - metricStart) / w.seconds : metricEnd;
+                w.hasMetric = true;
+            }
+            w.score = score(w);
+            // A counter score below zero means the counter did not read; the
+            // window says nothing about the candidate, so it is not counted.
+            if (objective_ != ExperimentObjective::Metric && w.score < 0) {
+                qWarning().noquote() << QStringLiteral("cpuaffinity: round %1/%2 %3: no %4 reading, window dropped")
+                                            .arg(round + 1).arg(opts_.rounds).arg(cand.label)
+                                            .arg(experimentObjectiveKey(objective_));
+            } else {
+                windows_.append(w);
+                qInfo().noquote() << QStringLiteral("cpuaffinity: round %1/%2 %3: %4 = %5, ipc %6")
+                                         .arg(round + 1).arg(opts_.rounds).arg(cand.label)
+                                         .arg(experimentObjectiveKey(objective_)).arg(w.score, 0, 'g', 6)
+                                         .arg(w.counters.ipc(), 0, 'f', 2);
+            }
+
+            QCoreApplication::processEvents();
+            if (stopping_) break;   // the window above still counts
+            if (ProcessEnumerator::processName(pid_).isEmpty()
+                || (child_ && child_->state() == QProcess::NotRunning)) {
+                if (error) *error = QStringLiteral("Process %1 exited during the experiment").arg(pid_);
+                ok = false;
+            }
+        }
+    }
+
+    if (stopping_ && ok) {
+        if (error) *error = QStringLiteral("Interrupted");
+        ok = false;
+    }
+    if (!original.isEmpty())
+        backend_.setProcessAffinity(pid_, original, &err);
+    stopTarget();
+    return ok;
+}
+
+// Sleeps in slices so a stop() can get through; false once it has.
+bool Experiment::wait(int ms)
+{
+    QElapsedTimer clock;
+    clock.start();
+    for (qint64 left = ms; left > 0 && !stopping_; left = ms - clock.elapsed()) {
+        QThread::msleep(ulong(qMin<qint64>(left, 100)));
+        QCoreApplication::processEvents();
+    }
+    return !stopping_;
+}
+
+QVector<ExperimentStats> Experiment::ranking() const
+{
+    QVector<ExperimentStats> stats(opts_.candidates.size());
+    // Per candidate: the sum of a rate and the windows it could be read in.
+    struct Rate {
+        double sum{0.0};
+        int n{0};
+        void add(double v) { if (v >= 0) { sum += v; ++n; } }
+        double mean() const { return n > 0 ? sum / n : -1.0; }
+    };
+    QVector<Rate> llc(stats.size()), ctx(stats.size()), mig(stats.size()), ipc(stats.size());
+    for (int i = 0; i < stats.size(); ++i)
+        stats[i].candidate = i;
+    for (const ExperimentWindow& w : windows_) {
+        ExperimentStats& s = stats[w.candidate];
+        ++s.n;
+        s.mean += w.score;
+        const double windowIpc = w.counters.ipc();
+        ipc[w.candidate].add(windowIpc > 0 ? windowIpc : -1.0);
+        llc[w.candidate].add(perSecond(w.counters.value(PerfReading::LlcMisses), w.seconds));
+        ctx[w.candidate].add(perSecond(w.counters.value(PerfReading::ContextSwitches), w.seconds));
+        mig[w.candidate].add(perSecond(w.counters.value(PerfReading::Migrations), w.seconds));
+    }
+    for (ExperimentStats& s : stats) {
+        if (s.n == 0) continue;
+        s.mean /= s.n;
+        s.ipc = qMax(0.0, ipc[s.candidate].mean());
+        s.llcMissesPerSec = llc[s.candidate].mean();
+        s.contextSwitchesPerSec = ctx[s.candidate].mean();
+        s.migrationsPerSec = mig[s.candidate].mean();
+    }
+    for (const ExperimentWindow& w : windows_) {
+        ExperimentStats& s = stats[w.candidate];
+        s.stddev += (w.score - s.mean) * (w.score - s.mean);
+    }
+    for (ExperimentStats& s : stats) {
+        s.stddev = s.n > 1 ? std::sqrt(s.stddev / (s.n - 1)) : 0.0;
+        const double half = s.n > 1 ? tQuantile(s.n - 1) * s.stddev / std::sqrt(double(s.n)) : 0.0;
+        s.ciLow = s.mean - half;
+        s.ciHigh = s.mean + half;
+    }
+
+    const bool lower = opts_.lowerIsBetter && objective_ == ExperimentObjective::Metric;
+    std::stable_sort(stats.begin(), stats.end(), [lower](const ExperimentStats& a, const ExperimentStats& b) {
+        if ((a.n == 0) != (b.n == 0)) return b.n == 0;
+        return lower ? a.mean < b.mean : a.mean > b.mean;
+    });
+    return stats;
+}
+
+bool Experiment::winnerIsSignificant() const
+{
+    const QVector<ExperimentStats> r = ranking();
+    if (r.size() < 2 || r[0].n < 2 || r[1].n < 2) return false;
+    const bool lower = opts_.lowerIsBetter && objective_ == ExperimentObjective::Metric;
+    return lower ? r[0].ciHigh < r[1].ciLow : r[0].ciLow > r[1].ciHigh;
+}
+
+AffinityConfig Experiment::winner() const
+{
+    const QVector<ExperimentStats> r = ranking();
+    AffinityConfig c;
+    if (!r.isEmpty() && r[0].n > 0)
+        c = opts_.candidates[r[0].candidate].config;
+    c.processName = processName_;
+    c.pid = pid_;
+    if (c.assignedCores < 1)
+        c.assignedCores = c.cpus.isEmpty() ? 1 : c.cpus.count();
+    return c;
+}
+
+QJsonObject Experiment::report() const
+{
+    QJsonArray rows;
+    for (const ExperimentStats& s : ranking()) {
+        QJsonObject o;
+        o["layout"] = opts_.candidates[s.candidate].label;
+        o["windows"] = s.n;
+        o["mean"] = s.mean;
+        o["stddev"] = s.stddev;
+        o["ci95"] = QJsonArray{s.ciLow, s.ciHigh};
+        o["ipc"] = s.ipc;
+        o["llc_misses_per_s"] = s.llcMissesPerSec;
+        o["context_switches_per_s"] = s.contextSwitchesPerSec;
+        o["migrations_per_s"] = s.migrationsPerSec;
+        rows.append(o);
+    }
+    QJsonObject r;
+    r["process"] = processName_;
+    r["objective"] = experimentObjectiveKey(objective_);
+    r["lowerIsBetter"] = opts_.lowerIsBetter && objective_ == ExperimentObjective::Metric;
+    r["rounds"] = opts_.rounds;
+    r["windowMs"] = opts_.windowMs;
+    r["ranking"] = rows;
+    r["significant"] = winnerIsSignificant();
+    r["winner"] = winner().toJson();
+    return r;
+}
@@ -0,0 +1,112 @@
+#ifndef EXPERIMENT_H
+#define EXPERIMENT_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "affinityconfig.h"
+#include "perfcounters.h"
+
+class AffinityBackend;
+class QProcess;
+
+// One CPU layout to try: a range list ("0-3,8-11") or "<policy>/<count>"
+// such as "pack-l3/4", where policy is a corePolicyKey().
+struct ExperimentCandidate {
+    QString label;
+    AffinityConfig config;
+
+    static ExperimentCandidate parse(const QString& spec, bool* ok=nullptr);
+};
+
+// What a window is scored by.
+enum class ExperimentObjective {
+    Auto,                    // Metric if a metric command is set, else InstructionsPerSecond
+    InstructionsPerSecond,
+    Ipc,
+    Metric,
+};
+
+QString experimentObjectiveKey(ExperimentObjective o);
+ExperimentObjective experimentObjectiveFromKey(const QString& key, ExperimentObjective fallback = ExperimentObjective::Auto);
+
+struct ExperimentWindow {
+    int    candidate{0};
+    int    round{0};
+    double seconds{0.0};
+    PerfReading counters;    // delta over the window
+    double metric{0.0};
+    bool   hasMetric{false};
+    double score{0.0};
+};
+
+struct ExperimentStats {
+    int    candidate{0};
+    int    n{0};
+    double mean{0.0};
+    double stddev{0.0};
+    double ciLow{0.0};       // 95 % confidence interval of the mean (Student t)
+    double ciHigh{0.0};
+    double ipc{0.0};
+    double llcMissesPerSec{-1.0};
+    double contextSwitchesPerSec{-1.0};
+    double migrationsPerSec{-1.0};
+};
+
+// Applies each candidate in turn for a fixed window and scores the window
+// from perf counters or a user metric. Rounds rotate the starting candidate
+// so slow drift in the workload does not favour whoever goes first.
+class Experiment
+{
+public:
+    struct Options {
+        qint64 pid{0};
+        QStringList command;            // started and stopped by us when pid == 0
+        QVector<ExperimentCandidate> candidates;
+        int rounds{5};
+        int warmupMs{1000};             // after each apply, not measured
+        int windowMs{5000};
+        QString metricCommand;          // prints a number on stdout
+        bool metricIsRate{true};        // (end - start) / seconds, else the value at the end
+        bool lowerIsBetter{false};
+        ExperimentObjective objective{ExperimentObjective::Auto};
+    };
+
+    Experiment(const Options& opts, AffinityBackend& backend, const CpuTopology& topo);
+    ~Experiment();
+
+    // Blocks for rounds x candidates x (warmup + window). The original mask
+    // of the target is restored afterwards.
+    bool run(QString* error=nullptr);
+    // Makes run() return false at its next wait or window end, through the
+    // same restore. Meant for events run() processes while it waits.
+    void stop() { stopping_ = true; }
+
+    const QVector<ExperimentWindow>& windows() const { return windows_; }
+    QVector<ExperimentStats> ranking() const;           // best first
+    bool winnerIsSignificant() const;                   // CI of #1 clear of #2
+    AffinityConfig winner() const;                      // ready to save as .affinity.json
+    ExperimentObjective objective() const { return objective_; }
+    QJsonObject report() const;
+
+private:
+    bool startTarget(QString* error);
+    void stopTarget();
+    bool readMetric(double* value, QString* error) const;
+    bool wait(int ms);
+    double score(const ExperimentWindow& w) const;
+
+    Options opts_;
+    AffinityBackend& backend_;
+    const CpuTopology& topo_;
+    ExperimentObjective objective_{ExperimentObjective::Auto};
+    qint64 pid_{0};
+    QString processName_;
+    QProcess* child_{};
+    QVector<ExperimentWindow> windows_;
+    bool stopping_{false};
+};
+
+#endif // EXPERIMENT_H
@@ -0,0 +1,645 @@
+#include "history.h"
+#include "affinitybackend.h"
+#include "telemetry.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QPair>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// File layout: the 8-byte magic, then blocks. A block is a 32-byte header
+// (magic, payload size, first and last ms, frame and event counts, all
+// little-endian) and a payload of sections, each a varint tag and a varint
+// byte length, so a reader can skip the columns it does not need:
+//
+//   times      frame timestamps as varint deltas from the block's first ms
+//   cpus       per CPU, its busy share over all frames in permille, each a
+//              zigzag varint delta from the frame before
+//   processes  per (pid, start time): pid as a delta from the previous one,
+//              start time, name, the frames it spans, its CPU use over those
+//              frames in permille (delta coded like cpus), and its affinity
+//              mask only where it changed
+//   events     ms since the block's first ms, kind, pid, text
+//
+// Utilisation moves slowly between samples and masks rarely change, so most
+// values take one byte.
+
+namespace {
+
+const char kFileMagic[8] = {'C', 'P', 'A', 'H', 'I', 'S', 'T', '1'};
+const char kBlockMagic[4] = {'C', 'P', 'A', 'B'};
+constexpr int kBlockHeaderSize = 32;
+
+enum Section : quint8 { SectionTimes = 1, SectionCpus = 2, SectionProcesses = 3, SectionEvents = 4 };
+
+// Process CPU use in a frame: 0 = not running, 1 = unknown, else permille + 2.
+constexpr qint64 kAbsent = 0;
+constexpr qint64 kUnknown = 1;
+
+qint64 usageCode(float cores)
+{
+    return cores < 0 ? kUnknown : qint64(std::lround(double(cores) * 1000.0)) + 2;
+}
+
+float usageFromCode(qint64 code)
+{
+    return code <= kUnknown ? -1.0f : float(code - 2) / 1000.0f;
+}
+
+quint64 zigzag(qint64 v) { return (quint64(v) << 1) ^ quint64(v >> 63); }
+qint64 unzigzag(quint64 v) { return qint64(v >> 1) ^ -qint64(v & 1); }
+
+void putVarint(QByteArray& out, quint64 v)
+{
+    while (v >= 0x80) {
+        out.append(char(v | 0x80));
+        v >>= 7;
+    }
+    out.append(char(v));
+}
+
+void putSigned(QByteArray& out, qint64 v) { putVarint(out, zigzag(v)); }
+
+void putString(QByteArray& out, const QString& s)
+{
+    const QByteArray utf8 = s.toUtf8();
+    putVarint(out, quint64(utf8.size()));
+    out.append(utf8);
+}
+
+void putMask(QByteArray& out, const CpuSet& mask)
+{
+    putVarint(out, quint64(mask.words().size()));
+    for (quint64 w : mask.words()) putVarint(out, w);
+}
+
+void putSection(QByteArray& out, Section tag, const QByteArray& body)
+{
+    putVarint(out, tag);
+    putVarint(out, quint64(body.size()));
+    out.append(body);
+}
+
+void putLE(char* p, quint64 v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i) p[i] = char((v >> (8 * i)) & 0xff);
+}
+
+quint64 getLE(const uchar* p, int bytes)
+{
+    quint64 v = 0;
+    for (int i = 0; i < bytes; ++i) v |= quint64(p[i]) << (8 * i);
+    return v;
+}
+
+// Bounds-checked reading; any overrun clears ok and yields zeros.
+struct Cursor {
+    const uchar* p;
+    const uchar* end;
+    bool ok{true};
+
+    bool atEnd() const { return p >= end; }
+
+    quint64 varint()
+    {
+        quint64 v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) break;
+            const uchar b = *p++;
+            v |= quint64(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    qint64 signedVarint() { return unzigzag(varint()); }
+
+    QString string()
+    {
+        const quint64 n = varint();
+        if (!ok || n > quint64(end - p)) {
+            ok = false;
+            return QString();
+        }
+        const QString s = QString::fromUtf8(reinterpret_cast<const char*>(p), int(n));
+        p += n;
+        return s;
+    }
+
+    CpuSet mask()
+    {
+        const quint64 words = varint();
+        CpuSet set;
+        for (quint64 w = 0; ok && w < words && w < 1024; ++w) {
+            const quint64 bits = varint();
+            for (int b = 0; b < 64; ++b)
+                if (bits & (quint64(1) << b)) set.set(int(w) * 64 + b);
+        }
+        return set;
+    }
+
+    // The next section; its body is returned as a cursor of its own.
+    bool section(quint8* tag, Cursor* body)
+    {
+        *tag = quint8(varint());
+        const quint64 n = varint();
+        if (!ok || n > quint64(end - p)) {
+            ok = false;
+            return false;
+        }
+        *body = Cursor{p, p + n};
+        p += n;
+        return true;
+    }
+};
+
+// One process across the frames of a block.
+struct Track {
+    qint64  pid{0};
+    quint64 startTime{0};
+    QString name;
+    int     firstFrame{0};
+    QVector<qint64> usage;                      // usageCode per frame from firstFrame
+    QVector<QPair<int, CpuSet>> affinity;       // (frame, mask) where it changed
+};
+
+QByteArray encodeBlock(const QVector<HistoryFrame>& frames, const QVector<HistoryEvent>& events,
+                       qint64* firstMs, qint64* lastMs)
+{
+    qint64 first = frames.isEmpty() ? events.first().ms : frames.first().ms;
+    qint64 last = first;
+    for (const HistoryFrame& f : frames) {
+        first = qMin(first, f.ms);
+        last = qMax(last, f.ms);
+    }
+    for (const HistoryEvent& e : events) {
+        first = qMin(first, e.ms);
+        last = qMax(last, e.ms);
+    }
+    *firstMs = first;
+    *lastMs = last;
+
+    QByteArray payload;
+    QByteArray body;
+
+    qint64 prevMs = first;
+    for (const HistoryFrame& f : frames) {
+        putVarint(body, quint64(qMax<qint64>(0, f.ms - prevMs)));
+        prevMs = qMax(prevMs, f.ms);
+    }
+    putSection(payload, SectionTimes, body);
+
+    body.clear();
+    int cpuCount = 0;
+    for (const HistoryFrame& f : frames) cpuCount = qMax(cpuCount, int(f.cpus.size()));
+    putVarint(body, quint64(cpuCount));
+    for (int cpu = 0; cpu < cpuCount; ++cpu) {
+        qint64 prev = 0;
+        for (const HistoryFrame& f : frames) {
+            const qint64 v = cpu < f.cpus.size() ? qint64(std::lround(double(f.cpus[cpu]) * 1000.0)) : 0;
+            putSigned(body, v - prev);
+            prev = v;
+        }
+    }
+    putSection(payload, SectionCpus, body);
+
+    body.clear();
+    QVector<Track> tracks;
+    QHash<qint64, int> trackOf;   // pid -> its latest track; a reused pid starts a new one
+    for (int fi = 0; fi < frames.size(); ++fi) {
+        for (const HistoryFrame::Process& p : frames[fi].processes) {
+            int index = trackOf.value(p.pid, -1);
+            if (index < 0 || tracks[index].startTime != p.startTime) {
+                Track t;
+                t.pid = p.pid;
+                t.startTime = p.startTime;
+                t.name = p.name;
+                t.firstFrame = fi;
+                tracks.append(t);
+                index = int(tracks.size()) - 1;
+                trackOf.insert(p.pid, index);
+            }
+            Track& t = tracks[index];
+            while (t.firstFrame + t.usage.size() < fi) t.usage.append(kAbsent);
+            t.usage.append(usageCode(p.cpuUsage));
+            if (t.affinity.isEmpty() || t.affinity.last().second != p.affinity)
+                t.affinity.append(qMakePair(fi, p.affinity));
+        }
+    }
+    std::sort(tracks.begin(), tracks.end(), [](const Track& a, const Track& b) {
+        return a.pid != b.pid ? a.pid < b.pid : a.startTime < b.startTime;
+    });
+    putVarint(body, quint64(tracks.size()));
+    qint64 prevPid = 0;
+    for (const Track& t : tracks) {
+        putSigned(body, t.pid - prevPid);
+        prevPid = t.pid;
+        putVarint(body, t.startTime);
+        putString(body, t.name);
+        putVarint(body, quint64(t.firstFrame));
+        putVarint(body, quint64(t.usage.size()));
+        qint64 prev = 0;
+        for (qint64 code : t.usage) {
+            putSigned(body, code - prev);
+            prev = code;
+        }
+        putVarint(body, quint64(t.affinity.size()));
+        int prevFrame = t.firstFrame;
+        for (const auto& change : t.affinity) {
+            putVarint(body, quint64(change.first - prevFrame));
+            prevFrame = change.first;
+            putMask(body, change.second);
+        }
+    }
+    putSection(payload, SectionProcesses, body);
+
+    body.clear();
+    putVarint(body, quint64(events.size()));
+    for (const HistoryEvent& e : events) {
+        putVarint(body, quint64(e.ms - first));
+        putVarint(body, quint64(e.kind));
+        putSigned(body, e.pid);
+        putString(body, e.text);
+    }
+    putSection(payload, SectionEvents, body);
+
+    QByteArray block(kBlockHeaderSize, '\0');
+    std::memcpy(block.data(), kBlockMagic, sizeof(kBlockMagic));
+    putLE(block.data() + 4, quint64(payload.size()), 4);
+    putLE(block.data() + 8, quint64(first), 8);
+    putLE(block.data() + 16, quint64(last), 8);
+    putLE(block.data() + 24, quint64(frames.size()), 4);
+    putLE(block.data() + 28, quint64(events.size()), 4);
+    block.append(payload);
+    return block;
+}
+
+void readEvents(Cursor c, qint64 firstMs, qint64 fromMs, qint64 toMs, QVector<HistoryEvent>* out)
+{
+    const quint64 n = c.varint();
+    for (quint64 i = 0; c.ok && i < n; ++i) {
+        HistoryEvent e;
+        e.ms = firstMs + qint64(c.varint());
+        const quint64 kind = c.varint();
+        e.kind = kind <= HistoryEvent::Note ? HistoryEvent::Kind(kind) : HistoryEvent::Note;
+        e.pid = c.signedVarint();
+        e.text = c.string();
+        if (c.ok && e.ms >= fromMs && e.ms <= toMs) out->append(e);
+    }
+}
+
+QString timestampedName(const QDir& dir, qint64 ms)
+{
+    const QString stamp = QDateTime::fromMSecsSinceEpoch(ms).toUTC().toString(QStringLiteral("yyyyMMdd-HHmmss"));
+    QString name = QStringLiteral("history-%1.cpah").arg(stamp);
+    for (int n = 2; dir.exists(name); ++n)
+        name = QStringLiteral("history-%1-%2.cpah").arg(stamp).arg(n);
+    return name;
+}
+
+} // namespace
+
+QString historyEventKindKey(HistoryEvent::Kind k)
+{
+    switch (k) {
+    case HistoryEvent::Applied:    return QStringLiteral("applied");
+    case HistoryEvent::Rebalanced: return QStringLiteral("rebalanced");
+    case HistoryEvent::Note:       return QStringLiteral("note");
+    }
+    return QString();
+}
+
+QString historyEventKindLabel(HistoryEvent::Kind k)
+{
+    switch (k) {
+    case HistoryEvent::Applied:    return QStringLiteral("Applied");
+    case HistoryEvent::Rebalanced: return QStringLiteral("Rebalanced");
+    case HistoryEvent::Note:       return QStringLiteral("Note");
+    }
+    return QString();
+}
+
+HistoryFrame HistoryFrame::capture(const UsageSampler& sampler, AffinityBackend* backend)
+{
+    HistoryFrame f;
+    f.ms = sampler.sampledMs();
+    f.cpus = sampler.cpus();
+    f.processes.reserve(sampler.processes().size());
+    for (const UsageSampler::Process& s : sampler.processes()) {
+        Process p;
+        p.pid = s.entry.pid;
+        p.startTime = s.entry.startTime;
+        p.name = s.entry.name;
+        p.cpuUsage = s.cpuUsage;
+        BackendError err;
+        if (backend && !backend->processAffinity(p.pid, &p.affinity, &err))
+            p.affinity.clear();
+        f.processes.append(p);
+    }
+    std::sort(f.processes.begin(), f.processes.end(),
+              [](const Process& a, const Process& b) { return a.pid < b.pid; });
+    return f;
+}
+
+// ---------- HistoryWriter ----------
+
+HistoryWriter::HistoryWriter(const Options& opts)
+    : opts_(opts)
+{
+    opts_.maxFiles = qMax(1, opts_.maxFiles);
+    opts_.framesPerBlock = qMax(1, opts_.framesPerBlock);
+}
+
+HistoryWriter::~HistoryWriter()
+{
+    flush();
+}
+
+bool HistoryWriter::open(QString* error)
+{
+    if (!QDir().mkpath(opts_.directory)) {
+        if (error) *error = QStringLiteral("Cannot create %1").arg(opts_.directory);
+        return false;
+    }
+    return startFile(QDateTime::currentMSecsSinceEpoch(), error);
+}
+
+bool HistoryWriter::isOpen() const
+{
+    return file_ && file_->isOpen();
+}
+
+QString HistoryWriter::currentFile() const
+{
+    return file_ ? file_->fileName() : QString();
+}
+
+void HistoryWriter::append(const HistoryFrame& frame)
+{
+    frames_.append(frame);
+    if (frames_.size() >= opts_.framesPerBlock)
+        flush();
+}
+
+void HistoryWriter::addEvent(const HistoryEvent& event)
+{
+    events_.append(event);
+}
+
+bool HistoryWriter::flush(QString* error)
+{
+    if (!isOpen() || (frames_.isEmpty() && events_.isEmpty())) return true;
+
+    qint64 firstMs = 0, lastMs = 0;
+    const QByteArray block = encodeBlock(frames_, events_, &firstMs, &lastMs);
+    frames_.clear();
+    events_.clear();
+
+    if (file_->size() > qint64(sizeof(kFileMagic)) && file_->size() + block.size() > opts_.maxFileBytes) {
+        if (!startFile(firstMs, error)) return false;
+    }
+    if (file_->write(block) != block.size() || !file_->flush()) {
+        if (error) *error = file_->errorString();
+        return false;
+    }
+    return true;
+}
+
+bool HistoryWriter::startFile(qint64 ms, QString* error)
+{
+    const QDir dir(opts_.directory);
+    auto next = std::make_unique<QFile>(dir.filePath(timestampedName(dir, ms)));
+    if (!next->open(QIODevice::WriteOnly)
+        || next->write(kFileMagic, sizeof(kFileMagic)) != qint64(sizeof(kFileMagic))
+        || !next->flush()) {
+        if (error) *error = QStringLiteral("%1: %2").arg(next->fileName(), next->errorString());
+        return false;
+    }
+    file_ = std::move(next);
+    removeOldFiles();
+    return true;
+}
+
+void HistoryWriter::removeOldFiles()
+{
+    QDir dir(opts_.directory);
+    QStringList names = dir.entryList({QStringLiteral("history-*.cpah")}, QDir::Files, QDir::Name);
+    const QString current = QFileInfo(currentFile()).fileName();
+    names.removeAll(current);
+    while (names.size() > opts_.maxFiles - 1)
+        dir.remove(names.takeFirst());
+}
+
+// ---------- HistoryReader ----------
+
+HistoryReader::HistoryReader() = default;
+
+HistoryReader::~HistoryReader()
+{
+    close();
+}
+
+bool HistoryReader::open(const QString& path, QString* error)
+{
+    close();
+    const QFileInfo info(path);
+    QStringList candidates;
+    if (info.isDir()) {
+        const QDir dir(path);
+        for (const QString& name : dir.entryList({QStringLiteral("history-*.cpah")}, QDir::Files, QDir::Name))
+            candidates.append(dir.filePath(name));
+    } else {
+        candidates.append(path);
+    }
+
+    for (const QString& p : candidates) {
+        auto file = std::make_unique<QFile>(p);
+        if (!file->open(QIODevice::ReadOnly)) {
+            if (error) *error = QStringLiteral("%1: %2").arg(p, file->errorString());
+            close();
+            return false;
+        }
+        const qint64 size = file->size();
+        // A recorder may have just created the newest file of a directory.
+        if (info.isDir() && size < qint64(sizeof(kFileMagic))) continue;
+        const uchar* map = size > 0 ? file->map(0, size) : nullptr;
+        if (!map || size < qint64(sizeof(kFileMagic)) || std::memcmp(map, kFileMagic, sizeof(kFileMagic)) != 0) {
+            if (error) *error = QStringLiteral("%1 is not a history file").arg(p);
+            close();
+            return false;
+        }
+        qint64 at = sizeof(kFileMagic);
+        while (at + kBlockHeaderSize <= size) {
+            const uchar* h = map + at;
+            if (std::memcmp(h, kBlockMagic, sizeof(kBlockMagic)) != 0) break;
+            const quint32 payload = quint32(getLE(h + 4, 4));
+            if (at + kBlockHeaderSize + qint64(payload) > size) break;   // still being written
+            Block b{h + kBlockHeaderSize, payload, qint64(getLE(h + 8, 8)), qint64(getLE(h + 16, 8)),
+                    quint32(getLE(h + 24, 4)), quint32(getLE(h + 28, 4))};
+            blocks_.append(b);
+            if (b.frames) ++frameBlocks_;
+            at += kBlockHeaderSize + payload;
+        }
+        paths_.append(p);
+        files_.push_back(std::move(file));
+    }
+    std::stable_sort(blocks_.begin(), blocks_.end(),
+                     [](const Block& a, const Block& b) { return a.firstMs < b.firstMs; });
+    if (blocks_.isEmpty()) {
+        if (error) *error = QStringLiteral("No history recorded in %1").arg(path);
+        return false;
+    }
+    return true;
+}
+
+void HistoryReader::close()
+{
+    blocks_.clear();
+    files_.clear();   // unmaps
+    paths_.clear();
+    frameBlocks_ = 0;
+    cached_ = -1;
+    cachedFrames_.clear();
+}
+
+qint64 HistoryReader::firstMs() const
+{
+    return blocks_.isEmpty() ? 0 : blocks_.first().firstMs;
+}
+
+qint64 HistoryReader::lastMs() const
+{
+    qint64 last = 0;
+    for (const Block& b : blocks_) last = qMax(last, b.lastMs);
+    return last;
+}
+
+bool HistoryReader::frameAt(qint64 ms, HistoryFrame* out)
+{
+    if (isEmpty()) return false;
+    // The last block with frames that starts at or before ms.
+    int block = -1;
+    auto it = std::upper_bound(blocks_.cbegin(), blocks_.cend(), ms,
+                               [](qint64 t, const Block& b) { return t < b.firstMs; });
+    for (int i = int(it - blocks_.cbegin()) - 1; i >= 0; --i) {
+        if (blocks_[i].frames) {
+            block = i;
+            break;
+        }
+    }
+    for (int i = 0; block < 0 && i < blocks_.size(); ++i)
+        if (blocks_[i].frames) block = i;
+    if (block < 0 || !decode(block) || cachedFrames_.isEmpty()) return false;
+
+    auto f = std::upper_bound(cachedFrames_.cbegin(), cachedFrames_.cend(), ms,
+                              [](qint64 t, const HistoryFrame& fr) { return t < fr.ms; });
+    *out = f == cachedFrames_.cbegin() ? *f : *(f - 1);
+    return true;
+}
+
+QVector<HistoryEvent> HistoryReader::events(qint64 fromMs, qint64 toMs) const
+{
+    QVector<HistoryEvent> out;
+    for (const Block& b : blocks_) {
+        if (!b.events || b.lastMs < fromMs || b.firstMs > toMs) continue;
+        Cursor c{b.data, b.data + b.size};
+        quint8 tag = 0;
+        Cursor body{nullptr, nullptr};
+        while (!c.atEnd() && c.section(&tag, &body)) {
+            if (tag == SectionEvents) readEvents(body, b.firstMs, fromMs, toMs, &out);
+        }
+    }
+    std::stable_sort(out.begin(), out.end(),
+                     [](const HistoryEvent& a, const HistoryEvent& b) { return a.ms < b.ms; });
+    return out;
+}
+
+bool HistoryReader::decode(int index)
+{
+    if (cached_ == index) return true;
+    cached_ = -1;
+    cachedFrames_.clear();
+
+    const Block& b = blocks_[index];
+    // Every frame costs at least a byte of time delta; a larger count is a
+    // damaged header, not something to allocate.
+    if (b.frames > b.size) return false;
+    QVector<HistoryFrame> frames(int(b.frames));
+    Cursor c{b.data, b.data + b.size};
+    quint8 tag = 0;
+    Cursor s{nullptr, nullptr};
+    while (!c.atEnd() && c.section(&tag, &s)) {
+        switch (tag) {
+        case SectionTimes: {
+            qint64 ms = b.firstMs;
+            for (HistoryFrame& f : frames) {
+                ms += qint64(s.varint());
+                f.ms = ms;
+            }
+            break;
+        }
+        case SectionCpus: {
+            const int cpus = int(qMin<quint64>(s.varint(), 4096));
+            for (HistoryFrame& f : frames) f.cpus.resize(cpus);
+            for (int cpu = 0; cpu < cpus && s.ok; ++cpu) {
+                qint64 v = 0;
+                for (HistoryFrame& f : frames) {
+                    v += s.signedVarint();
+                    f.cpus[cpu] = float(v) / 1000.0f;
+                }
+            }
+            break;
+        }
+        case SectionProcesses: {
+            const quint64 n = s.varint();
+            qint64 pid = 0;
+            for (quint64 i = 0; i < n && s.ok; ++i) {
+                HistoryFrame::Process p;
+                pid += s.signedVarint();
+                p.pid = pid;
+                p.startTime = s.varint();
+                p.name = s.string();
+                const int first = int(s.varint());
+                const int span = int(s.varint());
+                QVector<qint64> usage(qMax(0, qMin(span, int(frames.size()))));
+                qint64 code = 0;
+                for (int k = 0; k < span && s.ok; ++k) {
+                    code += s.signedVarint();
+                    if (k < usage.size()) usage[k] = code;
+                }
+                QVector<QPair<int, CpuSet>> changes;
+                const quint64 nChanges = s.varint();
+                int frame = first;
+                for (quint64 k = 0; k < nChanges && s.ok; ++k) {
+                    frame += int(s.varint());
+                    changes.append(qMakePair(frame, s.mask()));
+                }
+                int change = -1;
+                for (int k = 0; k < usage.size(); ++k) {
+                    const int fi = first + k;
+                    if (fi < 0 || fi >= frames.size()) break;
+                    while (change + 1 < changes.size() && changes[change + 1].first <= fi) ++change;
+                    if (usage[k] == kAbsent) continue;
+                    p.cpuUsage = usageFromCode(usage[k]);
+                    p.affinity = change >= 0 ? changes[change].second : CpuSet();
+                    frames[fi].processes.append(p);
+                }
+            }
+            break;
+        }
+        default:
+            break;   // events are read by events(); unknown sections are skipped
+        }
+        if (!s.ok) return false;
+    }
+    if (!c.ok) return false;
+    cached_ = index;
+    cachedFrames_ = frames;
+    return true;
+}
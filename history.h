@@ -0,0 +1,136 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+#include "cpuset.h"
+
+class AffinityBackend;
+class QFile;
+class UsageSampler;
+
+// One sample of the machine: how busy each CPU was and, per process, how
+// much CPU it used and where it was allowed to run.
+struct HistoryFrame {
+    struct Process {
+        qint64  pid{0};
+        quint64 startTime{0};     // as ProcEntry::startTime
+        QString name;
+        float   cpuUsage{-1};     // cores, -1 = unknown
+        CpuSet  affinity;         // empty = unreadable
+    };
+
+    qint64 ms{0};                 // wall clock
+    QVector<float> cpus;          // busy share 0..1 per CPU
+    QVector<Process> processes;   // sorted by pid
+
+    // The sampler's latest sample, plus each process's affinity if a backend is given.
+    static HistoryFrame capture(const UsageSampler& sampler, AffinityBackend* backend);
+};
+
+// Something the recorder was told about between frames.
+struct HistoryEvent {
+    enum Kind { Applied, Rebalanced, Note };
+
+    qint64  ms{0};
+    Kind    kind{Note};
+    qint64  pid{0};
+    QString text;
+};
+
+QString historyEventKindKey(HistoryEvent::Kind k);
+QString historyEventKindLabel(HistoryEvent::Kind k);
+
+// Appends frames and events to history-<time>.cpah files in a directory,
+// starting a new file past maxFileBytes and deleting the oldest past
+// maxFiles. Frames are buffered and written framesPerBlock at a time as one
+// columnar block (see history.cpp), so a crash loses at most one block.
+class HistoryWriter
+{
+public:
+    struct Options {
+        QString directory;
+        qint64  maxFileBytes{64 << 20};
+        int     maxFiles{8};
+        int     framesPerBlock{60};
+    };
+
+    explicit HistoryWriter(const Options& opts);
+    ~HistoryWriter();   // flushes
+
+    HistoryWriter(const HistoryWriter&) = delete;
+    HistoryWriter& operator=(const HistoryWriter&) = delete;
+
+    bool open(QString* error=nullptr);
+    bool isOpen() const;
+    QString currentFile() const;
+
+    void append(const HistoryFrame& frame);
+    void addEvent(const HistoryEvent& event);
+    // Writes what is buffered as a block now.
+    bool flush(QString* error=nullptr);
+
+private:
+    bool startFile(qint64 ms, QString* error);
+    void removeOldFiles();
+
+    Options opts_;
+    std::unique_ptr<QFile> file_;
+    QVector<HistoryFrame> frames_;
+    QVector<HistoryEvent> events_;
+};
+
+// Reads history files through a memory map. Opening only walks the block
+// headers; frameAt() decodes the one block it needs, so scrubbing through
+// hours of history keeps a single block in memory.
+class HistoryReader
+{
+public:
+    HistoryReader();
+    ~HistoryReader();
+
+    HistoryReader(const HistoryReader&) = delete;
+    HistoryReader& operator=(const HistoryReader&) = delete;
+
+    // A .cpah file, or a directory of them. A truncated last block (the
+    // recorder is still writing, or crashed) is ignored.
+    bool open(const QString& path, QString* error=nullptr);
+    void close();
+
+    bool isEmpty() const { return frameBlocks_ == 0; }
+    qint64 firstMs() const;
+    qint64 lastMs() const;
+    int blockCount() const { return int(blocks_.size()); }
+    QStringList files() const { return paths_; }
+
+    // The last frame at or before `ms`, or the first frame if `ms` is earlier.
+    bool frameAt(qint64 ms, HistoryFrame* out);
+    // Events with fromMs <= ms <= toMs, oldest first.
+    QVector<HistoryEvent> events(qint64 fromMs, qint64 toMs) const;
+
+private:
+    struct Block {
+        const uchar* data;        // payload, inside one of maps_
+        quint32 size;
+        qint64  firstMs;
+        qint64  lastMs;
+        quint32 frames;
+        quint32 events;
+    };
+
+    bool decode(int block);
+
+    QStringList paths_;
+    std::vector<std::unique_ptr<QFile>> files_;
+    QVector<Block> blocks_;       // in time order
+    int frameBlocks_{0};
+
+    int cached_{-1};              // block held in cachedFrames_
+    QVector<HistoryFrame> cachedFrames_;
+};
+
+#endif // HISTORY_H
@@ -0,0 +1,222 @@
+#include "historydialog.h"
+
+#include <QDateTime>
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QSlider>
+#include <QSplitter>
+#include <QStandardItemModel>
+#include <QTableView>
+#include <QVBoxLayout>
+#include <algorithm>
+
+// Events this long before the shown moment are listed with it.
+static constexpr qint64 kEventWindowMs = 10 * 60 * 1000;
+
+static QString formatTime(qint64 ms)
+{
+    return QDateTime::fromMSecsSinceEpoch(ms).toString("yyyy-MM-dd HH:mm:ss");
+}
+
+// One bar per CPU, its busy share in the frame.
+class CpuBarsView : public QWidget
+{
+public:
+    explicit CpuBarsView(QWidget* parent=nullptr) : QWidget(parent) { setMinimumHeight(90); }
+
+    void set(const QVector<float>& cpus)
+    {
+        cpus_ = cpus;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        QPainter p(this);
+        p.fillRect(rect(), palette().base());
+        p.setPen(palette().mid().color());
+        p.drawRect(rect().adjusted(0, 0, -1, -1));
+        if (cpus_.isEmpty()) {
+            p.setPen(palette().text().color());
+            p.drawText(rect(), Qt::AlignCenter, QStringLiteral("No CPU samples"));
+            return;
+        }
+        const int labelH = p.fontMetrics().height();
+        const QRect chart = rect().adjusted(4, 4, -4, -(labelH + 4));
+        const double w = double(chart.width()) / cpus_.size();
+        for (int i = 0; i < cpus_.size(); ++i) {
+            const double share = qBound(0.0, double(cpus_[i]), 1.0);
+            const double h = share * chart.height();
+            const QRectF bar(chart.left() + i * w, chart.bottom() - h, qMax(1.0, w - 1), h);
+            // Green to red as the CPU fills up.
+            p.fillRect(bar, QColor::fromHsvF(float((1.0 - share) / 3.0), 0.7f, 0.85f));
+            if (w >= p.fontMetrics().horizontalAdvance(QStringLiteral("000"))) {
+                p.setPen(palette().text().color());
+                p.drawText(QRectF(chart.left() + i * w, chart.bottom() + 2, w, labelH), Qt::AlignCenter,
+                           QString::number(i));
+            }
+        }
+    }
+
+private:
+    QVector<float> cpus_;
+};
+
+HistoryDialog::HistoryDialog(const QString& path, QWidget* parent)
+    : QDialog(parent)
+{
+    setWindowTitle("History");
+    resize(900, 650);
+
+    source_ = new QLabel(this);
+    source_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    auto* openButton = new QPushButton("Open...", this);
+    connect(openButton, &QPushButton::clicked, this, &HistoryDialog::onOpen);
+
+    time_ = new QLabel(this);
+    slider_ = new QSlider(Qt::Horizontal, this);
+    slider_->setEnabled(false);
+    slider_->setSingleStep(1);
+    slider_->setPageStep(60);
+    connect(slider_, &QSlider::valueChanged, this, [this](int secs) {
+        showAt(reader_.firstMs() + qint64(secs) * 1000);
+    });
+
+    cpus_ = new CpuBarsView(this);
+
+    model_ = new QStandardItemModel(0, ColumnCount, this);
+    model_->setHorizontalHeaderLabels({"PID", "Process", "CPU %", "Affinity"});
+    table_ = new QTableView(this);
+    table_->setModel(model_);
+    table_->setSelectionMode(QAbstractItemView::NoSelection);
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->setWordWrap(false);
+    table_->verticalHeader()->hide();
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 4);
+    table_->horizontalHeader()->setStretchLastSection(true);
+    table_->setColumnWidth(ColName, 220);
+
+    eventModel_ = new QStandardItemModel(0, EventColumnCount, this);
+    eventModel_->setHorizontalHeaderLabels({"Time", "Event", "PID", "Details"});
+    eventTable_ = new QTableView(this);
+    eventTable_->setModel(eventModel_);
+    eventTable_->setSelectionBehavior(QAbstractItemView::SelectRows);
+    eventTable_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    eventTable_->setWordWrap(false);
+    eventTable_->verticalHeader()->hide();
+    eventTable_->horizontalHeader()->setStretchLastSection(true);
+    eventTable_->horizontalHeader()->setSectionResizeMode(EvTime, QHeaderView::ResizeToContents);
+    eventTable_->setToolTip("Applies and rebalancer decisions in the ten minutes up to the shown time; double-click to jump");
+    connect(eventTable_, &QTableView::doubleClicked, this, [this](const QModelIndex& index) {
+        const qint64 ms = eventModel_->item(index.row(), EvTime)->data(Qt::UserRole).toLongLong();
+        slider_->setValue(int((ms - reader_.firstMs()) / 1000));
+    });
+
+    auto* splitter = new QSplitter(Qt::Vertical, this);
+    splitter->addWidget(table_);
+    splitter->addWidget(eventTable_);
+    splitter->setStretchFactor(0, 3);
+    splitter->setStretchFactor(1, 1);
+
+    auto* close = new QPushButton("Close", this);
+    connect(close, &QPushButton::clicked, this, &QDialog::accept);
+
+    auto* top = new QHBoxLayout;
+    top->addWidget(source_, 1);
+    top->addWidget(openButton);
+    auto* scrub = new QHBoxLayout;
+    scrub->addWidget(slider_, 1);
+    scrub->addWidget(time_);
+    auto* bottom = new QHBoxLayout;
+    bottom->addStretch();
+    bottom->addWidget(close);
+
+    auto* v = new QVBoxLayout(this);
+    v->addLayout(top);
+    v->addLayout(scrub);
+    v->addWidget(cpus_);
+    v->addWidget(splitter, 1);
+    v->addLayout(bottom);
+
+    if (!path.isEmpty()) open(path);
+    else source_->setText("Open a history directory recorded with --record.");
+}
+
+void HistoryDialog::onOpen()
+{
+    const QString dir = QFileDialog::getExistingDirectory(this, "Open history", path_);
+    if (!dir.isEmpty()) open(dir);
+}
+
+void HistoryDialog::open(const QString& path)
+{
+    path_ = path;
+    QString error;
+    if (!reader_.open(path, &error) || reader_.isEmpty()) {
+        source_->setText(error.isEmpty() ? QString("%1 holds no samples.").arg(path) : error);
+        slider_->setEnabled(false);
+        cpus_->set({});
+        model_->setRowCount(0);
+        eventModel_->setRowCount(0);
+        time_->clear();
+        return;
+    }
+    source_->setText(QString("%1: %2 file(s), %3 to %4")
+                         .arg(path).arg(reader_.files().size())
+                         .arg(formatTime(reader_.firstMs()), formatTime(reader_.lastMs())));
+    // One slider step per second; ints cover 68 years of it.
+    slider_->setRange(0, int((reader_.lastMs() - reader_.firstMs()) / 1000));
+    slider_->setEnabled(true);
+    if (slider_->value() == slider_->maximum()) showAt(reader_.lastMs());
+    else slider_->setValue(slider_->maximum());
+}
+
+void HistoryDialog::showAt(qint64 ms)
+{
+    HistoryFrame frame;
+    if (!reader_.frameAt(ms, &frame)) return;
+    const bool gap = ms - frame.ms > 60 * 1000;
+    time_->setText(gap ? QString("%1 (last sample %2)").arg(formatTime(ms), formatTime(frame.ms))
+                       : formatTime(frame.ms));
+    cpus_->set(frame.cpus);
+
+    // Busiest first; rows are updated in place.
+    std::sort(frame.processes.begin(), frame.processes.end(),
+              [](const HistoryFrame::Process& a, const HistoryFrame::Process& b) {
+                  return a.cpuUsage != b.cpuUsage ? a.cpuUsage > b.cpuUsage : a.pid < b.pid;
+              });
+    auto setCell = [](QStandardItemModel* model, int row, int col, const QString& text, bool right) {
+        if (QStandardItem* item = model->item(row, col)) {
+            if (item->text() != text) item->setText(text);
+        } else {
+            auto* created = new QStandardItem(text);
+            if (right) created->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            model->setItem(row, col, created);
+        }
+    };
+    model_->setRowCount(int(frame.processes.size()));
+    for (int row = 0; row < frame.processes.size(); ++row) {
+        const HistoryFrame::Process& p = frame.processes[row];
+        setCell(model_, row, ColPid, QString::number(p.pid), true);
+        setCell(model_, row, ColName, p.name, false);
+        setCell(model_, row, ColCpu, p.cpuUsage < 0 ? QString() : QString::number(p.cpuUsage * 100.0, 'f', 1), true);
+        setCell(model_, row, ColAffinity, p.affinity.toRangeList(), false);
+    }
+
+    const QVector<HistoryEvent> events = reader_.events(frame.ms - kEventWindowMs, ms);
+    eventModel_->setRowCount(int(events.size()));
+    for (int row = 0; row < events.size(); ++row) {
+        const HistoryEvent& e = events[events.size() - 1 - row];   // newest first
+        setCell(eventModel_, row, EvTime, formatTime(e.ms), false);
+        eventModel_->item(row, EvTime)->setData(e.ms, Qt::UserRole);
+        setCell(eventModel_, row, EvKind, historyEventKindLabel(e.kind), false);
+        setCell(eventModel_, row, EvPid, e.pid ? QString::number(e.pid) : QString(), true);
+        setCell(eventModel_, row, EvText, e.text, false);
+    }
+}
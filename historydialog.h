@@ -0,0 +1,46 @@
+#ifndef HISTORYDIALOG_H
+#define HISTORYDIALOG_H
+
+#include <QDialog>
+
+#include "history.h"
+
+class CpuBarsView;
+class QLabel;
+class QSlider;
+class QStandardItemModel;
+class QTableView;
+
+// Replays recorded history: drag through time to see how busy every CPU was,
+// which processes used it and where they were pinned, next to the applies
+// and rebalancer decisions around that moment. Files are memory-mapped and
+// only the block under the slider is decoded.
+class HistoryDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    enum Column { ColPid, ColName, ColCpu, ColAffinity, ColumnCount };
+    enum EventColumn { EvTime, EvKind, EvPid, EvText, EventColumnCount };
+
+    // `path` is a history directory or file; empty asks for one.
+    explicit HistoryDialog(const QString& path, QWidget* parent=nullptr);
+
+private:
+    void open(const QString& path);
+    void onOpen();
+    void showAt(qint64 ms);
+
+    HistoryReader reader_;
+    QString path_;
+
+    QLabel* source_{};
+    QLabel* time_{};
+    QSlider* slider_{};
+    CpuBarsView* cpus_{};
+    QTableView* table_{};
+    QStandardItemModel* model_{};
+    QTableView* eventTable_{};
+    QStandardItemModel* eventModel_{};
+};
+
+#endif // HISTORYDIALOG_H
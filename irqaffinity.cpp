@@ -0,0 +1,217 @@
+#include "irqaffinity.h"
+#include "affinitybackend.h"
+
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+qint64 IrqInfo::total() const
+{
+    qint64 sum = 0;
+    for (qint64 c : counts) sum += c;
+    return sum;
+}
+
+QHash<QString, QVector<double>> irqRates(const QVector<IrqInfo>& before,
+                                         const QVector<IrqInfo>& after, double seconds)
+{
+    QHash<QString, const IrqInfo*> earlier;
+    for (const IrqInfo& i : before) earlier.insert(i.name, &i);
+
+    QHash<QString, QVector<double>> rates;
+    if (seconds <= 0) return rates;
+    for (const IrqInfo& i : after) {
+        const IrqInfo* b = earlier.value(i.name);
+        if (!b) continue;
+        QVector<double> r(i.counts.size(), 0.0);
+        for (int cpu = 0; cpu < i.counts.size() && cpu < b->counts.size(); ++cpu)
+            r[cpu] = double(qMax<qint64>(0, i.counts[cpu] - b->counts[cpu])) / seconds;
+        rates.insert(i.name, r);
+    }
+    return rates;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+CpuSet readCpuList(const QString& path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly))
+        return CpuSet();
+    return CpuSet::fromRangeList(QString::fromLatin1(f.readAll().trimmed()));
+}
+
+} // namespace
+
+QVector<IrqInfo> readInterrupts()
+{
+    QVector<IrqInfo> out;
+    QFile f(QStringLiteral("/proc/interrupts"));
+    if (!f.open(QIODevice::ReadOnly))
+        return out;
+
+    // "           CPU0       CPU2" -- offline CPUs have no column.
+    QVector<int> cpus;
+    for (const QByteArray& col : f.readLine().simplified().split(' ')) {
+        if (col.startsWith("CPU")) cpus.append(col.mid(3).toInt());
+    }
+    const int width = cpus.isEmpty() ? 0 : *std::max_element(cpus.cbegin(), cpus.cend()) + 1;
+
+    while (!f.atEnd()) {
+        const QByteArray line = f.readLine();
+        const int colon = line.indexOf(':');
+        if (colon <= 0) continue;
+        IrqInfo irq;
+        irq.name = QString::fromLatin1(line.left(colon).trimmed());
+        bool numeric = false;
+        const int number = irq.name.toInt(&numeric);
+        irq.number = numeric ? number : -1;
+        irq.counts.fill(0, width);
+
+        // Counts, one per CPU column; some named rows (ERR, MIS) have only one.
+        int pos = colon + 1;
+        for (int col = 0; col < cpus.size(); ++col) {
+            while (pos < line.size() && line[pos] == ' ') ++pos;
+            const int start = pos;
+            while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9') ++pos;
+            if (pos == start) break;
+            irq.counts[cpus[col]] = line.mid(start, pos - start).toLongLong();
+        }
+
+        // "  IR-PCI-MSI 524288-edge      nvme0q1": the action names follow the
+        // last run of padding.
+        const QString rest = QString::fromLatin1(line.mid(pos)).trimmed();
+        const int gap = rest.lastIndexOf(QStringLiteral("  "));
+        if (!irq.steerable()) {
+            irq.devices = rest;
+        } else if (gap < 0) {
+            irq.chip = rest;
+        } else {
+            irq.chip = rest.left(gap).simplified();
+            irq.devices = rest.mid(gap).trimmed();
+        }
+        if (irq.steerable()) {
+            const QString dir = QStringLiteral("/proc/irq/%1/").arg(irq.number);
+            irq.affinity = readCpuList(dir + "smp_affinity_list");
+            irq.effective = readCpuList(dir + "effective_affinity_list");
+        }
+        out.append(irq);
+    }
+    return out;
+}
+
+bool setIrqAffinity(int irq, const CpuSet& cpus, BackendError* err)
+{
+    if (cpus.isEmpty())
+        return fail(err, EINVAL, QStringLiteral("IRQ %1: empty CPU set").arg(irq));
+    const QString path = QStringLiteral("/proc/irq/%1/smp_affinity_list").arg(irq);
+    const int fd = ::open(QFile::encodeName(path).constData(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("%1: %2").arg(path, qt_error_string(e)));
+    }
+    const QByteArray data = cpus.toRangeList().toLatin1();
+    const bool ok = ::write(fd, data.constData(), size_t(data.size())) == data.size();
+    const int code = errno;
+    ::close(fd);
+    if (!ok) {
+        return fail(err, code, code == EIO ? QStringLiteral("IRQ %1 is managed by the kernel and cannot be moved").arg(irq)
+                                           : QStringLiteral("%1: %2").arg(path, qt_error_string(code)));
+    }
+    return true;
+}
+
+qint64 irqBalancerPid()
+{
+    const QStringList entries = QDir(QStringLiteral("/proc")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& e : entries) {
+        bool ok = false;
+        const qint64 pid = e.toLongLong(&ok);
+        if (!ok) continue;
+        QFile comm(QStringLiteral("/proc/%1/comm").arg(pid));
+        if (comm.open(QIODevice::ReadOnly) && comm.readAll().trimmed() == "irqbalance")
+            return pid;
+    }
+    return 0;
+}
+
+#else
+
+QVector<IrqInfo> readInterrupts()
+{
+    return QVector<IrqInfo>();
+}
+
+bool setIrqAffinity(int, const CpuSet&, BackendError* err)
+{
+    return fail(err, -1, QStringLiteral("IRQ affinity is only supported on Linux"));
+}
+
+qint64 irqBalancerPid()
+{
+    return 0;
+}
+
+#endif
+
+IrqSteering::Result IrqSteering::steer(const CpuSet& claimed, const CpuSet& online)
+{
+    Result r;
+    const CpuSet free = online - claimed;
+    if (free.isEmpty())
+        return r;
+    const QVector<IrqInfo> irqs = readInterrupts();
+    r.overridden = overridden(irqs);
+    for (const IrqInfo& irq : irqs) {
+        if (!irq.steerable() || irq.affinity.isEmpty() || !irq.affinity.intersects(claimed))
+            continue;
+
+        CpuSet target = irq.affinity - claimed;
+        if (target.isEmpty()) target = free;
+        if (!setIrqAffinity(irq.number, target)) {
+            r.failed.append(irq.number);
+            continue;
+        }
+        if (!original_.contains(irq.number))
+            original_.insert(irq.number, irq.affinity);
+        written_.insert(irq.number, target);
+        r.moved.append(irq.number);
+    }
+    return r;
+}
+
+QVector<int> IrqSteering::overridden(const QVector<IrqInfo>& irqs) const
+{
+    QVector<int> out;
+    for (const IrqInfo& irq : irqs) {
+        const auto mine = written_.constFind(irq.number);
+        if (mine != written_.cend() && *mine != irq.affinity)
+            out.append(irq.number);
+    }
+    return out;
+}
+
+void IrqSteering::restore()
+{
+    for (auto it = original_.cbegin(); it != original_.cend(); ++it)
+        setIrqAffinity(it.key(), it.value());
+    original_.clear();
+    written_.clear();
+}
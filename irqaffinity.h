@@ -0,0 +1,71 @@
+#ifndef IRQAFFINITY_H
+#define IRQAFFINITY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+#include "cpuset.h"
+
+struct BackendError;
+
+// One row of /proc/interrupts plus the IRQ's affinity files. Rows such as
+// NMI or LOC are per-CPU architectural interrupts and cannot be steered.
+struct IrqInfo {
+    QString name;                 // "24", "NMI", ...
+    int     number{-1};           // -1 for the named rows
+    QString chip;                 // controller and trigger, e.g. "IR-PCI-MSI 524288-edge"
+    QString devices;              // action names, e.g. "nvme0q1" or "i915, snd_hda_intel"
+    QVector<qint64> counts;       // index = CPU id
+    CpuSet  affinity;             // smp_affinity_list
+    CpuSet  effective;            // effective_affinity_list, where it really lands
+
+    bool steerable() const { return number >= 0; }
+    qint64 total() const;
+};
+
+// Parses /proc/interrupts; affinity is read for numbered IRQs. Empty off Linux.
+QVector<IrqInfo> readInterrupts();
+
+// Interrupts per second on each CPU between two readings, keyed by name.
+// IRQs missing from `before` are left out.
+QHash<QString, QVector<double>> irqRates(const QVector<IrqInfo>& before,
+                                         const QVector<IrqInfo>& after, double seconds);
+
+// Writes /proc/irq/<irq>/smp_affinity_list. Managed IRQs (most NVMe queues)
+// refuse with EIO; the kernel spreads those itself.
+bool setIrqAffinity(int irq, const CpuSet& cpus, BackendError* err=nullptr);
+
+// PID of a running IRQ balancer (irqbalance), or 0.
+qint64 irqBalancerPid();
+
+// Keeps IRQs off CPUs that affinity configs claimed. Remembers what it wrote,
+// so a later check() can tell when someone else (usually irqbalance) moved an
+// IRQ back.
+class IrqSteering
+{
+public:
+    struct Result {
+        QVector<int> moved;
+        QVector<int> failed;          // refused by the kernel, e.g. managed IRQs
+        QVector<int> overridden;      // changed behind our back since the last call
+    };
+
+    // Moves every steerable IRQ whose affinity overlaps `claimed` onto the
+    // remaining CPUs of its mask, or onto all unclaimed online CPUs. Nothing
+    // happens when `claimed` covers every online CPU.
+    Result steer(const CpuSet& claimed, const CpuSet& online);
+
+    // IRQs in `irqs` whose mask no longer is what steer() wrote.
+    QVector<int> overridden(const QVector<IrqInfo>& irqs) const;
+
+    // Puts back the masks IRQs had before steer() touched them.
+    void restore();
+    bool isActive() const { return !written_.isEmpty(); }
+
+private:
+    QHash<int, CpuSet> written_;      // what we set
+    QHash<int, CpuSet> original_;     // what it was before
+};
+
+#endif // IRQAFFINITY_H
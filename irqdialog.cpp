@@ -0,0 +1,220 @@
+#include "irqdialog.h"
+#include "affinitybackend.h"
+
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <QLabel>
+#include <QLineEdit>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QStandardItemModel>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
+
+IrqDialog::IrqDialog(const CpuSet& claimed, const CpuSet& online, QWidget* parent)
+    : QDialog(parent)
+    , claimed_(claimed)
+    , online_(online)
+{
+    setWindowTitle("Interrupts");
+    resize(900, 500);
+
+    model_ = new QStandardItemModel(this);
+    table_ = new QTableView(this);
+    table_->setModel(model_);
+    table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->setWordWrap(false);
+    table_->verticalHeader()->hide();
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 4);
+    table_->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+
+    filterEdit_ = new QLineEdit(this);
+    filterEdit_->setPlaceholderText("Filter by IRQ or device, e.g. nvme or eth0");
+    connect(filterEdit_, &QLineEdit::textChanged, this, &IrqDialog::applyFilter);
+    cpusEdit_ = new QLineEdit(this);
+    cpusEdit_->setPlaceholderText("CPUs, e.g. 0-1");
+    auto* setSelected = new QPushButton("Set selected", this);
+    auto* setMatching = new QPushButton("Set matching", this);
+    setMatching->setToolTip("Every IRQ the filter shows, e.g. all queues of one device");
+    connect(setSelected, &QPushButton::clicked, this, &IrqDialog::onSetSelected);
+    connect(setMatching, &QPushButton::clicked, this, &IrqDialog::onSetMatching);
+
+    auto* editRow = new QHBoxLayout;
+    editRow->addWidget(filterEdit_, 2);
+    editRow->addWidget(cpusEdit_, 1);
+    editRow->addWidget(setSelected);
+    editRow->addWidget(setMatching);
+
+    auto* steer = new QPushButton(claimed_.isEmpty() ? QString("Keep off pinned CPUs")
+                                                     : QString("Keep off CPUs %1").arg(claimed_.toRangeList()), this);
+    steer->setToolTip("Move every IRQ that may fire on the current config's CPUs onto the other CPUs");
+    steer->setEnabled(!claimed_.isEmpty() && !(online_ - claimed_).isEmpty());
+    connect(steer, &QPushButton::clicked, this, &IrqDialog::onSteer);
+    auto* close = new QPushButton("Close", this);
+    connect(close, &QPushButton::clicked, this, &QDialog::accept);
+
+    status_ = new QLabel(this);
+    warning_ = new QLabel(this);
+    warning_->setWordWrap(true);
+    warning_->setStyleSheet("color: #b45309;");
+
+    auto* bottom = new QHBoxLayout;
+    bottom->addWidget(steer);
+    bottom->addWidget(status_, 1);
+    bottom->addWidget(close);
+
+    auto* v = new QVBoxLayout(this);
+    v->addWidget(table_, 1);
+    v->addLayout(editRow);
+    v->addWidget(warning_);
+    v->addLayout(bottom);
+
+    balancerPid_ = irqBalancerPid();
+    refresh();
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(1000);
+    connect(refreshTimer_, &QTimer::timeout, this, &IrqDialog::refresh);
+    refreshTimer_->start();
+}
+
+void IrqDialog::refresh()
+{
+    const QVector<IrqInfo> now = readInterrupts();
+    const double seconds = sinceLast_.isValid() ? double(sinceLast_.nsecsElapsed()) / 1e9 : 0.0;
+    const QHash<QString, QVector<double>> rates = irqRates(irqs_, now, seconds);
+    sinceLast_.restart();
+
+    const int cpuColumns = now.isEmpty() ? 0 : int(now.first().counts.size());
+    if (model_->columnCount() != ColFirstCpu + cpuColumns) {
+        QStringList headers{"IRQ", "Devices", "Controller", "Per s", "Affinity", "Effective"};
+        for (int cpu = 0; cpu < cpuColumns; ++cpu)
+            headers << QString("CPU%1").arg(cpu);
+        model_->setColumnCount(ColFirstCpu + cpuColumns);
+        model_->setHorizontalHeaderLabels(headers);
+    }
+
+    // Rows follow /proc/interrupts and are updated in place.
+    model_->setRowCount(int(now.size()));
+    auto setCell = [this](int row, int col, const QString& text) {
+        if (QStandardItem* item = model_->item(row, col)) {
+            if (item->text() != text) item->setText(text);
+        } else {
+            auto* created = new QStandardItem(text);
+            if (col == ColRate || col >= ColFirstCpu)
+                created->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            model_->setItem(row, col, created);
+        }
+    };
+    for (int row = 0; row < now.size(); ++row) {
+        const IrqInfo& irq = now[row];
+        const QVector<double> r = rates.value(irq.name);
+        double total = 0;
+        for (double v : r) total += v;
+        setCell(row, ColIrq, irq.name);
+        model_->item(row, ColIrq)->setData(irq.number, Qt::UserRole);
+        setCell(row, ColDevices, irq.devices);
+        setCell(row, ColChip, irq.chip);
+        setCell(row, ColRate, r.isEmpty() ? QString() : QString::number(total, 'f', 0));
+        setCell(row, ColAffinity, irq.affinity.toRangeList());
+        setCell(row, ColEffective, irq.effective.toRangeList());
+        for (int cpu = 0; cpu < cpuColumns; ++cpu)
+            setCell(row, ColFirstCpu + cpu, r.isEmpty() ? QString::number(irq.counts.value(cpu))
+                                                        : QString::number(r.value(cpu), 'f', 0));
+    }
+    irqs_ = now;
+    applyFilter();
+    updateWarning();
+}
+
+void IrqDialog::applyFilter()
+{
+    const QString filter = filterEdit_->text().trimmed();
+    for (int row = 0; row < irqs_.size(); ++row) {
+        const IrqInfo& irq = irqs_[row];
+        const bool match = filter.isEmpty() || irq.name == filter
+                           || irq.devices.contains(filter, Qt::CaseInsensitive);
+        table_->setRowHidden(row, !match);
+    }
+}
+
+bool IrqDialog::setAffinity(const QVector<int>& irqs)
+{
+    bool ok = false;
+    const CpuSet cpus = CpuSet::fromRangeList(cpusEdit_->text(), &ok);
+    if (!ok || cpus.isEmpty()) {
+        QMessageBox::warning(this, "Invalid CPU set", "Enter CPUs as a range list, e.g. 0-1.");
+        return false;
+    }
+    if (irqs.isEmpty()) {
+        QMessageBox::information(this, "No IRQs", "Numbered IRQs only; NMI, LOC and the like cannot be moved.");
+        return false;
+    }
+    QStringList refused;
+    for (int irq : irqs) {
+        BackendError err;
+        if (!setIrqAffinity(irq, cpus, &err))
+            refused << QString("%1 (%2)").arg(irq).arg(err.message);
+    }
+    status_->setText(QString("%1 IRQ(s) set to CPUs %2").arg(irqs.size() - refused.size()).arg(cpus.toRangeList()));
+    if (!refused.isEmpty())
+        QMessageBox::warning(this, "Some IRQs refused", refused.join('\n'));
+    refresh();
+    return refused.isEmpty();
+}
+
+void IrqDialog::onSetSelected()
+{
+    QVector<int> irqs;
+    for (const QModelIndex& idx : table_->selectionModel()->selectedRows())
+        if (idx.row() < irqs_.size() && irqs_[idx.row()].steerable())
+            irqs.append(irqs_[idx.row()].number);
+    setAffinity(irqs);
+}
+
+void IrqDialog::onSetMatching()
+{
+    if (filterEdit_->text().trimmed().isEmpty()) {
+        QMessageBox::information(this, "No filter", "Type a device name first, e.g. nvme0.");
+        return;
+    }
+    QVector<int> irqs;
+    for (int row = 0; row < irqs_.size(); ++row)
+        if (!table_->isRowHidden(row) && irqs_[row].steerable())
+            irqs.append(irqs_[row].number);
+    setAffinity(irqs);
+}
+
+void IrqDialog::onSteer()
+{
+    const IrqSteering::Result r = steering_.steer(claimed_, online_);
+    QString text = QString("Moved %1 IRQ(s) off CPUs %2").arg(r.moved.size()).arg(claimed_.toRangeList());
+    if (!r.failed.isEmpty())
+        text += QString(", %1 managed by the kernel").arg(r.failed.size());
+    status_->setText(text);
+    balancerPid_ = irqBalancerPid();
+    refresh();
+}
+
+void IrqDialog::updateWarning()
+{
+    const QVector<int> overridden = steering_.overridden(irqs_);
+    QString text;
+    if (!overridden.isEmpty()) {
+        QStringList ids;
+        for (int irq : overridden) ids << QString::number(irq);
+        text = QString("IRQ(s) %1 were moved back by %2. Ban CPUs %3 in its configuration "
+                       "(IRQBALANCE_BANNED_CPULIST) or stop it.")
+                   .arg(ids.join(", "),
+                        balancerPid_ ? QString("irqbalance (PID %1)").arg(balancerPid_) : QString("another program"),
+                        claimed_.toRangeList());
+    } else if (balancerPid_) {
+        text = QString("irqbalance (PID %1) is running and may move IRQs again within seconds.").arg(balancerPid_);
+    }
+    warning_->setText(text);
+    warning_->setVisible(!text.isEmpty());
+}
@@ -0,0 +1,53 @@
+#ifndef IRQDIALOG_H
+#define IRQDIALOG_H
+
+#include <QDialog>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "irqaffinity.h"
+
+class QLabel;
+class QLineEdit;
+class QStandardItemModel;
+class QTableView;
+class QTimer;
+
+// /proc/interrupts with per-CPU rates, and the IRQ affinity editor: set the
+// mask of the selected IRQs or of every IRQ of a device, or move them all off
+// the CPUs of the current config.
+class IrqDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    enum Column { ColIrq, ColDevices, ColChip, ColRate, ColAffinity, ColEffective, ColFirstCpu };
+
+    // `claimed` are the CPUs the current config pins its process to.
+    IrqDialog(const CpuSet& claimed, const CpuSet& online, QWidget* parent=nullptr);
+
+private:
+    void refresh();
+    void applyFilter();
+    void onSetSelected();
+    void onSetMatching();
+    void onSteer();
+    bool setAffinity(const QVector<int>& irqs);
+    void updateWarning();
+
+    CpuSet claimed_;
+    CpuSet online_;
+    QVector<IrqInfo> irqs_;
+    QElapsedTimer sinceLast_;
+    IrqSteering steering_;
+    qint64 balancerPid_{0};
+
+    QTableView* table_{};
+    QStandardItemModel* model_{};
+    QLineEdit* filterEdit_{};
+    QLineEdit* cpusEdit_{};
+    QLabel* status_{};
+    QLabel* warning_{};
+    QTimer* refreshTimer_{};
+};
+
+#endif // IRQDIALOG_H
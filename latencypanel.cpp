@@ -0,0 +1,293 @@
+#include "latencypanel.h"
+
+#include <QComboBox>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QStandardItemModel>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <algorithm>
+
+static QString formatNs(qint64 ns)
+{
+    if (ns < 1000) return QStringLiteral("%1 ns").arg(ns);
+    if (ns < 1000000) return QStringLiteral("%1 µs").arg(double(ns) / 1e3, 0, 'f', 1);
+    if (ns < 1000000000) return QStringLiteral("%1 ms").arg(double(ns) / 1e6, 0, 'f', 2);
+    return QStringLiteral("%1 s").arg(double(ns) / 1e9, 0, 'f', 2);
+}
+
+static QString percentiles(const LatencyHistogram& h)
+{
+    if (h.count() == 0) return QStringLiteral("no samples");
+    return QStringLiteral("p50 %1, p99 %2, p999 %3, max %4 (n=%5)")
+        .arg(formatNs(h.percentileNs(0.50)), formatNs(h.percentileNs(0.99)),
+             formatNs(h.percentileNs(0.999)), formatNs(h.maxNs()))
+        .arg(h.count());
+}
+
+// Bars on a log-scale time axis, as a share of all samples so a baseline with
+// more samples compares fairly. The baseline is drawn as an outline.
+class HistogramView : public QWidget
+{
+public:
+    explicit HistogramView(QWidget* parent=nullptr) : QWidget(parent) { setMinimumHeight(120); }
+
+    void set(const LatencyHistogram& current, const LatencyHistogram& baseline)
+    {
+        current_ = current;
+        baseline_ = baseline;
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        QPainter p(this);
+        p.fillRect(rect(), palette().base());
+        p.setPen(palette().mid().color());
+        p.drawRect(rect().adjusted(0, 0, -1, -1));
+
+        const int labelH = p.fontMetrics().height() + 2;
+        const QRect chart = rect().adjusted(6, 6, -6, -(labelH + 4));
+        int first = LatencyHistogram::kBuckets, last = -1;
+        double peak = 0;
+        for (const LatencyHistogram* h : {&current_, &baseline_}) {
+            if (h->count() == 0) continue;
+            for (int i = 0; i < LatencyHistogram::kBuckets; ++i) {
+                if (!h->bucket(i)) continue;
+                first = qMin(first, i);
+                last = qMax(last, i);
+                peak = qMax(peak, double(h->bucket(i)) / double(h->count()));
+            }
+        }
+        if (last < 0) {
+            p.setPen(palette().text().color());
+            p.drawText(chart, Qt::AlignCenter, QStringLiteral("No samples yet"));
+            return;
+        }
+        // Whole octaves on either side, so the axis starts and ends on a power of two.
+        first -= first % LatencyHistogram::kSub;
+        last += LatencyHistogram::kSub - 1 - last % LatencyHistogram::kSub;
+        const int n = last - first + 1;
+        const double w = double(chart.width()) / n;
+        auto barRect = [&](int i, double share) {
+            const double h = share / peak * chart.height();
+            return QRectF(chart.left() + (i - first) * w, chart.bottom() - h, qMax(1.0, w - 1), h);
+        };
+
+        for (int i = first; i <= last; ++i) {
+            if (current_.count() && current_.bucket(i))
+                p.fillRect(barRect(i, double(current_.bucket(i)) / double(current_.count())), palette().highlight());
+        }
+        p.setPen(QPen(palette().text().color(), 1));
+        for (int i = first; i <= last; ++i) {
+            if (baseline_.count() && baseline_.bucket(i))
+                p.drawRect(barRect(i, double(baseline_.bucket(i)) / double(baseline_.count())));
+        }
+
+        // Percentiles of the current samples.
+        if (current_.count()) {
+            const QColor marks[] = {QColor(39, 174, 96), QColor(230, 126, 34), QColor(192, 57, 43)};
+            const double qs[] = {0.50, 0.99, 0.999};
+            const char* names[] = {"p50", "p99", "p999"};
+            for (int k = 0; k < 3; ++k) {
+                const int b = LatencyHistogram::bucketOf(qMax<qint64>(0, current_.percentileNs(qs[k]) - 1));
+                const double x = chart.left() + (b - first + 1) * w;
+                p.setPen(QPen(marks[k], 1, Qt::DashLine));
+                p.drawLine(QPointF(x, chart.top()), QPointF(x, chart.bottom()));
+                p.drawText(QPointF(x + 2, chart.top() + p.fontMetrics().ascent() * (k + 1)), QString::fromLatin1(names[k]));
+            }
+        }
+
+        // Axis: the start of each octave that has room for a label.
+        p.setPen(palette().text().color());
+        int lastRight = -1000;
+        for (int i = first; i <= last + 1; i += LatencyHistogram::kSub) {
+            const QString text = formatNs(LatencyHistogram::bucketLowerNs(i));
+            const int x = int(chart.left() + (i - first) * w);
+            const int tw = p.fontMetrics().horizontalAdvance(text);
+            if (x - tw / 2 < lastRight + 8) continue;
+            p.drawLine(x, chart.bottom(), x, chart.bottom() + 3);
+            p.drawText(QRect(x - tw / 2, chart.bottom() + 3, tw, labelH), Qt::AlignCenter, text);
+            lastRight = x + tw / 2;
+        }
+    }
+
+private:
+    LatencyHistogram current_;
+    LatencyHistogram baseline_;
+};
+
+LatencyPanel::LatencyPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    metricCombo_ = new QComboBox(this);
+    metricCombo_->addItem("Run-queue wait");
+    metricCombo_->addItem("Time between migrations");
+    connect(metricCombo_, &QComboBox::currentIndexChanged, this, [this] { refresh(); });
+    auto* baseline = new QPushButton("Keep as baseline", this);
+    baseline->setToolTip("Compare what is collected from now on against the samples so far");
+    connect(baseline, &QPushButton::clicked, this, [this] { keepAsBaseline("Baseline"); });
+    auto* reset = new QPushButton("Reset", this);
+    connect(reset, &QPushButton::clicked, this, [this] {
+        latency_.reset();
+        baselineWait_.clear();
+        baselineMigration_.clear();
+        baselineLabel_.clear();
+        refresh();
+    });
+
+    view_ = new HistogramView(this);
+    summary_ = new QLabel(this);
+    summary_->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    status_ = new QLabel(this);
+    status_->setWordWrap(true);
+
+    model_ = new QStandardItemModel(0, ColumnCount, this);
+    model_->setHorizontalHeaderLabels({"TID", "Thread", "Waits", "Mean wait", "Wait ms", "Migrations"});
+    table_ = new QTableView(this);
+    table_->setModel(model_);
+    table_->setSelectionMode(QAbstractItemView::NoSelection);
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->verticalHeader()->hide();
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 4);
+    table_->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+    auto* top = new QHBoxLayout;
+    top->addWidget(metricCombo_, 1);
+    top->addWidget(baseline);
+    top->addWidget(reset);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addLayout(top);
+    layout->addWidget(view_, 2);
+    layout->addWidget(summary_);
+    layout->addWidget(table_, 1);
+    layout->addWidget(status_);
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(1000);
+    connect(refreshTimer_, &QTimer::timeout, this, &LatencyPanel::refresh);
+}
+
+LatencyPanel::~LatencyPanel() = default;
+
+void LatencyPanel::setPid(qint64 pid)
+{
+    if (pid == pid_) return;
+    pid_ = pid;
+    latency_.close();
+    baselineWait_.clear();
+    baselineMigration_.clear();
+    baselineLabel_.clear();
+    model_->setRowCount(0);
+    if (isVisible()) open();
+    refresh();
+}
+
+void LatencyPanel::markApplied()
+{
+    keepAsBaseline("Before apply");
+}
+
+void LatencyPanel::keepAsBaseline(const QString& label)
+{
+    if (!latency_.isOpen()) return;
+    latency_.poll();
+    baselineWait_ = latency_.runQueueWait();
+    baselineMigration_ = latency_.betweenMigrations();
+    baselineLabel_ = label;
+    latency_.reset();
+    refresh();
+}
+
+void LatencyPanel::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    open();
+    refreshTimer_->start();
+}
+
+void LatencyPanel::hideEvent(QHideEvent* event)
+{
+    refreshTimer_->stop();
+    latency_.close();
+    QWidget::hideEvent(event);
+}
+
+void LatencyPanel::open()
+{
+    latency_.close();
+    if (pid_ <= 0) {
+        status_->setText("No process selected.");
+        return;
+    }
+    QString error;
+    if (!latency_.open(pid_, &error)) {
+        status_->setText(QString("Cannot collect scheduler latency for PID %1: %2").arg(pid_).arg(error));
+        return;
+    }
+    status_->setText(latency_.limitation().isEmpty()
+                         ? QString("Every wakeup and preemption until the thread runs again, from the sched tracepoints.")
+                         : latency_.limitation() + ".");
+}
+
+const LatencyHistogram& LatencyPanel::shown(const SchedLatency& s) const
+{
+    return metricCombo_->currentIndex() == 0 ? s.runQueueWait() : s.betweenMigrations();
+}
+
+void LatencyPanel::refresh()
+{
+    if (latency_.isOpen()) {
+        latency_.poll();
+        if (!latency_.limitation().isEmpty()) status_->setText(latency_.limitation() + ".");
+    }
+    const bool wait = metricCombo_->currentIndex() == 0;
+    view_->set(shown(latency_), wait ? baselineWait_ : baselineMigration_);
+    updateSummary();
+
+    // Busiest waiters first; rows are updated in place.
+    QVector<QPair<qint64, SchedLatency::Task>> rows;
+    for (auto it = latency_.tasks().cbegin(); it != latency_.tasks().cend(); ++it)
+        rows.append(qMakePair(it.key(), it.value()));
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.waitNs != b.second.waitNs ? a.second.waitNs > b.second.waitNs : a.first < b.first;
+    });
+    model_->setRowCount(int(rows.size()));
+    auto setCell = [this](int row, int col, const QString& text) {
+        if (QStandardItem* item = model_->item(row, col)) {
+            if (item->text() != text) item->setText(text);
+        } else {
+            auto* created = new QStandardItem(text);
+            if (col != ColName) created->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            model_->setItem(row, col, created);
+        }
+    };
+    for (int row = 0; row < rows.size(); ++row) {
+        const SchedLatency::Task& t = rows[row].second;
+        setCell(row, ColTid, QString::number(rows[row].first));
+        setCell(row, ColName, t.name);
+        setCell(row, ColWaits, QString::number(t.waits));
+        setCell(row, ColMeanWait, t.waits ? formatNs(t.waitNs / qint64(t.waits)) : QString());
+        setCell(row, ColWaitMs, QString::number(double(t.waitNs) / 1e6, 'f', 1));
+        setCell(row, ColMigrations, QString::number(t.migrations));
+    }
+}
+
+void LatencyPanel::updateSummary()
+{
+    const bool wait = metricCombo_->currentIndex() == 0;
+    QString text = QString("Now: %1").arg(percentiles(shown(latency_)));
+    if (!wait) text += QString(", %1 migration(s)").arg(latency_.migrations());
+    const LatencyHistogram& before = wait ? baselineWait_ : baselineMigration_;
+    if (!baselineLabel_.isEmpty())
+        text += QString("\n%1: %2").arg(baselineLabel_, percentiles(before));
+    summary_->setText(text);
+}
@@ -0,0 +1,58 @@
+#ifndef LATENCYPANEL_H
+#define LATENCYPANEL_H
+
+#include <QWidget>
+
+#include "schedlatency.h"
+
+class QComboBox;
+class QLabel;
+class QStandardItemModel;
+class QTableView;
+class QTimer;
+class HistogramView;
+
+// Run-queue wait and migration histograms of the selected process, with
+// p50/p99/p999 and a baseline to compare against: applying a config keeps
+// what was collected so far as "before" and starts over. Collection runs
+// only while the panel is shown.
+class LatencyPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    enum Column { ColTid, ColName, ColWaits, ColMeanWait, ColWaitMs, ColMigrations, ColumnCount };
+
+    explicit LatencyPanel(QWidget* parent=nullptr);
+    ~LatencyPanel() override;
+
+    void setPid(qint64 pid);
+    // Keeps the current histograms as the baseline and clears them.
+    void markApplied();
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private:
+    void open();
+    void refresh();
+    void keepAsBaseline(const QString& label);
+    void updateSummary();
+    const LatencyHistogram& shown(const SchedLatency& s) const;
+
+    qint64 pid_{0};
+    SchedLatency latency_;
+    LatencyHistogram baselineWait_;
+    LatencyHistogram baselineMigration_;
+    QString baselineLabel_;
+
+    QComboBox* metricCombo_{};
+    HistogramView* view_{};
+    QLabel* summary_{};
+    QLabel* status_{};
+    QTableView* table_{};
+    QStandardItemModel* model_{};
+    QTimer* refreshTimer_{};
+};
+
+#endif // LATENCYPANEL_H
@@ -0,0 +1,327 @@
+#include "launcher.h"
+#include "affinitybackend.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <vector>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+// New threads are looked for this often while following.
+static constexpr int kFollowPollMs = 2;
+
+QString LaunchTimings::summary() const
+{
+    return QStringLiteral("started in %1 us (prepare %2, fork %3, settings %4, exec %5)")
+        .arg(totalUs()).arg(prepareUs).arg(forkUs).arg(settingsUs).arg(execUs);
+}
+
+Launcher::Launcher(AffinityBackend& backend, const CpuTopology& topo)
+    : backend_(backend), topo_(topo)
+{
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+// What the child reports through the status pipe before it would exec.
+struct ChildFailure {
+    enum Stage : int { MemoryPolicy = 1, Exec = 2 };
+    int stage;
+    int code;
+};
+
+[[noreturn]] void childFail(int fd, int stage, int code)
+{
+    const ChildFailure f{stage, code};
+    [[maybe_unused]] const ssize_t n = ::write(fd, &f, sizeof f);
+    ::_exit(127);
+}
+
+// Reads one record, or nothing once the other end is closed.
+bool readFailure(int fd, ChildFailure* out)
+{
+    ssize_t n;
+    do n = ::read(fd, out, sizeof *out);
+    while (n < 0 && errno == EINTR);
+    return n == ssize_t(sizeof *out);
+}
+
+} // namespace
+
+Launcher::~Launcher() = default;
+
+bool Launcher::start(const AffinityConfig& cfg, const QStringList& command, BackendError* err)
+{
+    if (pid_ > 0) return fail(err, EBUSY, QStringLiteral("Already started"));
+    if (command.isEmpty()) return fail(err, EINVAL, QStringLiteral("No command to run"));
+    timings_ = LaunchTimings();
+    QElapsedTimer clock;
+    clock.start();
+    auto lap = [&clock] { return clock.nsecsElapsed() / 1000; };
+
+    // Everything the child needs is worked out here: after fork it only makes
+    // system calls.
+    const QString program = command.first().contains(QLatin1Char('/'))
+        ? command.first() : QStandardPaths::findExecutable(command.first());
+    if (program.isEmpty())
+        return fail(err, ENOENT, QStringLiteral("%1: command not found").arg(command.first()));
+    const QByteArray path = QFile::encodeName(program);
+    std::vector<QByteArray> args;
+    args.reserve(size_t(command.size()));
+    for (const QString& a : command) args.push_back(QFile::encodeName(a));
+    std::vector<char*> argv;
+    for (QByteArray& a : args) argv.push_back(a.data());
+    argv.push_back(nullptr);
+
+    // Picked once, so the memory nodes are those of the mask.
+    const AffinityConfig resolved = cfg.resolved(topo_);
+    const bool setMemory = cfg.memoryPolicy != MemoryPolicy::Default;
+    MemoryPolicyArgs memory;
+    if (setMemory && !prepareMemoryPolicy(cfg.memoryPolicy, numaNodesOf(topo_, resolved.cpus), &memory, err))
+        return false;
+
+    // status: the child's errors, closed by a successful exec. go: one byte
+    // from the parent once the child is configured; closed means give up.
+    int status[2], go[2];
+    if (::pipe2(status, O_CLOEXEC) != 0)
+        return fail(err, errno);
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, go) != 0) {
+        const int e = errno;
+        ::close(status[0]);
+        ::close(status[1]);
+        return fail(err, e);
+    }
+    timings_.prepareUs = lap();
+
+    const pid_t child = ::fork();
+    if (child < 0) {
+        const int e = errno;
+        for (int fd : {status[0], status[1], go[0], go[1]}) ::close(fd);
+        return fail(err, e);
+    }
+    if (child == 0) {
+        ::close(status[0]);
+        ::close(go[0]);
+        if (setMemory) {
+            if (const int e = applyMemoryPolicy(memory))
+                childFail(status[1], ChildFailure::MemoryPolicy, e);
+        }
+        char c = 0;
+        ssize_t n;
+        do n = ::read(go[1], &c, 1);
+        while (n < 0 && errno == EINTR);
+        if (n != 1) ::_exit(127);
+        ::execv(path.constData(), argv.data());
+        childFail(status[1], ChildFailure::Exec, errno);
+    }
+    ::close(status[1]);
+    ::close(go[1]);
+    timings_.forkUs = lap() - timings_.prepareUs;
+
+    BackendError applyErr;
+    const bool applied = applyProcessSettings(backend_, topo_, child, resolved, &applyErr);
+    timings_.settingsUs = lap() - timings_.prepareUs - timings_.forkUs;
+    if (applied) {
+        const char g = 'g';
+        [[maybe_unused]] const ssize_t n = ::send(go[0], &g, 1, MSG_NOSIGNAL);
+    }
+    ::close(go[0]);
+
+    // EOF on the status pipe means exec went through.
+    ChildFailure failure{};
+    const bool childFailed = readFailure(status[0], &failure);
+    ::close(status[0]);
+    timings_.execUs = lap() - timings_.prepareUs - timings_.forkUs - timings_.settingsUs;
+    if (applied && !childFailed) {
+        pid_ = child;
+        cpus_ = resolved.cpus;
+        return true;
+    }
+
+    int ignored;
+    while (::waitpid(child, &ignored, 0) < 0 && errno == EINTR) {}
+    if (childFailed && failure.stage == ChildFailure::MemoryPolicy)
+        return fail(err, failure.code, QStringLiteral("Memory policy: %1").arg(qt_error_string(failure.code)));
+    if (childFailed)
+        return fail(err, failure.code, QStringLiteral("%1: %2").arg(program, qt_error_string(failure.code)));
+    if (err) *err = applyErr;
+    return false;
+}
+
+int Launcher::wait()
+{
+    if (pid_ <= 0) return -1;
+    int status = 0;
+    while (::waitpid(pid_t(pid_), &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    pid_ = 0;
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+// Exited but not yet reaped counts as exited; wait() still gets the status.
+static bool hasExited(qint64 pid)
+{
+    siginfo_t info{};
+    return ::waitid(P_PID, id_t(pid), &info, WEXITED | WNOHANG | WNOWAIT) != 0 || info.si_pid != 0;
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+// Quotes one argument the way CommandLineToArgvW splits them again.
+static QString quoteArgument(const QString& arg)
+{
+    if (!arg.isEmpty() && !arg.contains(QLatin1Char(' ')) && !arg.contains(QLatin1Char('\t'))
+        && !arg.contains(QLatin1Char('"')))
+        return arg;
+    QString out = QStringLiteral("\"");
+    int backslashes = 0;
+    for (const QChar c : arg) {
+        if (c == QLatin1Char('\\')) {
+            ++backslashes;
+            continue;
+        }
+        // Backslashes are literal unless they precede a quote.
+        out += QString(c == QLatin1Char('"') ? 2 * backslashes + 1 : backslashes, QLatin1Char('\\'));
+        out += c;
+        backslashes = 0;
+    }
+    out += QString(2 * backslashes, QLatin1Char('\\'));
+    out += QLatin1Char('"');
+    return out;
+}
+
+Launcher::~Launcher()
+{
+    if (process_) ::CloseHandle(process_);
+}
+
+bool Launcher::start(const AffinityConfig& cfg, const QStringList& command, BackendError* err)
+{
+    if (pid_ > 0) return fail(err, ERROR_BUSY, QStringLiteral("Already started"));
+    if (command.isEmpty()) return fail(err, ERROR_INVALID_PARAMETER, QStringLiteral("No command to run"));
+    if (cfg.memoryPolicy != MemoryPolicy::Default)
+        return fail(err, -1, QStringLiteral("Memory policies are only supported on Linux"));
+    timings_ = LaunchTimings();
+    QElapsedTimer clock;
+    clock.start();
+    auto lap = [&clock] { return clock.nsecsElapsed() / 1000; };
+
+    QStringList quoted;
+    for (const QString& a : command) quoted.append(quoteArgument(a));
+    std::wstring line = quoted.join(QLatin1Char(' ')).toStdWString();
+    STARTUPINFOW si{};
+    si.cb = sizeof si;
+    PROCESS_INFORMATION pi{};
+    timings_.prepareUs = lap();
+
+    if (!::CreateProcessW(nullptr, line.data(), nullptr, nullptr, FALSE, CREATE_SUSPENDED,
+                          nullptr, nullptr, &si, &pi)) {
+        const int e = int(::GetLastError());
+        return fail(err, e, QStringLiteral("%1: %2").arg(command.first(), qt_error_string(e)));
+    }
+    timings_.forkUs = lap() - timings_.prepareUs;
+
+    const AffinityConfig resolved = cfg.resolved(topo_);
+    const bool applied = applyProcessSettings(backend_, topo_, qint64(pi.dwProcessId), resolved, err);
+    timings_.settingsUs = lap() - timings_.prepareUs - timings_.forkUs;
+    if (!applied) {
+        ::TerminateProcess(pi.hProcess, 127);
+        ::CloseHandle(pi.hThread);
+        ::CloseHandle(pi.hProcess);
+        return false;
+    }
+    ::ResumeThread(pi.hThread);
+    ::CloseHandle(pi.hThread);
+    timings_.execUs = lap() - timings_.prepareUs - timings_.forkUs - timings_.settingsUs;
+    process_ = pi.hProcess;
+    pid_ = qint64(pi.dwProcessId);
+    cpus_ = resolved.cpus;
+    return true;
+}
+
+int Launcher::wait()
+{
+    if (!process_) return -1;
+    ::WaitForSingleObject(process_, INFINITE);
+    DWORD code = 0;
+    ::GetExitCodeProcess(process_, &code);
+    ::CloseHandle(process_);
+    process_ = nullptr;
+    pid_ = 0;
+    return int(code);
+}
+
+static bool hasExited(qint64 pid)
+{
+    HANDLE h = ::OpenProcess(SYNCHRONIZE, FALSE, DWORD(pid));
+    if (!h) return true;
+    const bool exited = ::WaitForSingleObject(h, 0) == WAIT_OBJECT_0;
+    ::CloseHandle(h);
+    return exited;
+}
+
+#else
+
+Launcher::~Launcher() = default;
+
+bool Launcher::start(const AffinityConfig&, const QStringList&, BackendError* err)
+{
+    return fail(err, -1, QStringLiteral("Launching is not supported on this platform"));
+}
+
+int Launcher::wait()
+{
+    return -1;
+}
+
+static bool hasExited(qint64)
+{
+    return true;
+}
+
+#endif
+
+int Launcher::followThreads(const QVector<ThreadPinRule>& rules, int ms, BackendError* err)
+{
+    if (pid_ <= 0 || rules.isEmpty()) return 0;
+    QSet<qint64> seen;
+    int total = 0;
+    bool reported = false;
+    QElapsedTimer clock;
+    clock.start();
+    for (;;) {
+        int pinned = 0;
+        BackendError e;
+        if (!applyThreadRules(backend_, pid_, rules, &pinned, &e, &seen) && !reported) {
+            reported = true;
+            if (err) *err = e;
+        }
+        total += pinned;
+        if (clock.elapsed() >= ms || hasExited(pid_)) break;
+        QThread::msleep(kFollowPollMs);
+    }
+    return total;
+}
@@ -0,0 +1,65 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "affinityconfig.h"
+
+class AffinityBackend;
+struct BackendError;
+
+// Where the time between start() and the command running went, in microseconds.
+struct LaunchTimings {
+    qint64 prepareUs{0};    // resolving the command, building arguments
+    qint64 forkUs{0};       // fork / CreateProcess
+    qint64 settingsUs{0};   // CPU set, cgroup and scheduling on the stopped child
+    qint64 execUs{0};       // releasing the child until exec succeeded
+
+    qint64 totalUs() const { return prepareUs + forkUs + settingsUs + execUs; }
+    QString summary() const;
+};
+
+// Starts a command with its CPUs, memory policy, scheduling class and cgroup
+// already in place, so not even its first instruction runs elsewhere. On Linux
+// the child sets its memory policy and waits after fork while the parent
+// applies the rest to it, then execs; on Windows the process is created
+// suspended and resumed once configured. If any setting fails, the command
+// is never run.
+class Launcher
+{
+public:
+    Launcher(AffinityBackend& backend, const CpuTopology& topo);
+    ~Launcher();
+
+    Launcher(const Launcher&) = delete;
+    Launcher& operator=(const Launcher&) = delete;
+
+    bool start(const AffinityConfig& cfg, const QStringList& command, BackendError* err=nullptr);
+
+    qint64 pid() const { return pid_; }
+    // The CPUs start() picked; the mask and the memory nodes both follow them.
+    const CpuSet& cpus() const { return cpus_; }
+    const LaunchTimings& timings() const { return timings_; }
+
+    // Applies `rules` to threads as they appear, for `ms` milliseconds or until
+    // the process exits. Returns the number of threads pinned.
+    int followThreads(const QVector<ThreadPinRule>& rules, int ms, BackendError* err=nullptr);
+
+    // Waits for the process: its exit code, 128 + signal if it was killed,
+    // -1 if it was not started.
+    int wait();
+
+private:
+    AffinityBackend& backend_;
+    const CpuTopology& topo_;
+    qint64 pid_{0};
+    CpuSet cpus_;
+    LaunchTimings timings_;
+#if defined(Q_OS_WINDOWS)
+    void* process_{};
+#endif
+};
+
+#endif // LAUNCHER_H
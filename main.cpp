@@ -1,4 +1,5 @@
 #include "cpuaffinity.h"
+#include "cli.h"
 
 #include <QApplication>
 #include <QLocale>
@@ -6,6 +7,10 @@
 
 int main(int argc, char *argv[])
 {
+    // Headless modes must decide before a QApplication (and a display) exists.
+    if (isCliInvocation(argc, argv))
+        return runCli(argc, argv);
+
     QApplication app(argc, argv);
 
     QTranslator translator;
@@ -0,0 +1,277 @@
+#include "numamemory.h"
+#include "affinitybackend.h"
+
+#include <QFile>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <vector>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+QVector<MemoryPolicy> allMemoryPolicies()
+{
+    return {MemoryPolicy::Default, MemoryPolicy::Bind, MemoryPolicy::Preferred, MemoryPolicy::Interleave};
+}
+
+QString memoryPolicyKey(MemoryPolicy p)
+{
+    switch (p) {
+    case MemoryPolicy::Default:    return QStringLiteral("default");
+    case MemoryPolicy::Bind:       return QStringLiteral("bind");
+    case MemoryPolicy::Preferred:  return QStringLiteral("preferred");
+    case MemoryPolicy::Interleave: return QStringLiteral("interleave");
+    }
+    return QString();
+}
+
+QString memoryPolicyLabel(MemoryPolicy p)
+{
+    switch (p) {
+    case MemoryPolicy::Default:    return QStringLiteral("Leave where it is");
+    case MemoryPolicy::Bind:       return QStringLiteral("Bind to the CPUs' nodes");
+    case MemoryPolicy::Preferred:  return QStringLiteral("Prefer the first node");
+    case MemoryPolicy::Interleave: return QStringLiteral("Interleave across the nodes");
+    }
+    return QString();
+}
+
+MemoryPolicy memoryPolicyFromKey(const QString& key, MemoryPolicy fallback)
+{
+    for (MemoryPolicy p : allMemoryPolicies())
+        if (memoryPolicyKey(p) == key) return p;
+    return fallback;
+}
+
+CpuSet onlineNumaNodes()
+{
+    QFile f(QStringLiteral("/sys/devices/system/node/online"));
+    if (!f.open(QIODevice::ReadOnly))
+        return CpuSet::fromList({0});
+    bool ok = false;
+    const CpuSet nodes = CpuSet::fromRangeList(QString::fromLatin1(f.readAll().trimmed()), &ok);
+    return ok && !nodes.isEmpty() ? nodes : CpuSet::fromList({0});
+}
+
+CpuSet numaNodesOf(const CpuTopology& topo, const CpuSet& cpus)
+{
+    CpuSet nodes;
+    for (int c = cpus.first(); c >= 0; c = cpus.next(c)) {
+        if (const CpuInfo* info = topo.find(c))
+            nodes.set(info->node);
+    }
+    return nodes;
+}
+
+QVector<qint64> numaResidentBytes(qint64 pid)
+{
+    QVector<qint64> bytes;
+#if defined(Q_OS_LINUX)
+    QFile f(QStringLiteral("/proc/%1/numa_maps").arg(pid));
+    if (!f.open(QIODevice::ReadOnly))
+        return bytes;
+
+    // "7f12a000 default anon=3 dirty=3 N0=2 N1=1 kernelpagesize_kB=4"
+    while (!f.atEnd()) {
+        const QList<QByteArray> tokens = f.readLine().trimmed().split(' ');
+        qint64 pageBytes = 4096;
+        for (const QByteArray& t : tokens) {
+            if (t.startsWith("kernelpagesize_kB="))
+                pageBytes = t.mid(18).toLongLong() * 1024;
+        }
+        for (const QByteArray& t : tokens) {
+            const int eq = t.indexOf('=');
+            if (t.size() < 4 || t.at(0) != 'N' || eq < 2) continue;
+            bool ok = false;
+            const int node = t.mid(1, eq - 1).toInt(&ok);
+            if (!ok || node < 0) continue;
+            if (node >= bytes.size()) bytes.resize(node + 1);
+            bytes[node] += t.mid(eq + 1).toLongLong() * pageBytes;
+        }
+    }
+#else
+    Q_UNUSED(pid);
+#endif
+    return bytes;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+constexpr int kLongBits = int(sizeof(unsigned long) * 8);
+
+// Kernel nodemask covering at least `bits` nodes.
+std::vector<unsigned long> nodeMask(const CpuSet& nodes, int bits)
+{
+    std::vector<unsigned long> mask(size_t((bits + kLongBits - 1) / kLongBits), 0);
+    for (int n = nodes.first(); n >= 0; n = nodes.next(n))
+        mask[size_t(n / kLongBits)] |= 1UL << (n % kLongBits);
+    return mask;
+}
+
+// Spreads every page of the private writable mappings round-robin over
+// `nodes`. Pages that were never touched come back as -ENOENT and are skipped.
+bool interleavePages(qint64 pid, const CpuSet& nodes, qint64* notMoved, BackendError* err)
+{
+    // Opened here so errno is still ours; QFile does not keep it.
+    const QByteArray path = QStringLiteral("/proc/%1/maps").arg(pid).toLocal8Bit();
+    const int fd = ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return fail(err, errno);
+    QFile maps;
+    if (!maps.open(fd, QIODevice::ReadOnly, QFileDevice::AutoCloseHandle)) {
+        ::close(fd);
+        return fail(err, EIO, maps.errorString());
+    }
+
+    const QVector<int> targets = nodes.toList();
+    const quintptr pageSize = quintptr(::sysconf(_SC_PAGESIZE));
+    constexpr size_t kBatch = 4096;
+    std::vector<void*> pages;
+    std::vector<int> dest, status;
+    pages.reserve(kBatch);
+    dest.reserve(kBatch);
+    size_t next = 0;
+
+    auto flush = [&]() -> bool {
+        if (pages.empty()) return true;
+        status.assign(pages.size(), 0);
+        if (::syscall(SYS_move_pages, pid_t(pid), pages.size(), pages.data(), dest.data(),
+                      status.data(), MPOL_MF_MOVE) < 0)
+            return fail(err, errno);
+        for (int s : status)
+            if (s < 0 && s != -ENOENT && s != -EFAULT && notMoved) ++*notMoved;
+        pages.clear();
+        dest.clear();
+        return true;
+    };
+
+    // "55d0c000-55d2d000 rw-p 00000000 00:00 0   [heap]"
+    while (!maps.atEnd()) {
+        const QByteArray line = maps.readLine();
+        const int dash = line.indexOf('-'), sp = line.indexOf(' ');
+        if (dash < 0 || sp < dash || line.size() < sp + 5) continue;
+        if (line.at(sp + 2) != 'w' || line.at(sp + 4) != 'p') continue;
+        if (line.contains("[vsyscall]") || line.contains("[vvar]")) continue;
+        const quintptr from = line.left(dash).toULongLong(nullptr, 16);
+        const quintptr to = line.mid(dash + 1, sp - dash - 1).toULongLong(nullptr, 16);
+        for (quintptr a = from; a < to; a += pageSize) {
+            pages.push_back(reinterpret_cast<void*>(a));
+            dest.push_back(targets[int(next++ % size_t(targets.size()))]);
+            if (pages.size() == kBatch && !flush())
+                return false;
+        }
+    }
+    return flush();
+}
+
+} // namespace
+
+bool migrateProcessMemory(qint64 pid, MemoryPolicy policy, const CpuSet& nodes,
+                          qint64* notMoved, BackendError* err)
+{
+    if (notMoved) *notMoved = 0;
+    if (policy == MemoryPolicy::Default)
+        return true;
+    if (nodes.isEmpty())
+        return fail(err, EINVAL, QStringLiteral("No NUMA node to move memory to"));
+
+    if (policy == MemoryPolicy::Interleave && nodes.count() > 1)
+        return interleavePages(pid, nodes, notMoved, err);
+
+    // The kernel maps the n-th source node onto the n-th target node, folding
+    // when there are more sources than targets.
+    const CpuSet target = policy == MemoryPolicy::Preferred ? CpuSet::fromList({nodes.first()}) : nodes;
+    const CpuSet from = onlineNumaNodes() - target;
+    if (from.isEmpty())
+        return true;   // everything already is on a target node
+    const int bits = qMax(from.last(), target.last()) + 1;
+    const std::vector<unsigned long> oldMask = nodeMask(from, bits);
+    const std::vector<unsigned long> newMask = nodeMask(target, bits);
+    const long left = ::syscall(SYS_migrate_pages, pid_t(pid), (unsigned long)(oldMask.size() * kLongBits + 1),
+                                oldMask.data(), newMask.data());
+    if (left < 0)
+        return fail(err, errno);
+    if (notMoved) *notMoved = left;
+    return true;
+}
+
+bool prepareMemoryPolicy(MemoryPolicy policy, const CpuSet& nodes, MemoryPolicyArgs* args, BackendError* err)
+{
+    int mode = MPOL_DEFAULT;
+    CpuSet mask = nodes;
+    switch (policy) {
+    case MemoryPolicy::Default:    mask.clear(); break;
+    case MemoryPolicy::Bind:       mode = MPOL_BIND; break;
+    case MemoryPolicy::Preferred:  mode = MPOL_PREFERRED; mask = CpuSet::fromList({nodes.first()}); break;
+    case MemoryPolicy::Interleave: mode = MPOL_INTERLEAVE; break;
+    }
+    if (mode != MPOL_DEFAULT && nodes.isEmpty())
+        return fail(err, EINVAL, QStringLiteral("No NUMA node for the memory policy"));
+    args->mode = mode;
+    args->mask = nodeMask(mask, mask.isEmpty() ? 1 : mask.last() + 1);
+    return true;
+}
+
+int applyMemoryPolicy(const MemoryPolicyArgs& args)
+{
+    if (::syscall(SYS_set_mempolicy, args.mode, args.mode == MPOL_DEFAULT ? nullptr : args.mask.data(),
+                  (unsigned long)(args.mask.size() * kLongBits + 1)) < 0)
+        return errno;
+    return 0;
+}
+
+bool setOwnMemoryPolicy(MemoryPolicy policy, const CpuSet& nodes, BackendError* err)
+{
+    MemoryPolicyArgs args;
+    if (!prepareMemoryPolicy(policy, nodes, &args, err))
+        return false;
+    if (const int e = applyMemoryPolicy(args))
+        return fail(err, e);
+    return true;
+}
+
+#else
+
+bool migrateProcessMemory(qint64, MemoryPolicy policy, const CpuSet&, qint64* notMoved, BackendError* err)
+{
+    if (notMoved) *notMoved = 0;
+    if (policy == MemoryPolicy::Default)
+        return true;
+    return fail(err, -1, QStringLiteral("Moving another process's memory is only supported on Linux"));
+}
+
+bool setOwnMemoryPolicy(MemoryPolicy policy, const CpuSet&, BackendError* err)
+{
+    if (policy == MemoryPolicy::Default)
+        return true;
+    return fail(err, -1, QStringLiteral("Memory policies are only supported on Linux"));
+}
+
+bool prepareMemoryPolicy(MemoryPolicy policy, const CpuSet&, MemoryPolicyArgs* args, BackendError* err)
+{
+    *args = MemoryPolicyArgs();
+    if (policy == MemoryPolicy::Default)
+        return true;
+    return fail(err, -1, QStringLiteral("Memory policies are only supported on Linux"));
+}
+
+int applyMemoryPolicy(const MemoryPolicyArgs&)
+{
+    return 0;
+}
+
+#endif
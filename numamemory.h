@@ -0,0 +1,57 @@
+#ifndef NUMAMEMORY_H
+#define NUMAMEMORY_H
+
+#include <QString>
+#include <QVector>
+#include <vector>
+
+#include "cpuset.h"
+#include "cputopology.h"
+
+struct BackendError;
+
+// Where a process's memory should live relative to its CPUs. Linux cannot set
+// the policy of another running process, so for an existing process the
+// policy decides where migrateProcessMemory() moves its pages; processes we
+// start ourselves inherit it via setOwnMemoryPolicy().
+enum class MemoryPolicy {
+    Default,       // leave memory alone
+    Bind,          // all memory on the nodes of the chosen CPUs
+    Preferred,     // on the first of those nodes
+    Interleave,    // page by page across those nodes
+};
+
+QString memoryPolicyKey(MemoryPolicy p);      // stable name for config files
+QString memoryPolicyLabel(MemoryPolicy p);    // human readable
+MemoryPolicy memoryPolicyFromKey(const QString& key, MemoryPolicy fallback = MemoryPolicy::Default);
+QVector<MemoryPolicy> allMemoryPolicies();
+
+// Node ids used as CpuSet bits.
+CpuSet onlineNumaNodes();                     // /sys/devices/system/node/online
+CpuSet numaNodesOf(const CpuTopology& topo, const CpuSet& cpus);
+
+// Resident bytes per node (index = node id) summed from /proc/<pid>/numa_maps.
+// Empty when the file is unreadable or NUMA is not supported.
+QVector<qint64> numaResidentBytes(qint64 pid);
+
+// Moves the pages `pid` already has onto `nodes`: migrate_pages for Bind and
+// Preferred, move_pages over its private writable mappings for Interleave.
+// `notMoved` receives the number of pages the kernel could not move.
+bool migrateProcessMemory(qint64 pid, MemoryPolicy policy, const CpuSet& nodes,
+                          qint64* notMoved=nullptr, BackendError* err=nullptr);
+
+// set_mempolicy for the calling thread; inherited across fork and exec.
+bool setOwnMemoryPolicy(MemoryPolicy policy, const CpuSet& nodes, BackendError* err=nullptr);
+
+// The same in two steps, for a forked child that must not allocate before
+// exec: prepare in the parent, then apply in the child. apply returns 0 or an
+// errno and only makes the system call.
+struct MemoryPolicyArgs {
+    int mode{0};                          // MPOL_*, 0 = MPOL_DEFAULT
+    std::vector<unsigned long> mask;
+};
+bool prepareMemoryPolicy(MemoryPolicy policy, const CpuSet& nodes, MemoryPolicyArgs* args,
+                         BackendError* err=nullptr);
+int applyMemoryPolicy(const MemoryPolicyArgs& args);
+
+#endif // NUMAMEMORY_H
@@ -0,0 +1,499 @@
+#include "perfcounters.h"
+#include "threadpinning.h"
+
+#include <QFile>
+#include <QSet>
+#include <QStringList>
+#include <algorithm>
+#include <chrono>
+
+#if defined(Q_OS_LINUX)
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+double PerfReading::ipc() const
+{
+    if (!has(Instructions) || !has(Cycles) || values[Cycles] == 0)
+        return 0.0;
+    return double(values[Instructions]) / double(values[Cycles]);
+}
+
+double PerfReading::ratio(Counter num, Counter den) const
+{
+    if (!has(num) || !has(den) || values[den] == 0)
+        return -1.0;
+    return double(values[num]) / double(values[den]);
+}
+
+PerfReading PerfReading::operator-(const PerfReading& earlier) const
+{
+    PerfReading d;
+    for (int c = 0; c < Count; ++c) {
+        if (values[c] >= 0 && earlier.values[c] >= 0)
+            d.values[c] = qMax<qint64>(0, values[c] - earlier.values[c]);
+    }
+    d.timestampNs = timestampNs - earlier.timestampNs;
+    return d;
+}
+
+QString perfCounterName(PerfReading::Counter c)
+{
+    switch (c) {
+    case PerfReading::Instructions:    return QStringLiteral("instructions");
+    case PerfReading::Cycles:          return QStringLiteral("cycles");
+    case PerfReading::LlcMisses:       return QStringLiteral("llc_misses");
+    case PerfReading::ContextSwitches: return QStringLiteral("context_switches");
+    case PerfReading::Migrations:      return QStringLiteral("cpu_migrations");
+    case PerfReading::TaskClockNs:     return QStringLiteral("task_clock_ns");
+    case PerfReading::LlcReferences:   return QStringLiteral("llc_references");
+    case PerfReading::L1dLoads:        return QStringLiteral("l1d_loads");
+    case PerfReading::L1dMisses:       return QStringLiteral("l1d_misses");
+    case PerfReading::Branches:        return QStringLiteral("branches");
+    case PerfReading::BranchMisses:    return QStringLiteral("branch_misses");
+    case PerfReading::Count:           break;
+    }
+    return QString();
+}
+
+static qint64 monotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PerfCounters::~PerfCounters()
+{
+    close();
+}
+
+bool PerfCounters::open(qint64 pid, QString* error)
+{
+    close();
+    return start(pid, error);
+}
+
+QString PerfCounters::limitation() const
+{
+    if (skipped_.isEmpty()) return limitation_;
+    QStringList tids;
+    for (int i = 0; i < skipped_.size() && i < 8; ++i)
+        tids << QString::number(skipped_[i]);
+    if (skipped_.size() > 8) tids << QStringLiteral("...");
+    const QString why = QStringLiteral("%1 threads not counted, out of descriptors (TIDs %2)")
+                            .arg(skipped_.size()).arg(tids.join(QStringLiteral(", ")));
+    return limitation_.isEmpty() ? why : limitation_ + QStringLiteral("; ") + why;
+}
+
+PerfReading PerfCounters::read()
+{
+    PerfReading total;
+    readPerCpu(&total);
+    return total;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+struct EventSpec {
+    PerfReading::Counter counter;
+    quint32 type;
+    quint64 config;
+};
+
+constexpr quint64 cacheEvent(quint64 cache, quint64 op, quint64 result)
+{
+    return cache | (op << 8) | (result << 16);
+}
+
+// Group 0 and 1 are hardware, group 2 software; the first event of each is
+// the leader. cache-misses/-references are the generic events the kernel maps
+// to the last-level cache. There is no generic L2 event, so L1D load misses
+// (= L2 data accesses) stand in for it.
+constexpr int kGroupSize[3] = {4, 4, 3};
+constexpr EventSpec kEvents[3][4] = {
+    {{PerfReading::Cycles,        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+     {PerfReading::Instructions,  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+     {PerfReading::Branches,      PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+     {PerfReading::BranchMisses,  PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}},
+    {{PerfReading::LlcReferences, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+     {PerfReading::LlcMisses,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+     {PerfReading::L1dLoads,      PERF_TYPE_HW_CACHE,
+      cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS)},
+     {PerfReading::L1dMisses,     PERF_TYPE_HW_CACHE,
+      cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS)}},
+    {{PerfReading::TaskClockNs,     PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+     {PerfReading::ContextSwitches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+     {PerfReading::Migrations,      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+     {}},
+};
+
+int openEvent(const EventSpec& e, qint64 tid, int cpu, int groupFd, bool userOnly, bool inherit)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = e.type;
+    attr.config = e.config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = userOnly;
+    attr.exclude_hv = userOnly;
+    // Threads and processes the thread creates later are counted too.
+    attr.inherit = inherit;
+    return int(::syscall(SYS_perf_event_open, &attr, pid_t(tid), cpu, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+int paranoidLevel()
+{
+    QFile f(QStringLiteral("/proc/sys/kernel/perf_event_paranoid"));
+    if (!f.open(QIODevice::ReadOnly))
+        return 2;
+    bool ok = false;
+    const int level = f.readAll().trimmed().toInt(&ok);
+    return ok ? level : 2;
+}
+
+QString hardwareLimitation(int err)
+{
+    if (err == ENOENT || err == ENODEV || err == EOPNOTSUPP)
+        return QStringLiteral("No hardware PMU is exposed (virtual machine?), software events only");
+    if (err == EACCES || err == EPERM)
+        return QStringLiteral("perf_event_paranoid is %1 and hardware events need CAP_PERFMON, "
+                              "software events only").arg(paranoidLevel());
+    return QStringLiteral("Hardware events unavailable (%1), software events only").arg(qt_error_string(err));
+}
+
+int fdBudget()
+{
+    rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+        return 4096;
+    return int(qBound<rlim_t>(0, rl.rlim_cur / 2, 4096));
+}
+
+} // namespace
+
+bool PerfCounters::isSupported()
+{
+    return ::access("/proc/sys/kernel/perf_event_paranoid", F_OK) == 0;
+}
+
+bool PerfCounters::attach(qint64 tid, int cpu)
+{
+    Attachment a;
+    a.tid = tid;
+    a.cpu = cpu;
+    a.last.fill(0);
+    bool any = false;
+    for (int g = 0; g < kGroups; ++g) {
+        if (!groupOn_[g]) continue;
+        Group& group = a.groups[g];
+        const int leader = openEvent(kEvents[g][0], tid, cpu, -1, userOnly_, inherit_);
+        if (leader < 0) {           // thread gone, or this CPU is offline
+            if (!openErrno_) openErrno_ = errno;
+            continue;
+        }
+        group.fds.append(leader);
+        group.counters.append(kEvents[g][0].counter);
+        for (int e = 1; e < kGroupSize[g]; ++e) {
+            // A member the PMU lacks only loses that counter, not the group.
+            const int fd = openEvent(kEvents[g][e], tid, cpu, leader, userOnly_, inherit_);
+            if (fd < 0) continue;
+            group.fds.append(fd);
+            group.counters.append(kEvents[g][e].counter);
+        }
+        for (int c : group.counters)
+            available_[c] = true;
+        any = true;
+    }
+    if (any)
+        attached_.append(a);
+    return any;
+}
+
+bool PerfCounters::start(qint64 pid, QString* error)
+{
+    const QVector<ThreadEntry> threads = listThreads(pid);
+    if (threads.isEmpty()) {
+        if (error) *error = QStringLiteral("Process %1 has no readable threads").arg(pid);
+        return false;
+    }
+
+    // Probe each group's leader once on the first thread. With
+    // perf_event_paranoid >= 2 only user-space counting is allowed, and
+    // old kernels refuse group reads of inherited events.
+    const qint64 probeTid = threads.first().tid;
+    int hwErrno = 0;
+    int swErrno = 0;
+    for (int g = 0; g < kGroups; ++g) {
+        int fd = openEvent(kEvents[g][0], probeTid, -1, -1, userOnly_, inherit_);
+        if (fd < 0 && inherit_ && errno == EINVAL) {
+            inherit_ = false;
+            fd = openEvent(kEvents[g][0], probeTid, -1, -1, userOnly_, false);
+        }
+        if (fd < 0 && !userOnly_ && (errno == EACCES || errno == EPERM)) {
+            userOnly_ = true;
+            fd = openEvent(kEvents[g][0], probeTid, -1, -1, true, inherit_);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            groupOn_[g] = true;
+        } else {
+            (kEvents[g][0].type == PERF_TYPE_SOFTWARE ? swErrno : hwErrno) = errno;
+        }
+    }
+    if (!groupOn_[kGroups - 1] && !hasHardware()) {
+        if (error) *error = QStringLiteral("perf_event_open: %1").arg(qt_error_string(swErrno ? swErrno : hwErrno));
+        return false;
+    }
+    if (!groupOn_[0] && !groupOn_[1])
+        addLimitation(hardwareLimitation(hwErrno));
+
+    // Every mode stays inside the descriptor budget: per-CPU counts give way
+    // to totals, and totals count as many threads as fit, lowest TIDs (the
+    // main thread) first.
+    int perAttachment = 0;
+    for (int g = 0; g < kGroups; ++g)
+        if (groupOn_[g]) perAttachment += kGroupSize[g];
+    maxAttachments_ = qMax(1, fdBudget() / perAttachment);
+    if (!cpus_.isEmpty() && threads.size() * cpus_.size() > maxAttachments_) {
+        addLimitation(QStringLiteral("%1 threads x %2 CPUs exceeds the descriptor budget, totals only")
+                          .arg(threads.size()).arg(cpus_.size()));
+        cpus_.clear();
+    }
+    retired_.fill(Counts{}, cpus_.isEmpty() ? 1 : cpus_.last() + 1);
+
+    pid_ = pid;
+    openErrno_ = 0;
+    for (const ThreadEntry& t : threads)
+        attachThread(t.tid);
+    if (attached_.isEmpty()) {
+        if (error) *error = QStringLiteral("perf_event_open: %1").arg(qt_error_string(openErrno_ ? openErrno_ : ESRCH));
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PerfCounters::attachThread(qint64 tid)
+{
+    const int perThread = cpus_.isEmpty() ? 1 : int(cpus_.size());
+    if (attached_.size() + perThread > maxAttachments_) {
+        skipped_.append(tid);
+        return;
+    }
+    bool outOfFds = false;
+    if (cpus_.isEmpty()) {
+        outOfFds = !attach(tid, -1) && (errno == EMFILE || errno == ENFILE);
+    } else {
+        for (int cpu : cpus_)
+            outOfFds |= !attach(tid, cpu) && (errno == EMFILE || errno == ENFILE);
+    }
+    if (outOfFds) skipped_.append(tid);
+}
+
+void PerfCounters::addLimitation(const QString& why)
+{
+    limitation_ = limitation_.isEmpty() ? why : limitation_ + QStringLiteral("; ") + why;
+}
+
+bool PerfCounters::openPerCpu(qint64 pid, const CpuSet& cpus, QString* error)
+{
+    close();
+    cpus_ = cpus.toList();
+    return start(pid, error);
+}
+
+void PerfCounters::closeAttachment(const Attachment& a)
+{
+    for (const Group& g : a.groups) {
+        // Members before their leader.
+        for (int i = int(g.fds.size()) - 1; i >= 0; --i)
+            ::close(g.fds[i]);
+    }
+}
+
+void PerfCounters::close()
+{
+    for (const Attachment& a : attached_)
+        closeAttachment(a);
+    attached_.clear();
+    retired_.clear();
+    cpus_.clear();
+    for (bool& a : available_) a = false;
+    for (bool& g : groupOn_) g = false;
+    userOnly_ = false;
+    inherit_ = true;
+    maxAttachments_ = 0;
+    openErrno_ = 0;
+    skipped_.clear();
+    limitation_.clear();
+    pid_ = 0;
+}
+
+void PerfCounters::readAll()
+{
+    quint64 buf[3 + 4];   // nr, time_enabled, time_running, values[nr]
+    for (Attachment& a : attached_) {
+        for (const Group& g : a.groups) {
+            if (g.fds.isEmpty()) continue;
+            const qint64 want = qint64(sizeof(quint64)) * (3 + g.fds.size());
+            if (::read(g.fds[0], buf, size_t(want)) != want || buf[0] != quint64(g.fds.size()))
+                continue;   // keep the last good value
+            const quint64 enabled = buf[1];
+            const quint64 running = buf[2];
+            for (int i = 0; i < g.fds.size(); ++i) {
+                quint64 v = buf[3 + i];
+                // The PMU multiplexed this group: extrapolate to the enabled time.
+                if (running == 0)
+                    v = 0;
+                else if (running < enabled)
+                    v = quint64(double(v) * double(enabled) / double(running));
+                a.last[size_t(g.counters[i])] = qint64(v);
+            }
+        }
+    }
+}
+
+void PerfCounters::refreshThreads()
+{
+    // Inherited events already count new threads, and the events of exited
+    // threads keep counting what those threads started.
+    if (!isOpen() || inherit_) return;
+    QSet<qint64> alive;
+    for (const ThreadEntry& t : listThreads(pid_))
+        alive.insert(t.tid);
+
+    // Fold exited threads into retired_ and drop their fds.
+    readAll();
+    QSet<qint64> known;
+    for (int i = int(attached_.size()) - 1; i >= 0; --i) {
+        const Attachment& a = attached_[i];
+        if (alive.contains(a.tid)) {
+            known.insert(a.tid);
+            continue;
+        }
+        Counts& r = retired_[slot(a.cpu)];
+        for (int c = 0; c < PerfReading::Count; ++c)
+            r[size_t(c)] += a.last[size_t(c)];
+        closeAttachment(a);
+        attached_.remove(i);
+    }
+    skipped_.erase(std::remove_if(skipped_.begin(), skipped_.end(),
+                                  [&alive](qint64 tid) { return !alive.contains(tid); }),
+                   skipped_.end());
+    for (qint64 tid : alive) {
+        if (known.contains(tid) || skipped_.contains(tid)) continue;
+        attachThread(tid);
+    }
+}
+
+PerfReading PerfCounters::collect(int cpu, qint64 timestampNs) const
+{
+    PerfReading r;
+    r.timestampNs = timestampNs;
+    const Counts& base = retired_[slot(cpu)];
+    for (int c = 0; c < PerfReading::Count; ++c)
+        r.values[c] = available_[c] ? base[size_t(c)] : -1;
+    for (const Attachment& a : attached_) {
+        if (a.cpu != cpu) continue;
+        for (int c = 0; c < PerfReading::Count; ++c)
+            if (available_[c]) r.values[c] += a.last[size_t(c)];
+    }
+    return r;
+}
+
+QVector<PerfReading> PerfCounters::readPerCpu(PerfReading* total)
+{
+    const qint64 now = monotonicNs();
+    QVector<PerfReading> perCpu;
+    if (!isOpen()) {
+        if (total) {
+            *total = PerfReading();
+            total->timestampNs = now;
+        }
+        return perCpu;
+    }
+    readAll();
+    if (cpus_.isEmpty()) {
+        if (total) *total = collect(-1, now);
+        return perCpu;
+    }
+
+    perCpu.resize(retired_.size());
+    PerfReading sum;
+    sum.timestampNs = now;
+    for (int c = 0; c < PerfReading::Count; ++c)
+        sum.values[c] = available_[c] ? 0 : -1;
+    for (int cpu : cpus_) {
+        perCpu[cpu] = collect(cpu, now);
+        for (int c = 0; c < PerfReading::Count; ++c)
+            if (available_[c]) sum.values[c] += perCpu[cpu].values[c];
+    }
+    if (total) *total = sum;
+    return perCpu;
+}
+
+#else
+
+bool PerfCounters::isSupported()
+{
+    return false;
+}
+
+bool PerfCounters::attach(qint64, int)
+{
+    return false;
+}
+
+bool PerfCounters::start(qint64, QString* error)
+{
+    if (error) *error = QStringLiteral("Hardware counters are only supported on Linux");
+    return false;
+}
+
+bool PerfCounters::openPerCpu(qint64 pid, const CpuSet&, QString* error)
+{
+    return open(pid, error);
+}
+
+void PerfCounters::readAll()
+{
+}
+
+void PerfCounters::closeAttachment(const Attachment&)
+{
+}
+
+void PerfCounters::close()
+{
+    attached_.clear();
+    pid_ = 0;
+}
+
+void PerfCounters::refreshThreads()
+{
+}
+
+PerfReading PerfCounters::collect(int, qint64 timestampNs) const
+{
+    PerfReading r;
+    r.timestampNs = timestampNs;
+    return r;
+}
+
+QVector<PerfReading> PerfCounters::readPerCpu(PerfReading* total)
+{
+    if (total) {
+        *total = PerfReading();
+        total->timestampNs = monotonicNs();
+    }
+    return QVector<PerfReading>();
+}
+
+#endif
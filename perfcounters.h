@@ -0,0 +1,116 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <QString>
+#include <QVector>
+#include <array>
+
+#include "cpuset.h"
+
+// One reading of a process's counters, summed over its threads. A counter the
+// kernel or PMU does not provide (VMs often lack hardware events) is -1.
+struct PerfReading {
+    enum Counter {
+        Instructions, Cycles, LlcMisses, ContextSwitches, Migrations, TaskClockNs,
+        LlcReferences, L1dLoads, L1dMisses, Branches, BranchMisses,
+        Count
+    };
+
+    qint64 values[Count]{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1};
+    qint64 timestampNs{0};    // monotonic
+
+    qint64 value(Counter c) const { return values[c]; }
+    bool has(Counter c) const { return values[c] >= 0; }
+    double ipc() const;        // instructions per cycle, 0 if unknown
+    // num / den, or -1 when either is unknown or den is 0.
+    double ratio(Counter num, Counter den) const;
+    PerfReading operator-(const PerfReading& earlier) const;   // per counter, -1 stays -1
+};
+
+QString perfCounterName(PerfReading::Counter c);   // stable key, e.g. "llc_misses"
+
+// perf_event_open counters for a running process, one set per thread (and
+// per CPU in per-CPU mode). Events are opened with `inherit`, so threads and
+// child processes started later are counted without more descriptors. They
+// are opened as three groups so ratios come from the same scheduling
+// intervals: {cycles, instructions, branches, branch misses}, {LLC
+// references, LLC misses, L1D loads, L1D misses} and the software events.
+// Groups the PMU has to multiplex are scaled by time_enabled / time_running.
+// Without hardware access (VM, or perf_event_paranoid) only the software
+// group is opened.
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    static bool isSupported();
+
+    // Whole-process counts. At most half of RLIMIT_NOFILE (and 4096)
+    // descriptors are used; threads past that are skipped.
+    bool open(qint64 pid, QString* error=nullptr);
+    // Separate counts for each CPU in `cpus`. Falls back to whole-process
+    // counts when threads x CPUs would need too many file descriptors.
+    bool openPerCpu(qint64 pid, const CpuSet& cpus, QString* error=nullptr);
+    void close();
+    bool isOpen() const { return pid_ > 0; }
+    qint64 pid() const { return pid_; }
+
+    bool perCpu() const { return !cpus_.isEmpty(); }
+    bool hasHardware() const { return groupOn_[0] || groupOn_[1]; }
+    // Why hardware or per-CPU counts, or some threads, are missing; empty if
+    // nothing is.
+    QString limitation() const;
+    // Threads left out because the descriptor budget or RLIMIT_NOFILE ran out.
+    const QVector<qint64>& skippedThreads() const { return skipped_; }
+
+    // Attaches counters to threads that appeared since the last call. Only
+    // needed on kernels without inherited group reads.
+    void refreshThreads();
+    // Counts since open(). Threads that exited keep contributing their last value.
+    PerfReading read();
+    // Index = CPU id; empty unless perCpu(). `total` gets the same as read().
+    QVector<PerfReading> readPerCpu(PerfReading* total=nullptr);
+
+private:
+    static constexpr int kGroups = 3;
+    using Counts = std::array<qint64, PerfReading::Count>;
+
+    struct Group {
+        QVector<int> fds;              // fds[0] is the leader
+        QVector<int> counters;         // PerfReading::Counter per fd
+    };
+    struct Attachment {
+        qint64 tid{0};
+        int cpu{-1};
+        Group groups[kGroups];
+        Counts last{};
+    };
+
+    bool start(qint64 pid, QString* error);
+    bool attach(qint64 tid, int cpu);
+    void attachThread(qint64 tid);     // on every CPU, within the budget
+    void addLimitation(const QString& why);
+    void readAll();
+    void closeAttachment(const Attachment& a);
+    int slot(int cpu) const { return cpu < 0 ? 0 : cpu; }
+    PerfReading collect(int cpu, qint64 timestampNs) const;
+
+    qint64 pid_{0};
+    QVector<int> cpus_;                // empty = whole process
+    QVector<Attachment> attached_;
+    QVector<Counts> retired_;          // by slot, from threads that have gone
+    bool available_[PerfReading::Count]{};
+    bool groupOn_[kGroups]{};          // leader opened on the first thread
+    bool userOnly_{false};
+    bool inherit_{true};               // false on kernels that refuse it with groups
+    int maxAttachments_{0};            // descriptor budget / descriptors per attachment
+    int openErrno_{0};                 // first leader attach() could not open
+    QVector<qint64> skipped_;
+    QString limitation_;
+};
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,332 @@
+#include "processenumerator.h"
+#include "telemetry.h"
+
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <tlhelp32.h>
+#include <string>
+#endif
+
+ProcessEnumerator::ProcessEnumerator()
+{
+#if defined(Q_OS_LINUX)
+    dirBuf_.resize(64 * 1024);
+#endif
+}
+
+ProcessEnumerator::~ProcessEnumerator()
+{
+#if defined(Q_OS_LINUX)
+    if (procFd_ >= 0)
+        ::close(procFd_);
+#endif
+}
+
+void ProcessEnumerator::setUseTelemetry(bool on)
+{
+    if (!on) {
+        telemetry_.reset();
+    } else if (!telemetry_) {
+        telemetry_ = std::make_unique<TelemetryReader>();
+        telemetry_->attach();
+    }
+}
+
+const QVector<ProcEntry>& ProcessEnumerator::scan()
+{
+    entries_.clear();
+    stats_.clear();
+    index_.clear();
+    rescan();
+    return entries_;
+}
+
+bool ProcessEnumerator::readTelemetry()
+{
+    // A collector that stopped, or was restarted under a new region.
+    if (!telemetry_->isFresh() && !(telemetry_->attach() && telemetry_->isFresh()))
+        return false;
+
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const quint64 seq = telemetry_->begin();
+        if (!seq) return false;
+        raw_.clear();
+#if defined(Q_OS_WINDOWS)
+        titles_.clear();
+#endif
+        const int n = telemetry_->processCount();
+        raw_.reserve(size_t(n));
+        for (int i = 0; i < n; ++i) {
+            const TelemetryProcess& p = telemetry_->process(i);
+#if defined(Q_OS_WINDOWS)
+            if (windowedOnly_ && p.titleLength == 0) continue;
+            if (p.titleLength) titles_.insert(p.pid, telemetry_->title(p));
+#endif
+            RawProc r{p.pid, p.startTime, QString(), Stats{p.cpuMs, p.rssBytes, p.threads, p.lastCpu}};
+            if (!isKnown(r.pid, r.startTime))
+                r.name = telemetry_->name(p);
+            raw_.push_back(std::move(r));
+        }
+        if (telemetry_->validate(seq))
+            return true;
+    }
+    return false;   // the collector kept writing; read the OS this time
+}
+
+bool ProcessEnumerator::isKnown(qint64 pid, quint64 startTime) const
+{
+    auto it = index_.constFind(pid);
+    return it != index_.constEnd() && entries_[*it].startTime == startTime;
+}
+
+ProcessDelta ProcessEnumerator::rescan()
+{
+    ProcessDelta delta;
+    usedTelemetry_ = telemetry_ && readTelemetry();
+    if (!usedTelemetry_ && !readRaw())
+        return delta; // keep the previous snapshot
+
+    QVector<ProcEntry> next;
+    QHash<qint64, int> nextIndex;
+    next.reserve(int(raw_.size()));
+    nextIndex.reserve(int(raw_.size()));
+    stats_.clear();
+    if (collectStats_) stats_.reserve(int(raw_.size()));
+    std::vector<char> kept(size_t(entries_.size()), 0);
+
+    for (RawProc& r : raw_) {
+        auto it = index_.constFind(r.pid);
+        if (it != index_.constEnd() && entries_[*it].startTime == r.startTime) {
+            kept[size_t(*it)] = 1;
+            next.append(entries_[*it]);
+        } else {
+            ProcEntry e;
+            e.name = std::move(r.name);
+            e.pid = r.pid;
+            e.startTime = r.startTime;
+#if defined(Q_OS_WINDOWS)
+            e.windowTitle = titles_.value(r.pid);
+#endif
+            delta.added.append(e);
+            next.append(std::move(e));
+        }
+        nextIndex.insert(r.pid, next.size() - 1);
+        if (collectStats_) stats_.append(r.stats);
+    }
+
+    for (int i = 0; i < entries_.size(); ++i) {
+        if (!kept[size_t(i)])
+            delta.removed.append(entries_[i].pid);
+    }
+
+    entries_.swap(next);
+    index_.swap(nextIndex);
+    return delta;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+struct LinuxDirent64 {
+    std::uint64_t  d_ino;
+    std::int64_t   d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[1];
+};
+
+// Fields 4..last of /proc/<pid>/stat into out[field], counted after the
+// "(comm)" field which may contain spaces. Returns the last field parsed.
+int parseStatFields(const char* afterComm, quint64* out, int last)
+{
+    const char* p = afterComm;
+    int field = 3;   // state
+    while (field < last) {
+        p = std::strchr(p + 1, ' ');
+        if (!p) break;
+        ++field;
+        char* end = nullptr;
+        out[field] = std::strtoull(p + 1, &end, 10);
+    }
+    return field;
+}
+
+} // namespace
+
+bool ProcessEnumerator::readRaw()
+{
+    if (procFd_ < 0) {
+        procFd_ = ::open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (procFd_ < 0) return false;
+    }
+    if (::lseek(procFd_, 0, SEEK_SET) < 0)
+        return false;
+
+    raw_.clear();
+    char path[32];
+    static const quint64 ticksPerSec = quint64(::sysconf(_SC_CLK_TCK));
+    static const qint64 pageSize = qint64(::sysconf(_SC_PAGESIZE));
+
+    for (;;) {
+        const long n = ::syscall(SYS_getdents64, procFd_, dirBuf_.data(), dirBuf_.size());
+        if (n < 0) return false;
+        if (n == 0) break;
+
+        for (long off = 0; off < n; ) {
+            const auto* d = reinterpret_cast<const LinuxDirent64*>(dirBuf_.data() + off);
+            off += d->d_reclen;
+
+            const char* name = d->d_name;
+            if (name[0] < '1' || name[0] > '9') continue;
+            qint64 pid = 0;
+            const char* c = name;
+            for (; *c >= '0' && *c <= '9'; ++c)
+                pid = pid * 10 + (*c - '0');
+            if (*c) continue;
+
+            std::snprintf(path, sizeof(path), "%s/stat", name);
+            const int fd = ::openat(procFd_, path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) continue; // exited since getdents
+            const ssize_t len = ::read(fd, statBuf_, sizeof(statBuf_) - 1);
+            ::close(fd);
+            if (len <= 0) continue;
+            statBuf_[len] = '\0';
+
+            const char* lp = std::strchr(statBuf_, '(');
+            const char* rp = std::strrchr(statBuf_, ')');
+            if (!lp || !rp || rp < lp) continue;
+
+            // utime 14, stime 15, threads 20, starttime 22, rss 24, processor 39
+            quint64 f[40] = {};
+            const int parsed = parseStatFields(rp + 1, f, collectStats_ ? 39 : 22);
+            RawProc r{pid, f[22], QString(), Stats()};
+            if (collectStats_) {
+                r.stats.cpuMs = (f[14] + f[15]) * 1000 / ticksPerSec;
+                r.stats.threads = int(f[20]);
+                r.stats.rssBytes = qint64(f[24]) * pageSize;
+                r.stats.lastCpu = parsed >= 39 ? int(f[39]) : -1;
+            }
+            if (!isKnown(r.pid, r.startTime))
+                r.name = QString::fromUtf8(lp + 1, int(rp - lp - 1));
+            raw_.push_back(std::move(r));
+        }
+    }
+    return true;
+}
+
+QString ProcessEnumerator::processName(qint64 pid)
+{
+    char path[48];
+    std::snprintf(path, sizeof(path), "/proc/%lld/comm", static_cast<long long>(pid));
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return QString();
+    char buf[64];
+    const ssize_t n = ::read(fd, buf, sizeof(buf));
+    ::close(fd);
+    if (n <= 0) return QString();
+    return QString::fromUtf8(buf, int(buf[n - 1] == '\n' ? n - 1 : n));
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+QString ProcessEnumerator::processName(qint64 pid)
+{
+    HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid));
+    if (!h) return QString();
+    wchar_t buf[MAX_PATH];
+    DWORD len = MAX_PATH;
+    const BOOL ok = ::QueryFullProcessImageNameW(h, 0, buf, &len);
+    ::CloseHandle(h);
+    if (!ok) return QString();
+    QString name = QString::fromWCharArray(buf, int(len));
+    name = name.mid(name.lastIndexOf('\\') + 1);
+    if (name.endsWith(QLatin1String(".exe"), Qt::CaseInsensitive))
+        name.chop(4);
+    return name;
+}
+
+static BOOL CALLBACK collectWindowTitle(HWND hwnd, LPARAM lparam)
+{
+    auto* titles = reinterpret_cast<QHash<qint64, QString>*>(lparam);
+    if (!::IsWindowVisible(hwnd) || ::GetWindow(hwnd, GW_OWNER) != nullptr)
+        return TRUE;
+    const int len = ::GetWindowTextLengthW(hwnd);
+    if (len <= 0)
+        return TRUE;
+    DWORD pid = 0;
+    ::GetWindowThreadProcessId(hwnd, &pid);
+    if (titles->contains(pid))
+        return TRUE;
+    std::wstring buf(size_t(len) + 1, L'\0');
+    const int got = ::GetWindowTextW(hwnd, buf.data(), len + 1);
+    titles->insert(pid, QString::fromWCharArray(buf.data(), got));
+    return TRUE;
+}
+
+bool ProcessEnumerator::readRaw()
+{
+    titles_.clear();
+    ::EnumWindows(collectWindowTitle, reinterpret_cast<LPARAM>(&titles_));
+
+    HANDLE snap = ::CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snap == INVALID_HANDLE_VALUE)
+        return false;
+
+    raw_.clear();
+    PROCESSENTRY32W pe{};
+    pe.dwSize = sizeof(pe);
+    for (BOOL more = ::Process32FirstW(snap, &pe); more; more = ::Process32NextW(snap, &pe)) {
+        const qint64 pid = pe.th32ProcessID;
+        if (pid == 0) continue;
+        if (windowedOnly_ && !titles_.contains(pid)) continue;
+
+        quint64 start = 0;
+        Stats stats;
+        stats.threads = int(pe.cntThreads);
+        if (HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pe.th32ProcessID)) {
+            FILETIME created{}, exited{}, kernel{}, user{};
+            if (::GetProcessTimes(h, &created, &exited, &kernel, &user)) {
+                start = (quint64(created.dwHighDateTime) << 32) | created.dwLowDateTime;
+                const quint64 k = (quint64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+                const quint64 u = (quint64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+                stats.cpuMs = (k + u) / 10000;   // 100 ns units
+            }
+            ::CloseHandle(h);
+        }
+
+        RawProc r{pid, start, QString(), stats};
+        if (!isKnown(pid, start)) {
+            r.name = QString::fromWCharArray(pe.szExeFile);
+            if (r.name.endsWith(QLatin1String(".exe"), Qt::CaseInsensitive))
+                r.name.chop(4);
+        }
+        raw_.push_back(std::move(r));
+    }
+    ::CloseHandle(snap);
+    return true;
+}
+
+#else
+
+QString ProcessEnumerator::processName(qint64)
+{
+    return QString();
+}
+
+bool ProcessEnumerator::readRaw()
+{
+    raw_.clear();
+    return false;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef PROCESSENUMERATOR_H
+#define PROCESSENUMERATOR_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+struct ProcEntry {
+    QString name;
+    qint64  pid{};
+    quint64 startTime{};   // clock ticks since boot (Linux) / FILETIME (Windows)
+    QString windowTitle;   // Windows only
+};
+
+// Difference between two consecutive scans. A pid whose start time changed
+// was reused by a new process and shows up in both lists.
+struct ProcessDelta {
+    QVector<ProcEntry> added;
+    QVector<qint64>    removed;
+
+    bool isEmpty() const { return added.isEmpty() && removed.isEmpty(); }
+};
+
+class TelemetryReader;
+
+// Native process enumerator. Walks /proc with getdents64 on Linux and a
+// Toolhelp snapshot on Windows; buffers are kept between scans. With
+// setUseTelemetry() it reads a running collector's shared snapshot instead,
+// and walks the OS itself whenever there is none.
+class ProcessEnumerator
+{
+public:
+    // Counters read along with each process, per scan.
+    struct Stats {
+        quint64 cpuMs{0};         // user + kernel since start
+        qint64  rssBytes{0};      // Linux only
+        int     threads{0};
+        int     lastCpu{-1};      // Linux only
+    };
+
+    ProcessEnumerator();
+    ~ProcessEnumerator();
+
+    ProcessEnumerator(const ProcessEnumerator&) = delete;
+    ProcessEnumerator& operator=(const ProcessEnumerator&) = delete;
+
+    // On Windows, only list processes that own a visible titled window
+    // (matches the old Get-Process | Where MainWindowTitle filter).
+    void setWindowedOnly(bool on) { windowedOnly_ = on; }
+    // Fill stats() on every scan; costs nothing extra on Linux.
+    void setCollectStats(bool on) { collectStats_ = on; }
+    void setUseTelemetry(bool on);
+    // The last scan came from a collector's snapshot.
+    bool usedTelemetry() const { return usedTelemetry_; }
+
+    // Forget the previous snapshot and scan from scratch.
+    const QVector<ProcEntry>& scan();
+
+    // Scan again and report what changed since the previous scan. Processes
+    // whose (pid, start time) is unchanged are not re-parsed.
+    ProcessDelta rescan();
+
+    const QVector<ProcEntry>& entries() const { return entries_; }
+    // Parallel to entries(); empty unless setCollectStats(true).
+    const QVector<Stats>& stats() const { return stats_; }
+
+    // Name of a single process as scan() would report it (comm on Linux,
+    // image name without ".exe" on Windows); empty if it is gone.
+    static QString processName(qint64 pid);
+
+private:
+    struct RawProc {
+        qint64  pid;
+        quint64 startTime;
+        QString name;      // only decoded for processes not in the previous snapshot
+        Stats   stats;
+    };
+
+    bool readRaw();        // fills raw_ from the OS
+    bool readTelemetry();  // fills raw_ from the collector's region
+    bool isKnown(qint64 pid, quint64 startTime) const;
+
+    QVector<ProcEntry>   entries_;
+    QVector<Stats>       stats_;
+    QHash<qint64, int>   index_;             // pid -> row in entries_
+    std::vector<RawProc> raw_;
+    bool windowedOnly_{true};
+    bool collectStats_{false};
+    bool usedTelemetry_{false};
+    std::unique_ptr<TelemetryReader> telemetry_;
+
+#if defined(Q_OS_LINUX)
+    int procFd_{-1};
+    std::vector<char> dirBuf_;
+    char statBuf_[1024]{};
+#elif defined(Q_OS_WINDOWS)
+    QHash<qint64, QString> titles_;          // pid -> main window title
+#endif
+};
+
+#endif // PROCESSENUMERATOR_H
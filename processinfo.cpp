@@ -0,0 +1,283 @@
+#include "processinfo.h"
+#include "affinitybackend.h"
+#include "cgroupcpuset.h"
+#include "numamemory.h"
+#include "telemetry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QThread>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#include <iterator>
+#include <string>
+#endif
+
+static bool cancelled(const std::atomic_bool* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+#if defined(Q_OS_LINUX)
+
+static QByteArray readProcFile(qint64 pid, const char* name)
+{
+    QFile f(QStringLiteral("/proc/%1/%2").arg(pid).arg(QLatin1String(name)));
+    if (!f.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return f.readAll();
+}
+
+// "VmRSS:     1234 kB" -> bytes
+static qint64 statusKb(const QByteArray& status, const char* key)
+{
+    const int at = status.indexOf(key);
+    if (at < 0) return 0;
+    const int eol = status.indexOf('\n', at);
+    const QByteArray line = status.mid(at + int(qstrlen(key)), eol < 0 ? -1 : eol - at - int(qstrlen(key)));
+    return line.trimmed().split(' ').value(0).toLongLong() * 1024;
+}
+
+static qint64 bootTimeSecs()
+{
+    static const qint64 btime = [] {
+        QFile f(QStringLiteral("/proc/stat"));
+        if (!f.open(QIODevice::ReadOnly)) return qint64(0);
+        while (!f.atEnd()) {
+            const QByteArray line = f.readLine();
+            if (line.startsWith("btime "))
+                return line.mid(6).trimmed().toLongLong();
+        }
+        return qint64(0);
+    }();
+    return btime;
+}
+
+static void collectNative(qint64 pid, ProcessInfo* info, const std::atomic_bool* cancel)
+{
+    const QByteArray stat = readProcFile(pid, "stat");
+    const int lp = stat.indexOf('(');
+    const int rp = stat.lastIndexOf(')');
+    if (lp < 0 || rp < lp) {
+        info->error = QStringLiteral("Process %1 not found.").arg(pid);
+        return;
+    }
+    info->name = QString::fromUtf8(stat.mid(lp + 1, rp - lp - 1));
+
+    // Fields after "(comm)" start at 3 (state); index 0 here is field 3.
+    const QList<QByteArray> f = stat.mid(rp + 2).split(' ');
+    auto field = [&](int n) { return f.value(n - 3).toULongLong(); };
+    const double ticks = double(::sysconf(_SC_CLK_TCK));
+    info->cpuSeconds = double(field(14) + field(15)) / ticks;
+    info->threads = int(field(20));
+    const qint64 startMs = bootTimeSecs() * 1000 + qint64(double(field(22)) * 1000.0 / ticks);
+    info->startTime = QDateTime::fromMSecsSinceEpoch(startMs);
+
+    if (cancelled(cancel)) return;
+
+    info->path = QFileInfo(QStringLiteral("/proc/%1/exe").arg(pid)).symLinkTarget();
+
+    const QByteArray status = readProcFile(pid, "status");
+    info->workingSet   = statusKb(status, "VmRSS:");
+    info->privateBytes = statusKb(status, "RssAnon:");
+    info->pagedBytes   = statusKb(status, "VmSwap:");
+    info->cgroup       = CgroupCpuset::groupOf(pid);
+    info->cgroupCpus   = CgroupCpuset::effectiveCpus(info->cgroup);
+
+    if (cancelled(cancel)) return;
+
+    QDir fds(QStringLiteral("/proc/%1/fd").arg(pid));
+    if (fds.isReadable())
+        info->handles = int(fds.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).size());
+
+    if (cancelled(cancel)) return;
+
+    // Walks the page tables of the whole process; left for last.
+    info->numaBytes = numaResidentBytes(pid);
+
+    info->valid = true;
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+namespace {
+
+struct MainWindowSearch {
+    DWORD pid;
+    HWND  hwnd;
+};
+
+BOOL CALLBACK findMainWindow(HWND hwnd, LPARAM lparam)
+{
+    auto* s = reinterpret_cast<MainWindowSearch*>(lparam);
+    DWORD pid = 0;
+    ::GetWindowThreadProcessId(hwnd, &pid);
+    if (pid != s->pid || !::IsWindowVisible(hwnd) || ::GetWindow(hwnd, GW_OWNER) != nullptr
+        || ::GetWindowTextLengthW(hwnd) <= 0)
+        return TRUE;
+    s->hwnd = hwnd;
+    return FALSE;
+}
+
+qint64 fileTimeToInt(const FILETIME& ft)
+{
+    return (qint64(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+} // namespace
+
+static void collectNative(qint64 pid, ProcessInfo* info, const std::atomic_bool* cancel)
+{
+    HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, DWORD(pid));
+    if (!h)
+        h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, DWORD(pid));
+    if (!h) {
+        info->error = qt_error_string(int(::GetLastError()));
+        return;
+    }
+
+    wchar_t buf[MAX_PATH * 2];
+    DWORD len = DWORD(std::size(buf));
+    if (::QueryFullProcessImageNameW(h, 0, buf, &len)) {
+        info->path = QDir::toNativeSeparators(QString::fromWCharArray(buf, int(len)));
+        info->name = QFileInfo(QString::fromWCharArray(buf, int(len))).completeBaseName();
+    }
+
+    FILETIME created{}, exited{}, kernel{}, user{};
+    if (::GetProcessTimes(h, &created, &exited, &kernel, &user)) {
+        // FILETIME is 100 ns since 1601-01-01.
+        const qint64 msSince1601 = fileTimeToInt(created) / 10000;
+        info->startTime = QDateTime::fromMSecsSinceEpoch(msSince1601 - 11644473600000LL);
+        info->cpuSeconds = double(fileTimeToInt(kernel) + fileTimeToInt(user)) / 1e7;
+    }
+
+    PROCESS_MEMORY_COUNTERS_EX mem{};
+    if (::GetProcessMemoryInfo(h, reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&mem), sizeof(mem))) {
+        info->workingSet   = qint64(mem.WorkingSetSize);
+        info->privateBytes = qint64(mem.PrivateUsage);
+        info->pagedBytes   = qint64(mem.PagefileUsage);
+    }
+
+    DWORD handles = 0;
+    if (::GetProcessHandleCount(h, &handles))
+        info->handles = int(handles);
+    ::CloseHandle(h);
+
+    if (cancelled(cancel)) return;
+
+    HANDLE snap = ::CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snap != INVALID_HANDLE_VALUE) {
+        PROCESSENTRY32W pe{};
+        pe.dwSize = sizeof(pe);
+        for (BOOL more = ::Process32FirstW(snap, &pe); more; more = ::Process32NextW(snap, &pe)) {
+            if (pe.th32ProcessID == DWORD(pid)) {
+                info->threads = int(pe.cntThreads);
+                if (info->name.isEmpty())
+                    info->name = QFileInfo(QString::fromWCharArray(pe.szExeFile)).completeBaseName();
+                break;
+            }
+        }
+        ::CloseHandle(snap);
+    }
+
+    MainWindowSearch search{DWORD(pid), nullptr};
+    ::EnumWindows(findMainWindow, reinterpret_cast<LPARAM>(&search));
+    if (search.hwnd) {
+        const int n = ::GetWindowTextLengthW(search.hwnd);
+        std::wstring title(size_t(n) + 1, L'\0');
+        const int got = ::GetWindowTextW(search.hwnd, title.data(), n + 1);
+        info->windowTitle = QString::fromWCharArray(title.data(), got);
+        info->responding = ::IsHungAppWindow(search.hwnd) ? 0 : 1;
+    }
+
+    info->valid = true;
+}
+
+#else
+
+static void collectNative(qint64, ProcessInfo* info, const std::atomic_bool*)
+{
+    info->error = QStringLiteral("Process info is not supported on this platform.");
+}
+
+#endif
+
+ProcessInfo collectProcessInfo(qint64 pid, const std::atomic_bool* cancel)
+{
+    ProcessInfo info;
+    info.pid = pid;
+    info.totalCores = QThread::idealThreadCount();
+    if (pid <= 0) {
+        info.error = QStringLiteral("No process selected.");
+        return info;
+    }
+
+    collectNative(pid, &info, cancel);
+    if (!info.valid || cancelled(cancel)) {
+        info.valid = false;
+        return info;
+    }
+
+    BackendError err;
+    if (!AffinityBackend::createNative()->processAffinity(pid, &info.affinity, &err))
+        info.affinity.clear();
+
+    // Recent usage needs two samples; a running collector already has them.
+    TelemetryReader telemetry;
+    TelemetryProcess rec{};
+    if (telemetry.attach() && telemetry.isFresh() && telemetry.find(pid, &rec))
+        info.cpuUsage = rec.cpuUsage;
+    return info;
+}
+
+// ---------- ProcessInfoLoader ----------
+
+ProcessInfoLoader::ProcessInfoLoader(QObject* parent)
+    : QObject(parent)
+    , cancel_(std::make_shared<std::atomic_bool>(false))
+{
+    pool_.setMaxThreadCount(2);
+}
+
+ProcessInfoLoader::~ProcessInfoLoader()
+{
+    // Workers post back to `this`; make sure none outlives it.
+    cancel();
+    pool_.waitForDone();
+}
+
+quint64 ProcessInfoLoader::request(qint64 pid)
+{
+    cancel();
+    cancel_ = std::make_shared<std::atomic_bool>(false);
+    const quint64 gen = ++generation_;
+
+    auto flag = cancel_;
+    pool_.start([this, gen, pid, flag]() {
+        ProcessInfo info = collectProcessInfo(pid, flag.get());
+        if (flag->load()) return;
+        QMetaObject::invokeMethod(this, [this, gen, info]() { deliver(gen, info); },
+                                  Qt::QueuedConnection);
+    });
+    return gen;
+}
+
+void ProcessInfoLoader::cancel()
+{
+    cancel_->store(true);
+    pool_.clear(); // drop queued requests that have not started yet
+}
+
+void ProcessInfoLoader::deliver(quint64 generation, const ProcessInfo& info)
+{
+    if (generation != generation_)
+        return; // stale: a newer request was made meanwhile
+    emit loaded(generation, info);
+}
@@ -0,0 +1,68 @@
+#ifndef PROCESSINFO_H
+#define PROCESSINFO_H
+
+#include <QDateTime>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+#include "cpuset.h"
+
+struct ProcessInfo {
+    qint64    pid{0};
+    bool      valid{false};
+    QString   error;            // set when !valid
+
+    QString   name;
+    QString   windowTitle;      // Windows only
+    QString   path;
+    QDateTime startTime;
+    double    cpuSeconds{0.0};  // user + kernel
+    double    cpuUsage{-1};     // cores over the collector's last interval; -1 = no collector
+    qint64    workingSet{0};    // bytes resident
+    qint64    privateBytes{0};  // Windows: private commit, Linux: RssAnon
+    qint64    pagedBytes{0};    // Windows: pagefile usage, Linux: VmSwap
+    int       threads{0};
+    int       handles{-1};      // Linux: open fds; -1 = not readable
+    int       responding{-1};   // -1 = unknown / no window
+    CpuSet    affinity;         // allowed CPUs
+    QVector<qint64> numaBytes;  // resident bytes per NUMA node (Linux)
+    QString   cgroup;           // Linux: cgroup path relative to the mount
+    CpuSet    cgroupCpus;       // cpuset.cpus.effective of that group (cgroup v2)
+    int       totalCores{0};
+};
+
+// Gathers ProcessInfo with native calls. `cancel` is polled between steps;
+// a cancelled result has valid == false.
+ProcessInfo collectProcessInfo(qint64 pid, const std::atomic_bool* cancel = nullptr);
+
+// Runs collectProcessInfo on a worker thread. Each request() bumps a
+// generation counter and cancels the one in flight; loaded() is only
+// emitted (on the owner's thread) for the latest generation.
+class ProcessInfoLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProcessInfoLoader(QObject* parent=nullptr);
+    ~ProcessInfoLoader() override;
+
+    quint64 request(qint64 pid);
+    void cancel();
+
+    quint64 generation() const { return generation_; }
+
+signals:
+    void loaded(quint64 generation, const ProcessInfo& info);
+
+private:
+    void deliver(quint64 generation, const ProcessInfo& info);
+
+    QThreadPool pool_;
+    quint64 generation_{0};
+    std::shared_ptr<std::atomic_bool> cancel_;
+};
+
+#endif // PROCESSINFO_H
@@ -1,12 +1,11 @@
 #include "processlistdialog.h"
+#include "processtablemodel.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QPushButton>
-#include <QTableWidget>
+#include <QTableView>
 #include <QHeaderView>
-#include <QProcess>
-#include <QTextStream>
-#include <QRegularExpression>
+#include <QTimer>
 
 ProcessListDialog::ProcessListDialog(QWidget* parent)
     : QDialog(parent)
@@ -15,16 +14,26 @@ ProcessListDialog::ProcessListDialog(QWidget* parent)
     resize(600, 400);
 
     auto* v = new QVBoxLayout(this);
-    table_ = new QTableWidget(this);
-    table_->setColumnCount(2);
-    table_->setHorizontalHeaderLabels({"Name", "PID"});
-    table_->horizontalHeader()->setStretchLastSection(true);
+    model_ = new ProcessTableModel(this);
+    table_ = new QTableView(this);
+    table_->setModel(model_);
     table_->setSelectionBehavior(QAbstractItemView::SelectRows);
     table_->setSelectionMode(QAbstractItemView::SingleSelection);
     table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->setWordWrap(false);
+    // Fixed sizes: never measure cells, the model is rendered lazily.
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 6);
+    table_->verticalHeader()->hide();
+    table_->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
+    table_->horizontalHeader()->setStretchLastSection(true);
+    table_->setColumnWidth(ProcessTableModel::ColName, 220);
+    table_->setColumnWidth(ProcessTableModel::ColPid, 80);
     v->addWidget(table_);
 
     auto* h = new QHBoxLayout();
+    auto* btnRefresh = new QPushButton("Refresh", this);
+    h->addWidget(btnRefresh);
     h->addStretch();
     auto* btnOk = new QPushButton("OK", this);
     auto* btnCancel = new QPushButton("Cancel", this);
@@ -34,91 +43,43 @@ ProcessListDialog::ProcessListDialog(QWidget* parent)
 
     connect(btnOk, &QPushButton::clicked, this, &ProcessListDialog::onAccept);
     connect(btnCancel, &QPushButton::clicked, this, &ProcessListDialog::reject);
-    connect(table_, &QTableWidget::cellDoubleClicked, this, &ProcessListDialog::onActivated);
+    connect(btnRefresh, &QPushButton::clicked, this, &ProcessListDialog::refresh);
+    connect(table_, &QTableView::doubleClicked, this, &ProcessListDialog::onActivated);
 
+    // Read a running collector's list when there is one instead of walking /proc.
+    enumerator_.setUseTelemetry(true);
     populate();
+
+    // Keep the list current while the dialog is open; rows update in place.
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(2000);
+    connect(refreshTimer_, &QTimer::timeout, this, &ProcessListDialog::refresh);
+    refreshTimer_->start();
 }
 
 void ProcessListDialog::populate()
 {
-#ifdef Q_OS_WINDOWS
-    // PowerShell: only processes with a window (non-background)
-    QString cmd =
-        "Get-Process | Where-Object { $_.MainWindowTitle -ne \"\" } "
-        "| Select-Object -Property ProcessName,Id,MainWindowTitle "
-        "| Sort-Object -Property ProcessName,Id "
-        "| ConvertTo-Csv -NoTypeInformation";
-
-    QProcess p;
-    p.start("powershell", {"-NoLogo","-NoProfile","-Command", cmd});
-    p.waitForFinished(3000);
-    const QString csv = QString::fromLocal8Bit(p.readAllStandardOutput());
-
-    // Split lines (use static regex to avoid temp objects each call)
-    static const QRegularExpression lineBreakRe("[\r\n]");
-    QStringList lines = csv.split(lineBreakRe, Qt::SkipEmptyParts);
-    if (lines.size() < 2) return; // no data
-    lines.removeFirst(); // remove header
-
-    // Setup table for 3 columns: Name, PID, Window Title
-    table_->setColumnCount(3);
-    table_->setHorizontalHeaderLabels({"Name", "PID", "Window Title"});
-    table_->setRowCount(lines.size());
-
-    int r = 0;
-    for (const QString& line : lines) {
-        QString s = line.trimmed();
-        if (!s.startsWith('"')) continue;
-
-        // Naive CSV split (since we know fields are quoted)
-        QStringList cols;
-        QString tmp;
-        bool inQuotes = false;
-        for (QChar c : s) {
-            if (c == '"') { inQuotes = !inQuotes; continue; }
-            if (c == ',' && !inQuotes) { cols << tmp; tmp.clear(); continue; }
-            tmp.append(c);
-        }
-        cols << tmp;
-
-        if (cols.size() < 3) continue;
-        QString name = cols[0].trimmed();
-        QString pidStr = cols[1].trimmed();
-        QString windowTitle = cols[2].trimmed();
-
-        bool ok = false;
-        qint64 pid = pidStr.toLongLong(&ok);
-        if (!ok) continue;
-
-        // Insert into table
-        table_->setItem(r, 0, new QTableWidgetItem(name));
-
-        auto* pidItem = new QTableWidgetItem(QString::number(pid));
-        pidItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-        table_->setItem(r, 1, pidItem);
-
-        table_->setItem(r, 2, new QTableWidgetItem(windowTitle));
-        ++r;
-    }
+    model_->reset(enumerator_.scan());
+}
 
-    table_->setRowCount(r); // in case of skips
-    table_->resizeColumnsToContents();
-#else
-    table_->setRowCount(0);
-#endif
+void ProcessListDialog::refresh()
+{
+    const ProcessDelta delta = enumerator_.rescan();
+    if (!delta.isEmpty())
+        model_->applyDelta(delta);
 }
 
-void ProcessListDialog::onActivated(int row, int /*col*/)
+void ProcessListDialog::onActivated(const QModelIndex& index)
 {
-    if (row < 0) return;
-    selected_.name = table_->item(row, 0)->text();
-    selected_.pid  = table_->item(row, 1)->text().toLongLong();
+    if (!index.isValid()) return;
+    selected_ = model_->entryAt(index.row());
     accept();
 }
 
 void ProcessListDialog::onAccept()
 {
-    int row = table_->currentRow();
-    if (row < 0 && table_->rowCount() > 0) row = 0;
-    onActivated(row, 0);
+    QModelIndex index = table_->currentIndex();
+    if (!index.isValid() && model_->rowCount() > 0)
+        index = model_->index(0, 0);
+    onActivated(index);
 }
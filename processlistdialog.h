@@ -4,12 +4,12 @@
 #include <QDialog>
 #include <QVector>
 
-struct ProcEntry {
-    QString name;
-    qint64 pid{};
-};
+#include "processenumerator.h"
 
-class QTableWidget;
+class QTableView;
+class QModelIndex;
+class QTimer;
+class ProcessTableModel;
 
 class ProcessListDialog : public QDialog
 {
@@ -22,10 +22,14 @@ public:
 
 private:
     void populate();
+    void refresh();   // incremental: only touches new and exited processes
     void onAccept();
-    void onActivated(int row, int /*col*/);
+    void onActivated(const QModelIndex& index);
 
-    QTableWidget* table_{};
+    QTableView* table_{};
+    ProcessTableModel* model_{};
+    QTimer* refreshTimer_{};
+    ProcessEnumerator enumerator_;
     ProcEntry selected_{};
 };
 
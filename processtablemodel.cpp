@@ -0,0 +1,232 @@
+#include "processtablemodel.h"
+
+#include <QSet>
+#include <algorithm>
+
+// ---------- ProcessSnapshot ----------
+
+int ProcessSnapshot::intern(const QString& s)
+{
+    auto it = stringIds.constFind(s);
+    if (it != stringIds.constEnd())
+        return *it;
+    const int id = int(strings.size());
+    strings.append(s);
+    stringIds.insert(s, id);
+    return id;
+}
+
+void ProcessSnapshot::clear()
+{
+    pids.clear();
+    startTimes.clear();
+    nameIds.clear();
+    titleIds.clear();
+    strings.clear();
+    stringIds.clear();
+}
+
+void ProcessSnapshot::append(const ProcEntry& e)
+{
+    pids.append(e.pid);
+    startTimes.append(e.startTime);
+    nameIds.append(intern(e.name));
+    titleIds.append(e.windowTitle.isEmpty() ? -1 : intern(e.windowTitle));
+}
+
+void ProcessSnapshot::insert(int row, const ProcEntry& e)
+{
+    pids.insert(row, e.pid);
+    startTimes.insert(row, e.startTime);
+    nameIds.insert(row, intern(e.name));
+    titleIds.insert(row, e.windowTitle.isEmpty() ? -1 : intern(e.windowTitle));
+}
+
+void ProcessSnapshot::removeRange(int first, int count)
+{
+    pids.remove(first, count);
+    startTimes.remove(first, count);
+    nameIds.remove(first, count);
+    titleIds.remove(first, count);
+}
+
+void ProcessSnapshot::compactStrings()
+{
+    QStringList kept;
+    QHash<QString, int> keptIds;
+    QVector<int> remap(strings.size(), -1);
+    auto keep = [&](int& id) {
+        if (id < 0) return;
+        if (remap[id] < 0) {
+            remap[id] = int(kept.size());
+            kept.append(strings[id]);
+            keptIds.insert(strings[id], remap[id]);
+        }
+        id = remap[id];
+    };
+    for (int& id : nameIds) keep(id);
+    for (int& id : titleIds) keep(id);
+    strings = kept;
+    stringIds = keptIds;
+}
+
+ProcEntry ProcessSnapshot::entry(int row) const
+{
+    ProcEntry e;
+    e.pid = pids[row];
+    e.startTime = startTimes[row];
+    e.name = strings[nameIds[row]];
+    if (titleIds[row] >= 0)
+        e.windowTitle = strings[titleIds[row]];
+    return e;
+}
+
+// ---------- ProcessTableModel ----------
+
+namespace {
+
+// Rows are ordered by name, case-insensitively, then by PID.
+bool rowLess(const QString& aName, qint64 aPid, const QString& bName, qint64 bPid)
+{
+    const int c = aName.compare(bName, Qt::CaseInsensitive);
+    return c != 0 ? c < 0 : aPid < bPid;
+}
+
+bool entryLess(const ProcEntry& a, const ProcEntry& b)
+{
+    return rowLess(a.name, a.pid, b.name, b.pid);
+}
+
+} // namespace
+
+ProcessTableModel::ProcessTableModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+void ProcessTableModel::reset(QVector<ProcEntry> entries)
+{
+    std::sort(entries.begin(), entries.end(), entryLess);
+
+    beginResetModel();
+    snap_.clear();
+    snap_.pids.reserve(entries.size());
+    snap_.startTimes.reserve(entries.size());
+    snap_.nameIds.reserve(entries.size());
+    snap_.titleIds.reserve(entries.size());
+    for (const ProcEntry& e : entries)
+        snap_.append(e);
+    endResetModel();
+}
+
+void ProcessTableModel::applyDelta(const ProcessDelta& delta)
+{
+    if (!delta.removed.isEmpty()) {
+        const QSet<qint64> gone(delta.removed.cbegin(), delta.removed.cend());
+        // Walk backwards and remove contiguous runs in one notification each.
+        for (int r = snap_.size() - 1; r >= 0; --r) {
+            if (!gone.contains(snap_.pids[r])) continue;
+            const int last = r;
+            while (r > 0 && gone.contains(snap_.pids[r - 1]))
+                --r;
+            beginRemoveRows(QModelIndex(), r, last);
+            snap_.removeRange(r, last - r + 1);
+            endRemoveRows();
+        }
+        // Exited names stay in the pool until it holds more strings than
+        // the rows could use; then it is rebuilt from the live rows.
+        if (snap_.strings.size() > 2 * snap_.size())
+            snap_.compactStrings();
+    }
+
+    if (!delta.added.isEmpty()) {
+        QVector<ProcEntry> added = delta.added;
+        std::sort(added.begin(), added.end(), entryLess);
+        // Each new row goes where reset() would have put it. Rows that land
+        // between the same two existing rows go in with one notification.
+        int row = 0;
+        for (int i = 0; i < added.size();) {
+            row = sortedRow(added[i], row);
+            int end = i + 1;
+            while (end < added.size() && (row == snap_.size() || rowLess(added[end].name, added[end].pid,
+                                                                        snap_.strings[snap_.nameIds[row]], snap_.pids[row])))
+                ++end;
+            beginInsertRows(QModelIndex(), row, row + (end - i) - 1);
+            for (int k = i; k < end; ++k)
+                snap_.insert(row + (k - i), added[k]);
+            endInsertRows();
+            row += end - i;
+            i = end;
+        }
+    }
+}
+
+// First row at or after `from` that sorts after `e`.
+int ProcessTableModel::sortedRow(const ProcEntry& e, int from) const
+{
+    int lo = from, hi = snap_.size();
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        if (rowLess(snap_.strings[snap_.nameIds[mid]], snap_.pids[mid], e.name, e.pid))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+ProcEntry ProcessTableModel::entryAt(int row) const
+{
+    if (row < 0 || row >= snap_.size())
+        return ProcEntry{};
+    return snap_.entry(row);
+}
+
+int ProcessTableModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : snap_.size();
+}
+
+int ProcessTableModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+#ifdef Q_OS_WINDOWS
+    return 3; // Name, PID, Window Title
+#else
+    return 2;
+#endif
+}
+
+QVariant ProcessTableModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= snap_.size())
+        return QVariant();
+    const int row = index.row();
+
+    switch (role) {
+    case Qt::DisplayRole:
+        switch (index.column()) {
+        case ColName:  return snap_.strings[snap_.nameIds[row]];
+        case ColPid:   return snap_.pids[row];
+        case ColTitle: return snap_.titleIds[row] >= 0 ? snap_.strings[snap_.titleIds[row]] : QString();
+        }
+        break;
+    case Qt::TextAlignmentRole:
+        if (index.column() == ColPid)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        break;
+    }
+    return QVariant();
+}
+
+QVariant ProcessTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+    switch (section) {
+    case ColName:  return QStringLiteral("Name");
+    case ColPid:   return QStringLiteral("PID");
+    case ColTitle: return QStringLiteral("Window Title");
+    }
+    return QVariant();
+}
@@ -0,0 +1,60 @@
+#ifndef PROCESSTABLEMODEL_H
+#define PROCESSTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QStringList>
+#include <QVector>
+
+#include "processenumerator.h"
+
+// Flat struct-of-arrays process snapshot. Row i is pids[i], startTimes[i],
+// nameIds[i] and titleIds[i]; names and titles are interned in `strings`.
+struct ProcessSnapshot {
+    QVector<qint64>  pids;
+    QVector<quint64> startTimes;
+    QVector<int>     nameIds;
+    QVector<int>     titleIds;     // -1 = no title
+    QStringList      strings;
+    QHash<QString, int> stringIds;
+
+    int size() const { return int(pids.size()); }
+    int intern(const QString& s);
+    void clear();
+    void append(const ProcEntry& e);
+    void insert(int row, const ProcEntry& e);
+    void removeRange(int first, int count);
+    void compactStrings();         // drop strings no row refers to
+    ProcEntry entry(int row) const;
+};
+
+// Renders the snapshot on demand; nothing is materialised per cell.
+class ProcessTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column { ColName, ColPid, ColTitle };
+
+    explicit ProcessTableModel(QObject* parent=nullptr);
+
+    // Replace everything (sorted by name, then PID).
+    void reset(QVector<ProcEntry> entries);
+
+    // Remove exited rows and insert new ones at their sorted place with
+    // row-level notifications, so views keep their scroll position and selection.
+    void applyDelta(const ProcessDelta& delta);
+
+    ProcEntry entryAt(int row) const;
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    int sortedRow(const ProcEntry& e, int from) const;
+
+    ProcessSnapshot snap_;
+};
+
+#endif // PROCESSTABLEMODEL_H
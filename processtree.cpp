@@ -0,0 +1,445 @@
+#include "processtree.h"
+#include "processwatcher.h"
+
+#include <QElapsedTimer>
+#include <QSet>
+#include <QThread>
+#include <cerrno>
+#include <thread>
+#include <vector>
+
+#if defined(Q_OS_LINUX)
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <tlhelp32.h>
+#endif
+
+namespace {
+
+// Walks until one finds nothing new; more than this means something forks
+// faster than we can follow, and the follower picks up the rest.
+constexpr int kMaxPasses = 4;
+
+// Runs fn(i) for every i below n, strided over up to eight threads once
+// there are at least `perWorker` items per thread.
+template <typename Fn>
+void parallelFor(int n, int perWorker, Fn fn)
+{
+    const int workers = qBound(1, qMin(QThread::idealThreadCount(), n / perWorker), 8);
+    if (workers == 1) {
+        for (int i = 0; i < n; ++i) fn(i);
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&fn, n, w, workers] {
+            for (int i = w; i < n; i += workers) fn(i);
+        });
+    }
+    for (std::thread& t : pool) t.join();
+}
+
+} // namespace
+
+#if defined(Q_OS_LINUX)
+
+QVector<qint64> childProcesses(qint64 pid)
+{
+    QVector<qint64> children;
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%lld/task", static_cast<long long>(pid));
+    DIR* d = ::opendir(path);
+    if (!d) return children;
+    char buf[4096];
+    while (dirent* e = ::readdir(d)) {
+        if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        char name[300];
+        std::snprintf(name, sizeof(name), "%s/children", e->d_name);
+        const int fd = ::openat(::dirfd(d), name, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        // "123 456 ", possibly split across reads.
+        qint64 value = 0;
+        bool inNumber = false;
+        ssize_t n;
+        while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < n; ++i) {
+                if (buf[i] >= '0' && buf[i] <= '9') {
+                    value = value * 10 + (buf[i] - '0');
+                    inNumber = true;
+                } else if (inNumber) {
+                    children.append(value);
+                    value = 0;
+                    inNumber = false;
+                }
+            }
+        }
+        if (inNumber) children.append(value);
+        ::close(fd);
+    }
+    ::closedir(d);
+    return children;
+}
+
+qint64 parentProcess(qint64 pid)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%lld/stat", static_cast<long long>(pid));
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    char buf[512];
+    const ssize_t n = ::read(fd, buf, sizeof(buf) - 1);
+    ::close(fd);
+    if (n <= 0) return 0;
+    buf[n] = '\0';
+    // "pid (comm) state ppid ...", and comm may contain anything.
+    const char* close = std::strrchr(buf, ')');
+    long long ppid = 0;
+    if (!close || std::sscanf(close + 1, " %*c %lld", &ppid) != 1) return 0;
+    return qint64(ppid);
+}
+
+QVector<qint64> processTree(qint64 root)
+{
+    QVector<qint64> tree{root};
+    QSet<qint64> seen{root};
+    QVector<qint64> level{root};
+    while (!level.isEmpty()) {
+        QVector<QVector<qint64>> children(level.size());
+        parallelFor(int(level.size()), 16, [&](int i) { children[i] = childProcesses(level[i]); });
+        QVector<qint64> next;
+        for (const QVector<qint64>& c : children) {
+            for (qint64 pid : c) {
+                if (seen.contains(pid)) continue;
+                seen.insert(pid);
+                next.append(pid);
+            }
+        }
+        tree += next;
+        level = next;
+    }
+    return tree;
+}
+
+static bool processGone(qint64 pid)
+{
+    return ::kill(pid_t(pid), 0) != 0 && errno == ESRCH;
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+// Parent -> children from one snapshot. A parent id may have been reused by
+// an unrelated process since the child started; Windows does not say.
+static QHash<qint64, QVector<qint64>> childMap(QHash<qint64, qint64>* parents = nullptr)
+{
+    QHash<qint64, QVector<qint64>> map;
+    HANDLE snap = ::CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snap == INVALID_HANDLE_VALUE) return map;
+    PROCESSENTRY32W pe{};
+    pe.dwSize = sizeof(pe);
+    for (BOOL more = ::Process32FirstW(snap, &pe); more; more = ::Process32NextW(snap, &pe)) {
+        if (pe.th32ProcessID == 0 || pe.th32ProcessID == pe.th32ParentProcessID) continue;
+        map[qint64(pe.th32ParentProcessID)].append(qint64(pe.th32ProcessID));
+        if (parents) parents->insert(qint64(pe.th32ProcessID), qint64(pe.th32ParentProcessID));
+    }
+    ::CloseHandle(snap);
+    return map;
+}
+
+QVector<qint64> childProcesses(qint64 pid)
+{
+    return childMap().value(pid);
+}
+
+qint64 parentProcess(qint64 pid)
+{
+    QHash<qint64, qint64> parents;
+    childMap(&parents);
+    return parents.value(pid);
+}
+
+QVector<qint64> processTree(qint64 root)
+{
+    const QHash<qint64, QVector<qint64>> map = childMap();
+    QVector<qint64> tree{root};
+    QSet<qint64> seen{root};
+    for (int i = 0; i < tree.size(); ++i) {
+        for (qint64 child : map.value(tree[i])) {
+            if (seen.contains(child)) continue;
+            seen.insert(child);
+            tree.append(child);
+        }
+    }
+    return tree;
+}
+
+static bool processGone(qint64 pid)
+{
+    HANDLE h = ::OpenProcess(SYNCHRONIZE, FALSE, DWORD(pid));
+    if (!h) return ::GetLastError() == ERROR_INVALID_PARAMETER;
+    const bool gone = ::WaitForSingleObject(h, 0) == WAIT_OBJECT_0;
+    ::CloseHandle(h);
+    return gone;
+}
+
+#else
+
+QVector<qint64> childProcesses(qint64)
+{
+    return {};
+}
+
+qint64 parentProcess(qint64)
+{
+    return 0;
+}
+
+QVector<qint64> processTree(qint64 root)
+{
+    return {root};
+}
+
+static bool processGone(qint64)
+{
+    return false;
+}
+
+#endif
+
+QString TreeApplyReport::summary() const
+{
+    QString s = QStringLiteral("%1 process(es) in %2 ms").arg(applied).arg(elapsedUs / 1000.0, 0, 'f', 1);
+    if (failed) s += QStringLiteral(", %1 failed: %2").arg(failed).arg(firstError.message);
+    return s;
+}
+
+bool applyToTree(AffinityBackend& backend, const CpuTopology& topo, qint64 root,
+                 const AffinityConfig& config, TreeApplyReport* report)
+{
+    QElapsedTimer clock;
+    clock.start();
+    TreeApplyReport r;
+    // Picked once: a random or IRQ-avoiding policy would give every process
+    // a different set, and read /proc/interrupts for each.
+    const AffinityConfig cfg = config.resolved(topo);
+
+    // A named group takes its CPUs with one write; after that every process
+    // only needs moving into it.
+    const bool groupOnly = !cfg.cpusetGroup.isEmpty() && cfg.sched.isDefault()
+                           && cfg.threadRules.isEmpty() && !cfg.migrateMemory;
+    if (groupOnly && !CgroupCpuset::configure(cfg.cpusetGroup, cfg.cpus, cfg.partition, &r.firstError)) {
+        r.failed = 1;
+        r.elapsedUs = clock.nsecsElapsed() / 1000;
+        if (report) *report = r;
+        return false;
+    }
+
+    QSet<qint64> done;
+    for (int pass = 0; pass < kMaxPasses; ++pass) {
+        QVector<qint64> todo;
+        for (qint64 pid : processTree(root))
+            if (!done.contains(pid)) todo.append(pid);
+        ++r.passes;
+        if (todo.isEmpty()) break;
+
+        // Each process costs a few syscalls per thread; workers take every
+        // n-th process so big and small ones spread evenly.
+        enum Outcome : char { Failed, Applied, Gone };
+        std::vector<Outcome> outcomes(size_t(todo.size()), Failed);
+        std::vector<BackendError> errors(size_t(todo.size()));
+        parallelFor(int(todo.size()), 4, [&](int i) {
+            const qint64 pid = todo[i];
+            BackendError* e = &errors[size_t(i)];
+            const bool ok = groupOnly ? CgroupCpuset::moveProcesses(cfg.cpusetGroup, {pid}, nullptr, e)
+                                      : applyAffinityConfig(backend, topo, pid, cfg, nullptr, e);
+            outcomes[size_t(i)] = ok ? Applied : processGone(pid) ? Gone : Failed;
+        });
+        for (int i = 0; i < todo.size(); ++i) {
+            done.insert(todo[i]);
+            if (outcomes[size_t(i)] == Gone) continue;
+            r.pids.append(todo[i]);
+            if (outcomes[size_t(i)] == Applied) {
+                ++r.applied;
+            } else {
+                if (!r.failed) r.firstError = errors[size_t(i)];
+                ++r.failed;
+            }
+        }
+    }
+    if (r.applied == 0 && r.failed == 0) {
+        r.failed = 1;
+        r.firstError.code = ESRCH;
+        r.firstError.message = QStringLiteral("Process %1 not found").arg(root);
+    }
+    r.elapsedUs = clock.nsecsElapsed() / 1000;
+    const bool allOk = r.failed == 0;
+    if (report) *report = std::move(r);
+    return allOk;
+}
+
+// ---------- ProcessTreeFollower ----------
+
+ProcessTreeFollower::ProcessTreeFollower(AffinityBackend& backend, const CpuTopology& topo,
+                                         ProcessWatcher* watcher, QObject* parent)
+    : QObject(parent)
+    , backend_(backend)
+    , topo_(topo)
+{
+    connect(watcher, &ProcessWatcher::processForked, this, &ProcessTreeFollower::onForked);
+    connect(watcher, &ProcessWatcher::processStarted, this, [this](qint64 pid, qint64) { onStarted(pid); });
+    connect(watcher, &ProcessWatcher::processExited, this, &ProcessTreeFollower::onExited);
+    connect(watcher, &ProcessWatcher::overflowed, this, &ProcessTreeFollower::onOverflowed);
+}
+
+bool ProcessTreeFollower::follow(qint64 root, const AffinityConfig& cfg, TreeApplyReport* report)
+{
+    unfollow(root);
+    detached_.remove(root);
+    // Children adopted later get the CPUs their siblings got.
+    const AffinityConfig resolved = cfg.resolved(topo_);
+    TreeApplyReport r;
+    const bool ok = applyToTree(backend_, topo_, root, resolved, &r);
+    if (!r.pids.isEmpty()) {
+        trees_.insert(root, Tree{resolved, 0});
+        for (qint64 pid : r.pids) addMember(pid, root);
+    }
+    if (report) *report = std::move(r);
+    return ok;
+}
+
+void ProcessTreeFollower::unfollow(qint64 root)
+{
+    if (!trees_.remove(root)) return;
+    for (auto it = owner_.begin(); it != owner_.end();) {
+        if (it.value() == root) it = owner_.erase(it);
+        else ++it;
+    }
+}
+
+void ProcessTreeFollower::detach(qint64 pid)
+{
+    const auto it = owner_.constFind(pid);
+    if (it == owner_.constEnd()) return;
+    const qint64 root = it.value();
+    detached_.insert(pid);
+    if (root == pid) {
+        unfollow(root);
+        return;
+    }
+    // Descendants that joined another tree stay in it.
+    owner_.remove(pid);
+    --trees_[root].members;
+    for (qint64 member : processTree(pid)) {
+        const auto m = owner_.find(member);
+        if (m == owner_.end() || m.value() != root) continue;
+        owner_.erase(m);
+        --trees_[root].members;
+    }
+    if (trees_.value(root).members <= 0)
+        trees_.remove(root);
+}
+
+void ProcessTreeFollower::clear()
+{
+    trees_.clear();
+    owner_.clear();
+    detached_.clear();
+}
+
+void ProcessTreeFollower::addMember(qint64 pid, qint64 root)
+{
+    const auto it = owner_.constFind(pid);
+    if (it != owner_.constEnd()) {
+        if (it.value() == root) return;
+        --trees_[it.value()].members;
+    }
+    owner_.insert(pid, root);
+    ++trees_[root].members;
+}
+
+void ProcessTreeFollower::onForked(qint64 parentPid, qint64 childPid)
+{
+    const auto it = owner_.constFind(parentPid);
+    if (it != owner_.constEnd() && !owner_.contains(childPid))
+        adopt(it.value(), childPid);
+}
+
+// Polling, or a fork event that was lost: look for a followed ancestor.
+void ProcessTreeFollower::onStarted(qint64 pid)
+{
+    if (trees_.isEmpty() || owner_.contains(pid)) return;
+    qint64 p = pid;
+    for (int depth = 0; depth < 64; ++depth) {
+        p = parentProcess(p);
+        if (p <= 1) return;
+        const auto it = owner_.constFind(p);
+        if (it != owner_.constEnd()) {
+            adopt(it.value(), pid);
+            return;
+        }
+        if (detached_.contains(p)) return;
+    }
+}
+
+// A tree stays followed while any process of it lives, even once its root
+// has exited and the rest were reparented.
+void ProcessTreeFollower::onExited(qint64 pid)
+{
+    detached_.remove(pid);
+    const auto it = owner_.find(pid);
+    if (it == owner_.end()) return;
+    const qint64 root = it.value();
+    owner_.erase(it);
+    if (--trees_[root].members <= 0)
+        trees_.remove(root);
+}
+
+// Forks and exits were lost: walk every tree again, from its root or, once
+// the root is gone, from each member whose parent is not in the tree.
+void ProcessTreeFollower::onOverflowed()
+{
+    const QList<qint64> roots = trees_.keys();
+    for (qint64 root : roots) {
+        QVector<qint64> tops;
+        QVector<qint64> gone;
+        for (auto it = owner_.cbegin(); it != owner_.cend(); ++it) {
+            if (it.value() != root) continue;
+            const qint64 parent = parentProcess(it.key());
+            if (parent <= 0) gone.append(it.key());
+            else if (owner_.value(parent) != root) tops.append(it.key());
+        }
+        for (qint64 pid : gone) onExited(pid);
+        const AffinityConfig cfg = trees_.value(root).config;
+        for (qint64 top : tops) {
+            TreeApplyReport r;
+            const bool ok = applyToTree(backend_, topo_, top, cfg, &r);
+            // Parents come first, so a detached process's subtree is known
+            // by the time its children are reached.
+            QSet<qint64> outside = detached_;
+            for (qint64 pid : r.pids) {
+                if (owner_.contains(pid)) continue;
+                if (outside.contains(pid) || outside.contains(parentProcess(pid))) {
+                    outside.insert(pid);
+                    continue;
+                }
+                addMember(pid, root);
+                emit adopted(root, pid, ok);
+            }
+        }
+    }
+}
+
+void ProcessTreeFollower::adopt(qint64 root, qint64 pid)
+{
+    // Its own children, if it forked before we heard of it, come along.
+    TreeApplyReport r;
+    const bool ok = applyToTree(backend_, topo_, pid, trees_.value(root).config, &r);
+    if (r.pids.isEmpty()) return;   // already gone
+    for (qint64 member : r.pids) addMember(member, root);
+    emit adopted(root, pid, ok);
+}
@@ -0,0 +1,92 @@
+#ifndef PROCESSTREE_H
+#define PROCESSTREE_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "affinitybackend.h"
+#include "affinityconfig.h"
+
+class ProcessWatcher;
+
+// Direct children of `pid`: on Linux from /proc/<pid>/task/*/children, which
+// lists what each thread forked; on Windows from a process snapshot.
+QVector<qint64> childProcesses(qint64 pid);
+// The parent of `pid`, 0 if unknown.
+qint64 parentProcess(qint64 pid);
+// `root` followed by all its descendants, parents before children. Large
+// trees are walked a level at a time on several threads.
+QVector<qint64> processTree(qint64 root);
+
+struct TreeApplyReport {
+    int applied{0};           // processes that got the config
+    int failed{0};
+    int passes{0};            // walks until one found nothing new
+    BackendError firstError;
+    qint64 elapsedUs{0};
+    QVector<qint64> pids;     // every process of the tree that was reached
+
+    QString summary() const;
+};
+
+// applyAffinityConfig() on every process under `root`, root included, spread
+// over several threads, all with the same resolved CPUs. Processes that exit in the meantime are skipped. The
+// tree is walked again until a walk finds no process that forked while the
+// others were being applied. Returns false if any process failed.
+bool applyToTree(AffinityBackend& backend, const CpuTopology& topo, qint64 root,
+                 const AffinityConfig& cfg, TreeApplyReport* report=nullptr);
+
+// Keeps trees configured: applies a root's config to every process that forks
+// or execs under it until the root is unfollowed. Fork events come from the
+// netlink proc connector; when polling, new processes are placed by walking
+// their parents.
+class ProcessTreeFollower : public QObject
+{
+    Q_OBJECT
+public:
+    ProcessTreeFollower(AffinityBackend& backend, const CpuTopology& topo, ProcessWatcher* watcher,
+                        QObject* parent=nullptr);
+
+    // Applies `cfg` to the tree under `root` now and follows it. Its CPUs are
+    // resolved once, so processes adopted later get the same set. Following
+    // a root again replaces its config and applies it again.
+    bool follow(qint64 root, const AffinityConfig& cfg, TreeApplyReport* report=nullptr);
+    void unfollow(qint64 root);
+    // Takes `pid` and the part of its tree below it out of the tree they
+    // belong to, e.g. once it has settings of its own. Their later children
+    // are not adopted either.
+    void detach(qint64 pid);
+    void clear();
+
+    bool isFollowing(qint64 root) const { return trees_.contains(root); }
+    int treeCount() const { return int(trees_.size()); }
+    int memberCount() const { return int(owner_.size()); }
+
+signals:
+    // A process joined the tree under `root` and was configured (or not).
+    void adopted(qint64 root, qint64 pid, bool ok);
+
+private:
+    void onForked(qint64 parentPid, qint64 childPid);
+    void onStarted(qint64 pid);
+    void onExited(qint64 pid);
+    void onOverflowed();
+    void adopt(qint64 root, qint64 pid);
+    void addMember(qint64 pid, qint64 root);
+
+    struct Tree {
+        AffinityConfig config;
+        int members{0};
+    };
+
+    AffinityBackend& backend_;
+    const CpuTopology& topo_;
+    QHash<qint64, Tree> trees_;     // by root PID
+    QHash<qint64, qint64> owner_;   // member PID -> root of its tree
+    QSet<qint64> detached_;         // left a tree; stops the walk up in onStarted()
+};
+
+#endif // PROCESSTREE_H
@@ -0,0 +1,213 @@
+#include "processwatcher.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+#include <chrono>
+#include <cstring>
+
+#if defined(Q_OS_LINUX)
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#endif
+
+ProcessWatcher::ProcessWatcher(QObject* parent)
+    : QObject(parent)
+{
+    enumerator_.setWindowedOnly(false);
+}
+
+ProcessWatcher::~ProcessWatcher()
+{
+    stop();
+}
+
+qint64 ProcessWatcher::nowNs()
+{
+    // steady_clock is CLOCK_MONOTONIC on Linux, the same clock as the
+    // connector's timestamp_ns.
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+QString ProcessWatcher::modeName() const
+{
+    switch (mode_) {
+    case Mode::Netlink: return QStringLiteral("netlink");
+    case Mode::Polling: return QStringLiteral("polling");
+    case Mode::Stopped: break;
+    }
+    return QStringLiteral("stopped");
+}
+
+bool ProcessWatcher::start(bool allowNetlink, int pollIntervalMs)
+{
+    stop();
+    if (allowNetlink && startNetlink())
+        return true;
+    startPolling(pollIntervalMs);
+    return mode_ != Mode::Stopped;
+}
+
+void ProcessWatcher::stop()
+{
+    delete notifier_;
+    notifier_ = nullptr;
+    delete pollTimer_;
+    pollTimer_ = nullptr;
+#if defined(Q_OS_LINUX)
+    if (nlFd_ >= 0) ::close(nlFd_);
+#endif
+    nlFd_ = -1;
+    mode_ = Mode::Stopped;
+}
+
+// ---------- Polling ----------
+
+// Process start time from the enumerator, converted to the nowNs() clock.
+static qint64 startTimeToNs(quint64 startTime)
+{
+#if defined(Q_OS_LINUX)
+    static const long ticks = ::sysconf(_SC_CLK_TCK);
+    timespec boot{};
+    ::clock_gettime(CLOCK_BOOTTIME, &boot);
+    const qint64 bootNs = qint64(boot.tv_sec) * 1000000000 + boot.tv_nsec;
+    const qint64 startNs = qint64(startTime) * (1000000000 / (ticks > 0 ? ticks : 100));
+    return ProcessWatcher::nowNs() - qMax<qint64>(0, bootNs - startNs);
+#elif defined(Q_OS_WINDOWS)
+    FILETIME now{};
+    ::GetSystemTimeAsFileTime(&now);
+    const quint64 nowFt = (quint64(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+    const qint64 ageNs = nowFt > startTime ? qint64(nowFt - startTime) * 100 : 0;
+    return ProcessWatcher::nowNs() - ageNs;
+#else
+    Q_UNUSED(startTime);
+    return ProcessWatcher::nowNs();
+#endif
+}
+
+void ProcessWatcher::startPolling(int intervalMs)
+{
+    enumerator_.scan(); // baseline: only report processes started from now on
+    pollTimer_ = new QTimer(this);
+    pollTimer_->setTimerType(Qt::PreciseTimer);
+    pollTimer_->setInterval(qMax(10, intervalMs));
+    connect(pollTimer_, &QTimer::timeout, this, &ProcessWatcher::poll);
+    pollTimer_->start();
+    mode_ = Mode::Polling;
+}
+
+void ProcessWatcher::poll()
+{
+    const ProcessDelta delta = enumerator_.rescan();
+    for (qint64 pid : delta.removed)   // first, in case a pid was reused
+        emit processExited(pid);
+    for (const ProcEntry& e : delta.added)
+        emit processStarted(e.pid, startTimeToNs(e.startTime));
+}
+
+// ---------- Netlink proc connector ----------
+
+#if defined(Q_OS_LINUX)
+
+bool ProcessWatcher::startNetlink()
+{
+    const int fd = ::socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_CONNECTOR);
+    if (fd < 0) return false;
+
+    sockaddr_nl addr{};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // Large receive buffer so a fork storm does not overflow between wakeups.
+    const int rcvbuf = 4 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    char req[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))]{};
+    auto* nlh = reinterpret_cast<nlmsghdr*>(req);
+    nlh->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_pid = static_cast<__u32>(::getpid());
+    auto* msg = static_cast<cn_msg*>(NLMSG_DATA(nlh));
+    msg->id.idx = CN_IDX_PROC;
+    msg->id.val = CN_VAL_PROC;
+    msg->len = sizeof(proc_cn_mcast_op);
+    const proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    std::memcpy(msg->data, &op, sizeof(op));
+    if (::send(fd, req, nlh->nlmsg_len, 0) < 0) {   // EPERM without CAP_NET_ADMIN
+        ::close(fd);
+        return false;
+    }
+
+    nlFd_ = fd;
+    recvBuf_.resize(64 * 1024);
+    notifier_ = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier_, &QSocketNotifier::activated, this, &ProcessWatcher::onNetlinkReadable);
+    mode_ = Mode::Netlink;
+    return true;
+}
+
+void ProcessWatcher::onNetlinkReadable()
+{
+    for (;;) {
+        sockaddr_nl from{};
+        socklen_t fromLen = sizeof(from);
+        const ssize_t n = ::recvfrom(nlFd_, recvBuf_.data(), size_t(recvBuf_.size()), 0,
+                                     reinterpret_cast<sockaddr*>(&from), &fromLen);
+        if (n < 0) {
+            if (errno == ENOBUFS) {      // kernel dropped events
+                emit overflowed();
+                continue;
+            }
+            return;                      // EAGAIN: drained
+        }
+        if (from.nl_pid != 0) continue;  // only trust the kernel
+
+        int len = int(n);
+        for (auto* nlh = reinterpret_cast<nlmsghdr*>(recvBuf_.data()); NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_NOOP) continue;
+            const auto* msg = static_cast<const cn_msg*>(NLMSG_DATA(nlh));
+            if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) continue;
+            const auto* ev = reinterpret_cast<const proc_event*>(msg->data);
+            switch (ev->what) {
+            case proc_event::PROC_EVENT_EXEC:
+                emit processStarted(ev->event_data.exec.process_tgid, qint64(ev->timestamp_ns));
+                break;
+            case proc_event::PROC_EVENT_FORK:
+                if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid)
+                    emit processForked(ev->event_data.fork.parent_tgid, ev->event_data.fork.child_tgid);
+                break;
+            case proc_event::PROC_EVENT_EXIT:
+                if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid)
+                    emit processExited(ev->event_data.exit.process_tgid);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+#else
+
+bool ProcessWatcher::startNetlink()
+{
+    return false;
+}
+
+void ProcessWatcher::onNetlinkReadable()
+{
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PROCESSWATCHER_H
+#define PROCESSWATCHER_H
+
+#include <QObject>
+
+#include "processenumerator.h"
+
+class QSocketNotifier;
+class QTimer;
+
+// Reports new processes as soon as they exec. On Linux this listens on the
+// netlink proc connector (needs CAP_NET_ADMIN); otherwise, or when that is
+// unavailable, it diffs ProcessEnumerator snapshots on a timer.
+class ProcessWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Mode { Stopped, Netlink, Polling };
+
+    explicit ProcessWatcher(QObject* parent=nullptr);
+    ~ProcessWatcher() override;
+
+    // Tries netlink first unless `allowNetlink` is false.
+    bool start(bool allowNetlink=true, int pollIntervalMs=250);
+    void stop();
+    Mode mode() const { return mode_; }
+    QString modeName() const;
+
+    // Monotonic clock that eventNs values are expressed in.
+    static qint64 nowNs();
+
+signals:
+    // `eventNs` is when the kernel saw the exec (netlink) or the process start
+    // time (polling), on the nowNs() clock. Polling events are late by up to
+    // one interval, which shows up in any latency measured from eventNs.
+    void processStarted(qint64 pid, qint64 eventNs);
+    // A process forked another (netlink only; threads are not reported).
+    void processForked(qint64 parentPid, qint64 childPid);
+    // A process exited (netlink), or was gone at the next poll.
+    void processExited(qint64 pid);
+    // The event stream lost messages; consumers should rescan.
+    void overflowed();
+
+private:
+    bool startNetlink();
+    void onNetlinkReadable();
+    void startPolling(int intervalMs);
+    void poll();
+
+    Mode mode_{Mode::Stopped};
+    int nlFd_{-1};
+    QSocketNotifier* notifier_{};
+    QTimer* pollTimer_{};
+    ProcessEnumerator enumerator_;
+    QByteArray recvBuf_;
+};
+
+#endif // PROCESSWATCHER_H
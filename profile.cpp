@@ -0,0 +1,456 @@
+#include "profile.h"
+#include "cgroupcpuset.h"
+#include "processenumerator.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#endif
+
+namespace {
+
+constexpr int kChunkSize = 32;
+
+#if defined(Q_OS_LINUX)
+QByteArray readProc(qint64 pid, const char* name)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%lld/%s", static_cast<long long>(pid), name);
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return QByteArray();
+    QByteArray out;
+    char buf[4096];
+    for (ssize_t n; (n = ::read(fd, buf, sizeof(buf))) > 0; )
+        out.append(buf, int(n));
+    ::close(fd);
+    return out;
+}
+#endif
+
+QString globToRegex(const QString& glob)
+{
+    return QRegularExpression::wildcardToRegularExpression(glob);
+}
+
+// Alternation would renumber groups under a backreference, so those are
+// matched one by one instead.
+bool hasBackreference(const QString& re)
+{
+    for (int i = 0; i + 1 < re.size(); ++i) {
+        if (re.at(i) == '\\') {
+            const ushort c = re.at(++i).unicode();
+            if ((c >= '1' && c <= '9') || c == 'g' || c == 'k') return true;
+        } else if (re.at(i) == '(' && re.mid(i, 4) == QLatin1String("(?P=")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+QString commKey(const QString& name)
+{
+#if defined(Q_OS_LINUX)
+    return name.left(15);
+#else
+    return name.toLower();
+#endif
+}
+
+// ---------- ProcessIdentity ----------
+
+ProcessIdentity::ProcessIdentity(qint64 pid, const QString& comm)
+    : pid_(pid)
+{
+    if (!comm.isEmpty()) {
+        comm_ = comm;
+        loaded_ |= Comm;
+    }
+}
+
+const QString& ProcessIdentity::comm() const
+{
+    if (!(loaded_ & Comm)) {
+        comm_ = ProcessEnumerator::processName(pid_);
+        loaded_ |= Comm;
+    }
+    return comm_;
+}
+
+const QString& ProcessIdentity::exePath() const
+{
+    if (!(loaded_ & Exe)) {
+        loaded_ |= Exe;
+#if defined(Q_OS_LINUX)
+        char path[64], buf[4096];
+        std::snprintf(path, sizeof(path), "/proc/%lld/exe", static_cast<long long>(pid_));
+        const ssize_t n = ::readlink(path, buf, sizeof(buf));
+        if (n > 0) exe_ = QString::fromUtf8(buf, int(n));
+#elif defined(Q_OS_WINDOWS)
+        if (HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, static_cast<DWORD>(pid_))) {
+            wchar_t buf[MAX_PATH];
+            DWORD len = MAX_PATH;
+            if (::QueryFullProcessImageNameW(h, 0, buf, &len))
+                exe_ = QString::fromWCharArray(buf, int(len));
+            ::CloseHandle(h);
+        }
+#endif
+    }
+    return exe_;
+}
+
+const QString& ProcessIdentity::cmdline() const
+{
+    if (!(loaded_ & Cmdline)) {
+        loaded_ |= Cmdline;
+#if defined(Q_OS_LINUX)
+        QByteArray raw = readProc(pid_, "cmdline");
+        raw.replace('\0', ' ');
+        cmdline_ = QString::fromUtf8(raw).trimmed();
+#endif
+    }
+    return cmdline_;
+}
+
+const QString& ProcessIdentity::cgroup() const
+{
+    if (!(loaded_ & Cgroup)) {
+        cgroup_ = CgroupCpuset::groupOf(pid_);
+        loaded_ |= Cgroup;
+    }
+    return cgroup_;
+}
+
+// ---------- ProfileRule ----------
+
+bool ProfileRule::hasCriteria() const
+{
+    return !comm.isEmpty() || !pathGlob.isEmpty() || !cmdlineRegex.isEmpty() || !cgroup.isEmpty();
+}
+
+static bool cgroupContains(const QString& subtree, const QString& cg)
+{
+    if (subtree == QLatin1String("/")) return !cg.isEmpty();
+    return cg == subtree || (cg.startsWith(subtree) && cg.at(subtree.size()) == '/');
+}
+
+bool ProfileRule::matches(const ProcessIdentity& id) const
+{
+    if (!hasCriteria()) return false;
+    if (!comm.isEmpty() && commKey(comm) != commKey(id.comm())) return false;
+    if (!cgroup.isEmpty() && !cgroupContains(cgroup, id.cgroup())) return false;
+    if (!pathGlob.isEmpty() && !QRegularExpression(globToRegex(pathGlob)).match(id.exePath()).hasMatch())
+        return false;
+    if (!cmdlineRegex.isEmpty() && !QRegularExpression(cmdlineRegex).match(id.cmdline()).hasMatch())
+        return false;
+    return true;
+}
+
+QJsonObject ProfileRule::toJson() const
+{
+    QJsonObject o = config.toJson();
+    o.remove("processName");
+    o.remove("pid");
+    if (!name.isEmpty()) o["name"] = name;
+    QJsonObject m;
+    if (!comm.isEmpty())         m["comm"] = comm;
+    if (!pathGlob.isEmpty())     m["path"] = pathGlob;
+    if (!cmdlineRegex.isEmpty()) m["cmdline"] = cmdlineRegex;
+    if (!cgroup.isEmpty())       m["cgroup"] = cgroup;
+    o["match"] = m;
+    return o;
+}
+
+ProfileRule ProfileRule::fromJson(const QJsonObject& o, bool* ok, QString* error)
+{
+    ProfileRule r;
+    QString why;
+    bool configOk = false;
+    r.config = AffinityConfig::fromJson(o, &configOk);
+    r.config.pid = 0;
+    r.name = o.value("name").toString();
+    if (!configOk) why = QStringLiteral("invalid settings");
+    if (o.contains("match")) {
+        const QJsonObject m = o.value("match").toObject();
+        for (const char* key : {"comm", "path", "cmdline", "cgroup"}) {
+            if (m.contains(key) && !m.value(key).isString() && why.isEmpty())
+                why = QStringLiteral("\"%1\" is not a string").arg(key);
+        }
+        r.comm         = m.value("comm").toString();
+        r.pathGlob     = m.value("path").toString();
+        r.cmdlineRegex = m.value("cmdline").toString();
+        r.cgroup       = m.value("cgroup").toString();
+        if (r.cgroup.size() > 1 && r.cgroup.endsWith('/')) r.cgroup.chop(1);
+    } else {
+        r.comm = r.config.processName;   // plain .affinity.json
+    }
+    if (r.name.isEmpty())
+        r.name = !r.comm.isEmpty() ? r.comm : !r.pathGlob.isEmpty() ? r.pathGlob : r.cgroup;
+
+    // A bad pattern would otherwise only show up as a rule that never matches.
+    if (why.isEmpty() && !r.pathGlob.isEmpty()) {
+        const QRegularExpression re(globToRegex(r.pathGlob));
+        if (!re.isValid())
+            why = QStringLiteral("path glob \"%1\": %2").arg(r.pathGlob, re.errorString());
+    }
+    if (why.isEmpty() && !r.cmdlineRegex.isEmpty()) {
+        const QRegularExpression re(r.cmdlineRegex);
+        if (!re.isValid())
+            why = QStringLiteral("cmdline regex \"%1\": %2").arg(r.cmdlineRegex, re.errorString());
+    }
+    if (why.isEmpty() && !r.hasCriteria())
+        why = QStringLiteral("matches nothing");
+    if (ok) *ok = why.isEmpty();
+    if (error) *error = why;
+    return r;
+}
+
+// ---------- Profile ----------
+
+QJsonObject Profile::toJson() const
+{
+    QJsonArray list;
+    for (const ProfileRule& r : rules) list.append(r.toJson());
+    QJsonObject o;
+    o["version"] = 1;
+    o["rules"] = list;
+    return o;
+}
+
+Profile Profile::fromJson(const QJsonObject& o, QString* error)
+{
+    Profile p;
+    const QJsonArray list = o.contains("rules") ? o.value("rules").toArray() : QJsonArray{o};
+    p.rules.reserve(list.size());
+    for (int i = 0; i < list.size(); ++i) {
+        bool ok = false;
+        QString why;
+        ProfileRule r = ProfileRule::fromJson(list[i].toObject(), &ok, &why);
+        if (!ok) {
+            if (error) *error = QStringLiteral("rule %1: %2").arg(i).arg(why);
+            return Profile();
+        }
+        p.rules.append(std::move(r));
+    }
+    return p;
+}
+
+Profile Profile::load(const QString& path, QString* error)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (error) *error = QStringLiteral("Cannot open %1: %2").arg(path, f.errorString());
+        return Profile();
+    }
+    QJsonParseError pe;
+    const QJsonDocument doc = QJsonDocument::fromJson(f.readAll(), &pe);
+    if (!doc.isObject()) {
+        if (error) *error = QStringLiteral("%1: %2").arg(path, pe.errorString());
+        return Profile();
+    }
+    QString why;
+    Profile p = fromJson(doc.object(), &why);
+    if (!why.isEmpty() && error) *error = QStringLiteral("%1: %2").arg(path, why);
+    return p;
+}
+
+bool Profile::save(const QString& path) const
+{
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) return false;
+    f.write(QJsonDocument(toJson()).toJson(QJsonDocument::Indented));
+    return f.commit();
+}
+
+// ---------- ProfileDiff ----------
+
+ProfileDiff ProfileDiff::compute(const QVector<ProfileRule>& before, const QVector<ProfileRule>& after)
+{
+    QHash<QString, QVector<int>> byName;   // unpaired old rules, in order
+    for (int i = 0; i < before.size(); ++i) byName[before[i].name].append(i);
+
+    ProfileDiff d;
+    d.changes.reserve(after.size());
+    d.previous.reserve(after.size());
+    for (const ProfileRule& r : after) {
+        QVector<int>& candidates = byName[r.name];
+        if (candidates.isEmpty()) {
+            d.changes.append(Added);
+            d.previous.append(-1);
+            continue;
+        }
+        const ProfileRule& old = before[candidates.takeFirst()];
+        d.previous.append(int(&old - before.constData()));
+        if (!old.config.sameSettings(r.config))
+            d.changes.append(Config);
+        else if (old.comm != r.comm || old.pathGlob != r.pathGlob || old.cmdlineRegex != r.cmdlineRegex
+                 || old.cgroup != r.cgroup)
+            d.changes.append(Match);
+        else
+            d.changes.append(Unchanged);
+    }
+    for (const QVector<int>& left : byName)
+        d.removed += left;
+    std::sort(d.removed.begin(), d.removed.end());
+    return d;
+}
+
+bool ProfileDiff::isEmpty() const
+{
+    if (!removed.isEmpty()) return false;
+    for (int i = 0; i < changes.size(); ++i) {
+        // A rule that moved can now shadow, or be shadowed by, another one.
+        if (changes[i] != Unchanged || previous[i] != i) return false;
+    }
+    return true;
+}
+
+int ProfileDiff::count(Change c) const
+{
+    return int(std::count(changes.cbegin(), changes.cend(), c));
+}
+
+QString ProfileDiff::summary() const
+{
+    return QStringLiteral("%1 added, %2 removed, %3 with new settings, %4 with new criteria, %5 unchanged")
+        .arg(count(Added)).arg(removed.size()).arg(count(Config)).arg(count(Match)).arg(count(Unchanged));
+}
+
+// ---------- RuleIndex ----------
+
+void RuleIndex::addToChunks(QVector<Chunk>& chunks, int rule, const QString& regex)
+{
+    if (chunks.isEmpty() || chunks.last().rules.size() >= kChunkSize)
+        chunks.append(Chunk());
+    Chunk& c = chunks.last();
+    if (!c.pattern.isEmpty()) c.pattern += '|';
+    c.pattern += QStringLiteral("(?:") + regex + ')';
+    c.rules.append(rule);
+}
+
+void RuleIndex::build(const QVector<ProfileRule>& rules)
+{
+    rules_ = rules;
+    compiled_ = QVector<Compiled>(rules_.size());
+    byComm_.clear();
+    byCgroup_.clear();
+    pathChunks_.clear();
+    cmdlineChunks_.clear();
+    unchunked_.clear();
+
+    // Primary criterion: comm > cgroup > path > cmdline. Rules are visited in
+    // order, so every bucket and chunk lists its rules ascending.
+    for (int i = 0; i < rules_.size(); ++i) {
+        const ProfileRule& r = rules_[i];
+        if (!r.comm.isEmpty())
+            byComm_[commKey(r.comm)].append(i);
+        else if (!r.cgroup.isEmpty())
+            byCgroup_[r.cgroup].append(i);
+        else if (!r.pathGlob.isEmpty())
+            addToChunks(pathChunks_, i, globToRegex(r.pathGlob));
+        else if (!r.cmdlineRegex.isEmpty() && !hasBackreference(r.cmdlineRegex))
+            addToChunks(cmdlineChunks_, i, r.cmdlineRegex);
+        else if (!r.cmdlineRegex.isEmpty())
+            unchunked_.append(i);
+    }
+}
+
+bool RuleIndex::mayMatch(const QString& comm) const
+{
+    return byComm_.contains(commKey(comm)) || !byCgroup_.isEmpty() || !pathChunks_.isEmpty()
+        || !cmdlineChunks_.isEmpty() || !unchunked_.isEmpty();
+}
+
+const RuleIndex::Compiled& RuleIndex::compiledRule(int rule) const
+{
+    Compiled& c = compiled_[rule];
+    if (!c.compiled) {
+        const ProfileRule& r = rules_[rule];
+        if (!r.pathGlob.isEmpty()) c.path = QRegularExpression(globToRegex(r.pathGlob));
+        if (!r.cmdlineRegex.isEmpty()) c.cmdline = QRegularExpression(r.cmdlineRegex);
+        c.compiled = true;
+    }
+    return c;
+}
+
+bool RuleIndex::fullMatch(int rule, const ProcessIdentity& id) const
+{
+    const ProfileRule& r = rules_[rule];
+    if (!r.comm.isEmpty() && commKey(r.comm) != commKey(id.comm())) return false;
+    if (!r.cgroup.isEmpty() && !cgroupContains(r.cgroup, id.cgroup())) return false;
+    if (r.pathGlob.isEmpty() && r.cmdlineRegex.isEmpty()) return true;
+    const Compiled& c = compiledRule(rule);
+    if (!r.pathGlob.isEmpty() && !c.path.match(id.exePath()).hasMatch()) return false;
+    if (!r.cmdlineRegex.isEmpty() && !c.cmdline.match(id.cmdline()).hasMatch()) return false;
+    return true;
+}
+
+void RuleIndex::scanChunks(const QVector<Chunk>& chunks, const QString& subject,
+                           const ProcessIdentity& id, int* best) const
+{
+    for (const Chunk& c : chunks) {
+        if (c.rules.first() >= *best) return;     // later chunks only hold higher indexes
+        if (!c.compiled) {
+            c.combined = QRegularExpression(c.pattern);
+            c.compiled = true;
+        }
+        // An invalid combination (one bad rule) just disables the prefilter.
+        if (c.combined.isValid() && !c.combined.match(subject).hasMatch())
+            continue;
+        for (int r : c.rules) {
+            if (r >= *best) break;
+            if (fullMatch(r, id)) {
+                *best = r;
+                break;
+            }
+        }
+    }
+}
+
+int RuleIndex::match(const ProcessIdentity& id) const
+{
+    int best = int(rules_.size());
+    auto firstIn = [&](const QVector<int>& list) {
+        for (int r : list) {
+            if (r >= best) break;
+            if (fullMatch(r, id)) {
+                best = r;
+                break;
+            }
+        }
+    };
+
+    const auto comm = byComm_.constFind(commKey(id.comm()));
+    if (comm != byComm_.constEnd())
+        firstIn(*comm);
+
+    if (!byCgroup_.isEmpty()) {
+        // Walk up the hierarchy: /a/b/c, /a/b, /a, /
+        QString cg = id.cgroup();
+        while (!cg.isEmpty()) {
+            const auto it = byCgroup_.constFind(cg);
+            if (it != byCgroup_.constEnd()) firstIn(*it);
+            if (cg == QLatin1String("/")) break;
+            const int slash = cg.lastIndexOf('/');
+            cg = slash > 0 ? cg.left(slash) : QStringLiteral("/");
+        }
+    }
+
+    if (!pathChunks_.isEmpty())
+        scanChunks(pathChunks_, id.exePath(), id, &best);
+    if (!cmdlineChunks_.isEmpty())
+        scanChunks(cmdlineChunks_, id.cmdline(), id, &best);
+    firstIn(unchunked_);
+
+    return best < rules_.size() ? best : -1;
+}
@@ -0,0 +1,132 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+
+#include "affinityconfig.h"
+
+// Process names as they compare: comm is truncated to 15 bytes on Linux,
+// Windows image names are case-insensitive.
+QString commKey(const QString& name);
+
+// Attributes a profile rule can match on, read from the OS on first use so a
+// process that only needs a comm lookup never touches the other files.
+class ProcessIdentity
+{
+public:
+    explicit ProcessIdentity(qint64 pid, const QString& comm = QString());
+
+    qint64 pid() const { return pid_; }
+    const QString& comm() const;      // ProcessEnumerator::processName
+    const QString& exePath() const;   // /proc/<pid>/exe, QueryFullProcessImageName
+    const QString& cmdline() const;   // arguments joined by spaces (Linux only)
+    const QString& cgroup() const;    // cgroup v2 path, e.g. /system.slice/foo.service (Linux only)
+
+private:
+    enum Field { Comm = 1, Exe = 2, Cmdline = 4, Cgroup = 8 };
+
+    qint64 pid_;
+    mutable int loaded_{0};
+    mutable QString comm_, exe_, cmdline_, cgroup_;
+};
+
+// One entry of a profile: which processes it applies to and what to apply.
+// Every criterion that is set must match.
+struct ProfileRule {
+    QString name;           // label for logs
+    QString comm;           // exact process name
+    QString pathGlob;       // executable path, '*' does not cross '/'
+    QString cmdlineRegex;   // searched in the command line
+    QString cgroup;         // cgroup subtree, e.g. /system.slice/nginx.service
+    AffinityConfig config;  // processName and pid are not used
+
+    bool hasCriteria() const;
+    bool matches(const ProcessIdentity& id) const;   // slow path, compiles per call
+
+    QJsonObject toJson() const;
+    // `error` says what is wrong when *ok is set to false.
+    static ProfileRule fromJson(const QJsonObject& o, bool* ok=nullptr, QString* error=nullptr);
+};
+
+// Many rules for many services. Loads {"rules": [...]} profiles as well as a
+// single .affinity.json, which becomes one rule matching its processName.
+struct Profile {
+    QVector<ProfileRule> rules;
+
+    QJsonObject toJson() const;
+    static Profile fromJson(const QJsonObject& o, QString* error=nullptr);
+    static Profile load(const QString& path, QString* error=nullptr);
+    bool save(const QString& path) const;
+};
+
+// What changed between two versions of a profile, for reloading it without
+// touching processes whose settings stay the same. Rules are paired by name;
+// a name used twice pairs up in order.
+struct ProfileDiff {
+    enum Change {
+        Unchanged,
+        Match,      // same settings, different criteria
+        Config,     // different settings (CPUs, policy, scheduling, ...)
+        Added,
+    };
+    QVector<Change> changes;    // per rule of the new profile
+    QVector<int>    previous;   // per rule of the new profile: old index, -1 if added
+    QVector<int>    removed;    // old rules nothing pairs with
+
+    static ProfileDiff compute(const QVector<ProfileRule>& before, const QVector<ProfileRule>& after);
+
+    bool isEmpty() const;       // no rule changed, moved or went away
+    int count(Change c) const;
+    QString summary() const;
+};
+
+// Precompiled matcher over a profile's rules. Each rule is filed under one
+// primary criterion: comm and cgroup rules go into hash tables, glob and regex
+// rules into chunks whose alternatives are combined into a single regex used as
+// a prefilter. A match returns the lowest rule index whose criteria all hold.
+// Regexes are compiled on first use, so building the index stays cheap.
+class RuleIndex
+{
+public:
+    void build(const QVector<ProfileRule>& rules);
+    int match(const ProcessIdentity& id) const;   // rule index or -1
+
+    int size() const { return int(rules_.size()); }
+    const ProfileRule& rule(int i) const { return rules_[i]; }
+    // True if some rule could match a process with this comm; false means
+    // match() would return -1 without reading anything else.
+    bool mayMatch(const QString& comm) const;
+
+private:
+    struct Chunk {
+        QVector<int> rules;                   // ascending
+        QString pattern;                      // (?:a)|(?:b)|...
+        mutable QRegularExpression combined;
+        mutable bool compiled{false};
+    };
+    struct Compiled {
+        QRegularExpression path;              // anchored glob
+        QRegularExpression cmdline;
+        mutable bool compiled{false};
+    };
+
+    bool fullMatch(int rule, const ProcessIdentity& id) const;
+    const Compiled& compiledRule(int rule) const;
+    void scanChunks(const QVector<Chunk>& chunks, const QString& subject,
+                    const ProcessIdentity& id, int* best) const;
+    static void addToChunks(QVector<Chunk>& chunks, int rule, const QString& regex);
+
+    QVector<ProfileRule> rules_;
+    mutable QVector<Compiled> compiled_;
+    QHash<QString, QVector<int>> byComm_;     // commKey -> rules
+    QHash<QString, QVector<int>> byCgroup_;   // cgroup path -> rules
+    QVector<Chunk> pathChunks_;
+    QVector<Chunk> cmdlineChunks_;
+    QVector<int> unchunked_;                  // regexes with backreferences
+};
+
+#endif // PROFILE_H
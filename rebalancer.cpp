@@ -0,0 +1,287 @@
+#include "rebalancer.h"
+#include "affinitybackend.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+// ---------- RebalanceBounds ----------
+
+QJsonObject RebalanceBounds::toJson() const
+{
+    QJsonObject o;
+    o["minCores"] = minCores;
+    o["maxCores"] = maxCores;
+    if (!allowed.isEmpty())
+        o["allowed"] = allowed.toRangeList();
+    return o;
+}
+
+RebalanceBounds RebalanceBounds::fromJson(const QJsonObject& o, bool* ok)
+{
+    RebalanceBounds b;
+    b.enabled  = true;      // only written when enabled
+    b.minCores = o.value("minCores").toInt(1);
+    b.maxCores = o.value("maxCores").toInt(0);
+    bool valid = true;
+    b.allowed  = CpuSet::fromRangeList(o.value("allowed").toString(), &valid);
+    if (b.minCores < 1 || b.maxCores < 0 || (b.maxCores > 0 && b.maxCores < b.minCores))
+        valid = false;
+    if (ok) *ok = valid;
+    return b;
+}
+
+// ---------- RebalanceDecision ----------
+
+QString rebalanceActionKey(RebalanceDecision::Action a)
+{
+    switch (a) {
+    case RebalanceDecision::Grow:   return QStringLiteral("grow");
+    case RebalanceDecision::Shrink: return QStringLiteral("shrink");
+    case RebalanceDecision::Move:   return QStringLiteral("move");
+    }
+    return QString();
+}
+
+QJsonObject RebalanceDecision::toJson() const
+{
+    QJsonObject o;
+    o["time"]        = QDateTime::fromMSecsSinceEpoch(timestampMs).toString(Qt::ISODateWithMs);
+    o["pid"]         = QString::number(pid);
+    o["name"]        = name;
+    o["action"]      = rebalanceActionKey(action);
+    o["from"]        = from.toRangeList();
+    o["to"]          = to.toRangeList();
+    o["demandCores"] = demandCores;
+    o["perCoreUtil"] = perCoreUtil;
+    QJsonObject cpuLoads;
+    for (const auto& l : loads)
+        cpuLoads[QString::number(l.first)] = l.second;
+    o["cpuLoads"]    = cpuLoads;
+    o["reason"]      = reason;
+    o["applied"]     = applied;
+    if (!error.isEmpty())
+        o["error"]   = error;
+    return o;
+}
+
+// ---------- Rebalancer ----------
+
+Rebalancer::Rebalancer(const Options& opts, const CpuSampler& sampler, AffinityBackend& backend,
+                       const CpuTopology& topo)
+    : opts_(opts)
+    , sampler_(sampler)
+    , backend_(backend)
+    , topo_(topo)
+{
+}
+
+void Rebalancer::manage(qint64 pid, const QString& name, const CpuSet& cpus, const RebalanceBounds& bounds,
+                        const QVector<ThreadPinRule>& threadRules)
+{
+    Managed& m = managed_[pid];
+    m = Managed();
+    m.name = name;
+    m.cpus = cpus;
+    m.bounds = bounds;
+    m.threadRules = threadRules;
+    // Settle in before the first change.
+    m.lastChangeMs = QDateTime::currentMSecsSinceEpoch();
+}
+
+void Rebalancer::unmanage(qint64 pid)
+{
+    managed_.remove(pid);
+}
+
+double Rebalancer::average(const CpuSampler::SeriesPtr& series) const
+{
+    if (!series) return -1.0;
+    QVector<float> values(qMax(1, opts_.windowSamples));
+    const int n = series->history.copyLatest(values.data(), int(values.size()));
+    if (n == 0) return -1.0;
+    double sum = 0;
+    for (int i = 0; i < n; ++i) sum += values[i];
+    return sum / n;
+}
+
+namespace {
+
+// The least loaded of `candidates`, preferring one that shares a cache with
+// `current` as long as it is not busier than `coolEnough`.
+int pickTarget(const CpuTopology& topo, const CpuSet& current, const CpuSet& candidates,
+               const QVector<double>& load, double coolEnough)
+{
+    QVector<int> l3s;
+    for (int cpu : current.toList())
+        if (const CpuInfo* info = topo.find(cpu)) l3s.append(info->l3);
+
+    int best = -1, bestNear = -1;
+    for (int cpu : candidates.toList()) {
+        const double l = load.value(cpu, 1.0);
+        if (best < 0 || l < load.value(best, 1.0)) best = cpu;
+        const CpuInfo* info = topo.find(cpu);
+        if (info && l3s.contains(info->l3) && l <= coolEnough
+            && (bestNear < 0 || l < load.value(bestNear, 1.0)))
+            bestNear = cpu;
+    }
+    return bestNear >= 0 ? bestNear : best;
+}
+
+} // namespace
+
+// Updates the streaks of `m` and fills `d` once a condition held long enough.
+bool Rebalancer::decide(qint64 pid, Managed& m, const QVector<double>& load, qint64 nowMs, RebalanceDecision* d)
+{
+    const double demand = average(sampler_.process(pid));
+    const int n = m.cpus.count();
+    if (demand < 0 || n == 0) return false;
+
+    const CpuSet online = topo_.online();
+    const CpuSet allowed = m.bounds.allowed.isEmpty() ? online : (m.bounds.allowed & online);
+    const int maxCores = m.bounds.maxCores > 0 ? qMin(m.bounds.maxCores, allowed.count()) : allowed.count();
+    const int minCores = qBound(1, m.bounds.minCores, qMax(1, maxCores));
+    const CpuSet outside = allowed - m.cpus;
+    const double perCore = demand / n;
+
+    // Grow: the process keeps every CPU it has busy.
+    const bool wantGrow = perCore > opts_.growAbove && n < maxCores && !outside.isEmpty();
+    // Shrink: mostly idle, and would still be well below the grow threshold
+    // with one CPU less; the gap between the two is the hysteresis.
+    const double midpoint = (opts_.growAbove + opts_.shrinkBelow) / 2;
+    const bool wantShrink = !wantGrow && n > minCores && perCore < opts_.shrinkBelow
+                            && demand / (n - 1) < midpoint;
+    // Move: one of its CPUs is hot mostly because of other tasks, and a cool
+    // allowed CPU would stay below hot with this process's share added. The
+    // process may run on a single one of its CPUs, so only load beyond what it
+    // could cause on its own counts as others'; otherwise it would chase its
+    // own heat from CPU to CPU.
+    int hot = -1, cool = -1;
+    if (!wantGrow && !wantShrink && !outside.isEmpty()) {
+        const double ownAtMost = qMin(1.0, demand);
+        for (int cpu : m.cpus.toList()) {
+            const double l = load.value(cpu, 0.0);
+            if (l >= opts_.hotCpu && l - ownAtMost >= l / 2 && (hot < 0 || l > load.value(hot)))
+                hot = cpu;
+        }
+        if (hot >= 0) {
+            cool = pickTarget(topo_, m.cpus, outside, load, opts_.coolCpu);
+            if (cool >= 0 && (load.value(cool, 1.0) > opts_.coolCpu
+                              || load.value(cool, 1.0) + perCore >= opts_.hotCpu))
+                cool = -1;
+        }
+    }
+    const bool wantMove = cool >= 0;
+
+    m.growStreak   = wantGrow   ? m.growStreak + 1   : 0;
+    m.shrinkStreak = wantShrink ? m.shrinkStreak + 1 : 0;
+    m.moveStreak   = wantMove   ? m.moveStreak + 1   : 0;
+    const int streak = qMax(m.growStreak, qMax(m.shrinkStreak, m.moveStreak));
+    if (streak < opts_.sustainTicks || nowMs - m.lastChangeMs < qint64(opts_.cooldownSecs) * 1000)
+        return false;
+
+    d->timestampMs = nowMs;
+    d->pid = pid;
+    d->name = m.name;
+    d->from = m.cpus;
+    d->demandCores = demand;
+    d->perCoreUtil = perCore;
+    d->to = m.cpus;
+    if (wantGrow) {
+        const int cpu = pickTarget(topo_, m.cpus, outside, load, opts_.coolCpu);
+        d->action = RebalanceDecision::Grow;
+        d->to.set(cpu);
+        d->reason = QStringLiteral("%1 CPU(s) at %2% per CPU for %3 checks, above %4%")
+                        .arg(n).arg(perCore * 100, 0, 'f', 0).arg(streak).arg(opts_.growAbove * 100, 0, 'f', 0);
+    } else if (wantShrink) {
+        // Give back the busiest one; whatever else runs there gets it.
+        int victim = -1;
+        for (int cpu : m.cpus.toList())
+            if (victim < 0 || load.value(cpu, 0.0) > load.value(victim, 0.0)) victim = cpu;
+        d->action = RebalanceDecision::Shrink;
+        d->to.reset(victim);
+        d->reason = QStringLiteral("%1 CPU(s) at %2% per CPU for %3 checks, below %4%")
+                        .arg(n).arg(perCore * 100, 0, 'f', 0).arg(streak).arg(opts_.shrinkBelow * 100, 0, 'f', 0);
+    } else {
+        d->action = RebalanceDecision::Move;
+        d->to.reset(hot);
+        d->to.set(cool);
+        d->reason = QStringLiteral("CPU %1 at %2% with others' load, CPU %3 at %4%")
+                        .arg(hot).arg(load.value(hot) * 100, 0, 'f', 0)
+                        .arg(cool).arg(load.value(cool) * 100, 0, 'f', 0);
+    }
+    for (int cpu : (d->from | d->to).toList())
+        d->loads.append(qMakePair(cpu, load.value(cpu, 0.0)));
+    return true;
+}
+
+QVector<RebalanceDecision> Rebalancer::tick()
+{
+    QVector<RebalanceDecision> out;
+    if (managed_.isEmpty()) return out;
+
+    QVector<double> load(topo_.online().last() + 1, 0.0);
+    for (int cpu = 0; cpu < load.size(); ++cpu)
+        load[cpu] = qMax(0.0, average(sampler_.cpu(cpu)));
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (auto it = managed_.begin(); it != managed_.end();) {
+        Managed& m = it.value();
+        // Gone, or changed by someone else: drop it, or start over from the
+        // new mask.
+        CpuSet actual;
+        if (!backend_.processAffinity(it.key(), &actual)) {
+            it = managed_.erase(it);
+            continue;
+        }
+        if (actual != m.cpus) {
+            m.cpus = actual;
+            m.growStreak = m.shrinkStreak = m.moveStreak = 0;
+            m.lastChangeMs = now;
+        }
+
+        RebalanceDecision d;
+        if (out.size() < opts_.maxChangesPerTick && decide(it.key(), m, load, now, &d)) {
+            BackendError err;
+            d.applied = backend_.setProcessAffinity(it.key(), d.to, &err);
+            if (d.applied) {
+                m.cpus = d.to;
+                if (!reapplyThreadRules(it.key(), m, &err))
+                    d.error = QStringLiteral("thread rules: %1").arg(err.message);
+            } else {
+                d.error = err.message;
+            }
+            // A refused change waits out the cooldown too.
+            m.lastChangeMs = now;
+            m.growStreak = m.shrinkStreak = m.moveStreak = 0;
+            audit(d);
+            out.append(d);
+        }
+        ++it;
+    }
+    return out;
+}
+
+bool Rebalancer::reapplyThreadRules(qint64 pid, const Managed& m, BackendError* err)
+{
+    if (m.threadRules.isEmpty()) return true;
+    // A pin with no CPU left in the new set gets the whole set; the rule stays
+    // so the threads it matches do not fall through to a later one.
+    QVector<ThreadPinRule> rules = m.threadRules;
+    for (ThreadPinRule& r : rules) {
+        const CpuSet narrowed = r.cpus & m.cpus;
+        r.cpus = narrowed.isEmpty() ? m.cpus : narrowed;
+    }
+    return applyThreadRules(backend_, pid, rules, nullptr, err);
+}
+
+void Rebalancer::audit(const RebalanceDecision& d) const
+{
+    if (auditPath_.isEmpty()) return;
+    QFile f(auditPath_);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Append))
+        return;
+    f.write(QJsonDocument(d.toJson()).toJson(QJsonDocument::Compact));
+    f.write("\n");
+}
@@ -0,0 +1,113 @@
+#ifndef REBALANCER_H
+#define REBALANCER_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "cpusampler.h"
+#include "cpuset.h"
+#include "cputopology.h"
+#include "threadpinning.h"
+
+class AffinityBackend;
+
+// Limits for the rebalancer, stored with a config.
+struct RebalanceBounds {
+    bool   enabled{false};
+    int    minCores{1};
+    int    maxCores{0};      // 0 = as many as `allowed` has
+    CpuSet allowed;          // empty = every online CPU
+
+    QJsonObject toJson() const;
+    static RebalanceBounds fromJson(const QJsonObject& o, bool* ok=nullptr);
+};
+
+// One change, with the inputs it was based on, for the audit log.
+struct RebalanceDecision {
+    enum Action { Grow, Shrink, Move };
+
+    qint64  timestampMs{0};  // wall clock
+    qint64  pid{0};
+    QString name;
+    Action  action{Grow};
+    CpuSet  from;
+    CpuSet  to;
+    double  demandCores{0.0};            // process CPU use, averaged over the window
+    double  perCoreUtil{0.0};            // demand / CPUs it had
+    QVector<QPair<int, double>> loads;   // load of every CPU in from | to
+    QString reason;
+    bool    applied{false};
+    QString error;
+
+    QJsonObject toJson() const;
+};
+
+QString rebalanceActionKey(RebalanceDecision::Action a);
+
+// Grows, shrinks or moves the CPU sets of managed processes from the
+// sampler's per-CPU and per-process utilisation. A condition has to hold for
+// `sustainTicks` passes in a row, the shrink threshold leaves a gap below
+// the grow threshold, and each process waits `cooldownSecs` between changes,
+// so load noise does not make it thrash. The caller tracks managed pids in
+// the sampler and calls tick() periodically. Managed processes are moved
+// with the process mask, so configs confined by a cgroup are left out. The
+// process mask replaces every thread's mask, so thread rules are applied
+// again after each change, narrowed to the new set.
+class Rebalancer
+{
+public:
+    struct Options {
+        int    windowSamples{20};     // sampler values averaged per decision
+        double growAbove{0.85};       // per-core utilisation of the process
+        double shrinkBelow{0.40};
+        double hotCpu{0.90};          // a CPU this busy is worth leaving...
+        double coolCpu{0.50};         // ...for one at most this busy
+        int    sustainTicks{3};
+        int    cooldownSecs{30};
+        int    maxChangesPerTick{4};  // across all processes
+    };
+
+    Rebalancer(const Options& opts, const CpuSampler& sampler, AffinityBackend& backend,
+               const CpuTopology& topo);
+
+    void manage(qint64 pid, const QString& name, const CpuSet& cpus, const RebalanceBounds& bounds,
+                const QVector<ThreadPinRule>& threadRules = {});
+    void unmanage(qint64 pid);
+    bool isManaged(qint64 pid) const { return managed_.contains(pid); }
+    int  managedCount() const { return int(managed_.size()); }
+
+    // Every decision is appended to this file as one JSON line.
+    void setAuditLog(const QString& path) { auditPath_ = path; }
+
+    // One pass over every managed process; returns what it changed or tried to.
+    QVector<RebalanceDecision> tick();
+
+private:
+    struct Managed {
+        QString name;
+        CpuSet  cpus;
+        RebalanceBounds bounds;
+        QVector<ThreadPinRule> threadRules;
+        int     growStreak{0};
+        int     shrinkStreak{0};
+        int     moveStreak{0};
+        qint64  lastChangeMs{0};
+    };
+
+    double average(const CpuSampler::SeriesPtr& series) const;
+    bool decide(qint64 pid, Managed& m, const QVector<double>& load, qint64 nowMs, RebalanceDecision* d);
+    bool reapplyThreadRules(qint64 pid, const Managed& m, BackendError* err);
+    void audit(const RebalanceDecision& d) const;
+
+    Options opts_;
+    const CpuSampler& sampler_;
+    AffinityBackend& backend_;
+    const CpuTopology& topo_;
+    QHash<qint64, Managed> managed_;
+    QString auditPath_;
+};
+
+#endif // REBALANCER_H
@@ -0,0 +1,61 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+
+// Fixed-size history of the last N values. One writer thread pushes, any
+// number of readers copy the most recent values without taking a lock.
+template <typename T, int N>
+class HistoryRing
+{
+    static_assert(N > 0, "HistoryRing needs at least one slot");
+    static_assert(std::atomic<T>::is_always_lock_free, "HistoryRing slots must be lock-free");
+
+public:
+    static constexpr int capacity() { return N; }
+
+    void push(T v)
+    {
+        const quint64 h = head_.load(std::memory_order_relaxed);
+        slots_[h % N].store(v, std::memory_order_relaxed);
+        head_.store(h + 1, std::memory_order_release);
+    }
+
+    // Total number of values ever pushed.
+    quint64 pushed() const { return head_.load(std::memory_order_acquire); }
+
+    T latest(T fallback = T()) const
+    {
+        const quint64 h = head_.load(std::memory_order_acquire);
+        return h ? slots_[(h - 1) % N].load(std::memory_order_relaxed) : fallback;
+    }
+
+    // Copy up to `max` of the most recent values into `out`, oldest first.
+    // Values the writer overwrote while we were copying are dropped.
+    int copyLatest(T* out, int max) const
+    {
+        const quint64 h = head_.load(std::memory_order_acquire);
+        const int n = int(std::min<quint64>(h, quint64(std::min(max, N))));
+        const quint64 first = h - quint64(n);
+        for (int i = 0; i < n; ++i)
+            out[i] = slots_[(first + quint64(i)) % N].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const quint64 h2 = head_.load(std::memory_order_relaxed);
+        // Slots below h2 - N may have been reused since we read them.
+        const quint64 safeFrom = h2 > quint64(N) ? h2 - quint64(N) : 0;
+        if (safeFrom <= first)
+            return n;
+        const int lost = int(std::min<quint64>(safeFrom - first, quint64(n)));
+        std::copy(out + lost, out + n, out);
+        return n - lost;
+    }
+
+private:
+    std::atomic<T> slots_[N]{};
+    std::atomic<quint64> head_{0};
+};
+
+#endif // RINGBUFFER_H
@@ -0,0 +1,124 @@
+#include "schededitor.h"
+
+#include <QComboBox>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QSpinBox>
+
+namespace {
+
+// A spin box whose minimum reads "Leave" and means "unchanged".
+QSpinBox* optionalSpin(QWidget* parent, int unchanged, int max, const QString& tip)
+{
+    auto* s = new QSpinBox(parent);
+    s->setRange(unchanged, max);
+    s->setSpecialValueText(QStringLiteral("Leave"));
+    s->setValue(unchanged);
+    s->setToolTip(tip);
+    return s;
+}
+
+QSpinBox* microsSpin(QWidget* parent, const QString& tip)
+{
+    auto* s = new QSpinBox(parent);
+    s->setRange(0, 1000000000);
+    s->setSuffix(QStringLiteral(" µs"));
+    s->setToolTip(tip);
+    return s;
+}
+
+} // namespace
+
+SchedEditor::SchedEditor(QWidget* parent)
+    : QWidget(parent)
+{
+    classCombo_ = new QComboBox(this);
+    for (SchedClass c : allSchedClasses())
+        classCombo_->addItem(schedClassLabel(c), schedClassKey(c));
+    classCombo_->setToolTip("Scheduling class of every thread; real-time classes need CAP_SYS_NICE");
+    prioritySpin_ = new QSpinBox(this);
+    prioritySpin_->setRange(1, 99);
+    prioritySpin_->setToolTip("Real-time priority, 99 is highest");
+
+    deadlineRow_ = new QWidget(this);
+    runtimeSpin_ = microsSpin(deadlineRow_, "CPU time guaranteed every period");
+    deadlineSpin_ = microsSpin(deadlineRow_, "The runtime is delivered within this much of each period's start");
+    periodSpin_ = microsSpin(deadlineRow_, "Period; 0 means the same as the deadline");
+    auto* dl = new QHBoxLayout(deadlineRow_);
+    dl->setContentsMargins(0, 0, 0, 0);
+    dl->addWidget(runtimeSpin_);
+    dl->addWidget(deadlineSpin_);
+    dl->addWidget(periodSpin_);
+
+    niceSpin_ = optionalSpin(this, -21, 19, "Nice value for normal and batch threads, -20 (highest) to 19");
+    ioCombo_ = new QComboBox(this);
+    for (IoPrioClass c : allIoPrioClasses())
+        ioCombo_->addItem(ioPrioClassLabel(c), ioPrioClassKey(c));
+    ioCombo_->setToolTip("I/O scheduling class (ioprio); real time needs CAP_SYS_ADMIN");
+    ioLevelSpin_ = new QSpinBox(this);
+    ioLevelSpin_->setRange(0, 7);
+    ioLevelSpin_->setToolTip("I/O priority within the class, 0 is highest");
+    utilMinSpin_ = optionalSpin(this, -1, 1024, "sched_util_min: the scheduler treats the threads as at least this busy (0-1024)");
+    utilMaxSpin_ = optionalSpin(this, -1, 1024, "sched_util_max: caps the frequency the threads can ask for (0-1024)");
+
+    auto* grid = new QGridLayout(this);
+    grid->setContentsMargins(0, 0, 0, 0);
+    grid->addWidget(new QLabel("Scheduling:", this), 0, 0);
+    grid->addWidget(classCombo_, 0, 1, 1, 2);
+    grid->addWidget(prioritySpin_, 0, 3);
+    grid->addWidget(deadlineRow_, 1, 1, 1, 3);
+    grid->addWidget(new QLabel("Nice / I/O:", this), 2, 0);
+    grid->addWidget(niceSpin_, 2, 1);
+    grid->addWidget(ioCombo_, 2, 2);
+    grid->addWidget(ioLevelSpin_, 2, 3);
+    grid->addWidget(new QLabel("Util clamp:", this), 3, 0);
+    grid->addWidget(utilMinSpin_, 3, 1);
+    grid->addWidget(utilMaxSpin_, 3, 2);
+    grid->setColumnStretch(2, 1);
+
+    connect(classCombo_, &QComboBox::currentIndexChanged, this, &SchedEditor::syncEnabled);
+    connect(ioCombo_, &QComboBox::currentIndexChanged, this, &SchedEditor::syncEnabled);
+    syncEnabled();
+}
+
+void SchedEditor::syncEnabled()
+{
+    const SchedClass c = schedClassFromKey(classCombo_->currentData().toString());
+    prioritySpin_->setEnabled(c == SchedClass::Fifo || c == SchedClass::RoundRobin);
+    deadlineRow_->setVisible(c == SchedClass::Deadline);
+    const IoPrioClass io = ioPrioClassFromKey(ioCombo_->currentData().toString());
+    ioLevelSpin_->setEnabled(io == IoPrioClass::RealTime || io == IoPrioClass::BestEffort);
+}
+
+void SchedEditor::setSettings(const SchedSettings& s)
+{
+    classCombo_->setCurrentIndex(qMax(0, classCombo_->findData(schedClassKey(s.cls))));
+    prioritySpin_->setValue(s.priority);
+    runtimeSpin_->setValue(int(s.runtimeUs));
+    deadlineSpin_->setValue(int(s.deadlineUs));
+    periodSpin_->setValue(int(s.periodUs));
+    niceSpin_->setValue(s.changeNice ? s.nice : niceSpin_->minimum());
+    ioCombo_->setCurrentIndex(qMax(0, ioCombo_->findData(ioPrioClassKey(s.ioClass))));
+    ioLevelSpin_->setValue(s.ioLevel);
+    utilMinSpin_->setValue(s.utilMin);
+    utilMaxSpin_->setValue(s.utilMax);
+    syncEnabled();
+}
+
+SchedSettings SchedEditor::settings() const
+{
+    SchedSettings s;
+    s.cls = schedClassFromKey(classCombo_->currentData().toString());
+    s.priority = prioritySpin_->value();
+    s.runtimeUs = runtimeSpin_->value();
+    s.deadlineUs = deadlineSpin_->value();
+    s.periodUs = periodSpin_->value();
+    s.changeNice = niceSpin_->value() != niceSpin_->minimum();
+    s.nice = s.changeNice ? niceSpin_->value() : 0;
+    s.ioClass = ioPrioClassFromKey(ioCombo_->currentData().toString());
+    s.ioLevel = ioLevelSpin_->value();
+    s.utilMin = utilMinSpin_->value();
+    s.utilMax = utilMaxSpin_->value();
+    return s;
+}
@@ -0,0 +1,38 @@
+#ifndef SCHEDEDITOR_H
+#define SCHEDEDITOR_H
+
+#include <QWidget>
+
+#include "schedpolicy.h"
+
+class QComboBox;
+class QSpinBox;
+
+// Scheduling class with its priority or deadline parameters, nice, I/O
+// priority and utilisation clamps. Every control has a "leave as is" state.
+class SchedEditor : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SchedEditor(QWidget* parent=nullptr);
+
+    void setSettings(const SchedSettings& s);
+    SchedSettings settings() const;
+
+private:
+    void syncEnabled();
+
+    QComboBox* classCombo_{};
+    QSpinBox* prioritySpin_{};
+    QWidget* deadlineRow_{};
+    QSpinBox* runtimeSpin_{};
+    QSpinBox* deadlineSpin_{};
+    QSpinBox* periodSpin_{};
+    QSpinBox* niceSpin_{};
+    QComboBox* ioCombo_{};
+    QSpinBox* ioLevelSpin_{};
+    QSpinBox* utilMinSpin_{};
+    QSpinBox* utilMaxSpin_{};
+};
+
+#endif // SCHEDEDITOR_H
@@ -0,0 +1,635 @@
+#include "schedlatency.h"
+#include "threadpinning.h"
+
+#include <QFile>
+#include <QStringList>
+#include <algorithm>
+#include <chrono>
+
+#if defined(Q_OS_LINUX)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#endif
+
+// ---------- LatencyHistogram ----------
+
+int LatencyHistogram::bucketOf(qint64 ns)
+{
+    if (ns <= 1) return 0;
+    int octave = 63 - __builtin_clzll(quint64(ns));
+    if (octave >= kOctaves) return kBuckets - 1;
+    // The two bits below the leading one pick the quarter of the octave.
+    const int sub = octave >= 2 ? int((quint64(ns) >> (octave - 2)) & 3) : 0;
+    return octave * kSub + sub;
+}
+
+qint64 LatencyHistogram::bucketLowerNs(int i)
+{
+    const int octave = i / kSub;
+    const int sub = i % kSub;
+    if (octave < 2) {
+        // Whole octaves only; the sub-buckets above the first stay empty.
+        if (sub > 0) return qint64(2) << octave;
+        return i == 0 ? 0 : qint64(1) << octave;
+    }
+    return qint64(kSub + sub) << (octave - 2);
+}
+
+void LatencyHistogram::add(qint64 ns, quint64 weight)
+{
+    if (weight == 0) return;
+    ns = qMax<qint64>(0, ns);
+    buckets_[bucketOf(ns)] += weight;
+    count_ += weight;
+    if (ns > maxNs_) maxNs_ = ns;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& o)
+{
+    for (int i = 0; i < kBuckets; ++i) buckets_[i] += o.buckets_[i];
+    count_ += o.count_;
+    maxNs_ = qMax(maxNs_, o.maxNs_);
+}
+
+void LatencyHistogram::clear()
+{
+    *this = LatencyHistogram();
+}
+
+qint64 LatencyHistogram::percentileNs(double p) const
+{
+    if (count_ == 0) return 0;
+    const quint64 want = quint64(p * double(count_ - 1)) + 1;
+    quint64 seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i];
+        if (seen >= want)
+            return i + 1 < kBuckets ? qMin(maxNs_, bucketLowerNs(i + 1)) : maxNs_;
+    }
+    return maxNs_;
+}
+
+// ---------- SchedLatency ----------
+
+SchedLatency::~SchedLatency()
+{
+    close();
+}
+
+quint64 SchedLatency::migrations() const
+{
+    quint64 sum = 0;
+    for (const Task& t : tasks_) sum += t.migrations;
+    return sum;
+}
+
+void SchedLatency::reset()
+{
+    wait_.clear();
+    migrationGap_.clear();
+    for (Task& t : tasks_) {
+        t.waits = 0;
+        t.waitNs = 0;
+        t.migrations = 0;
+    }
+    lost_ = 0;
+}
+
+void SchedLatency::refreshThreads()
+{
+    QSet<qint64> now;
+    for (const ThreadEntry& t : listThreads(pid_)) {
+        now.insert(t.tid);
+        tasks_[t.tid].name = t.name;
+    }
+    tids_ = now;
+}
+
+void SchedLatency::poll()
+{
+    if (source_ == Schedstat) {
+        pollSchedstat();
+        return;
+    }
+    if (source_ != Tracepoints) return;
+
+    // Events from all CPUs, in time order: a wakeup on one CPU pairs with the
+    // switch-in on another.
+    QVector<Event> events;
+    for (Ring* r : rings_) drainRing(*r, events);
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.timeNs != b.timeNs ? a.timeNs < b.timeNs : a.tid != b.tid ? a.tid < b.tid : a.kind < b.kind;
+    });
+    // A switch between threads in different filter chunks is recorded once
+    // per chunk.
+    events.erase(std::unique(events.begin(), events.end(), [](const Event& a, const Event& b) {
+                     return a.timeNs == b.timeNs && a.tid == b.tid && a.kind == b.kind;
+                 }),
+                 events.end());
+    for (const Event& e : events) handle(e);
+
+    const QSet<qint64> before = tids_;
+    refreshThreads();
+    if (tids_ != before) {
+        for (auto it = runnableSince_.begin(); it != runnableSince_.end();) {
+            if (tids_.contains(it.key())) ++it;
+            else it = runnableSince_.erase(it);
+        }
+        applyFilters();
+    }
+    QStringList notes;
+    if (!filterLimitation_.isEmpty())
+        notes << filterLimitation_;
+    if (lost_ > 0)
+        notes << QStringLiteral("%1 scheduler event(s) lost, the ring buffers overflowed").arg(lost_);
+    limitation_ = notes.join(QStringLiteral("; "));
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+enum EventKind { Wakeup, SwitchOutRunnable, SwitchOutSleeping, SwitchIn, Migrate };
+
+struct Field {
+    int offset{-1};
+    int size{0};
+};
+
+struct Tracepoint {
+    quint64 id{0};
+    QHash<QByteArray, Field> fields;
+};
+
+QString tracefsRoot()
+{
+    for (const char* dir : {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+        const QString root = QString::fromLatin1(dir);
+        if (::access(QFile::encodeName(root + "/events/sched").constData(), R_OK) == 0)
+            return root;
+    }
+    return QString();
+}
+
+// Reads events/sched/<name>/{id,format}.
+bool readTracepoint(const QString& root, const char* name, Tracepoint* tp)
+{
+    const QString dir = QStringLiteral("%1/events/sched/%2/").arg(root, QString::fromLatin1(name));
+    QFile id(dir + "id");
+    QFile format(dir + "format");
+    if (!id.open(QIODevice::ReadOnly) || !format.open(QIODevice::ReadOnly))
+        return false;
+    tp->id = id.readAll().trimmed().toULongLong();
+    // "\tfield:pid_t prev_pid;\toffset:24;\tsize:4;\tsigned:1;"
+    for (const QByteArray& line : format.readAll().split('\n')) {
+        const int f = line.indexOf("field:");
+        const int semi = line.indexOf(';');
+        const int off = line.indexOf("offset:");
+        const int size = line.indexOf("size:");
+        if (f < 0 || semi < 0 || off < 0 || size < 0) continue;
+        QByteArray decl = line.mid(f + 6, semi - f - 6).trimmed();
+        if (decl.endsWith(']')) decl.truncate(decl.lastIndexOf('['));
+        const QByteArray fieldName = decl.mid(decl.lastIndexOf(' ') + 1);
+        Field field;
+        field.offset = line.mid(off + 7, line.indexOf(';', off) - off - 7).toInt();
+        field.size = line.mid(size + 5, line.indexOf(';', size) - size - 5).toInt();
+        tp->fields.insert(fieldName, field);
+    }
+    return tp->id > 0;
+}
+
+qint64 rawField(const char* raw, quint32 rawSize, const Field& f)
+{
+    if (f.offset < 0 || quint32(f.offset + f.size) > rawSize) return -1;
+    switch (f.size) {
+    case 4: { qint32 v; std::memcpy(&v, raw + f.offset, 4); return v; }
+    case 8: { qint64 v; std::memcpy(&v, raw + f.offset, 8); return v; }
+    default: return -1;
+    }
+}
+
+// Filters are evaluated in the kernel, so only the process's own events
+// reach the ring. One expression covers this many threads, which keeps it
+// under the page the kernel accepts; more threads get more event sets, each
+// filtered on its share, all writing into the same ring.
+constexpr int kMaxFilterTids = 64;
+// Past this many sets (threads / kMaxFilterTids) the descriptors cost more
+// than filtering here.
+constexpr int kMaxFilterChunks = 16;
+// sched_switch, sched_wakeup, sched_wakeup_new, sched_migrate_task.
+constexpr int kTracepoints = 4;
+
+QByteArray tidFilter(const QVector<qint64>& tids, std::initializer_list<const char*> fields)
+{
+    QByteArray out;
+    for (qint64 tid : tids) {
+        for (const char* field : fields) {
+            if (!out.isEmpty()) out += " || ";
+            out += field;
+            out += " == " + QByteArray::number(tid);
+        }
+    }
+    return out;
+}
+
+CpuSet onlineCpus()
+{
+    QFile f(QStringLiteral("/sys/devices/system/cpu/online"));
+    if (!f.open(QIODevice::ReadOnly)) return CpuSet();
+    return CpuSet::fromRangeList(QString::fromLatin1(f.readAll().trimmed()));
+}
+
+} // namespace
+
+struct SchedLatency::Ring {
+    int cpu{-1};
+    QVector<int> fds;             // kTracepoints per filter chunk; fds[0] owns the buffer,
+                                  // the others write into it
+    char* base{nullptr};
+    size_t mapSize{0};
+    size_t dataSize{0};
+    Tracepoint switchTp, wakeupTp, wakeupNewTp, migrateTp;
+};
+
+bool SchedLatency::open(qint64 pid, QString* error)
+{
+    close();
+    if (pid <= 0 || listThreads(pid).isEmpty()) {
+        if (error) *error = QStringLiteral("Process %1 not found").arg(pid);
+        return false;
+    }
+    pid_ = pid;
+    refreshThreads();
+
+    QString why;
+    if (openTracepoints(&why)) {
+        source_ = Tracepoints;
+        return true;
+    }
+    source_ = Schedstat;
+    limitation_ = QStringLiteral("Scheduler tracepoints unavailable (%1); showing the mean wait per "
+                                 "timeslice of each thread from schedstat instead").arg(why);
+    pollSchedstat();   // baseline
+    reset();
+    return true;
+}
+
+bool SchedLatency::openTracepoints(QString* why)
+{
+    const QString root = tracefsRoot();
+    if (root.isEmpty()) {
+        *why = QStringLiteral("tracefs is not mounted or not readable");
+        return false;
+    }
+    Tracepoint tps[4];
+    const char* names[4] = {"sched_switch", "sched_wakeup", "sched_wakeup_new", "sched_migrate_task"};
+    for (int i = 0; i < 4; ++i) {
+        if (!readTracepoint(root, names[i], &tps[i])) {
+            *why = QStringLiteral("cannot read %1/events/sched/%2").arg(root, QString::fromLatin1(names[i]));
+            return false;
+        }
+    }
+
+    for (int cpu : onlineCpus().toList()) {
+        auto* ring = new Ring;
+        rings_.append(ring);
+        ring->cpu = cpu;
+        ring->switchTp = tps[0];
+        ring->wakeupTp = tps[1];
+        ring->wakeupNewTp = tps[2];
+        ring->migrateTp = tps[3];
+        if (!openEvents(*ring, why)) {
+            closeRings();
+            return false;
+        }
+    }
+    if (rings_.isEmpty()) {
+        *why = QStringLiteral("no online CPUs");
+        return false;
+    }
+    applyFilters();
+    return true;
+}
+
+// One set of the four tracepoints on the ring's CPU. The first set maps the
+// ring buffer; later ones write into it.
+bool SchedLatency::openEvents(Ring& r, QString* why)
+{
+    const Tracepoint* tps[kTracepoints] = {&r.switchTp, &r.wakeupTp, &r.wakeupNewTp, &r.migrateTp};
+    const long pageSize = ::sysconf(_SC_PAGESIZE);
+    const int first = int(r.fds.size());
+    auto undo = [&r, first] {
+        while (r.fds.size() > first) ::close(r.fds.takeLast());
+    };
+    for (int i = 0; i < kTracepoints; ++i) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = tps[i]->id;
+        attr.sample_period = 1;
+        attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+        attr.use_clockid = 1;
+        attr.clockid = CLOCK_MONOTONIC;
+        const int fd = int(::syscall(SYS_perf_event_open, &attr, -1, r.cpu, -1, PERF_FLAG_FD_CLOEXEC));
+        if (fd < 0) {
+            const int e = errno;
+            *why = QStringLiteral("perf_event_open(sched/%1): %2").arg(tps[i]->id).arg(qt_error_string(e));
+            undo();
+            return false;
+        }
+        r.fds.append(fd);
+        if (r.fds.size() == 1) {
+            // 1 + 2^n pages; smaller if the locked-memory limit is tight.
+            for (int pages : {128, 16}) {
+                const size_t size = size_t(pageSize) * size_t(pages + 1);
+                void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED) continue;
+                r.base = static_cast<char*>(p);
+                r.mapSize = size;
+                r.dataSize = size_t(pageSize) * size_t(pages);
+                break;
+            }
+            if (!r.base) {
+                *why = QStringLiteral("mmap of the perf ring buffer: %1").arg(qt_error_string(errno));
+                undo();
+                return false;
+            }
+        } else if (::ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, r.fds.first()) != 0) {
+            *why = QStringLiteral("PERF_EVENT_IOC_SET_OUTPUT: %1").arg(qt_error_string(errno));
+            undo();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SchedLatency::applyFilters()
+{
+    filterLimitation_.clear();
+    QVector<qint64> tids(tids_.begin(), tids_.end());
+    std::sort(tids.begin(), tids.end());
+    const int chunks = int((tids.size() + kMaxFilterTids - 1) / kMaxFilterTids);
+    QString why;
+    if (tids.isEmpty())
+        why = QStringLiteral("no threads");
+    else if (chunks > kMaxFilterChunks)
+        why = QStringLiteral("%1 threads").arg(tids.size());
+    else if (setFilters(tids, chunks, &why))
+        return;
+    // Every task's events reach the ring then; drainRing() keeps the
+    // process's own.
+    setFilters(QVector<qint64>(), 1, nullptr);
+    if (!tids.isEmpty())
+        filterLimitation_ = QStringLiteral("Kernel-side filtering is off (%1), so every task's "
+                                           "scheduler events are read").arg(why);
+}
+
+// `chunks` event sets per CPU, set i filtered on tids[i * kMaxFilterTids...];
+// no tids means no filtering.
+bool SchedLatency::setFilters(const QVector<qint64>& tids, int chunks, QString* why)
+{
+    for (Ring* r : rings_) {
+        while (r->fds.size() > chunks * kTracepoints) ::close(r->fds.takeLast());
+        while (r->fds.size() < chunks * kTracepoints) {
+            QString openWhy;
+            if (!openEvents(*r, &openWhy)) {
+                if (why) *why = openWhy;
+                return false;
+            }
+        }
+        for (int i = 0; i < r->fds.size(); ++i) {
+            // common_pid is the current task, 0 for idle: always true.
+            QByteArray expr("common_pid >= 0");
+            if (!tids.isEmpty()) {
+                const QVector<qint64> part = tids.mid((i / kTracepoints) * kMaxFilterTids, kMaxFilterTids);
+                expr = i % kTracepoints == 0 ? tidFilter(part, {"prev_pid", "next_pid"}) : tidFilter(part, {"pid"});
+            }
+            if (::ioctl(r->fds[i], PERF_EVENT_IOC_SET_FILTER, expr.constData()) != 0) {
+                if (why) *why = QStringLiteral("PERF_EVENT_IOC_SET_FILTER: %1").arg(qt_error_string(errno));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void SchedLatency::closeRings()
+{
+    for (Ring* r : rings_) {
+        if (r->base) ::munmap(r->base, r->mapSize);
+        for (int fd : r->fds) ::close(fd);
+        delete r;
+    }
+    rings_.clear();
+}
+
+void SchedLatency::close()
+{
+    closeRings();
+    source_ = None;
+    pid_ = 0;
+    limitation_.clear();
+    filterLimitation_.clear();
+    tids_.clear();
+    tasks_.clear();
+    runnableSince_.clear();
+    lastMigration_.clear();
+    lastStat_.clear();
+    wait_.clear();
+    migrationGap_.clear();
+    lost_ = 0;
+}
+
+// Records are decoded where they lie in the mapped buffer; only one that
+// wraps around the end is copied, into scratch_.
+void SchedLatency::drainRing(Ring& r, QVector<Event>& out)
+{
+    auto* meta = reinterpret_cast<perf_event_mmap_page*>(r.base);
+    const char* data = r.base + meta->data_offset;
+    const size_t size = meta->data_size ? size_t(meta->data_size) : r.dataSize;
+    const quint64 head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    quint64 tail = meta->data_tail;
+
+    while (tail + sizeof(perf_event_header) <= head) {
+        const size_t at = size_t(tail % size);
+        perf_event_header h;
+        std::memcpy(&h, data + at, sizeof(h));
+        if (h.size < sizeof(h) || tail + h.size > head) break;
+        const char* rec = data + at;
+        if (at + h.size > size) {
+            scratch_.resize(h.size);
+            std::memcpy(scratch_.data(), data + at, size - at);
+            std::memcpy(scratch_.data() + (size - at), data, h.size - (size - at));
+            rec = scratch_.constData();
+        }
+        tail += h.size;
+
+        if (h.type == PERF_RECORD_LOST && h.size >= 24) {
+            quint64 lost;
+            std::memcpy(&lost, rec + 16, sizeof(lost));
+            lost_ += lost;
+            continue;
+        }
+        if (h.type != PERF_RECORD_SAMPLE || h.size < 20) continue;
+        // PERF_SAMPLE_TIME, then PERF_SAMPLE_RAW: u32 size, raw tracepoint data.
+        quint64 time;
+        quint32 rawSize;
+        std::memcpy(&time, rec + 8, sizeof(time));
+        std::memcpy(&rawSize, rec + 16, sizeof(rawSize));
+        const char* raw = rec + 20;
+        if (20 + rawSize > h.size || rawSize < 2) continue;
+        quint16 type;
+        std::memcpy(&type, raw, sizeof(type));
+
+        const qint64 t = qint64(time);
+        if (type == r.switchTp.id) {
+            const qint64 prev = rawField(raw, rawSize, r.switchTp.fields.value("prev_pid"));
+            const qint64 next = rawField(raw, rawSize, r.switchTp.fields.value("next_pid"));
+            if (tids_.contains(prev)) {
+                // Low byte: sleep states; none set means it was preempted and
+                // is still runnable.
+                const qint64 state = rawField(raw, rawSize, r.switchTp.fields.value("prev_state"));
+                out.append({t, prev, (state & 0xff) == 0 ? SwitchOutRunnable : SwitchOutSleeping});
+            }
+            if (tids_.contains(next))
+                out.append({t, next, SwitchIn});
+        } else if (type == r.wakeupTp.id || type == r.wakeupNewTp.id) {
+            const Tracepoint& tp = type == r.wakeupTp.id ? r.wakeupTp : r.wakeupNewTp;
+            const qint64 tid = rawField(raw, rawSize, tp.fields.value("pid"));
+            if (tids_.contains(tid)) out.append({t, tid, Wakeup});
+        } else if (type == r.migrateTp.id) {
+            const qint64 tid = rawField(raw, rawSize, r.migrateTp.fields.value("pid"));
+            if (tids_.contains(tid)) out.append({t, tid, Migrate});
+        }
+    }
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void SchedLatency::handle(const Event& e)
+{
+    switch (e.kind) {
+    case Wakeup:
+        if (!runnableSince_.contains(e.tid)) runnableSince_.insert(e.tid, e.timeNs);
+        break;
+    case SwitchOutRunnable:
+        runnableSince_.insert(e.tid, e.timeNs);
+        break;
+    case SwitchOutSleeping:
+        runnableSince_.remove(e.tid);
+        break;
+    case SwitchIn: {
+        const auto since = runnableSince_.constFind(e.tid);
+        if (since == runnableSince_.cend()) break;
+        const qint64 waited = e.timeNs - *since;
+        runnableSince_.erase(since);
+        if (waited < 0) break;
+        wait_.add(waited);
+        Task& t = tasks_[e.tid];
+        ++t.waits;
+        t.waitNs += waited;
+        break;
+    }
+    case Migrate: {
+        ++tasks_[e.tid].migrations;
+        const auto last = lastMigration_.constFind(e.tid);
+        if (last != lastMigration_.cend()) migrationGap_.add(e.timeNs - *last);
+        lastMigration_.insert(e.tid, e.timeNs);
+        break;
+    }
+    }
+}
+
+void SchedLatency::pollSchedstat()
+{
+    refreshThreads();
+    const qint64 now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch()).count();
+    QHash<qint64, Stat> current;
+    for (qint64 tid : tids_) {
+        const QString dir = QStringLiteral("/proc/%1/task/%2/").arg(pid_).arg(tid);
+        QFile schedstat(dir + "schedstat");
+        if (!schedstat.open(QIODevice::ReadOnly)) continue;
+        // "<run ns> <wait ns> <timeslices>"
+        const QList<QByteArray> parts = schedstat.readAll().simplified().split(' ');
+        if (parts.size() < 3) continue;
+        Stat s{parts[1].toLongLong(), parts[2].toLongLong(), -1, now};
+        // se.nr_migrations needs CONFIG_SCHED_DEBUG.
+        QFile sched(dir + "sched");
+        if (sched.open(QIODevice::ReadOnly)) {
+            for (const QByteArray& line : sched.readAll().split('\n')) {
+                if (!line.startsWith("se.nr_migrations")) continue;
+                s.migrations = line.mid(line.indexOf(':') + 1).trimmed().toLongLong();
+                break;
+            }
+        }
+        current.insert(tid, s);
+
+        const auto last = lastStat_.constFind(tid);
+        if (last == lastStat_.cend()) continue;
+        Task& t = tasks_[tid];
+        const qint64 slices = s.slices - last->slices;
+        const qint64 waited = s.waitNs - last->waitNs;
+        if (slices > 0 && waited >= 0) {
+            wait_.add(waited / slices, quint64(slices));
+            t.waits += quint64(slices);
+            t.waitNs += waited;
+        }
+        const qint64 moved = s.migrations - last->migrations;
+        if (s.migrations >= 0 && last->migrations >= 0 && moved > 0) {
+            migrationGap_.add((now - last->timeNs) / moved, quint64(moved));
+            t.migrations += quint64(moved);
+        }
+    }
+    lastStat_ = current;
+}
+
+#else
+
+bool SchedLatency::open(qint64, QString* error)
+{
+    if (error) *error = QStringLiteral("Scheduler latency is only available on Linux");
+    return false;
+}
+
+bool SchedLatency::openTracepoints(QString*)
+{
+    return false;
+}
+
+void SchedLatency::applyFilters()
+{
+}
+
+void SchedLatency::closeRings()
+{
+}
+
+void SchedLatency::close()
+{
+    source_ = None;
+    pid_ = 0;
+    tasks_.clear();
+    wait_.clear();
+    migrationGap_.clear();
+}
+
+void SchedLatency::drainRing(Ring&, QVector<Event>&)
+{
+}
+
+void SchedLatency::handle(const Event&)
+{
+}
+
+void SchedLatency::pollSchedstat()
+{
+}
+
+#endif
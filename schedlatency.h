@@ -0,0 +1,121 @@
+#ifndef SCHEDLATENCY_H
+#define SCHEDLATENCY_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+// Log-scale histogram of durations in nanoseconds. Each power of two is split
+// into four buckets. A percentile reports its bucket's upper edge, which is at
+// most 25% above the true value (a sample at 4k in the bucket [4k, 5k)).
+class LatencyHistogram
+{
+public:
+    static constexpr int kSub = 4;
+    static constexpr int kOctaves = 40;      // up to ~18 minutes
+    static constexpr int kBuckets = kSub * kOctaves;
+
+    void add(qint64 ns, quint64 weight = 1);
+    void merge(const LatencyHistogram& o);
+    void clear();
+
+    quint64 count() const { return count_; }
+    quint64 bucket(int i) const { return buckets_[i]; }
+    static qint64 bucketLowerNs(int i);
+    static int bucketOf(qint64 ns);
+
+    // Upper bound of the bucket holding quantile `p`, 0 when empty.
+    qint64 percentileNs(double p) const;
+    qint64 maxNs() const { return maxNs_; }
+
+private:
+    quint64 buckets_[kBuckets]{};
+    quint64 count_{0};
+    qint64  maxNs_{0};
+};
+
+// Run-queue wait and CPU migrations of one process's threads. With
+// permission to trace the scheduler (root or CAP_PERFMON, and a readable
+// tracefs) every wakeup/preemption -> switch-in is timed from the sched
+// tracepoints, read straight out of per-CPU perf ring buffers. Otherwise it
+// falls back to /proc/<pid>/task/*/schedstat and sched deltas: the mean wait
+// per timeslice of each thread over each poll, weighted by its timeslices.
+class SchedLatency
+{
+public:
+    enum Source { None, Tracepoints, Schedstat };
+
+    struct Task {
+        QString name;
+        quint64 waits{0};          // run-queue waits (timeslices for schedstat)
+        qint64  waitNs{0};
+        quint64 migrations{0};
+    };
+
+    SchedLatency() = default;
+    ~SchedLatency();
+
+    SchedLatency(const SchedLatency&) = delete;
+    SchedLatency& operator=(const SchedLatency&) = delete;
+
+    bool open(qint64 pid, QString* error=nullptr);
+    void close();
+    bool isOpen() const { return source_ != None; }
+    Source source() const { return source_; }
+    // Why the tracepoints are not used, why they are not filtered by thread,
+    // or how many events were lost.
+    QString limitation() const { return limitation_; }
+
+    // Reads what happened since the last call; about once a second.
+    void poll();
+    // Clears the histograms and per-thread numbers; the sources stay open.
+    void reset();
+
+    const LatencyHistogram& runQueueWait() const { return wait_; }
+    // Time between two migrations of the same thread.
+    const LatencyHistogram& betweenMigrations() const { return migrationGap_; }
+    const QHash<qint64, Task>& tasks() const { return tasks_; }
+    quint64 migrations() const;
+    quint64 lostEvents() const { return lost_; }
+
+private:
+    struct Ring;
+    struct Event {
+        qint64 timeNs;
+        qint64 tid;
+        int    kind;               // EventKind in the .cpp
+    };
+
+    bool openTracepoints(QString* why);
+    void closeRings();
+    bool openEvents(Ring& r, QString* why);
+    void applyFilters();
+    bool setFilters(const QVector<qint64>& tids, int chunks, QString* why);
+    void refreshThreads();
+    void drainRing(Ring& r, QVector<Event>& out);
+    void handle(const Event& e);
+    void pollSchedstat();
+
+    qint64 pid_{0};
+    Source source_{None};
+    QString limitation_;
+    QString filterLimitation_;              // why the kernel does not filter by thread
+    LatencyHistogram wait_;
+    LatencyHistogram migrationGap_;
+    QHash<qint64, Task> tasks_;
+    QSet<qint64> tids_;
+
+    // Tracepoints
+    QVector<Ring*> rings_;
+    QHash<qint64, qint64> runnableSince_;   // tid -> wakeup or preemption time
+    QHash<qint64, qint64> lastMigration_;   // tid -> time
+    quint64 lost_{0};
+    QByteArray scratch_;                    // records that wrap the ring end
+
+    // Schedstat: tid -> {wait ns, timeslices, migrations, time}
+    struct Stat { qint64 waitNs; qint64 slices; qint64 migrations; qint64 timeNs; };
+    QHash<qint64, Stat> lastStat_;
+};
+
+#endif // SCHEDLATENCY_H
@@ -0,0 +1,424 @@
+#include "schedpolicy.h"
+#include "affinitybackend.h"
+#include "threadpinning.h"
+
+#include <QStringList>
+
+#if defined(Q_OS_LINUX)
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+QVector<SchedClass> allSchedClasses()
+{
+    return {SchedClass::Unchanged, SchedClass::Other, SchedClass::Batch, SchedClass::Idle,
+            SchedClass::Fifo, SchedClass::RoundRobin, SchedClass::Deadline};
+}
+
+QString schedClassKey(SchedClass c)
+{
+    switch (c) {
+    case SchedClass::Unchanged:  return QStringLiteral("unchanged");
+    case SchedClass::Other:      return QStringLiteral("other");
+    case SchedClass::Batch:      return QStringLiteral("batch");
+    case SchedClass::Idle:       return QStringLiteral("idle");
+    case SchedClass::Fifo:       return QStringLiteral("fifo");
+    case SchedClass::RoundRobin: return QStringLiteral("rr");
+    case SchedClass::Deadline:   return QStringLiteral("deadline");
+    }
+    return QString();
+}
+
+QString schedClassLabel(SchedClass c)
+{
+    switch (c) {
+    case SchedClass::Unchanged:  return QStringLiteral("Leave as is");
+    case SchedClass::Other:      return QStringLiteral("Normal (SCHED_OTHER)");
+    case SchedClass::Batch:      return QStringLiteral("Batch (SCHED_BATCH)");
+    case SchedClass::Idle:       return QStringLiteral("Idle (SCHED_IDLE)");
+    case SchedClass::Fifo:       return QStringLiteral("Real time FIFO (SCHED_FIFO)");
+    case SchedClass::RoundRobin: return QStringLiteral("Real time round robin (SCHED_RR)");
+    case SchedClass::Deadline:   return QStringLiteral("Deadline (SCHED_DEADLINE)");
+    }
+    return QString();
+}
+
+SchedClass schedClassFromKey(const QString& key, SchedClass fallback)
+{
+    for (SchedClass c : allSchedClasses())
+        if (schedClassKey(c) == key) return c;
+    return fallback;
+}
+
+QVector<IoPrioClass> allIoPrioClasses()
+{
+    return {IoPrioClass::Unchanged, IoPrioClass::RealTime, IoPrioClass::BestEffort, IoPrioClass::Idle};
+}
+
+QString ioPrioClassKey(IoPrioClass c)
+{
+    switch (c) {
+    case IoPrioClass::Unchanged:  return QStringLiteral("unchanged");
+    case IoPrioClass::RealTime:   return QStringLiteral("realtime");
+    case IoPrioClass::BestEffort: return QStringLiteral("best-effort");
+    case IoPrioClass::Idle:       return QStringLiteral("idle");
+    }
+    return QString();
+}
+
+QString ioPrioClassLabel(IoPrioClass c)
+{
+    switch (c) {
+    case IoPrioClass::Unchanged:  return QStringLiteral("Leave as is");
+    case IoPrioClass::RealTime:   return QStringLiteral("Real time");
+    case IoPrioClass::BestEffort: return QStringLiteral("Best effort");
+    case IoPrioClass::Idle:       return QStringLiteral("Idle");
+    }
+    return QString();
+}
+
+IoPrioClass ioPrioClassFromKey(const QString& key, IoPrioClass fallback)
+{
+    for (IoPrioClass c : allIoPrioClasses())
+        if (ioPrioClassKey(c) == key) return c;
+    return fallback;
+}
+
+bool SchedSettings::isDefault() const
+{
+    return cls == SchedClass::Unchanged && !changeNice && ioClass == IoPrioClass::Unchanged
+           && utilMin < 0 && utilMax < 0;
+}
+
+bool SchedSettings::isValid(QString* why) const
+{
+    auto bad = [why](const QString& msg) {
+        if (why) *why = msg;
+        return false;
+    };
+    if ((cls == SchedClass::Fifo || cls == SchedClass::RoundRobin) && (priority < 1 || priority > 99))
+        return bad(QStringLiteral("Real-time priority must be 1-99"));
+    if (cls == SchedClass::Deadline) {
+        const qint64 period = periodUs > 0 ? periodUs : deadlineUs;
+        if (runtimeUs < 1 || runtimeUs > deadlineUs || deadlineUs > period)
+            return bad(QStringLiteral("Deadline needs 0 < runtime <= deadline <= period"));
+    }
+    if (changeNice && (nice < -20 || nice > 19))
+        return bad(QStringLiteral("Nice must be -20..19"));
+    if (ioClass != IoPrioClass::Unchanged && (ioLevel < 0 || ioLevel > 7))
+        return bad(QStringLiteral("I/O priority level must be 0-7"));
+    if (utilMin > 1024 || utilMax > 1024 || (utilMin >= 0 && utilMax >= 0 && utilMin > utilMax))
+        return bad(QStringLiteral("Utilisation clamps must satisfy 0 <= min <= max <= 1024"));
+    return true;
+}
+
+QString SchedSettings::describe() const
+{
+    QStringList parts;
+    if (cls == SchedClass::Fifo || cls == SchedClass::RoundRobin)
+        parts << QStringLiteral("%1 %2").arg(schedClassKey(cls)).arg(priority);
+    else if (cls == SchedClass::Deadline)
+        parts << QStringLiteral("deadline %1/%2/%3 us").arg(runtimeUs).arg(deadlineUs)
+                     .arg(periodUs > 0 ? periodUs : deadlineUs);
+    else if (cls != SchedClass::Unchanged)
+        parts << schedClassKey(cls);
+    if (changeNice)
+        parts << QStringLiteral("nice %1").arg(nice);
+    if (ioClass == IoPrioClass::Idle)
+        parts << QStringLiteral("io idle");
+    else if (ioClass != IoPrioClass::Unchanged)
+        parts << QStringLiteral("io %1/%2").arg(ioPrioClassKey(ioClass)).arg(ioLevel);
+    if (utilMin >= 0 || utilMax >= 0)
+        parts << QStringLiteral("uclamp %1-%2").arg(qMax(0, utilMin)).arg(utilMax >= 0 ? utilMax : 1024);
+    return parts.join(QStringLiteral(", "));
+}
+
+void SchedSettings::writeJson(QJsonObject& o) const
+{
+    if (cls != SchedClass::Unchanged)
+        o["schedClass"] = schedClassKey(cls);
+    if (cls == SchedClass::Fifo || cls == SchedClass::RoundRobin)
+        o["schedPriority"] = priority;
+    if (cls == SchedClass::Deadline) {
+        o["schedRuntimeUs"]  = runtimeUs;
+        o["schedDeadlineUs"] = deadlineUs;
+        o["schedPeriodUs"]   = periodUs;
+    }
+    if (changeNice)
+        o["nice"] = nice;
+    if (ioClass != IoPrioClass::Unchanged) {
+        o["ioClass"] = ioPrioClassKey(ioClass);
+        o["ioLevel"] = ioLevel;
+    }
+    if (utilMin >= 0)
+        o["utilMin"] = utilMin;
+    if (utilMax >= 0)
+        o["utilMax"] = utilMax;
+}
+
+SchedSettings SchedSettings::readJson(const QJsonObject& o, bool* ok)
+{
+    SchedSettings s;
+    bool valid = true;
+    const QString cls = o.value("schedClass").toString();
+    s.cls = schedClassFromKey(cls);
+    if (!cls.isEmpty() && schedClassKey(s.cls) != cls)
+        valid = false;
+    s.priority   = o.value("schedPriority").toInt(1);
+    s.runtimeUs  = qint64(o.value("schedRuntimeUs").toDouble(0));
+    s.deadlineUs = qint64(o.value("schedDeadlineUs").toDouble(0));
+    s.periodUs   = qint64(o.value("schedPeriodUs").toDouble(0));
+    s.changeNice = o.contains("nice");
+    s.nice       = o.value("nice").toInt(0);
+    const QString io = o.value("ioClass").toString();
+    s.ioClass = ioPrioClassFromKey(io);
+    if (!io.isEmpty() && ioPrioClassKey(s.ioClass) != io)
+        valid = false;
+    s.ioLevel    = o.value("ioLevel").toInt(4);
+    s.utilMin    = o.value("utilMin").toInt(-1);
+    s.utilMax    = o.value("utilMax").toInt(-1);
+    if (!s.isValid())
+        valid = false;
+    if (ok) *ok = valid;
+    return s;
+}
+
+bool ThreadSchedState::operator==(const ThreadSchedState& o) const
+{
+    return policy == o.policy && priority == o.priority && nice == o.nice
+           && runtimeNs == o.runtimeNs && deadlineNs == o.deadlineNs && periodNs == o.periodNs
+           && utilMin == o.utilMin && utilMax == o.utilMax && resetOnFork == o.resetOnFork
+           && ioprio == o.ioprio;
+}
+
+#if defined(Q_OS_LINUX)
+
+namespace {
+
+// struct sched_attr (SCHED_ATTR_SIZE_VER1). Declared here because glibc only
+// gained it recently and <linux/sched/types.h> clashes with <sched.h>.
+struct SchedAttr {
+    quint32 size;
+    quint32 policy;
+    quint64 flags;
+    qint32  nice;
+    quint32 priority;
+    quint64 runtime;
+    quint64 deadline;
+    quint64 period;
+    quint32 utilMin;
+    quint32 utilMax;
+};
+
+constexpr quint32 kSchedOther = 0, kSchedFifo = 1, kSchedRr = 2, kSchedBatch = 3,
+                  kSchedIdle = 5, kSchedDeadline = 6;
+constexpr quint64 kFlagResetOnFork = 0x01, kFlagUtilClampMin = 0x20, kFlagUtilClampMax = 0x40;
+constexpr int kIoprioWhoProcess = 1;   // per thread, despite the name
+constexpr int kIoprioClassShift = 13;
+
+int schedGetattr(qint64 tid, SchedAttr* attr)
+{
+    std::memset(attr, 0, sizeof(*attr));
+    return int(::syscall(SYS_sched_getattr, pid_t(tid), attr, unsigned(sizeof(*attr)), 0u));
+}
+
+int schedSetattr(qint64 tid, SchedAttr attr)
+{
+    attr.size = sizeof(attr);
+    return int(::syscall(SYS_sched_setattr, pid_t(tid), &attr, 0u));
+}
+
+quint32 policyOf(SchedClass c)
+{
+    switch (c) {
+    case SchedClass::Batch:      return kSchedBatch;
+    case SchedClass::Idle:       return kSchedIdle;
+    case SchedClass::Fifo:       return kSchedFifo;
+    case SchedClass::RoundRobin: return kSchedRr;
+    case SchedClass::Deadline:   return kSchedDeadline;
+    case SchedClass::Other:
+    case SchedClass::Unchanged:  break;
+    }
+    return kSchedOther;
+}
+
+int ioprioOf(IoPrioClass c, int level)
+{
+    const int cls = c == IoPrioClass::RealTime ? 1 : c == IoPrioClass::BestEffort ? 2 : 3;
+    return (cls << kIoprioClassShift) | (c == IoPrioClass::Idle ? 0 : level);
+}
+
+// Settings of a thread before we touched it.
+struct SavedThread {
+    qint64 tid{0};
+    SchedAttr attr{};
+    int ioprio{-1};
+    bool clampsChanged{false};
+};
+
+void restore(const SavedThread& t)
+{
+    if (t.attr.size != 0) {
+        SchedAttr attr = t.attr;
+        attr.flags &= kFlagResetOnFork;
+        if (t.clampsChanged) attr.flags |= kFlagUtilClampMin | kFlagUtilClampMax;
+        schedSetattr(t.tid, attr);
+    }
+    if (t.ioprio >= 0)
+        ::syscall(SYS_ioprio_set, kIoprioWhoProcess, pid_t(t.tid), t.ioprio);
+}
+
+} // namespace
+
+bool applySchedSettings(qint64 pid, const SchedSettings& s, BackendError* err)
+{
+    if (s.isDefault()) return true;
+    QString why;
+    if (!s.isValid(&why))
+        return fail(err, EINVAL, why);
+
+    const QVector<ThreadEntry> threads = listThreads(pid);
+    if (threads.isEmpty())
+        return fail(err, ESRCH);
+
+    const bool touchSched = s.cls != SchedClass::Unchanged || s.changeNice || s.utilMin >= 0 || s.utilMax >= 0;
+    QVector<SavedThread> changed;
+    changed.reserve(threads.size());
+    // Puts back every thread changed so far, newest first.
+    auto rollback = [&changed, err](int code, qint64 tid, const char* what) {
+        for (int i = int(changed.size()) - 1; i >= 0; --i)
+            restore(changed[i]);
+        return fail(err, code, QStringLiteral("%1 on thread %2: %3")
+                                   .arg(QLatin1String(what)).arg(tid).arg(qt_error_string(code)));
+    };
+
+    for (const ThreadEntry& t : threads) {
+        SavedThread saved;
+        saved.tid = t.tid;
+        if (touchSched) {
+            SchedAttr attr;
+            if (schedGetattr(t.tid, &attr) != 0) {
+                if (errno == ESRCH) continue;
+                return rollback(errno, t.tid, "sched_getattr");
+            }
+            SchedAttr want = attr;
+            want.flags &= kFlagResetOnFork;
+            if (s.cls != SchedClass::Unchanged) {
+                want.policy = policyOf(s.cls);
+                want.priority = s.cls == SchedClass::Fifo || s.cls == SchedClass::RoundRobin ? quint32(s.priority) : 0;
+                const bool dl = s.cls == SchedClass::Deadline;
+                want.runtime  = dl ? quint64(s.runtimeUs) * 1000 : 0;
+                want.deadline = dl ? quint64(s.deadlineUs) * 1000 : 0;
+                want.period   = dl ? quint64(s.periodUs) * 1000 : 0;
+            }
+            if (s.changeNice)
+                want.nice = s.nice;
+            if (s.utilMin >= 0 || s.utilMax >= 0) {
+                want.flags |= kFlagUtilClampMin | kFlagUtilClampMax;
+                if (s.utilMin >= 0) want.utilMin = quint32(s.utilMin);
+                if (s.utilMax >= 0) want.utilMax = quint32(s.utilMax);
+                saved.clampsChanged = true;
+            }
+            if (schedSetattr(t.tid, want) != 0) {
+                if (errno == ESRCH) continue;
+                return rollback(errno, t.tid, "sched_setattr");
+            }
+            saved.attr = attr;
+        }
+        if (s.ioClass != IoPrioClass::Unchanged) {
+            const int old = int(::syscall(SYS_ioprio_get, kIoprioWhoProcess, pid_t(t.tid)));
+            if (old < 0 || ::syscall(SYS_ioprio_set, kIoprioWhoProcess, pid_t(t.tid), ioprioOf(s.ioClass, s.ioLevel)) != 0) {
+                const int code = errno;
+                if (code == ESRCH) continue;
+                changed.append(saved);   // its sched_setattr already went through
+                return rollback(code, t.tid, "ioprio_set");
+            }
+            saved.ioprio = old;
+        }
+        changed.append(saved);
+    }
+    return true;
+}
+
+bool readThreadSched(qint64 tid, ThreadSchedState* state, BackendError* err)
+{
+    SchedAttr attr;
+    if (schedGetattr(tid, &attr) != 0)
+        return fail(err, errno);
+    state->policy      = attr.policy;
+    state->priority    = attr.priority;
+    state->nice        = attr.nice;
+    state->runtimeNs   = attr.runtime;
+    state->deadlineNs  = attr.deadline;
+    state->periodNs    = attr.period;
+    state->utilMin     = attr.utilMin;
+    state->utilMax     = attr.utilMax;
+    state->resetOnFork = attr.flags & kFlagResetOnFork;
+    state->ioprio      = int(::syscall(SYS_ioprio_get, kIoprioWhoProcess, pid_t(tid)));
+    return true;
+}
+
+bool writeThreadSched(qint64 tid, const ThreadSchedState& state, BackendError* err)
+{
+    ThreadSchedState now;
+    if (!readThreadSched(tid, &now, err))
+        return false;
+    if (now == state)
+        return true;
+
+    SchedAttr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.policy   = state.policy;
+    attr.priority = state.priority;
+    attr.nice     = state.nice;
+    attr.runtime  = state.runtimeNs;
+    attr.deadline = state.deadlineNs;
+    attr.period   = state.periodNs;
+    attr.flags    = state.resetOnFork ? kFlagResetOnFork : 0;
+    if (now.utilMin != state.utilMin || now.utilMax != state.utilMax) {
+        attr.flags |= kFlagUtilClampMin | kFlagUtilClampMax;
+        attr.utilMin = state.utilMin;
+        attr.utilMax = state.utilMax;
+    }
+    if (schedSetattr(tid, attr) != 0) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("sched_setattr on thread %1: %2").arg(tid).arg(qt_error_string(e)));
+    }
+    if (state.ioprio >= 0 && state.ioprio != now.ioprio
+        && ::syscall(SYS_ioprio_set, kIoprioWhoProcess, pid_t(tid), state.ioprio) != 0) {
+        const int e = errno;
+        return fail(err, e, QStringLiteral("ioprio_set on thread %1: %2").arg(tid).arg(qt_error_string(e)));
+    }
+    return true;
+}
+
+#else
+
+bool applySchedSettings(qint64, const SchedSettings& s, BackendError* err)
+{
+    if (s.isDefault()) return true;
+    return fail(err, -1, QStringLiteral("Scheduling classes, I/O priority and clamps are only supported on Linux"));
+}
+
+bool readThreadSched(qint64, ThreadSchedState*, BackendError* err)
+{
+    return fail(err, -1, QStringLiteral("Scheduling state is only available on Linux"));
+}
+
+bool writeThreadSched(qint64, const ThreadSchedState&, BackendError* err)
+{
+    return fail(err, -1, QStringLiteral("Scheduling state is only available on Linux"));
+}
+
+#endif
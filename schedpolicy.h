@@ -0,0 +1,91 @@
+#ifndef SCHEDPOLICY_H
+#define SCHEDPOLICY_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+struct BackendError;
+
+// Linux scheduling class. Unchanged leaves the class and its parameters alone.
+enum class SchedClass {
+    Unchanged,
+    Other,        // SCHED_OTHER, the default time-sharing class
+    Batch,        // SCHED_BATCH, CPU-bound, fewer wakeup preemptions
+    Idle,         // SCHED_IDLE, only runs when nothing else wants the CPU
+    Fifo,         // SCHED_FIFO, real time
+    RoundRobin,   // SCHED_RR, real time with a time slice
+    Deadline,     // SCHED_DEADLINE, runtime every period before a deadline
+};
+
+QString schedClassKey(SchedClass c);          // stable name for config files
+QString schedClassLabel(SchedClass c);        // human readable
+SchedClass schedClassFromKey(const QString& key, SchedClass fallback = SchedClass::Unchanged);
+QVector<SchedClass> allSchedClasses();
+
+// I/O priority class (ioprio_set). Unchanged leaves it alone.
+enum class IoPrioClass {
+    Unchanged,
+    RealTime,
+    BestEffort,
+    Idle,
+};
+
+QString ioPrioClassKey(IoPrioClass c);
+QString ioPrioClassLabel(IoPrioClass c);
+IoPrioClass ioPrioClassFromKey(const QString& key, IoPrioClass fallback = IoPrioClass::Unchanged);
+QVector<IoPrioClass> allIoPrioClasses();
+
+// Scheduling settings for every thread of a process. Each field has an
+// "unchanged" value, so a config only touches what it names.
+struct SchedSettings {
+    SchedClass cls{SchedClass::Unchanged};
+    int     priority{1};          // 1..99, Fifo and RoundRobin
+    qint64  runtimeUs{0};         // Deadline; runtime <= deadline <= period
+    qint64  deadlineUs{0};
+    qint64  periodUs{0};          // 0 = same as deadline
+    bool    changeNice{false};
+    int     nice{0};              // -20..19
+    IoPrioClass ioClass{IoPrioClass::Unchanged};
+    int     ioLevel{4};           // 0 (highest) .. 7, RealTime and BestEffort
+    int     utilMin{-1};          // uclamp, 0..1024; -1 = unchanged
+    int     utilMax{-1};
+
+    bool isDefault() const;
+    bool isValid(QString* why=nullptr) const;
+    QString describe() const;     // e.g. "fifo 50, nice -5, io best-effort/2"
+
+    // Flat keys inside an AffinityConfig object; only the fields that are set.
+    void writeJson(QJsonObject& o) const;
+    static SchedSettings readJson(const QJsonObject& o, bool* ok=nullptr);
+};
+
+// Applies `s` to every thread of `pid`, one sched_setattr and one ioprio_set
+// per thread. Either all threads change or none: on the first failure the
+// threads already changed get their previous settings back. Threads that exit
+// meanwhile are skipped.
+bool applySchedSettings(qint64 pid, const SchedSettings& s, BackendError* err=nullptr);
+
+// A thread's scheduling state exactly as the kernel reports it, so a
+// snapshot can put it back whatever class it was in.
+struct ThreadSchedState {
+    quint32 policy{0};            // SCHED_* number
+    quint32 priority{0};
+    qint32  nice{0};
+    quint64 runtimeNs{0};
+    quint64 deadlineNs{0};
+    quint64 periodNs{0};
+    quint32 utilMin{0};
+    quint32 utilMax{1024};
+    bool    resetOnFork{false};
+    int     ioprio{-1};           // raw ioprio value, -1 = unknown
+
+    bool operator==(const ThreadSchedState& o) const;
+    bool operator!=(const ThreadSchedState& o) const { return !(*this == o); }
+};
+
+bool readThreadSched(qint64 tid, ThreadSchedState* state, BackendError* err=nullptr);
+// Clamps are only written when they differ, so kernels without uclamp work.
+bool writeThreadSched(qint64 tid, const ThreadSchedState& state, BackendError* err=nullptr);
+
+#endif // SCHEDPOLICY_H
@@ -0,0 +1,381 @@
+#include "snapshot.h"
+#include "affinitybackend.h"
+#include "cgroupcpuset.h"
+#include "processenumerator.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <algorithm>
+#include <thread>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#endif
+
+static bool fail(BackendError* err, int code, const QString& msg = QString())
+{
+    if (err) {
+        err->code = code;
+        err->message = msg.isEmpty() ? qt_error_string(code) : msg;
+    }
+    return false;
+}
+
+// File layout: the 8-byte magic, then a qCompress()ed QDataStream of
+// name, creation time, the distinct states and the processes. Thread ids are
+// stored as deltas from the previous thread, which compresses well.
+static const char kMagic[8] = {'C', 'P', 'A', 'S', 'N', 'A', 'P', '1'};
+
+bool AffinitySnapshot::State::operator==(const State& o) const
+{
+    return affinity == o.affinity && hasSched == o.hasSched && (!hasSched || sched == o.sched);
+}
+
+int AffinitySnapshot::threadCount() const
+{
+    int n = 0;
+    for (const Process& p : processes) n += int(p.threads.size());
+    return n;
+}
+
+namespace {
+
+// A process as one worker read it, before states are shared.
+struct RawProcess {
+    AffinitySnapshot::Process info;
+    AffinitySnapshot::State state;
+    QVector<AffinitySnapshot::State> threadStates;   // parallel to info.threads
+    bool ok{false};
+};
+
+AffinitySnapshot::State readState(AffinityBackend& backend, qint64 tid, bool* ok)
+{
+    AffinitySnapshot::State s;
+    *ok = backend.processAffinity(tid, &s.affinity);
+#if defined(Q_OS_LINUX)
+    s.hasSched = *ok && readThreadSched(tid, &s.sched);
+#endif
+    return s;
+}
+
+void readProcess(AffinityBackend& backend, RawProcess& p)
+{
+    p.state = readState(backend, p.info.pid, &p.ok);
+    if (!p.ok) return;
+#if defined(Q_OS_LINUX)
+    p.info.cgroup = CgroupCpuset::groupOf(p.info.pid);
+    const QStringList tasks = QDir(QStringLiteral("/proc/%1/task").arg(p.info.pid)).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& t : tasks) {
+        const qint64 tid = t.toLongLong();
+        bool ok = false;
+        const AffinitySnapshot::State s = readState(backend, tid, &ok);
+        if (!ok) continue;   // exited meanwhile
+        p.info.threads.append({tid, 0});
+        p.threadStates.append(s);
+    }
+#endif
+}
+
+int stateIndex(QVector<AffinitySnapshot::State>& states, const AffinitySnapshot::State& s)
+{
+    // A handful of distinct states in practice; newest first, since threads
+    // of one process are added together.
+    for (int i = int(states.size()) - 1; i >= 0; --i)
+        if (states[i] == s) return i;
+    states.append(s);
+    return int(states.size()) - 1;
+}
+
+} // namespace
+
+AffinitySnapshot AffinitySnapshot::take(AffinityBackend& backend, const QVector<qint64>& pids)
+{
+    AffinitySnapshot snap;
+    snap.createdMs = QDateTime::currentMSecsSinceEpoch();
+
+    ProcessEnumerator e;
+    e.setWindowedOnly(false);
+    QVector<RawProcess> raw;
+    for (const ProcEntry& p : e.scan()) {
+        if (!pids.isEmpty() && !pids.contains(p.pid)) continue;
+        RawProcess r;
+        r.info.pid = p.pid;
+        r.info.startTime = p.startTime;
+        r.info.name = p.name;
+        raw.append(r);
+    }
+
+    // Reading a process costs a few syscalls per thread; spread them out.
+    const int workers = qBound(1, qMin(QThread::idealThreadCount(), int(raw.size()) / 32), 8);
+    if (workers == 1) {
+        for (RawProcess& r : raw) readProcess(backend, r);
+    } else {
+        std::vector<std::thread> pool;
+        for (int w = 0; w < workers; ++w) {
+            pool.emplace_back([&raw, &backend, w, workers] {
+                for (int i = w; i < raw.size(); i += workers) readProcess(backend, raw[i]);
+            });
+        }
+        for (std::thread& t : pool) t.join();
+    }
+
+    for (RawProcess& r : raw) {
+        if (!r.ok) continue;
+        r.info.state = stateIndex(snap.states, r.state);
+        for (int i = 0; i < r.info.threads.size(); ++i)
+            r.info.threads[i].state = stateIndex(snap.states, r.threadStates[i]);
+        snap.processes.append(r.info);
+    }
+    return snap;
+}
+
+static QDataStream& operator<<(QDataStream& out, const AffinitySnapshot::State& s)
+{
+    out << s.affinity.words() << s.hasSched;
+    if (s.hasSched) {
+        const ThreadSchedState& t = s.sched;
+        out << t.policy << t.priority << t.nice << t.runtimeNs << t.deadlineNs << t.periodNs
+            << t.utilMin << t.utilMax << t.resetOnFork << qint32(t.ioprio);
+    }
+    return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, AffinitySnapshot::State& s)
+{
+    QVector<quint64> words;
+    in >> words >> s.hasSched;
+    s.affinity.clear();
+    for (int w = 0; w < words.size(); ++w)
+        for (int bit = 0; bit < 64; ++bit)
+            if (words[w] & (quint64(1) << bit)) s.affinity.set(w * 64 + bit);
+    if (s.hasSched) {
+        ThreadSchedState& t = s.sched;
+        qint32 ioprio = -1;
+        in >> t.policy >> t.priority >> t.nice >> t.runtimeNs >> t.deadlineNs >> t.periodNs
+           >> t.utilMin >> t.utilMax >> t.resetOnFork >> ioprio;
+        t.ioprio = ioprio;
+    }
+    return in;
+}
+
+bool AffinitySnapshot::save(const QString& path, QString* error) const
+{
+    QByteArray payload;
+    {
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << name << createdMs << quint32(states.size());
+        for (const State& s : states) out << s;
+        out << quint32(processes.size());
+        for (const Process& p : processes) {
+            out << p.pid << p.startTime << p.name << p.cgroup << qint32(p.state) << quint32(p.threads.size());
+            qint64 previous = p.pid;
+            for (const Thread& t : p.threads) {
+                out << qint32(t.tid - previous) << qint32(t.state);
+                previous = t.tid;
+            }
+        }
+    }
+
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        if (error) *error = f.errorString();
+        return false;
+    }
+    f.write(kMagic, sizeof(kMagic));
+    f.write(qCompress(payload));
+    if (!f.commit()) {
+        if (error) *error = f.errorString();
+        return false;
+    }
+    return true;
+}
+
+AffinitySnapshot AffinitySnapshot::load(const QString& path, QString* error)
+{
+    AffinitySnapshot snap;
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        if (error) *error = f.errorString();
+        return snap;
+    }
+    const QByteArray data = f.readAll();
+    if (data.size() < int(sizeof(kMagic)) || !data.startsWith(QByteArray(kMagic, sizeof(kMagic)))) {
+        if (error) *error = QStringLiteral("%1 is not a snapshot file").arg(path);
+        return snap;
+    }
+    const QByteArray payload = qUncompress(data.mid(sizeof(kMagic)));
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint32 stateCount = 0, processCount = 0;
+    in >> snap.name >> snap.createdMs >> stateCount;
+    for (quint32 i = 0; i < stateCount && in.status() == QDataStream::Ok; ++i) {
+        State s;
+        in >> s;
+        snap.states.append(s);
+    }
+    in >> processCount;
+    for (quint32 i = 0; i < processCount && in.status() == QDataStream::Ok; ++i) {
+        Process p;
+        qint32 state = 0;
+        quint32 threads = 0;
+        in >> p.pid >> p.startTime >> p.name >> p.cgroup >> state >> threads;
+        p.state = state;
+        qint64 previous = p.pid;
+        for (quint32 t = 0; t < threads && in.status() == QDataStream::Ok; ++t) {
+            qint32 delta = 0, threadState = 0;
+            in >> delta >> threadState;
+            previous += delta;
+            p.threads.append({previous, threadState});
+        }
+        snap.processes.append(p);
+    }
+
+    // Indexes out of range mean a truncated or foreign file.
+    bool valid = in.status() == QDataStream::Ok;
+    for (const Process& p : snap.processes) {
+        valid = valid && p.state >= 0 && p.state < snap.states.size();
+        for (const Thread& t : p.threads)
+            valid = valid && t.state >= 0 && t.state < snap.states.size();
+    }
+    if (!valid) {
+        if (error) *error = QStringLiteral("%1 is damaged").arg(path);
+        return AffinitySnapshot();
+    }
+    return snap;
+}
+
+QString AffinitySnapshot::directory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + QStringLiteral("/snapshots");
+}
+
+QString AffinitySnapshot::pathFor(const QString& name)
+{
+    return directory() + QLatin1Char('/') + name + QStringLiteral(".snapshot");
+}
+
+QStringList AffinitySnapshot::names()
+{
+    QStringList out;
+    const QFileInfoList files = QDir(directory()).entryInfoList({QStringLiteral("*.snapshot")}, QDir::Files, QDir::Time);
+    for (const QFileInfo& fi : files) out << fi.completeBaseName();
+    return out;
+}
+
+QString RestoreReport::summary() const
+{
+    QString s = QStringLiteral("%1 process(es) and %2 thread(s) restored").arg(processes).arg(threads);
+    if (skipped) s += QStringLiteral(", %1 gone").arg(skipped);
+    if (!failures.isEmpty()) s += QStringLiteral(", %1 failed").arg(failures.size());
+    return s;
+}
+
+RestoreReport restoreSnapshot(AffinityBackend& backend, const AffinitySnapshot& snap)
+{
+    RestoreReport report;
+    ProcessEnumerator e;
+    e.setWindowedOnly(false);
+    QHash<qint64, quint64> alive;
+    for (const ProcEntry& p : e.scan()) alive.insert(p.pid, p.startTime);
+
+    for (const AffinitySnapshot::Process& p : snap.processes) {
+        const auto it = alive.constFind(p.pid);
+        if (it == alive.cend() || *it != p.startTime) {
+            ++report.skipped;
+            continue;
+        }
+        const AffinitySnapshot::State& proc = snap.states[p.state];
+        auto failed = [&report, &p](const QString& what, const BackendError& err) {
+            report.failures << QStringLiteral("%1 (PID %2): %3: %4").arg(p.name).arg(p.pid).arg(what, err.message);
+        };
+        BackendError err;
+        bool ok = true;
+
+#if defined(Q_OS_LINUX)
+        if (!p.cgroup.isEmpty() && CgroupCpuset::groupOf(p.pid) != p.cgroup
+            && !CgroupCpuset::moveProcesses(p.cgroup, {p.pid}, nullptr, &err)) {
+            failed(QStringLiteral("cgroup %1").arg(p.cgroup), err);
+            ok = false;
+        }
+#endif
+        // Only what changed is written: kernel threads refuse any mask, even
+        // their own. The process mask also covers threads started since.
+        CpuSet current;
+        if ((!backend.processAffinity(p.pid, &current) || current != proc.affinity)
+            && !backend.setProcessAffinity(p.pid, proc.affinity, &err)) {
+            failed(QStringLiteral("affinity"), err);
+            ok = false;
+        }
+#if defined(Q_OS_LINUX)
+        // A thread that exited may have left its TID to an unrelated task,
+        // which must not get this one's mask or real-time class.
+        QSet<qint64> tids;
+        if (!p.threads.isEmpty()) {
+            const QStringList tasks = QDir(QStringLiteral("/proc/%1/task").arg(p.pid)).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString& t : tasks) tids.insert(t.toLongLong());
+        }
+#endif
+        for (const AffinitySnapshot::Thread& t : p.threads) {
+#if defined(Q_OS_LINUX)
+            if (!tids.contains(t.tid)) continue;   // exited, like ESRCH below
+#endif
+            const AffinitySnapshot::State& s = snap.states[t.state];
+            bool threadOk = true;
+            if ((!backend.processAffinity(t.tid, &current) || current != s.affinity)
+                && !backend.setThreadAffinity(t.tid, s.affinity, &err))
+                threadOk = false;
+            if (threadOk && s.hasSched && !writeThreadSched(t.tid, s.sched, &err))
+                threadOk = false;
+#if defined(Q_OS_LINUX)
+            if (!threadOk && err.code == ESRCH) continue;
+#endif
+            if (!threadOk) {
+                failed(QStringLiteral("thread %1").arg(t.tid), err);
+                ok = false;
+                continue;
+            }
+            ++report.threads;
+        }
+        if (ok) ++report.processes;
+    }
+    return report;
+}
+
+bool applyTransaction(AffinityBackend& backend, const CpuTopology& topo,
+                      const QVector<QPair<qint64, AffinityConfig>>& targets,
+                      AffinitySnapshot* before, BackendError* err)
+{
+    // An empty PID list would snapshot, and on failure restore, every process.
+    if (targets.isEmpty())
+        return fail(err, EINVAL, QStringLiteral("No processes to apply to"));
+    QVector<qint64> pids;
+    for (const auto& t : targets) pids.append(t.first);
+    AffinitySnapshot snap = AffinitySnapshot::take(backend, pids);
+    if (snap.processes.size() < pids.size()) {
+        if (before) *before = snap;
+        return fail(err, ESRCH, QStringLiteral("%1 of %2 process(es) could not be read, nothing was changed")
+                                    .arg(pids.size() - snap.processes.size()).arg(pids.size()));
+    }
+    if (before) *before = snap;
+
+    for (const auto& t : targets) {
+        BackendError applyErr;
+        if (applyAffinityConfig(backend, topo, t.first, t.second, nullptr, &applyErr))
+            continue;
+        const RestoreReport r = restoreSnapshot(backend, snap);
+        QString msg = QStringLiteral("PID %1: %2; rolled back, %3").arg(t.first).arg(applyErr.message, r.summary());
+        if (!r.ok()) msg += QStringLiteral(" (") + r.failures.join(QStringLiteral("; ")) + QStringLiteral(")");
+        return fail(err, applyErr.code, msg);
+    }
+    return true;
+}
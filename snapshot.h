@@ -0,0 +1,85 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "affinityconfig.h"
+#include "cpuset.h"
+#include "schedpolicy.h"
+
+class AffinityBackend;
+struct BackendError;
+
+// Affinity and scheduling of every thread, plus the cgroup of every process,
+// at one point in time. Threads mostly share a handful of states, so those
+// are stored once and threads refer to them by index.
+struct AffinitySnapshot {
+    struct State {
+        CpuSet affinity;
+        ThreadSchedState sched;
+        bool hasSched{false};
+
+        bool operator==(const State& o) const;
+    };
+    struct Thread {
+        qint64 tid{0};
+        int    state{0};          // index into states
+    };
+    struct Process {
+        qint64  pid{0};
+        quint64 startTime{0};     // as ProcessEnumerator reports it; tells PID reuse apart
+        QString name;
+        QString cgroup;           // empty when unknown (Windows, no cgroup v2)
+        int     state{0};         // the process mask (Windows: all there is)
+        QVector<Thread> threads;
+    };
+
+    QString name;
+    qint64  createdMs{0};
+    QVector<State> states;
+    QVector<Process> processes;
+
+    bool isEmpty() const { return processes.isEmpty(); }
+    int threadCount() const;
+
+    // Every process, or only `pids`. Processes are read on several threads.
+    static AffinitySnapshot take(AffinityBackend& backend, const QVector<qint64>& pids = {});
+
+    // Compact binary file, see the .cpp for the layout.
+    bool save(const QString& path, QString* error=nullptr) const;
+    static AffinitySnapshot load(const QString& path, QString* error=nullptr);
+
+    // Named snapshots live in one directory under the app data location.
+    static QString directory();
+    static QString pathFor(const QString& name);
+    static QStringList names();   // newest first
+};
+
+// What restore() did. Processes that exited or whose PID now belongs to
+// another process are skipped, not failures.
+struct RestoreReport {
+    int processes{0};
+    int threads{0};
+    int skipped{0};
+    QStringList failures;
+
+    bool ok() const { return failures.isEmpty(); }
+    QString summary() const;
+};
+
+// Puts every process and thread of `snap` back: cgroup first, then masks,
+// then scheduling. Keeps going past failures and lists them in the report.
+RestoreReport restoreSnapshot(AffinityBackend& backend, const AffinitySnapshot& snap);
+
+// Applies each config to its process. If any of them fails, the processes
+// are restored from a snapshot taken just before, so either every change
+// lands or none does. Moved memory pages are not moved back. `before` gets
+// the snapshot, e.g. for a later manual rollback. No targets is an error.
+bool applyTransaction(AffinityBackend& backend, const CpuTopology& topo,
+                      const QVector<QPair<qint64, AffinityConfig>>& targets,
+                      AffinitySnapshot* before=nullptr, BackendError* err=nullptr);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,562 @@
+#include "telemetry.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QThread>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(Q_OS_LINUX)
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#endif
+
+namespace {
+
+#if defined(Q_OS_LINUX)
+const char kRegionName[] = "/cpuaffinity-telemetry";
+#elif defined(Q_OS_WINDOWS)
+const wchar_t kRegionName[] = L"Local\\CPUAffinityTelemetry";
+#endif
+
+constexpr quint64 align64(quint64 n) { return (n + 63) & ~quint64(63); }
+
+constexpr quint64 kCpuOffset = align64(sizeof(TelemetryHeader));
+constexpr quint64 kProcessOffset = align64(kCpuOffset + TelemetryCollector::kCpuCapacity * sizeof(float));
+constexpr quint64 kStringOffset = align64(kProcessOffset + quint64(TelemetryCollector::kProcessCapacity) * sizeof(TelemetryProcess));
+constexpr quint64 kRegionSize = kStringOffset + TelemetryCollector::kStringCapacity;
+
+qint64 currentPid()
+{
+#if defined(Q_OS_WINDOWS)
+    return qint64(::GetCurrentProcessId());
+#elif defined(Q_OS_UNIX)
+    return qint64(::getpid());
+#else
+    return 0;
+#endif
+}
+
+bool pidAlive(qint64 pid)
+{
+    if (pid <= 0) return false;
+#if defined(Q_OS_LINUX)
+    return ::kill(pid_t(pid), 0) == 0 || errno == EPERM;
+#elif defined(Q_OS_WINDOWS)
+    HANDLE h = ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, DWORD(pid));
+    if (!h) return ::GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD code = 0;
+    const bool alive = ::GetExitCodeProcess(h, &code) && code == STILL_ACTIVE;
+    ::CloseHandle(h);
+    return alive;
+#else
+    return false;
+#endif
+}
+
+bool headerValid(const TelemetryHeader* h, quint64 mapped)
+{
+    return std::memcmp(h->magic, kTelemetryMagic, sizeof(kTelemetryMagic)) == 0
+        && h->version == kTelemetryVersion
+        && h->headerSize == sizeof(TelemetryHeader)
+        && h->regionSize <= mapped
+        && h->cpuOffset + quint64(h->cpuCapacity) * sizeof(float) <= h->regionSize
+        && h->processOffset + quint64(h->processCapacity) * sizeof(TelemetryProcess) <= h->regionSize
+        && h->stringOffset + h->stringCapacity <= h->regionSize;
+}
+
+bool fresh(const TelemetryHeader* h)
+{
+    // Three missed publishes, with slack for a busy collector.
+    const qint64 age = QDateTime::currentMSecsSinceEpoch() - h->publishedMs;
+    return h->publishedMs > 0 && age <= 3 * qint64(h->intervalMs) + 1000 && pidAlive(h->collectorPid);
+}
+
+} // namespace
+
+// ---------- TelemetryReader ----------
+
+TelemetryReader::~TelemetryReader()
+{
+    detach();
+}
+
+bool TelemetryReader::attach(QString* error)
+{
+    detach();
+#if defined(Q_OS_LINUX)
+    const int fd = ::shm_open(kRegionName, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        if (error) *error = errno == ENOENT ? QStringLiteral("No telemetry collector is running")
+                                            : qt_error_string(errno);
+        return false;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || quint64(st.st_size) < sizeof(TelemetryHeader)) {
+        ::close(fd);
+        if (error) *error = QStringLiteral("The telemetry region is not initialised");
+        return false;
+    }
+    // Only a collector run by root or by us is trusted to write what we read.
+    if (st.st_uid != 0 && st.st_uid != ::geteuid()) {
+        ::close(fd);
+        if (error) *error = QStringLiteral("The telemetry region belongs to another user (uid %1)").arg(st.st_uid);
+        return false;
+    }
+    void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        if (error) *error = qt_error_string(errno);
+        return false;
+    }
+    base_ = static_cast<const char*>(p);
+    size_ = quint64(st.st_size);
+#elif defined(Q_OS_WINDOWS)
+    HANDLE h = ::OpenFileMappingW(FILE_MAP_READ, FALSE, kRegionName);
+    if (!h) {
+        if (error) *error = QStringLiteral("No telemetry collector is running");
+        return false;
+    }
+    void* p = ::MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION mbi{};
+    if (!p || !::VirtualQuery(p, &mbi, sizeof(mbi))) {
+        if (p) ::UnmapViewOfFile(p);
+        ::CloseHandle(h);
+        if (error) *error = qt_error_string(int(::GetLastError()));
+        return false;
+    }
+    mapping_ = h;
+    base_ = static_cast<const char*>(p);
+    size_ = quint64(mbi.RegionSize);
+#else
+    if (error) *error = QStringLiteral("Shared telemetry is not supported on this platform");
+    return false;
+#endif
+    header_ = reinterpret_cast<const TelemetryHeader*>(base_);
+    if (!headerValid(header_, size_)) {
+        detach();
+        if (error) *error = QStringLiteral("The telemetry region has another version");
+        return false;
+    }
+    // The layout as validated; the collector must not move it under us later.
+    cpuOffset_ = header_->cpuOffset;
+    cpuCapacity_ = header_->cpuCapacity;
+    processOffset_ = header_->processOffset;
+    processCapacity_ = header_->processCapacity;
+    stringOffset_ = header_->stringOffset;
+    stringCapacity_ = header_->stringCapacity;
+    return true;
+}
+
+void TelemetryReader::detach()
+{
+#if defined(Q_OS_LINUX)
+    if (base_) ::munmap(const_cast<char*>(base_), size_t(size_));
+#elif defined(Q_OS_WINDOWS)
+    if (base_) ::UnmapViewOfFile(base_);
+    if (mapping_) ::CloseHandle(mapping_);
+    mapping_ = nullptr;
+#endif
+    header_ = nullptr;
+    base_ = nullptr;
+    size_ = 0;
+    cpuCapacity_ = processCapacity_ = stringCapacity_ = 0;
+}
+
+bool TelemetryReader::isFresh() const
+{
+    return header_ && fresh(header_);
+}
+
+int TelemetryReader::intervalMs() const
+{
+    return header_ ? int(header_->intervalMs) : 0;
+}
+
+quint64 TelemetryReader::begin() const
+{
+    if (!header_) return 0;
+    for (int spin = 0; spin < 1000; ++spin) {
+        const quint64 seq = header_->sequence.load(std::memory_order_acquire);
+        if (!(seq & 1)) return seq;   // 0: nothing published yet
+        QThread::yieldCurrentThread();
+    }
+    return 0;
+}
+
+bool TelemetryReader::validate(quint64 sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_ && header_->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+int TelemetryReader::processCount() const
+{
+    return header_ ? int(qMin(header_->processCount, processCapacity_)) : 0;
+}
+
+const TelemetryProcess& TelemetryReader::process(int i) const
+{
+    return reinterpret_cast<const TelemetryProcess*>(base_ + processOffset_)[i];
+}
+
+QString TelemetryReader::string(quint32 offset, quint16 length) const
+{
+    // A torn record can point anywhere; stay inside the pool.
+    if (!header_ || quint64(offset) + length > stringCapacity_) return QString();
+    return QString::fromUtf8(base_ + stringOffset_ + offset, length);
+}
+
+QString TelemetryReader::name(const TelemetryProcess& p) const
+{
+    return string(p.nameOffset, p.nameLength);
+}
+
+QString TelemetryReader::title(const TelemetryProcess& p) const
+{
+    return string(p.titleOffset, p.titleLength);
+}
+
+int TelemetryReader::cpuCount() const
+{
+    return header_ ? int(qMin(header_->cpuCount, cpuCapacity_)) : 0;
+}
+
+float TelemetryReader::cpuUsage(int cpu) const
+{
+    if (cpu < 0 || cpu >= cpuCount()) return -1;
+    return reinterpret_cast<const float*>(base_ + cpuOffset_)[cpu];
+}
+
+bool TelemetryReader::find(qint64 pid, TelemetryProcess* out) const
+{
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        const quint64 seq = begin();
+        if (!seq) return false;
+        bool found = false;
+        const int n = processCount();
+        for (int i = 0; i < n; ++i) {
+            if (process(i).pid == pid) {
+                *out = process(i);
+                found = true;
+                break;
+            }
+        }
+        if (validate(seq)) return found;
+    }
+    return false;
+}
+
+// ---------- TelemetryCollector ----------
+
+TelemetryCollector::TelemetryCollector(int intervalMs)
+    : intervalMs_(qMax(100, intervalMs))
+{
+}
+
+TelemetryCollector::~TelemetryCollector()
+{
+    close();
+}
+
+bool TelemetryCollector::open(QString* error)
+{
+    if (header_) return true;
+#if defined(Q_OS_LINUX)
+    int fd = ::shm_open(kRegionName, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st{};
+    if (fd >= 0 && ::fstat(fd, &st) != 0) {
+        const int e = errno;
+        ::close(fd);
+        if (error) *error = qt_error_string(e);
+        return false;
+    }
+    if (fd < 0) {
+        if (error) *error = qt_error_string(errno);
+        return false;
+    }
+    if (quint64(st.st_size) >= sizeof(TelemetryHeader)) {
+        // Someone else's region; only take it over once that collector is gone.
+        void* p = ::mmap(nullptr, sizeof(TelemetryHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            const auto* h = static_cast<const TelemetryHeader*>(p);
+            const bool busy = fresh(h);
+            const qint64 owner = h->collectorPid;
+            ::munmap(p, sizeof(TelemetryHeader));
+            if (busy) {
+                ::close(fd);
+                if (error) *error = QStringLiteral("Collector %1 is already running").arg(owner);
+                return false;
+            }
+        }
+    }
+    if (st.st_uid != ::geteuid()) {
+        // Left by another user, who could still rewrite it under the readers:
+        // replace it with one of our own.
+        ::close(fd);
+        fd = -1;
+        if (::shm_unlink(kRegionName) == 0 || errno == ENOENT)
+            fd = ::shm_open(kRegionName, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            const int e = errno;
+            if (error) *error = QStringLiteral("Cannot replace the telemetry region of uid %1: %2")
+                                    .arg(st.st_uid).arg(qt_error_string(e));
+            return false;
+        }
+    }
+    ::fchmod(fd, 0644);   // readable by every viewer, whatever our umask
+    if (::ftruncate(fd, off_t(kRegionSize)) != 0) {
+        if (error) *error = qt_error_string(errno);
+        ::close(fd);
+        return false;
+    }
+    void* p = ::mmap(nullptr, size_t(kRegionSize), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        if (error) *error = qt_error_string(errno);
+        return false;
+    }
+#elif defined(Q_OS_WINDOWS)
+    HANDLE h = ::CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                    DWORD(kRegionSize >> 32), DWORD(kRegionSize & 0xffffffffu), kRegionName);
+    if (!h) {
+        if (error) *error = qt_error_string(int(::GetLastError()));
+        return false;
+    }
+    void* p = ::MapViewOfFile(h, FILE_MAP_WRITE, 0, 0, 0);
+    if (!p) {
+        if (error) *error = qt_error_string(int(::GetLastError()));
+        ::CloseHandle(h);
+        return false;
+    }
+    const auto* existing = static_cast<const TelemetryHeader*>(p);
+    if (fresh(existing)) {
+        if (error) *error = QStringLiteral("Collector %1 is already running").arg(existing->collectorPid);
+        ::UnmapViewOfFile(p);
+        ::CloseHandle(h);
+        return false;
+    }
+    mapping_ = h;
+#else
+    if (error) *error = QStringLiteral("Shared telemetry is not supported on this platform");
+    return false;
+#endif
+#if defined(Q_OS_LINUX) || defined(Q_OS_WINDOWS)
+    base_ = static_cast<char*>(p);
+    size_ = kRegionSize;
+    header_ = reinterpret_cast<TelemetryHeader*>(base_);
+
+    // Keep counting from a previous collector's sequence so readers that
+    // stayed attached never see it go backwards; just make it even.
+    quint64 seq = header_->sequence.load(std::memory_order_relaxed);
+    if (std::memcmp(header_->magic, kTelemetryMagic, sizeof(kTelemetryMagic)) != 0
+        || header_->version != kTelemetryVersion)
+        seq = 0;
+    header_->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header_->magic, kTelemetryMagic, sizeof(kTelemetryMagic));
+    header_->version = kTelemetryVersion;
+    header_->headerSize = sizeof(TelemetryHeader);
+    header_->regionSize = kRegionSize;
+    header_->publishedMs = 0;
+    header_->collectorPid = currentPid();
+    header_->intervalMs = quint32(intervalMs_);
+    header_->flags = 0;
+    header_->cpuCapacity = kCpuCapacity;
+    header_->cpuCount = 0;
+    header_->processCapacity = kProcessCapacity;
+    header_->processCount = 0;
+    header_->stringCapacity = kStringCapacity;
+    header_->stringBytes = 0;
+    header_->cpuOffset = kCpuOffset;
+    header_->processOffset = kProcessOffset;
+    header_->stringOffset = kStringOffset;
+    header_->sequence.store(seq + 2, std::memory_order_release);
+    return true;
+#endif
+}
+
+void TelemetryCollector::close()
+{
+    if (!header_) return;
+    header_->publishedMs = 0;
+    header_->collectorPid = 0;
+#if defined(Q_OS_LINUX)
+    ::munmap(base_, size_t(size_));
+    ::shm_unlink(kRegionName);
+#elif defined(Q_OS_WINDOWS)
+    ::UnmapViewOfFile(base_);
+    ::CloseHandle(mapping_);
+    mapping_ = nullptr;
+#endif
+    header_ = nullptr;
+    base_ = nullptr;
+    size_ = 0;
+}
+
+int TelemetryCollector::processCount() const
+{
+    return header_ ? int(header_->processCount) : 0;
+}
+
+void TelemetryCollector::publish()
+{
+    if (!header_) return;
+
+    sampler_.sample();
+    const QVector<UsageSampler::Process>& procs = sampler_.processes();
+    const QVector<float>& cpus = sampler_.cpus();
+
+    // Build the records first so the region is only "being written" for the
+    // length of a few memcpys.
+    quint32 flags = 0;
+    QVector<TelemetryProcess> records;
+    QByteArray strings;
+    records.reserve(int(qMin<qsizetype>(procs.size(), kProcessCapacity)));
+    auto addString = [&](const QString& s, quint32* offset, quint16* length) {
+        const QByteArray utf8 = s.toUtf8().left(0xffff);
+        if (quint64(strings.size()) + quint64(utf8.size()) > kStringCapacity) {
+            flags |= TelemetryTruncated;
+            *offset = 0;
+            *length = 0;
+            return;
+        }
+        *offset = quint32(strings.size());
+        *length = quint16(utf8.size());
+        strings.append(utf8);
+    };
+    for (const UsageSampler::Process& p : procs) {
+        if (records.size() >= int(kProcessCapacity)) {
+            flags |= TelemetryTruncated;
+            break;
+        }
+        TelemetryProcess r{};
+        r.pid = p.entry.pid;
+        r.startTime = p.entry.startTime;
+        r.cpuMs = p.stats.cpuMs;
+        r.rssBytes = p.stats.rssBytes;
+        r.threads = p.stats.threads;
+        r.lastCpu = p.stats.lastCpu;
+        r.cpuUsage = p.cpuUsage;
+        addString(p.entry.name, &r.nameOffset, &r.nameLength);
+        if (!p.entry.windowTitle.isEmpty())
+            addString(p.entry.windowTitle, &r.titleOffset, &r.titleLength);
+        records.append(r);
+    }
+
+    const quint64 seq = header_->sequence.load(std::memory_order_relaxed);
+    header_->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const int cpuCount = int(qMin<qsizetype>(cpus.size(), kCpuCapacity));
+    std::memcpy(base_ + header_->cpuOffset, cpus.constData(), size_t(cpuCount) * sizeof(float));
+    std::memcpy(base_ + header_->processOffset, records.constData(), size_t(records.size()) * sizeof(TelemetryProcess));
+    std::memcpy(base_ + header_->stringOffset, strings.constData(), size_t(strings.size()));
+    header_->cpuCount = quint32(cpuCount);
+    header_->processCount = quint32(records.size());
+    header_->stringBytes = quint32(strings.size());
+    header_->flags = flags;
+    header_->intervalMs = quint32(intervalMs_);
+    header_->collectorPid = currentPid();
+    header_->publishedMs = sampler_.sampledMs();
+
+    header_->sequence.store(seq + 2, std::memory_order_release);
+}
+
+// ---------- UsageSampler ----------
+
+UsageSampler::UsageSampler()
+{
+    enumerator_.setWindowedOnly(false);
+    enumerator_.setCollectStats(true);
+}
+
+void UsageSampler::sample()
+{
+    enumerator_.rescan();
+    const QVector<ProcEntry>& entries = enumerator_.entries();
+    const QVector<ProcessEnumerator::Stats>& stats = enumerator_.stats();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 dtMs = sampledMs_ ? now - sampledMs_ : 0;
+    sampleCpus();
+
+    processes_.resize(int(entries.size()));
+    QHash<qint64, Previous> previous;
+    previous.reserve(entries.size());
+    for (int i = 0; i < entries.size(); ++i) {
+        Process& p = processes_[i];
+        p.entry = entries[i];
+        p.stats = i < stats.size() ? stats[i] : ProcessEnumerator::Stats();
+        p.cpuUsage = -1;
+        const auto prev = previous_.constFind(p.entry.pid);
+        if (dtMs > 0 && prev != previous_.cend() && prev->startTime == p.entry.startTime
+            && p.stats.cpuMs >= prev->cpuMs)
+            p.cpuUsage = float(double(p.stats.cpuMs - prev->cpuMs) / double(dtMs));
+        previous.insert(p.entry.pid, Previous{p.entry.startTime, p.stats.cpuMs});
+    }
+    previous_ = std::move(previous);
+    sampledMs_ = now;
+}
+
+#if defined(Q_OS_LINUX)
+
+// Busy share of each CPU since the previous sample, from /proc/stat as
+// CpuSampler reads it. The first call only primes the counters.
+void UsageSampler::sampleCpus()
+{
+    const int fd = ::open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    std::vector<char> buf(64 * 1024);
+    ssize_t n = 0;
+    for (;;) {
+        n = ::pread(fd, buf.data(), buf.size() - 1, 0);
+        if (n < 0 || size_t(n) < buf.size() - 1) break;
+        buf.resize(buf.size() * 2);
+    }
+    ::close(fd);
+    if (n <= 0) return;
+    buf[size_t(n)] = '\0';
+
+    const char* p = buf.data();
+    while (p && *p) {
+        if (p[0] == 'c' && p[1] == 'p' && p[2] == 'u' && p[3] >= '0' && p[3] <= '9') {
+            char* end = nullptr;
+            const int id = int(std::strtol(p + 3, &end, 10));
+            quint64 v[8] = {};
+            const char* q = end;
+            for (quint64& x : v)
+                x = std::strtoull(q, const_cast<char**>(&q), 10);
+            quint64 total = 0;
+            for (quint64 x : v) total += x;
+            const quint64 busy = total - (v[3] + v[4]);   // minus idle + iowait
+
+            if (id >= 0 && id < int(TelemetryCollector::kCpuCapacity)) {
+                while (cpuTotal_.size() <= id) {
+                    cpuBusy_.append(0);
+                    cpuTotal_.append(0);
+                    cpus_.append(0);
+                }
+                if (cpuTotal_[id] && total > cpuTotal_[id])
+                    cpus_[id] = float(double(busy - qMin(busy, cpuBusy_[id])) / double(total - cpuTotal_[id]));
+                cpuBusy_[id] = busy;
+                cpuTotal_[id] = total;
+            }
+        }
+        p = std::strchr(p, '\n');
+        if (p) ++p;
+    }
+}
+
+#else
+
+// Per-CPU counters are only read on Linux, as in CpuSampler.
+void UsageSampler::sampleCpus() {}
+
+#endif
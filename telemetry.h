@@ -0,0 +1,191 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+#include "processenumerator.h"
+
+// Shared-memory telemetry: one collector process publishes the process list
+// and utilisation into a named region, and any number of viewers read it in
+// place instead of each walking /proc. The region is a fixed-size header, then
+// per-CPU utilisation, process records and a string pool for names and titles.
+//
+// Readers never lock. The collector makes `sequence` odd while it writes and
+// even again afterwards; a reader notes the sequence, reads, and keeps what it
+// read only if the sequence is still the same (a seqlock).
+//
+// Any change to the structs below bumps kTelemetryVersion; readers ignore
+// regions of another version.
+constexpr quint32 kTelemetryVersion = 1;
+constexpr char kTelemetryMagic[8] = {'C', 'P', 'A', 'T', 'E', 'L', 'M', '\0'};
+
+struct TelemetryHeader {
+    char    magic[8];
+    quint32 version;
+    quint32 headerSize;              // sizeof(TelemetryHeader)
+    quint64 regionSize;
+    std::atomic<quint64> sequence;   // odd while the collector writes
+    qint64  publishedMs;             // wall clock of the last publish, 0 = collector stopped
+    qint64  collectorPid;
+    quint32 intervalMs;
+    quint32 flags;                   // TelemetryFlag
+    quint32 cpuCapacity;
+    quint32 cpuCount;
+    quint32 processCapacity;
+    quint32 processCount;
+    quint32 stringCapacity;
+    quint32 stringBytes;
+    quint64 cpuOffset;               // float[cpuCapacity], 0..1 per CPU
+    quint64 processOffset;           // TelemetryProcess[processCapacity]
+    quint64 stringOffset;            // UTF-8, not terminated
+};
+
+enum TelemetryFlag : quint32 {
+    TelemetryTruncated = 1,          // more processes or names than fit; readers should not rely on it
+};
+
+struct TelemetryProcess {
+    qint64  pid;
+    quint64 startTime;               // as ProcEntry::startTime
+    quint64 cpuMs;                   // user + kernel since start
+    qint64  rssBytes;
+    float   cpuUsage;                // cores over the last interval (1.0 = one core), -1 = first sample
+    qint32  threads;
+    qint32  lastCpu;                 // -1 = unknown
+    quint32 nameOffset;              // into the string pool
+    quint16 nameLength;
+    quint16 titleLength;             // Windows: main window title, 0 = none
+    quint32 titleOffset;
+};
+
+static_assert(sizeof(TelemetryProcess) == 56, "TelemetryProcess is part of the shared layout");
+static_assert(std::atomic<quint64>::is_always_lock_free, "the sequence must work across processes");
+
+// Read side. Maps the region read-only; cheap enough to attach per use.
+class TelemetryReader
+{
+public:
+    TelemetryReader() = default;
+    ~TelemetryReader();
+
+    TelemetryReader(const TelemetryReader&) = delete;
+    TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+    // Maps the region, replacing a previous mapping. Fails when no collector
+    // ever ran, the region has another version, or (Linux) it belongs to a
+    // user other than root and us.
+    bool attach(QString* error=nullptr);
+    void detach();
+    bool isAttached() const { return header_ != nullptr; }
+
+    // The collector is alive and published within the last few intervals.
+    bool isFresh() const;
+    int intervalMs() const;
+
+    // Seqlock read: begin() returns a sequence, or 0 when there is nothing to
+    // read. Records are then read in place; they may be torn until
+    // validate(sequence) returns true, so bounds are checked on every access.
+    quint64 begin() const;
+    bool validate(quint64 sequence) const;
+
+    int processCount() const;
+    const TelemetryProcess& process(int i) const;
+    QString name(const TelemetryProcess& p) const;
+    QString title(const TelemetryProcess& p) const;
+    int cpuCount() const;
+    float cpuUsage(int cpu) const;
+
+    // One consistent copy of one process's record; false if it is not listed.
+    bool find(qint64 pid, TelemetryProcess* out) const;
+
+private:
+    QString string(quint32 offset, quint16 length) const;
+
+    const TelemetryHeader* header_{};
+    const char* base_{};
+    quint64 size_{0};
+    // The layout checked by attach(), not re-read from the shared header.
+    quint64 cpuOffset_{0};
+    quint32 cpuCapacity_{0};
+    quint64 processOffset_{0};
+    quint32 processCapacity_{0};
+    quint64 stringOffset_{0};
+    quint32 stringCapacity_{0};
+#if defined(Q_OS_WINDOWS)
+    void* mapping_{};
+#endif
+};
+
+// Per-CPU and per-process utilisation between two calls of sample(); what the
+// collector publishes and the history recorder stores.
+class UsageSampler
+{
+public:
+    struct Process {
+        ProcEntry entry;
+        ProcessEnumerator::Stats stats;
+        float cpuUsage{-1};          // cores since the previous sample, -1 = first sample
+    };
+
+    UsageSampler();
+
+    void sample();
+    qint64 sampledMs() const { return sampledMs_; }
+    const QVector<float>& cpus() const { return cpus_; }   // busy share 0..1; all 0 after the first sample
+    const QVector<Process>& processes() const { return processes_; }
+
+private:
+    void sampleCpus();
+
+    ProcessEnumerator enumerator_;
+    struct Previous { quint64 startTime; quint64 cpuMs; };
+    QHash<qint64, Previous> previous_;
+    qint64 sampledMs_{0};
+    QVector<quint64> cpuBusy_, cpuTotal_;
+    QVector<float> cpus_;
+    QVector<Process> processes_;
+};
+
+// Write side: scans processes and CPUs and publishes them. Only one collector
+// runs per host; a second one refuses to start while the first is alive.
+class TelemetryCollector
+{
+public:
+    static constexpr quint32 kProcessCapacity = 65536;
+    static constexpr quint32 kStringCapacity = 4u << 20;
+    static constexpr quint32 kCpuCapacity = 4096;
+
+    explicit TelemetryCollector(int intervalMs = 1000);
+    ~TelemetryCollector();
+
+    TelemetryCollector(const TelemetryCollector&) = delete;
+    TelemetryCollector& operator=(const TelemetryCollector&) = delete;
+
+    bool open(QString* error=nullptr);
+    // Marks the region as stopped and removes its name; readers fall back.
+    void close();
+    bool isOpen() const { return header_ != nullptr; }
+
+    // One scan and publish, every intervalMs.
+    void publish();
+    int intervalMs() const { return intervalMs_; }
+    int processCount() const;
+    // What the last publish() was built from.
+    const UsageSampler& sampler() const { return sampler_; }
+
+private:
+    int intervalMs_;
+    TelemetryHeader* header_{};
+    char* base_{};
+    quint64 size_{0};
+#if defined(Q_OS_WINDOWS)
+    void* mapping_{};
+#endif
+
+    UsageSampler sampler_;
+};
+
+#endif // TELEMETRY_H
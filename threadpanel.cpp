@@ -0,0 +1,188 @@
+#include "threadpanel.h"
+#include "cpusampler.h"
+
+#include <QHBoxLayout>
+#include <QHash>
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QRegularExpression>
+#include <QStandardItemModel>
+#include <QTableView>
+#include <QTimer>
+#include <QVBoxLayout>
+
+ThreadPanel::ThreadPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    model_ = new QStandardItemModel(0, ColumnCount, this);
+    model_->setHorizontalHeaderLabels({"TID", "Name", "CPU", "Util %", "Pinned"});
+
+    table_ = new QTableView(this);
+    table_->setModel(model_);
+    table_->setSelectionBehavior(QAbstractItemView::SelectRows);
+    table_->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table_->verticalHeader()->hide();
+    table_->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    table_->verticalHeader()->setDefaultSectionSize(table_->fontMetrics().height() + 4);
+    table_->horizontalHeader()->setStretchLastSection(true);
+
+    matchEdit_ = new QLineEdit(this);
+    matchEdit_->setPlaceholderText("Name regex, e.g. ^gc-");
+    cpusEdit_ = new QLineEdit(this);
+    cpusEdit_->setPlaceholderText("CPUs, e.g. 2-3");
+    auto* pinSelected = new QPushButton("Pin selected", this);
+    auto* addPattern = new QPushButton("Add by name", this);
+    connect(pinSelected, &QPushButton::clicked, this, &ThreadPanel::onPinSelected);
+    connect(addPattern, &QPushButton::clicked, this, &ThreadPanel::onAddPattern);
+
+    auto* ruleRow = new QHBoxLayout;
+    ruleRow->addWidget(matchEdit_, 2);
+    ruleRow->addWidget(cpusEdit_, 1);
+    ruleRow->addWidget(pinSelected);
+    ruleRow->addWidget(addPattern);
+
+    rulesList_ = new QListWidget(this);
+    rulesList_->setMaximumHeight(60);
+    auto* remove = new QPushButton("Remove", this);
+    connect(remove, &QPushButton::clicked, this, &ThreadPanel::onRemoveRule);
+    auto* listRow = new QHBoxLayout;
+    listRow->addWidget(rulesList_, 1);
+    listRow->addWidget(remove, 0, Qt::AlignTop);
+
+    auto* layout = new QVBoxLayout(this);
+    layout->setContentsMargins(4, 4, 4, 4);
+    layout->addWidget(table_, 1);
+    layout->addLayout(ruleRow);
+    layout->addLayout(listRow);
+
+    refreshTimer_ = new QTimer(this);
+    refreshTimer_->setInterval(1000);
+    connect(refreshTimer_, &QTimer::timeout, this, &ThreadPanel::refresh);
+}
+
+void ThreadPanel::setSampler(const CpuSampler* sampler)
+{
+    sampler_ = sampler;
+}
+
+void ThreadPanel::setPid(qint64 pid)
+{
+    pid_ = pid;
+    threads_.clear();
+    model_->setRowCount(0);
+    if (isVisible()) refresh();
+}
+
+void ThreadPanel::setRules(const QVector<ThreadPinRule>& rules)
+{
+    rules_ = rules;
+    refreshRules();
+}
+
+void ThreadPanel::showEvent(QShowEvent* event)
+{
+    QWidget::showEvent(event);
+    refresh();
+    refreshTimer_->start();
+}
+
+void ThreadPanel::hideEvent(QHideEvent* event)
+{
+    refreshTimer_->stop();
+    QWidget::hideEvent(event);
+}
+
+void ThreadPanel::refresh()
+{
+    threads_ = pid_ > 0 ? listThreads(pid_) : QVector<ThreadEntry>();
+
+    // Current CPU and utilisation come from the sampler (Linux only).
+    QHash<qint64, CpuSampler::SeriesPtr> series;
+    if (sampler_ && pid_ > 0)
+        for (const CpuSampler::SeriesPtr& s : sampler_->threads(pid_))
+            series.insert(s->id, s);
+
+    // Rows are updated in place so the selection survives a refresh.
+    model_->setRowCount(int(threads_.size()));
+    auto setCell = [this](int row, int col, const QString& text) {
+        if (QStandardItem* item = model_->item(row, col)) {
+            if (item->text() != text) item->setText(text);
+        } else {
+            model_->setItem(row, col, new QStandardItem(text));
+        }
+    };
+    for (int row = 0; row < threads_.size(); ++row) {
+        const ThreadEntry& t = threads_[row];
+        const CpuSampler::SeriesPtr s = series.value(t.tid);
+        const int ruleIndex = matcher_.match(t);
+        const QString rule = ruleIndex >= 0 ? rules_[ruleIndex].cpus.toRangeList() : QString();
+        setCell(row, ColTid, QString::number(t.tid));
+        setCell(row, ColName, t.name);
+        setCell(row, ColCpu, s && s->lastCpu >= 0 ? QString::number(s->lastCpu) : QStringLiteral("—"));
+        setCell(row, ColUtil, s ? QString::number(s->history.latest() * 100.0, 'f', 1) : QStringLiteral("—"));
+        setCell(row, ColRule, rule);
+    }
+}
+
+void ThreadPanel::refreshRules()
+{
+    matcher_ = ThreadPinMatcher(rules_);
+    rulesList_->clear();
+    for (const ThreadPinRule& r : rules_)
+        rulesList_->addItem(r.describe());
+    if (isVisible()) refresh();
+}
+
+bool ThreadPanel::addRule(ThreadPinRule rule)
+{
+    bool ok = false;
+    rule.cpus = CpuSet::fromRangeList(cpusEdit_->text(), &ok);
+    if (!ok || rule.cpus.isEmpty()) {
+        QMessageBox::warning(this, "Invalid CPU set", "Enter CPUs as a range list, e.g. 0-3,8.");
+        return false;
+    }
+    rules_.append(rule);
+    refreshRules();
+    emit rulesChanged();
+    return true;
+}
+
+void ThreadPanel::onPinSelected()
+{
+    ThreadPinRule rule;
+    for (const QModelIndex& idx : table_->selectionModel()->selectedRows())
+        if (idx.row() < threads_.size()) rule.tids.append(threads_[idx.row()].tid);
+    if (rule.tids.isEmpty()) {
+        QMessageBox::information(this, "No threads selected", "Select one or more threads first.");
+        return;
+    }
+    addRule(rule);
+}
+
+void ThreadPanel::onAddPattern()
+{
+    ThreadPinRule rule;
+    rule.pattern = matchEdit_->text().trimmed();
+    const QRegularExpression re(rule.pattern);
+    if (rule.pattern.isEmpty() || !re.isValid()) {
+        QMessageBox::warning(this, "Invalid pattern",
+                             rule.pattern.isEmpty() ? QString("Enter a thread name regex.") : re.errorString());
+        return;
+    }
+    if (addRule(rule))
+        matchEdit_->clear();
+}
+
+void ThreadPanel::onRemoveRule()
+{
+    const int row = rulesList_->currentRow();
+    if (row < 0 || row >= rules_.size()) return;
+    rules_.removeAt(row);
+    refreshRules();
+    emit rulesChanged();
+}
@@ -0,0 +1,60 @@
+#ifndef THREADPANEL_H
+#define THREADPANEL_H
+
+#include <QWidget>
+
+#include "threadpinning.h"
+
+class CpuSampler;
+class QLineEdit;
+class QListWidget;
+class QStandardItemModel;
+class QTableView;
+class QTimer;
+
+// Threads of the selected process (TID, name, current CPU, utilisation) plus
+// the editor for per-thread pinning rules. Refreshes once a second while shown.
+class ThreadPanel : public QWidget
+{
+    Q_OBJECT
+public:
+    enum Column { ColTid, ColName, ColCpu, ColUtil, ColRule, ColumnCount };
+
+    explicit ThreadPanel(QWidget* parent=nullptr);
+
+    void setSampler(const CpuSampler* sampler);
+    void setPid(qint64 pid);
+
+    void setRules(const QVector<ThreadPinRule>& rules);
+    const QVector<ThreadPinRule>& rules() const { return rules_; }
+
+signals:
+    void rulesChanged();
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private:
+    void refresh();
+    void refreshRules();
+    void onPinSelected();
+    void onAddPattern();
+    void onRemoveRule();
+    bool addRule(ThreadPinRule rule);
+
+    const CpuSampler* sampler_{};
+    qint64 pid_{0};
+    QVector<ThreadPinRule> rules_;
+    ThreadPinMatcher matcher_;     // rules_, compiled
+    QVector<ThreadEntry> threads_;
+
+    QTableView* table_{};
+    QStandardItemModel* model_{};
+    QLineEdit* matchEdit_{};
+    QLineEdit* cpusEdit_{};
+    QListWidget* rulesList_{};
+    QTimer* refreshTimer_{};
+};
+
+#endif // THREADPANEL_H
@@ -0,0 +1,189 @@
+#include "threadpinning.h"
+#include "affinitybackend.h"
+
+#include <QJsonArray>
+#include <QRegularExpression>
+#include <QStringList>
+#include <algorithm>
+
+#if defined(Q_OS_LINUX)
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#elif defined(Q_OS_WINDOWS)
+#include <windows.h>
+#include <tlhelp32.h>
+#endif
+
+#if defined(Q_OS_LINUX)
+
+QVector<ThreadEntry> listThreads(qint64 pid)
+{
+    QVector<ThreadEntry> out;
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%lld/task", static_cast<long long>(pid));
+    DIR* d = ::opendir(path);
+    if (!d) return out;
+    const int dfd = ::dirfd(d);
+    while (dirent* e = ::readdir(d)) {
+        if (e->d_name[0] < '0' || e->d_name[0] > '9') continue;
+        ThreadEntry t;
+        t.tid = std::strtoll(e->d_name, nullptr, 10);
+        char rel[sizeof(e->d_name) + 8];
+        std::snprintf(rel, sizeof(rel), "%s/comm", e->d_name);
+        const int fd = ::openat(dfd, rel, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            char buf[64];
+            const ssize_t n = ::read(fd, buf, sizeof(buf));
+            ::close(fd);
+            if (n > 0) t.name = QString::fromUtf8(buf, int(n)).trimmed();
+        }
+        out.append(t);
+    }
+    ::closedir(d);
+    std::sort(out.begin(), out.end(), [](const ThreadEntry& a, const ThreadEntry& b) { return a.tid < b.tid; });
+    return out;
+}
+
+#elif defined(Q_OS_WINDOWS)
+
+QVector<ThreadEntry> listThreads(qint64 pid)
+{
+    QVector<ThreadEntry> out;
+    HANDLE snap = ::CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snap == INVALID_HANDLE_VALUE) return out;
+
+    // Windows 10 1607+, so resolved at runtime.
+    using GetThreadDescriptionFn = HRESULT (WINAPI*)(HANDLE, PWSTR*);
+    static const auto getDescription = reinterpret_cast<GetThreadDescriptionFn>(
+        ::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"), "GetThreadDescription"));
+
+    THREADENTRY32 te{};
+    te.dwSize = sizeof(te);
+    for (BOOL ok = ::Thread32First(snap, &te); ok; ok = ::Thread32Next(snap, &te)) {
+        if (te.th32OwnerProcessID != DWORD(pid)) continue;
+        ThreadEntry t;
+        t.tid = te.th32ThreadID;
+        if (getDescription) {
+            if (HANDLE h = ::OpenThread(THREAD_QUERY_LIMITED_INFORMATION, FALSE, te.th32ThreadID)) {
+                PWSTR desc = nullptr;
+                if (SUCCEEDED(getDescription(h, &desc)) && desc) {
+                    t.name = QString::fromWCharArray(desc);
+                    ::LocalFree(desc);
+                }
+                ::CloseHandle(h);
+            }
+        }
+        out.append(t);
+    }
+    ::CloseHandle(snap);
+    std::sort(out.begin(), out.end(), [](const ThreadEntry& a, const ThreadEntry& b) { return a.tid < b.tid; });
+    return out;
+}
+
+#else
+
+QVector<ThreadEntry> listThreads(qint64)
+{
+    return {};
+}
+
+#endif
+
+// ---------- ThreadPinRule ----------
+
+QString ThreadPinRule::describe() const
+{
+    QString what;
+    if (!tids.isEmpty()) {
+        QStringList list;
+        for (qint64 tid : tids) list << QString::number(tid);
+        what = QStringLiteral("TID %1").arg(list.join(','));
+    } else {
+        what = QStringLiteral("/%1/").arg(pattern);
+    }
+    return QStringLiteral("%1 → CPUs %2").arg(what, cpus.toRangeList());
+}
+
+QJsonObject ThreadPinRule::toJson() const
+{
+    QJsonObject o;
+    if (!tids.isEmpty()) {
+        QJsonArray arr;
+        for (qint64 tid : tids) arr.append(QString::number(tid));
+        o["tids"] = arr;
+    } else {
+        o["match"] = pattern;
+    }
+    o["cpus"] = cpus.toRangeList();
+    return o;
+}
+
+ThreadPinRule ThreadPinRule::fromJson(const QJsonObject& o, bool* ok)
+{
+    ThreadPinRule r;
+    r.pattern = o.value("match").toString();
+    for (const QJsonValue& v : o.value("tids").toArray()) {
+        const qint64 tid = v.isString() ? v.toString().toLongLong() : qint64(v.toDouble());
+        if (tid > 0) r.tids.append(tid);
+    }
+    bool cpusOk = false;
+    r.cpus = CpuSet::fromRangeList(o.value("cpus").toString(), &cpusOk);
+    if (ok)
+        *ok = cpusOk && !r.cpus.isEmpty() && (!r.tids.isEmpty() || QRegularExpression(r.pattern).isValid());
+    return r;
+}
+
+// ---------- ThreadPinMatcher ----------
+
+ThreadPinMatcher::ThreadPinMatcher(const QVector<ThreadPinRule>& rules)
+    : rules_(rules)
+{
+    regexes_.reserve(rules_.size());
+    for (const ThreadPinRule& r : rules_) {
+        QRegularExpression re(r.tids.isEmpty() ? r.pattern : QString());
+        re.optimize();
+        regexes_.append(re);
+    }
+}
+
+int ThreadPinMatcher::match(const ThreadEntry& t) const
+{
+    for (int i = 0; i < rules_.size(); ++i) {
+        const ThreadPinRule& r = rules_[i];
+        const bool hit = !r.tids.isEmpty()
+            ? r.tids.contains(t.tid)
+            : !r.pattern.isEmpty() && regexes_[i].isValid() && regexes_[i].match(t.name).hasMatch();
+        if (hit) return i;
+    }
+    return -1;
+}
+
+// ---------- Apply ----------
+
+bool applyThreadRules(AffinityBackend& backend, qint64 pid, const QVector<ThreadPinRule>& rules,
+                      int* pinned, BackendError* err, QSet<qint64>* seen)
+{
+    if (pinned) *pinned = 0;
+    if (rules.isEmpty()) return true;
+
+    const ThreadPinMatcher matcher(rules);
+    bool allOk = true;
+    for (const ThreadEntry& t : listThreads(pid)) {
+        if (seen && seen->contains(t.tid)) continue;
+        const int i = matcher.match(t);
+        if (i < 0) continue;
+        if (seen) seen->insert(t.tid);
+
+        BackendError e;
+        if (backend.setThreadAffinity(t.tid, rules[i].cpus, &e)) {
+            if (pinned) ++*pinned;
+        } else if (allOk) {
+            allOk = false;
+            if (err) *err = e;
+        }
+    }
+    return allOk;
+}
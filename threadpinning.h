@@ -0,0 +1,58 @@
+#ifndef THREADPINNING_H
+#define THREADPINNING_H
+
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+#include "cpuset.h"
+
+class AffinityBackend;
+struct BackendError;
+
+struct ThreadEntry {
+    qint64  tid{0};
+    QString name;    // Linux: /proc/<pid>/task/<tid>/comm, Windows: thread description
+};
+
+// Threads of `pid`, sorted by tid. Empty if the process is gone or unreadable.
+QVector<ThreadEntry> listThreads(qint64 pid);
+
+// Pins the threads it matches to `cpus`. A rule matches either by thread id
+// (only meaningful while the process lives) or by a regex on the thread name.
+struct ThreadPinRule {
+    QString         pattern;   // regex on the name; ignored when tids is non-empty
+    QVector<qint64> tids;
+    CpuSet          cpus;
+
+    QString describe() const;
+
+    QJsonObject toJson() const;
+    static ThreadPinRule fromJson(const QJsonObject& o, bool* ok=nullptr);
+};
+
+// `rules` with their name regexes compiled once, for matching many threads.
+class ThreadPinMatcher
+{
+public:
+    explicit ThreadPinMatcher(const QVector<ThreadPinRule>& rules = {});
+
+    // Index of the first rule that matches `t`, -1 if none does.
+    int match(const ThreadEntry& t) const;
+
+private:
+    QVector<ThreadPinRule> rules_;
+    QVector<QRegularExpression> regexes_;   // empty for TID rules
+};
+
+// Applies `rules` to the current threads of `pid`; the first matching rule wins
+// and unmatched threads keep the process mask. Every matching thread is tried;
+// returns false if any of them failed, with the first error in `err`. With
+// `seen`, threads already in it are skipped and matched threads are added, so
+// calling it repeatedly only handles new threads and ones renamed into a match.
+bool applyThreadRules(AffinityBackend& backend, qint64 pid, const QVector<ThreadPinRule>& rules,
+                      int* pinned=nullptr, BackendError* err=nullptr, QSet<qint64>* seen=nullptr);
+
+#endif // THREADPINNING_H
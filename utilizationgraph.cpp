@@ -0,0 +1,115 @@
+#include "utilizationgraph.h"
+#include "cpusampler.h"
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QTimer>
+#include <algorithm>
+#include <vector>
+
+UtilizationGraph::UtilizationGraph(QWidget* parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(80);
+    repaintTimer_ = new QTimer(this);
+    repaintTimer_->setInterval(250);
+    connect(repaintTimer_, &QTimer::timeout, this, qOverload<>(&QWidget::update));
+}
+
+void UtilizationGraph::setSampler(const CpuSampler* sampler)
+{
+    sampler_ = sampler;
+    if (sampler_) repaintTimer_->start();
+    else repaintTimer_->stop();
+    update();
+}
+
+void UtilizationGraph::setPid(qint64 pid)
+{
+    pid_ = pid;
+    update();
+}
+
+void UtilizationGraph::paintEvent(QPaintEvent*)
+{
+    QPainter p(this);
+    p.fillRect(rect(), palette().base());
+    p.setPen(palette().mid().color());
+    p.drawRect(rect().adjusted(0, 0, -1, -1));
+    if (!sampler_) return;
+
+    const int cpuCount = sampler_->cpuCount();
+    const int stripH = cpuCount > 0 ? 12 : 0;
+    const QRect chart = rect().adjusted(4, 4, -4, -(stripH + 8));
+    const QRect strip(4, height() - stripH - 4, width() - 8, stripH);
+
+    // --- Process and hottest threads, newest sample at the right edge ---
+    struct Line {
+        QString label;
+        QColor color;
+        std::vector<float> values;
+    };
+    const int samples = qMax(2, qMin(chart.width() / 2, CpuSampler::kHistory));
+    std::vector<float> buf(size_t(samples), 0.0f);
+    std::vector<Line> lines;
+
+    if (auto proc = sampler_->process(pid_)) {
+        const int n = proc->history.copyLatest(buf.data(), samples);
+        lines.push_back({proc->name, palette().highlight().color(), {buf.begin(), buf.begin() + n}});
+
+        QVector<CpuSampler::SeriesPtr> threads = sampler_->threads(pid_);
+        std::sort(threads.begin(), threads.end(), [](const auto& a, const auto& b) {
+            return a->history.latest() > b->history.latest();
+        });
+        static const QColor threadColors[] = {QColor(230, 126, 34), QColor(39, 174, 96), QColor(142, 68, 173)};
+        for (int i = 0; i < qMin(3, int(threads.size())); ++i) {
+            const int m = threads[i]->history.copyLatest(buf.data(), samples);
+            lines.push_back({QStringLiteral("%1 [%2]").arg(threads[i]->name).arg(threads[i]->id),
+                             threadColors[i], {buf.begin(), buf.begin() + m}});
+        }
+    }
+
+    float peak = 1.0f;
+    for (const Line& l : lines)
+        for (float v : l.values) peak = std::max(peak, v);
+
+    const double step = double(chart.width()) / double(samples - 1);
+    p.setRenderHint(QPainter::Antialiasing);
+    for (const Line& l : lines) {
+        if (l.values.size() < 2) continue;
+        QPainterPath path;
+        const int n = int(l.values.size());
+        for (int i = 0; i < n; ++i) {
+            const double x = chart.right() - (n - 1 - i) * step;
+            const double y = chart.bottom() - double(l.values[size_t(i)]) / peak * chart.height();
+            if (i == 0) path.moveTo(x, y);
+            else path.lineTo(x, y);
+        }
+        p.setPen(QPen(l.color, 1.5));
+        p.drawPath(path);
+    }
+    p.setRenderHint(QPainter::Antialiasing, false);
+
+    // Legend: current value in % of one core.
+    int ly = chart.top() + p.fontMetrics().ascent();
+    for (const Line& l : lines) {
+        const float cur = l.values.empty() ? 0.0f : l.values.back();
+        p.setPen(l.color);
+        p.drawText(chart.left() + 2, ly, QStringLiteral("%1  %2%").arg(l.label).arg(qRound(cur * 100)));
+        ly += p.fontMetrics().height();
+    }
+    p.setPen(palette().text().color());
+    p.drawText(chart, Qt::AlignRight | Qt::AlignTop,
+               QStringLiteral("sampler %1%").arg(sampler_->overhead() * 100.0, 0, 'f', 2));
+
+    // --- One cell per logical CPU, green (idle) to red (busy) ---
+    if (cpuCount > 0) {
+        const double cellW = double(strip.width()) / cpuCount;
+        for (int c = 0; c < cpuCount; ++c) {
+            const auto s = sampler_->cpu(c);
+            const float u = s ? qBound(0.0f, s->history.latest(), 1.0f) : 0.0f;
+            const QRectF cell(strip.left() + c * cellW, strip.top(), qMax(1.0, cellW - 1), strip.height());
+            p.fillRect(cell, QColor::fromHsvF((1.0f - u) * 0.33f, 0.75f, 0.9f));
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef UTILIZATIONGRAPH_H
+#define UTILIZATIONGRAPH_H
+
+#include <QWidget>
+
+class CpuSampler;
+class QTimer;
+
+// Live utilisation view: a line chart of the process and its hottest threads
+// on top, one cell per logical CPU underneath.
+class UtilizationGraph : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit UtilizationGraph(QWidget* parent=nullptr);
+
+    void setSampler(const CpuSampler* sampler);
+    void setPid(qint64 pid);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    const CpuSampler* sampler_{};
+    qint64 pid_{0};
+    QTimer* repaintTimer_{};
+};
+
+#endif // UTILIZATIONGRAPH_H